@@ -0,0 +1,187 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  bench_arena.c: Pth benchmark program (request-scoped allocation)
+*/
+                             /* ``Memory is the treasury and
+                                  guardian of all things.''
+                                          -- Cicero */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "pth.h"
+
+/*
+ * Usage: bench_arena [-r requests] [-a allocations] [-t threads]
+ *
+ * Simulates request handlers which allocate many small pieces of memory
+ * (between 16 and 256 bytes, the given number per request, default 32)
+ * and drop them all when the request is done: once with malloc(3) and
+ * free(3) for every piece and once with pth_arena_alloc(3) and a
+ * pth_arena_reset(3) per request. The given number of requests (default
+ * 200000) is spread over the given number of threads (default 4), which
+ * yield after each request so that their allocations interleave like
+ * those of concurrent handlers. Reports the time per allocation (the
+ * freeing included) of both variants and their ratio, without the time
+ * of a run which just computes the sizes and yields.
+ */
+
+#define MAX_ALLOCS 1024
+
+static long requests = 200000;
+static long allocs   = 32;
+static long threads  = 4;
+static volatile size_t sink;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* the piece sizes: a simple deterministic pseudo random sequence */
+static size_t piece(unsigned long *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return 16 + (size_t)((*seed >> 16) % 241);
+}
+
+static void *handler_none(void *arg)
+{
+    unsigned long seed = (unsigned long)(long)arg;
+    long r, i;
+
+    for (r = 0; r < requests / threads; r++) {
+        for (i = 0; i < allocs; i++)
+            sink += piece(&seed);
+        pth_yield(NULL);
+    }
+    return NULL;
+}
+
+static void *handler_malloc(void *arg)
+{
+    char *p[MAX_ALLOCS];
+    unsigned long seed = (unsigned long)(long)arg;
+    long r, i;
+    size_t n;
+
+    for (r = 0; r < requests / threads; r++) {
+        for (i = 0; i < allocs; i++) {
+            n = piece(&seed);
+            if ((p[i] = (char *)malloc(n)) == NULL)
+                return (void *)1;
+            p[i][0] = p[i][n - 1] = (char)i;
+        }
+        for (i = 0; i < allocs; i++)
+            free(p[i]);
+        pth_yield(NULL);
+    }
+    return NULL;
+}
+
+static void *handler_arena(void *arg)
+{
+    char *p;
+    unsigned long seed = (unsigned long)(long)arg;
+    long r, i;
+    size_t n;
+
+    for (r = 0; r < requests / threads; r++) {
+        for (i = 0; i < allocs; i++) {
+            n = piece(&seed);
+            if ((p = (char *)pth_arena_alloc(n)) == NULL)
+                return (void *)1;
+            p[0] = p[n - 1] = (char)i;
+        }
+        pth_arena_reset();
+        pth_yield(NULL);
+    }
+    return NULL;
+}
+
+/* run the handlers in the given number of threads */
+static double run(void *(*handler)(void *), pth_attr_t attr)
+{
+    pth_t tid[64];
+    double t;
+    void *rc;
+    long i;
+
+    t = now();
+    for (i = 0; i < threads; i++)
+        if ((tid[i] = pth_spawn(attr, handler, (void *)(i + 1))) == NULL) {
+            fprintf(stderr, "bench_arena: pth_spawn failed\n");
+            exit(1);
+        }
+    for (i = 0; i < threads; i++)
+        if (!pth_join(tid[i], &rc) || rc != NULL) {
+            fprintf(stderr, "bench_arena: allocation failed\n");
+            exit(1);
+        }
+    return now() - t;
+}
+
+int main(int argc, char *argv[])
+{
+    pth_attr_t attr;
+    double t_none, t_malloc, t_arena, total;
+    int c;
+
+    while ((c = getopt(argc, argv, "r:a:t:")) != -1) {
+        switch (c) {
+            case 'r': requests = atol(optarg); break;
+            case 'a': allocs   = atol(optarg); break;
+            case 't': threads  = atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-r requests] [-a allocations] [-t threads]\n", argv[0]);
+                exit(1);
+        }
+    }
+    if (allocs < 1 || allocs > MAX_ALLOCS || threads < 1 || threads > 64 || requests < threads) {
+        fprintf(stderr, "bench_arena: need 1 to %d allocations, 1 to 64 threads "
+                "and at least one request per thread\n", MAX_ALLOCS);
+        exit(1);
+    }
+
+    pth_init();
+    attr = pth_attr_new();
+    pth_attr_set(attr, PTH_ATTR_ARENA_SIZE, 16384);
+    t_none   = run(handler_none, attr);
+    t_malloc = run(handler_malloc, attr) - t_none;
+    t_arena  = run(handler_arena, attr) - t_none;
+    pth_attr_destroy(attr);
+
+    total = (double)(requests / threads) * threads * allocs;
+    printf("arena.requests %ld count\n", (requests / threads) * threads);
+    printf("arena.allocs_per_request %ld count\n", allocs);
+    printf("arena.threads %ld count\n", threads);
+    printf("arena.malloc_alloc %.1f ns\n", t_malloc / total * 1e9);
+    printf("arena.arena_alloc %.1f ns\n", t_arena / total * 1e9);
+    printf("arena.speedup %.2f x\n", t_malloc / (t_arena > 0 ? t_arena : 1e-9));
+    pth_kill();
+    return 0;
+}
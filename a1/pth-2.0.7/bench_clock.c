@@ -0,0 +1,157 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  bench_clock.c: Pth benchmark program (clock cost per dispatch)
+*/
+                             /* ``A man with a watch knows what time
+                                  it is. A man with two watches is
+                                  never sure.''
+                                          -- Segal's law */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "pth.h"
+
+/*
+ * Usage: bench_clock [-n threads] [-d dispatches] [-c]
+ *
+ * First measures what reading the time of day and the monotonic
+ * clocks costs, then lets the given number of threads (default 100)
+ * yield to each other until about the given number of dispatches
+ * (default 1000000) happened and reports the cost of a single one. The
+ * scheduler reads its clock a few times per dispatch, so the
+ * difference between the plain run and a run with -c (which selects
+ * the coarse monotonic clock) is the share of the clock.
+ */
+
+#define CLOCK_LOOPS 1000000
+
+static volatile int stop = FALSE;
+static long yields = 0;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void *yielder(void *arg)
+{
+    while (!stop) {
+        pth_yield(NULL);
+        yields++;
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pth_attr_t attr;
+    pth_t *tids;
+    long threads, dispatches, i;
+    struct timeval tv;
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+#endif
+    double t_start, t_run;
+    int coarse, c;
+
+    threads    = 100;
+    dispatches = 1000000;
+    coarse     = FALSE;
+    while ((c = getopt(argc, argv, "n:d:c")) != -1) {
+        switch (c) {
+            case 'n': threads    = atol(optarg); break;
+            case 'd': dispatches = atol(optarg); break;
+            case 'c': coarse     = TRUE;         break;
+            default:
+                fprintf(stderr, "usage: %s [-n threads] [-d dispatches] [-c]\n", argv[0]);
+                exit(1);
+        }
+    }
+
+    /* the raw cost of the clocks */
+    t_start = now();
+    for (i = 0; i < CLOCK_LOOPS; i++)
+        gettimeofday(&tv, NULL);
+    printf("clock.gettimeofday %.1f ns\n", (now() - t_start) * 1e9 / CLOCK_LOOPS);
+#if defined(CLOCK_MONOTONIC)
+    t_start = now();
+    for (i = 0; i < CLOCK_LOOPS; i++)
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+    printf("clock.monotonic %.1f ns\n", (now() - t_start) * 1e9 / CLOCK_LOOPS);
+#endif
+#if defined(CLOCK_MONOTONIC_COARSE)
+    t_start = now();
+    for (i = 0; i < CLOCK_LOOPS; i++)
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    printf("clock.monotonic_coarse %.1f ns\n", (now() - t_start) * 1e9 / CLOCK_LOOPS);
+#endif
+
+    /* the cost of a dispatch */
+    pth_init();
+    if (coarse && pth_ctrl(PTH_CTRL_CLOCKSOURCE, PTH_CLOCK_COARSE) == -1) {
+        fprintf(stderr, "bench_clock: no coarse clock: %s\n", strerror(errno));
+        exit(1);
+    }
+    if ((tids = (pth_t *)malloc(threads * sizeof(pth_t))) == NULL) {
+        fprintf(stderr, "bench_clock: out of memory\n");
+        exit(1);
+    }
+    attr = pth_attr_new();
+    pth_attr_set(attr, PTH_ATTR_STACK_SIZE, (unsigned int)PTH_STACK_SIZE_SMALL);
+    for (i = 0; i < threads; i++) {
+        tids[i] = pth_spawn(attr, yielder, NULL);
+        if (tids[i] == NULL) {
+            fprintf(stderr, "bench_clock: pth_spawn failed: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    pth_attr_destroy(attr);
+    pth_yield(NULL);
+
+    yields = 0;
+    t_start = now();
+    while (yields < dispatches) {
+        pth_yield(NULL);
+        yields++;
+    }
+    t_run = now() - t_start;
+    stop = TRUE;
+    for (i = 0; i < threads; i++)
+        pth_join(tids[i], NULL);
+
+    printf("clock.threads %ld count\n", threads);
+    printf("clock.source %s name\n", coarse ? "coarse" : "monotonic");
+    printf("clock.dispatch %.1f ns\n", t_run * 1e9 / dispatches);
+
+    free(tids);
+    pth_kill();
+    return 0;
+}
@@ -0,0 +1,89 @@
+#!/bin/sh
+##
+##  GNU Pth - The GNU Portable Threads
+##  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+##
+##  This file is part of GNU Pth, a non-preemptive thread scheduling
+##  library which can be found at http://www.gnu.org/software/pth/.
+##
+##  This library is free software; you can redistribute it and/or
+##  modify it under the terms of the GNU Lesser General Public
+##  License as published by the Free Software Foundation; either
+##  version 2.1 of the License, or (at your option) any later version.
+##
+##  This library is distributed in the hope that it will be useful,
+##  but WITHOUT ANY WARRANTY; without even the implied warranty of
+##  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+##  Lesser General Public License for more details.
+##
+##  You should have received a copy of the GNU Lesser General Public
+##  License along with this library; if not, write to the Free Software
+##  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+##  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+##
+##  bench_compare.sh: compare two "make bench" result files
+##
+
+#   Usage: bench_compare.sh [-t percent] baseline.out current.out
+#
+#   Both files hold "<metric> <value> <unit>" lines as written by the
+#   bench_* programs. For every metric found in both files the change
+#   is printed; whether larger values are better follows from the unit
+#   (ns, us, ms, s, pp, KB, bytes and wakeups/s are costs, ops/s,
+#   threads/s and ratio are rates, everything else is just shown). A
+#   cost of zero means nothing was measured and is not compared, a rate
+#   coming from zero counts as a change of 1000 percent. A cost or rate
+#   which got worse by more than the threshold (default 10 percent) is
+#   marked as REGRESSION and makes the script exit 1.
+
+threshold=10
+if [ ".$1" = ".-t" ]; then
+    threshold="$2"
+    shift; shift
+fi
+if [ $# -ne 2 ]; then
+    echo "usage: $0 [-t percent] baseline.out current.out" 1>&2
+    exit 2
+fi
+for f in "$1" "$2"; do
+    if [ ! -r "$f" ]; then
+        echo "$0: cannot read $f" 1>&2
+        exit 2
+    fi
+done
+
+awk -v threshold="$threshold" '
+    FNR == NR { if (NF == 3) { base[$1] = $2 }; next }
+    NF != 3 || !($1 in base) { next }
+    {
+        metric = $1; old = base[metric]; new = $2; unit = $3
+        if (unit ~ /^(ns|us|ms|s|pp|KB|bytes|wakeups\/s)$/)
+            dir = -1
+        else if (unit ~ /^(ops\/s|threads\/s|ratio)$/)
+            dir = 1
+        else
+            dir = 0
+        if (dir == 0 || (dir < 0 && (old + 0 == 0 || new + 0 == 0)) || old + new == 0) {
+            printf("%-28s %12s %12s %-10s %8s\n", metric, old, new, unit, "-")
+            next
+        }
+        if (old + 0 == 0)
+            change = (new > 0 ? 1 : -1) * 1000
+        else
+            change = (new - old) * 100.0 / old
+        status = ""
+        if (change * dir < -threshold) {
+            status = "REGRESSION"
+            regressions++
+        }
+        else if (change * dir > threshold)
+            status = "improved"
+        printf("%-28s %12s %12s %-10s %+7.1f%% %s\n", metric, old, new, unit, change, status)
+    }
+    END {
+        if (regressions > 0) {
+            printf("%d regression(s) beyond %s%%\n", regressions, threshold)
+            exit 1
+        }
+    }
+' "$1" "$2"
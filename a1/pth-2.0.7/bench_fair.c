@@ -0,0 +1,331 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  bench_fair.c: Pth benchmark program (fairness and convergence of the lottery)
+*/
+                             /* ``All animals are equal, but some
+                                  animals are more equal than others.''
+                                          -- George Orwell */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "pth.h"
+
+/*
+ * Usage: bench_fair [-m mix] [-t seconds] [-i msec] [-e epsilon]
+ *                   [-k scale] [-x exp] [-v]
+ *
+ * Runs a mix of threads under the lottery policy for the given number
+ * of seconds (default 5) and samples the target and the actual CPU
+ * share of every thread (PTH_ATTR_CPU_TARGET and PTH_ATTR_CPU_ACTUAL)
+ * every given number of milliseconds (default 100). The mix is a comma
+ * separated list of "kind:count:prio[:arg]" groups, where kind is one of
+ *
+ *   cpu     CPU-bound, runs in bursts of 200us between yields
+ *   greedy  CPU-bound, but runs in bursts of arg ms (default 5)
+ *   io      I/O-bound, runs 50us and then sleeps arg ms (default 1)
+ *   late    like cpu, but spawned only after arg ms (default half the run)
+ *   short   like cpu, but exits after arg ms (default 200) and is
+ *           replaced by a new thread, so there is a steady churn
+ *
+ * The default mix is "cpu:2:0,cpu:2:2,greedy:1:0,io:2:0,late:2:1,short:2:0".
+ * The cpu, greedy and late threads want all the CPU they can get, so
+ * for them the actual share should converge to the target; over these
+ * the program reports Jain's fairness index of actual/target and the
+ * deviation actual-target (in percentage points) at the end of the run,
+ * and how long it took until every one of them stayed within epsilon
+ * (default 2) percentage points of its target, measured from its spawn
+ * (separately for the late threads). The io and short threads only
+ * disturb them; their average actual share is reported for reference.
+ * The -k and -x options set PTH_CTRL_TICKETSCALE and PTH_CTRL_TICKETEXP
+ * to compare ticket formulas, -v prints every sample to stderr.
+ */
+
+#define MAX_SLOTS 256
+
+#define KIND_CPU    0
+#define KIND_GREEDY 1
+#define KIND_IO     2
+#define KIND_LATE   3
+#define KIND_SHORT  4
+
+static const char *kind_name[] = { "cpu", "greedy", "io", "late", "short" };
+
+/* a tracked thread (a short thread's successors reuse its slot) */
+typedef struct {
+    int    kind;
+    int    prio;
+    long   arg;       /* burst, sleep, spawn delay or lifetime in ms  */
+    pth_t  tid;       /* NULL while not (yet) running                 */
+    double spawned;   /* when tid was spawned                         */
+    double outside;   /* last sample outside of epsilon (or spawned)  */
+    double target;    /* last sampled shares                          */
+    double actual;
+} slot_t;
+
+static slot_t slots[MAX_SLOTS];
+static int nslots = 0;
+static volatile int stop = FALSE;
+static pth_attr_t attr;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void burn(long usec)
+{
+    double t = now() + usec / 1000000.0;
+
+    while (now() < t)
+        ;
+}
+
+static void *worker(void *arg);
+
+static void spawn(slot_t *s)
+{
+    pth_attr_set(attr, PTH_ATTR_PRIO, s->prio);
+    pth_attr_set(attr, PTH_ATTR_JOINABLE, s->kind == KIND_SHORT ? FALSE : TRUE);
+    s->spawned = s->outside = now();
+    if ((s->tid = pth_spawn(attr, worker, s)) == NULL) {
+        fprintf(stderr, "bench_fair: pth_spawn failed: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+static void *worker(void *arg)
+{
+    slot_t *s = (slot_t *)arg;
+
+    while (!stop) {
+        switch (s->kind) {
+            case KIND_GREEDY:
+                burn(s->arg * 1000);
+                break;
+            case KIND_IO:
+                burn(50);
+                pth_usleep((unsigned int)(s->arg * 1000));
+                break;
+            case KIND_SHORT:
+                if (now() - s->spawned >= s->arg / 1000.0) {
+                    /* hand over to a successor */
+                    spawn(s);
+                    return NULL;
+                }
+                /* fall through */
+            default:
+                burn(200);
+                break;
+        }
+        pth_yield(NULL);
+    }
+    if (s->kind == KIND_SHORT)
+        s->tid = NULL;
+    return NULL;
+}
+
+/* whether the actual share of a thread should converge to its target */
+#define steady(s) ((s)->kind == KIND_CPU || (s)->kind == KIND_GREEDY || (s)->kind == KIND_LATE)
+
+static void parse_mix(char *mix, long seconds)
+{
+    char *group, *kind;
+    int count, prio, i, k;
+    long arg;
+
+    for (group = strtok(mix, ","); group != NULL; group = strtok(NULL, ",")) {
+        kind = group;
+        if ((group = strchr(group, ':')) == NULL)
+            goto bad;
+        *group++ = '\0';
+        arg = -1;
+        if (sscanf(group, "%d:%d:%ld", &count, &prio, &arg) < 2)
+            goto bad;
+        for (k = 0; k < 5; k++)
+            if (strcmp(kind, kind_name[k]) == 0)
+                break;
+        if (k == 5 || count < 0 || prio < PTH_PRIO_MIN || prio > PTH_PRIO_MAX)
+            goto bad;
+        if (arg < 0)
+            arg = (k == KIND_GREEDY ? 5 : k == KIND_IO ? 1 :
+                   k == KIND_LATE ? seconds * 500 : 200);
+        for (i = 0; i < count; i++) {
+            if (nslots == MAX_SLOTS) {
+                fprintf(stderr, "bench_fair: more than %d threads\n", MAX_SLOTS);
+                exit(1);
+            }
+            slots[nslots].kind = k;
+            slots[nslots].prio = prio;
+            slots[nslots].arg  = arg;
+            slots[nslots].tid  = NULL;
+            nslots++;
+        }
+    }
+    return;
+
+bad:
+    fprintf(stderr, "bench_fair: invalid mix group \"%s\"\n", kind);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    char mix[1024] = "cpu:2:0,cpu:2:2,greedy:1:0,io:2:0,late:2:1,short:2:0";
+    long seconds, interval, scale, expo;
+    double epsilon, t_start, t, dev, dev_sum, dev_max, x, x_sum, x_sq;
+    double conv, conv_late, io_sum, short_sum;
+    int verbose, unconverged, steadies, ios, shorts, c, i;
+    pth_attr_t ta;
+    slot_t *s;
+
+    seconds  = 5;
+    interval = 100;
+    epsilon  = 2.0;
+    scale    = -1;
+    expo     = -1;
+    verbose  = FALSE;
+    while ((c = getopt(argc, argv, "m:t:i:e:k:x:v")) != -1) {
+        switch (c) {
+            case 'm': strncpy(mix, optarg, sizeof(mix) - 1); break;
+            case 't': seconds  = atol(optarg); break;
+            case 'i': interval = atol(optarg); break;
+            case 'e': epsilon  = atof(optarg); break;
+            case 'k': scale    = atol(optarg); break;
+            case 'x': expo     = atol(optarg); break;
+            case 'v': verbose  = TRUE;         break;
+            default:
+                fprintf(stderr, "usage: %s [-m mix] [-t seconds] [-i msec] [-e epsilon] "
+                        "[-k scale] [-x exp] [-v]\n", argv[0]);
+                exit(1);
+        }
+    }
+    if (seconds < 1 || interval < 1) {
+        fprintf(stderr, "bench_fair: need at least 1 second and 1 msec\n");
+        exit(1);
+    }
+    parse_mix(mix, seconds);
+
+    pth_init();
+    if (   pth_ctrl(PTH_CTRL_SCHEDPOLICY, PTH_SCHED_LOTTERY) == -1
+        || pth_ctrl(PTH_CTRL_TICKETSCALE, (int)scale) == -1
+        || pth_ctrl(PTH_CTRL_TICKETEXP, (int)expo) == -1) {
+        fprintf(stderr, "bench_fair: invalid ticket scale or exponent\n");
+        exit(1);
+    }
+    scale = pth_ctrl(PTH_CTRL_TICKETSCALE, -1);
+    expo  = pth_ctrl(PTH_CTRL_TICKETEXP, -1);
+
+    attr = pth_attr_new();
+    pth_attr_set(attr, PTH_ATTR_STACK_SIZE, (unsigned int)PTH_STACK_SIZE_SMALL);
+    for (i = 0; i < nslots; i++)
+        if (slots[i].kind != KIND_LATE)
+            spawn(&slots[i]);
+
+    /* sample until the end of the run */
+    t_start = t = now();
+    while (t - t_start < seconds) {
+        pth_nap(pth_time(interval / 1000, (interval % 1000) * 1000));
+        t = now();
+        for (i = 0; i < nslots; i++) {
+            s = &slots[i];
+            if (s->tid == NULL) {
+                if (s->kind == KIND_LATE && (t - t_start) * 1000 >= s->arg)
+                    spawn(s);
+                continue;
+            }
+            ta = pth_attr_of(s->tid);
+            pth_attr_get(ta, PTH_ATTR_CPU_TARGET, &s->target);
+            pth_attr_get(ta, PTH_ATTR_CPU_ACTUAL, &s->actual);
+            pth_attr_destroy(ta);
+            dev = s->actual - s->target;
+            if (dev < -epsilon || dev > epsilon)
+                s->outside = t;
+            if (verbose)
+                fprintf(stderr, "%.3f %d %s %d %.2f %.2f\n",
+                        t - t_start, i, kind_name[s->kind], s->prio, s->target, s->actual);
+        }
+    }
+    stop = TRUE;
+
+    /* evaluate the last samples */
+    dev_sum = dev_max = x_sum = x_sq = conv = conv_late = io_sum = short_sum = 0.0;
+    unconverged = steadies = ios = shorts = 0;
+    for (i = 0; i < nslots; i++) {
+        s = &slots[i];
+        if (s->tid == NULL)
+            continue;
+        if (s->kind == KIND_IO) {
+            io_sum += s->actual;
+            ios++;
+            continue;
+        }
+        if (s->kind == KIND_SHORT) {
+            short_sum += s->actual;
+            shorts++;
+            continue;
+        }
+        steadies++;
+        dev = s->actual - s->target;
+        dev = (dev < 0 ? -dev : dev);
+        dev_sum += dev;
+        if (dev > dev_max)
+            dev_max = dev;
+        x = (s->target > 0 ? s->actual / s->target : 0.0);
+        x_sum += x;
+        x_sq  += x * x;
+        if (s->outside >= t)
+            unconverged++;
+        else if (s->kind == KIND_LATE) {
+            if (s->outside - s->spawned > conv_late)
+                conv_late = s->outside - s->spawned;
+        }
+        else if (s->outside - s->spawned > conv)
+            conv = s->outside - s->spawned;
+    }
+
+    printf("fair.threads %d count\n", nslots);
+    printf("fair.ticket_scale %ld count\n", scale);
+    printf("fair.ticket_exp %ld count\n", expo);
+    printf("fair.jain %.4f ratio\n", x_sq > 0 ? x_sum * x_sum / (steadies * x_sq) : 0.0);
+    printf("fair.dev_avg %.2f pp\n", steadies > 0 ? dev_sum / steadies : 0.0);
+    printf("fair.dev_max %.2f pp\n", dev_max);
+    printf("fair.converge %.3f s\n", conv);
+    printf("fair.converge_late %.3f s\n", conv_late);
+    printf("fair.unconverged %d count\n", unconverged);
+    printf("fair.io_share %.2f pct\n", ios > 0 ? io_sum / ios : 0.0);
+    printf("fair.short_share %.2f pct\n", shorts > 0 ? short_sum / shorts : 0.0);
+
+    for (i = 0; i < nslots; i++)
+        if (slots[i].tid != NULL && slots[i].kind != KIND_SHORT)
+            pth_join(slots[i].tid, NULL);
+    pth_attr_destroy(attr);
+    pth_kill();
+    return 0;
+}
@@ -0,0 +1,352 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  bench_http.c: Pth benchmark program (HTTP load generator)
+*/
+                             /* ``The network is the computer.''
+                                          -- John Gage */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "pth.h"
+
+/*
+ * Usage: bench_http [-c connections] [-t seconds] [-p depth]
+ *                   [-s size | -f file] [-a address:port]
+ *
+ * A closed-loop HTTP/1.1 load generator: every connection (default 1)
+ * is driven by its own thread, which sends the given number of
+ * pipelined requests (default 1) at once, waits for all responses and
+ * starts over, for the given number of seconds (default 2) after half a
+ * second of warming up. The requests are for bodies of the given size
+ * (default 64 bytes, "GET /<size>") or with -f for the file the server
+ * was started with ("GET /file"). Without -a the test_httpd of the
+ * build directory is started on a port of its own (serving the file for
+ * -f) and stopped afterwards, so the benchmark covers the whole path
+ * from the load generator's through the server's scheduler and back.
+ * Reports the request rate, the body throughput and the latency
+ * percentiles (measured from the write of a batch to the end of each
+ * response) as http.c<connections>[.p<depth>][.s<size>|.file].<metric>,
+ * where the size is only given when it is not the default.
+ */
+
+#define MAX_SAMPLES (1024*1024)
+#define MAX_DEPTH   64
+#define BUFSIZE     16384
+
+static volatile int stop = FALSE;
+static volatile int measuring = FALSE;
+static struct sockaddr_in server;
+static char request[256];
+static int depth = 1;
+static double *lat;
+static long nlat = 0;
+static long requests = 0;
+static long errors = 0;
+static double bytes = 0.0;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* the receive state of a connection */
+struct conn {
+    int  fd;
+    char buf[BUFSIZE+1];
+    int  len;
+};
+
+/* read one response and return the size of its body (-1 on error) */
+static long response(struct conn *c)
+{
+    char *end, *cp;
+    long length, skip;
+    ssize_t n;
+    int hlen;
+
+    /* the header */
+    c->buf[c->len] = NUL;
+    while ((end = strstr(c->buf, "\r\n\r\n")) == NULL) {
+        if (c->len == BUFSIZE)
+            return -1;
+        if ((n = pth_read(c->fd, c->buf + c->len, BUFSIZE - c->len)) <= 0)
+            return -1;
+        c->len += n;
+        c->buf[c->len] = NUL;
+    }
+    if (strncmp(c->buf, "HTTP/1.1 200 ", 13) != 0)
+        return -1;
+    length = -1;
+    for (cp = strchr(c->buf, '\n'); cp != NULL && cp < end; cp = strchr(cp, '\n')) {
+        cp++;
+        if (strncasecmp(cp, "Content-Length:", 15) == 0)
+            length = atol(cp + 15);
+    }
+    if (length < 0)
+        return -1;
+
+    /* the body (all we do with it is skipping it) */
+    hlen = (int)(end + 4 - c->buf);
+    if (c->len - hlen >= length) {
+        c->len -= hlen + length;
+        memmove(c->buf, c->buf + hlen + length, c->len);
+        return length;
+    }
+    skip = length - (c->len - hlen);
+    c->len = 0;
+    while (skip > 0) {
+        if ((n = pth_read(c->fd, c->buf, skip < BUFSIZE ? skip : BUFSIZE)) <= 0)
+            return -1;
+        skip -= n;
+    }
+    return length;
+}
+
+static void *client(void *arg)
+{
+    struct conn *c;
+    char batch[MAX_DEPTH * sizeof(request)];
+    int batch_len, i, one = 1;
+    double t, l;
+    long n;
+
+    if ((c = (struct conn *)malloc(sizeof(struct conn))) == NULL)
+        return NULL;
+    c->len = 0;
+    if ((c->fd = socket(AF_INET, SOCK_STREAM, 0)) == -1
+        || pth_connect(c->fd, (struct sockaddr *)&server, sizeof(server)) == -1) {
+        errors++;
+        free(c);
+        return NULL;
+    }
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, (void *)&one, sizeof(one));
+    batch_len = 0;
+    for (i = 0; i < depth; i++) {
+        strcpy(batch + batch_len, request);
+        batch_len += strlen(request);
+    }
+
+    while (!stop) {
+        t = now();
+        if (pth_write(c->fd, batch, batch_len) != batch_len) {
+            errors++;
+            break;
+        }
+        for (i = 0; i < depth; i++) {
+            if ((n = response(c)) < 0) {
+                errors++;
+                break;
+            }
+            if (measuring) {
+                l = now() - t;
+                if (nlat < MAX_SAMPLES)
+                    lat[nlat++] = l;
+                requests++;
+                bytes += n;
+            }
+        }
+        if (i < depth)
+            break;
+    }
+    close(c->fd);
+    free(c);
+    return NULL;
+}
+
+/* start the server of the build directory and wait until it listens */
+static pid_t server_start(int port, char *file)
+{
+    char portbuf[16];
+    pid_t pid;
+    int fd, i;
+
+    sprintf(portbuf, "%d", port);
+    if ((pid = fork()) == -1)
+        return -1;
+    if (pid == 0) {
+        if (file != NULL)
+            execl("./test_httpd", "test_httpd", "-q", "-f", file, portbuf, (char *)NULL);
+        else
+            execl("./test_httpd", "test_httpd", "-q", portbuf, (char *)NULL);
+        fprintf(stderr, "bench_http: cannot run ./test_httpd: %s\n", strerror(errno));
+        _exit(1);
+    }
+    for (i = 0; i < 300; i++) {
+        if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+            break;
+        if (connect(fd, (struct sockaddr *)&server, sizeof(server)) == 0) {
+            close(fd);
+            return pid;
+        }
+        close(fd);
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+            return -1;
+        usleep(10000);
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    pth_attr_t attr;
+    pth_t *tid;
+    long conns, seconds, size, i;
+    char *file, *address, *cp;
+    double t_start, t_run;
+    char prefix[64];
+    pid_t pid;
+    int port;
+    int c;
+
+    conns   = 1;
+    seconds = 2;
+    size    = 64;
+    file    = NULL;
+    address = NULL;
+    while ((c = getopt(argc, argv, "c:t:p:s:f:a:")) != -1) {
+        switch (c) {
+            case 'c': conns   = atol(optarg); break;
+            case 't': seconds = atol(optarg); break;
+            case 'p': depth   = atoi(optarg); break;
+            case 's': size    = atol(optarg); break;
+            case 'f': file    = optarg;       break;
+            case 'a': address = optarg;       break;
+            default:
+                fprintf(stderr, "usage: %s [-c connections] [-t seconds] [-p depth] "
+                        "[-s size | -f file] [-a address:port]\n", argv[0]);
+                exit(1);
+        }
+    }
+    if (conns < 1 || seconds < 1 || depth < 1 || depth > MAX_DEPTH || size < 0) {
+        fprintf(stderr, "bench_http: need at least 1 connection and second "
+                "and a depth of 1 to %d\n", MAX_DEPTH);
+        exit(1);
+    }
+    sprintf(prefix, "http.c%ld", conns);
+    if (depth > 1)
+        sprintf(prefix + strlen(prefix), ".p%d", depth);
+    if (file != NULL)
+        strcat(prefix, ".file");
+    else if (size != 64)
+        sprintf(prefix + strlen(prefix), ".s%ld", size);
+    if (file != NULL)
+        sprintf(request, "GET /file HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    else
+        sprintf(request, "GET /%ld HTTP/1.1\r\nHost: localhost\r\n\r\n", size);
+    if ((lat = (double *)malloc(MAX_SAMPLES * sizeof(double))) == NULL
+        || (tid = (pth_t *)malloc(conns * sizeof(pth_t))) == NULL) {
+        fprintf(stderr, "bench_http: out of memory\n");
+        exit(1);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    /* the server to load (started before Pth is initialized here) */
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    pid = 0;
+    if (address != NULL) {
+        if ((cp = strrchr(address, ':')) == NULL) {
+            fprintf(stderr, "bench_http: address has to be <address>:<port>\n");
+            exit(1);
+        }
+        *cp = NUL;
+        server.sin_addr.s_addr = inet_addr(address);
+        server.sin_port = htons(atoi(cp + 1));
+    }
+    else {
+        port = 20000 + (int)(getpid() % 20000);
+        server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        server.sin_port = htons(port);
+        if ((pid = server_start(port, file)) == -1) {
+            fprintf(stderr, "bench_http: cannot start the server on port %d\n", port);
+            exit(1);
+        }
+    }
+
+    /* the clients */
+    pth_init();
+    attr = pth_attr_new();
+    pth_attr_set(attr, PTH_ATTR_STACK_SIZE, (unsigned int)(64*1024 + MAX_DEPTH * sizeof(request)));
+    for (i = 0; i < conns; i++) {
+        if ((tid[i] = pth_spawn(attr, client, NULL)) == NULL) {
+            fprintf(stderr, "bench_http: pth_spawn failed: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    pth_attr_destroy(attr);
+
+    /* warm up, measure and stop */
+    pth_nap(pth_time(0, 500000));
+    measuring = TRUE;
+    t_start = now();
+    pth_nap(pth_time(seconds, 0));
+    measuring = FALSE;
+    t_run = now() - t_start;
+    stop = TRUE;
+    for (i = 0; i < conns; i++)
+        pth_join(tid[i], NULL);
+    pth_kill();
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+
+    qsort(lat, nlat, sizeof(double), cmp_double);
+    printf("%s.conns %ld count\n", prefix, conns);
+    if (file != NULL)
+        printf("%s.file %.0f bytes\n", prefix, requests > 0 ? bytes / requests : 0.0);
+    else
+        printf("%s.size %ld bytes\n", prefix, size);
+    printf("%s.req_rate %.0f ops/s\n", prefix, requests / t_run);
+    printf("%s.throughput %.1f MB/s\n", prefix, bytes / t_run / (1024 * 1024));
+    if (nlat > 0) {
+        printf("%s.lat_p50 %.1f us\n", prefix, lat[nlat / 2] * 1000000);
+        printf("%s.lat_p99 %.1f us\n", prefix, lat[nlat * 99 / 100] * 1000000);
+        printf("%s.lat_p999 %.1f us\n", prefix, lat[nlat * 999 / 1000] * 1000000);
+    }
+    printf("%s.errors %ld count\n", prefix, errors);
+    return (errors > 0 || requests == 0);
+}
@@ -0,0 +1,277 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  bench_io.c: Pth benchmark program (socket I/O with many connections)
+*/
+                             /* ``Latency is forever.''
+                                          -- Stuart Cheshire */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "pth.h"
+
+/*
+ * Usage: bench_io [-c connections] [-s size] [-t seconds] [-b dispatches] [-u usec]
+ *
+ * Connects the given number of client threads (default 1) to a single
+ * echo server thread, each over its own socketpair(2). Every client
+ * sends a message of the given size (default 64 bytes) with pth_write(3)
+ * and reads the echo with pth_read(3) for the given number of seconds
+ * (default 2), while the server waits for all connections with
+ * pth_poll(3). The clients are connected in batches, each one after the
+ * previous batch has done its first round trip, and the measurement
+ * starts once every client has; reports how long that took and the
+ * round trip rate and latency afterwards. When not all clients got
+ * through within ten times the measurement period, or no round trip
+ * completed during it, nothing is reported and the exit status is 1.
+ * The file descriptor limit is raised as far as allowed; when it is
+ * still too low the number of connections is reduced accordingly. With
+ * -b and -u the scheduler polls the event manager only every given
+ * number of dispatches or microseconds (see PTH_CTRL_EVBATCH, -b 0
+ * leaves it to -u); the metrics are then named
+ * io.<connections>.b<dispatches>.<metric>.
+ */
+
+#define MAX_SIZE 4096
+#define RAMP     256  /* connections added per warmup step */
+
+static volatile int stop = FALSE;
+static int go = FALSE;
+static pth_mutex_t go_mutex = PTH_MUTEX_INIT;
+static pth_cond_t go_cond = PTH_COND_INIT;
+static long size = 64;
+static long warm = 0;
+static long trips = 0;
+static double trip_sum = 0.0;
+static struct pollfd *pfd;
+static long conns;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* read exactly n bytes */
+static int readn(int fd, char *buf, long n)
+{
+    ssize_t rc;
+    long got;
+
+    for (got = 0; got < n; got += rc)
+        if ((rc = pth_read(fd, buf + got, n - got)) <= 0)
+            return FALSE;
+    return TRUE;
+}
+
+static void *client(void *arg)
+{
+    int fd = (int)(long)arg;
+    char buf[MAX_SIZE];
+    double t;
+
+    memset(buf, 'x', size);
+    if (pth_write(fd, buf, size) == size && readn(fd, buf, size))
+        warm++;
+
+    /* stay quiet until all connections are warm */
+    pth_mutex_acquire(&go_mutex, FALSE, NULL);
+    while (!go)
+        pth_cond_await(&go_cond, &go_mutex, NULL);
+    pth_mutex_release(&go_mutex);
+
+    while (!stop) {
+        t = now();
+        if (pth_write(fd, buf, size) != size || !readn(fd, buf, size))
+            break;
+        trip_sum += now() - t;
+        trips++;
+    }
+    close(fd);
+    return NULL;
+}
+
+static void *server(void *arg)
+{
+    char buf[MAX_SIZE];
+    long active, i;
+    ssize_t n;
+
+    active = conns;
+    while (active > 0) {
+        if (pth_poll(pfd, conns, -1) <= 0)
+            continue;
+        for (i = 0; i < conns; i++) {
+            if (pfd[i].fd < 0 || pfd[i].revents == 0)
+                continue;
+            if ((n = pth_read(pfd[i].fd, buf, sizeof(buf))) <= 0
+                || pth_write(pfd[i].fd, buf, n) != n) {
+                close(pfd[i].fd);
+                pfd[i].fd = -1;
+                active--;
+            }
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pth_attr_t attr;
+    struct rlimit rl;
+    long requested, seconds, batch, budget, i, j;
+    double t_start, t_warm, t_run;
+    char prefix[64];
+    int sv[2];
+    int c;
+
+    requested = 1;
+    seconds   = 2;
+    batch     = 1;
+    budget    = 0;
+    while ((c = getopt(argc, argv, "c:s:t:b:u:")) != -1) {
+        switch (c) {
+            case 'c': requested = atol(optarg); break;
+            case 's': size      = atol(optarg); break;
+            case 't': seconds   = atol(optarg); break;
+            case 'b': batch     = atol(optarg); break;
+            case 'u': budget    = atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-c connections] [-s size] [-t seconds] "
+                        "[-b dispatches] [-u usec]\n", argv[0]);
+                exit(1);
+        }
+    }
+    if (requested < 1 || size < 1 || size > MAX_SIZE || batch < 0 || budget < 0) {
+        fprintf(stderr, "bench_io: need at least 1 connection, 1 to %d bytes "
+                "and no negative batch or budget\n", MAX_SIZE);
+        exit(1);
+    }
+    if (batch != 1 || budget > 0)
+        sprintf(prefix, "io.%ld.b%ld", requested, batch);
+    else
+        sprintf(prefix, "io.%ld", requested);
+
+    /* every connection needs two descriptors */
+    conns = requested;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        if (rl.rlim_cur < rl.rlim_max) {
+            rl.rlim_cur = rl.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &rl);
+            getrlimit(RLIMIT_NOFILE, &rl);
+        }
+        if (rl.rlim_cur != RLIM_INFINITY && (rlim_t)(conns * 2 + 16) > rl.rlim_cur)
+            conns = ((long)rl.rlim_cur - 16) / 2;
+    }
+
+    pth_init();
+    if (   pth_ctrl(PTH_CTRL_EVBATCH, (int)batch) == -1
+        || pth_ctrl(PTH_CTRL_EVBUDGET, budget) == -1) {
+        fprintf(stderr, "bench_io: cannot batch dispatches: %s\n", strerror(errno));
+        exit(1);
+    }
+    if ((pfd = (struct pollfd *)malloc(conns * sizeof(struct pollfd))) == NULL) {
+        fprintf(stderr, "bench_io: out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < conns; i++) {
+        pfd[i].fd = -1; /* ignored by poll(2) until connected */
+        pfd[i].events = POLLIN;
+        pfd[i].revents = 0;
+    }
+    attr = pth_attr_new();
+    pth_attr_set(attr, PTH_ATTR_STACK_SIZE, (unsigned int)PTH_STACK_SIZE_SMALL + MAX_SIZE);
+    if (pth_spawn(attr, server, NULL) == NULL) {
+        fprintf(stderr, "bench_io: pth_spawn failed: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    /* connect the clients in batches and let each batch do its first
+       round trip before adding the next, with the event manager polled
+       only once per batch: spawning all of them at once makes every one
+       of their first dispatches poll all the others, which takes
+       quadratic time (but do not wait longer than ten measurement
+       periods overall) */
+    pth_ctrl(PTH_CTRL_EVBATCH, RAMP);
+    t_start = now();
+    for (i = 0; i < conns && now() - t_start < seconds * 10; i = j) {
+        for (j = i; j < conns && j < i + RAMP; j++) {
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+                fprintf(stderr, "bench_io: socketpair failed after %ld connections: %s\n",
+                        j, strerror(errno));
+                exit(1);
+            }
+            pfd[j].fd = sv[0];
+            if (pth_spawn(attr, client, (void *)(long)sv[1]) == NULL) {
+                fprintf(stderr, "bench_io: pth_spawn failed: %s\n", strerror(errno));
+                exit(1);
+            }
+        }
+        while (warm < j && now() - t_start < seconds * 10)
+            pth_nap(pth_time(0, 1000));
+    }
+    pth_attr_destroy(attr);
+    t_warm = now() - t_start;
+    if (warm < conns) {
+        fprintf(stderr, "bench_io: only %ld of %ld connections warmed up within %.3f s\n",
+                warm, conns, t_warm);
+        exit(1);
+    }
+    pth_ctrl(PTH_CTRL_EVBATCH, (int)batch);
+    trips = 0;
+    trip_sum = 0.0;
+    pth_mutex_acquire(&go_mutex, FALSE, NULL);
+    go = TRUE;
+    pth_cond_notify(&go_cond, TRUE);
+    pth_mutex_release(&go_mutex);
+    t_start = now();
+    pth_nap(pth_time(seconds, 0));
+    stop = TRUE;
+    t_run = now() - t_start;
+    if (trips == 0) {
+        fprintf(stderr, "bench_io: no round trip completed within %.3f s "
+                "(use a longer -t)\n", t_run);
+        exit(1);
+    }
+
+    printf("%s.conns %ld count\n", prefix, conns);
+    printf("%s.size %ld bytes\n", prefix, size);
+    if (budget > 0)
+        printf("%s.budget %ld us\n", prefix, budget);
+    printf("%s.warmup %.3f s\n", prefix, t_warm);
+    printf("%s.trip_rate %.0f ops/s\n", prefix, trips / t_run);
+    printf("%s.trip_avg %.1f us\n", prefix, trip_sum / trips * 1e6);
+
+    /* with many connections draining the round trips still in flight
+       takes much longer than the measurement, so the threads are simply
+       torn down with the process */
+    exit(0);
+}
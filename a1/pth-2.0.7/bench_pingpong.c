@@ -0,0 +1,192 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  bench_pingpong.c: Pth benchmark program (round trips between processes)
+*/
+                             /* ``The fastest I/O is the one
+                                  you never have to wait for.''
+                                          -- Anonymous */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "pth.h"
+
+/*
+ * Usage: bench_pingpong [-n trips] [-s usec] [-w usec]
+ *
+ * Forks an echo process and sends a small message back and forth over a
+ * socketpair(2) between a thread in each process for the given number of
+ * round trips (default 20000), so that both schedulers run out of ready
+ * threads and wait for the other side on every hop. Reports the median
+ * and 99th percentile round trip time and the CPU time both processes
+ * spent per round trip and in relation to the elapsed time. With -s both
+ * schedulers spin for up to the given microseconds before they sleep
+ * (see PTH_CTRL_BUSYPOLL) and the metrics are named pingpong.s<usec>.
+ * With -w the echo thread naps for the given microseconds before every
+ * response, which shows how spinning backs off when events are rare.
+ */
+
+#define WARMUP 1000
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double cpu(struct rusage *ru)
+{
+    return ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1000000.0
+         + ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1000000.0;
+}
+
+/* the echo process: answer every byte until the peer closes */
+static void echo(int fd, long spin, long think)
+{
+    char c;
+
+    pth_init();
+    pth_ctrl(PTH_CTRL_BUSYPOLL, spin);
+    while (pth_read(fd, &c, 1) == 1) {
+        if (think > 0)
+            pth_nap(pth_time(0, think));
+        if (pth_write(fd, &c, 1) != 1)
+            break;
+    }
+    pth_kill();
+    exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    struct rusage ru0, ru1, ruc;
+    long trips, spin, think, i;
+    double *rtt, t, t_start, t_run, cpu_self, cpu_echo;
+    char prefix[64];
+    char c;
+    int sv[2];
+    int status;
+    pid_t pid;
+    int ch;
+
+    trips = 20000;
+    spin  = 0;
+    think = 0;
+    while ((ch = getopt(argc, argv, "n:s:w:")) != -1) {
+        switch (ch) {
+            case 'n': trips = atol(optarg); break;
+            case 's': spin  = atol(optarg); break;
+            case 'w': think = atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n trips] [-s usec] [-w usec]\n", argv[0]);
+                exit(1);
+        }
+    }
+    if (trips < 1 || spin < 0 || spin > 1000000 || think < 0 || think >= 1000000) {
+        fprintf(stderr, "bench_pingpong: need at least 1 trip, "
+                "a spin of at most 1000000 and a nap below 1000000 usec\n");
+        exit(1);
+    }
+    if (spin > 0)
+        sprintf(prefix, "pingpong.s%ld", spin);
+    else
+        sprintf(prefix, "pingpong");
+    if ((rtt = (double *)malloc(trips * sizeof(double))) == NULL) {
+        fprintf(stderr, "bench_pingpong: out of memory\n");
+        exit(1);
+    }
+
+    /* fork the echo process before Pth is initialized in either */
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+        fprintf(stderr, "bench_pingpong: socketpair: %s\n", strerror(errno));
+        exit(1);
+    }
+    if ((pid = fork()) == -1) {
+        fprintf(stderr, "bench_pingpong: fork: %s\n", strerror(errno));
+        exit(1);
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        echo(sv[1], spin, think);
+    }
+    close(sv[1]);
+
+    pth_init();
+    pth_ctrl(PTH_CTRL_BUSYPOLL, spin);
+
+    /* the round trips themselves (after some to warm up both sides) */
+    c = 'x';
+    for (i = 0; i < WARMUP; i++)
+        if (pth_write(sv[0], &c, 1) != 1 || pth_read(sv[0], &c, 1) != 1)
+            break;
+    getrusage(RUSAGE_SELF, &ru0);
+    t_start = now();
+    for (i = 0; i < trips; i++) {
+        t = now();
+        if (pth_write(sv[0], &c, 1) != 1 || pth_read(sv[0], &c, 1) != 1) {
+            fprintf(stderr, "bench_pingpong: echo process went away\n");
+            exit(1);
+        }
+        rtt[i] = now() - t;
+    }
+    t_run = now() - t_start;
+    getrusage(RUSAGE_SELF, &ru1);
+    cpu_self = cpu(&ru1) - cpu(&ru0);
+
+    /* the echo process spent its CPU time (nearly) all on the trips */
+    close(sv[0]);
+    if (wait4(pid, &status, 0, &ruc) == -1) {
+        fprintf(stderr, "bench_pingpong: wait4: %s\n", strerror(errno));
+        exit(1);
+    }
+    cpu_echo = cpu(&ruc);
+    pth_kill();
+
+    qsort(rtt, trips, sizeof(double), cmp_double);
+    printf("%s.trips %ld count\n", prefix, trips);
+    if (spin > 0)
+        printf("%s.spin %ld us\n", prefix, spin);
+    if (think > 0)
+        printf("%s.nap %ld us\n", prefix, think);
+    printf("%s.trip_rate %.0f ops/s\n", prefix, trips / t_run);
+    printf("%s.rtt_p50 %.1f us\n", prefix, rtt[trips / 2] * 1000000);
+    printf("%s.rtt_p99 %.1f us\n", prefix, rtt[trips * 99 / 100] * 1000000);
+    printf("%s.cpu_per_trip %.1f us\n", prefix, (cpu_self + cpu_echo) / trips * 1000000);
+    printf("%s.cpu_usage %.0f %%\n", prefix, (cpu_self + cpu_echo) / t_run * 100);
+    free(rtt);
+    return 0;
+}
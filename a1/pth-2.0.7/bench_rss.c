@@ -0,0 +1,146 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  bench_rss.c: Pth benchmark program (memory footprint of idle threads)
+*/
+                             /* ``Memory is like an orgasm.
+                                  It's a lot better if you
+                                  don't have to fake it.''
+                                          -- Seymour Cray */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "pth.h"
+
+/*
+ * Usage: bench_rss [-n threads] [-s stacksize] [-g]
+ *
+ * Spawns the given number of threads (default 2000) which all go to
+ * sleep immediately, and reports the resident set size the process
+ * needs for them. Use "-n 1000000 -s 16384" for the one-million thread
+ * case. With -g every stack gets a guard page; note that this needs two
+ * memory mappings per thread, so vm.max_map_count has to be raised for
+ * very large thread counts.
+ */
+
+/* the resident set size of the current process in KB */
+static long rss_kb(void)
+{
+    long pages, resident;
+    FILE *fp;
+
+    if ((fp = fopen("/proc/self/statm", "r")) != NULL) {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+            resident = -1;
+        fclose(fp);
+        if (resident >= 0)
+            return resident * (getpagesize() / 1024);
+    }
+    /* fallback: peak RSS is the best we can get */
+    {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        return ru.ru_maxrss;
+    }
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void *sleeper(void *arg)
+{
+    pth_nap(pth_time(3600, 0));
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pth_attr_t attr;
+    long threads, stacksize, rss_base, rss_idle;
+    double t_start, t_spawn, t_sleep;
+    int guard, c;
+    long i;
+
+    threads   = 2000;
+    stacksize = PTH_STACK_SIZE_SMALL;
+    guard     = FALSE;
+    while ((c = getopt(argc, argv, "n:s:g")) != -1) {
+        switch (c) {
+            case 'n': threads   = atol(optarg); break;
+            case 's': stacksize = atol(optarg); break;
+            case 'g': guard     = TRUE;         break;
+            default:
+                fprintf(stderr, "usage: %s [-n threads] [-s stacksize] [-g]\n", argv[0]);
+                exit(1);
+        }
+    }
+
+    pth_init();
+    rss_base = rss_kb();
+
+    attr = pth_attr_new();
+    pth_attr_set(attr, PTH_ATTR_JOINABLE, FALSE);
+    pth_attr_set(attr, PTH_ATTR_STACK_SIZE, (unsigned int)stacksize);
+    pth_attr_set(attr, PTH_ATTR_STACK_GUARD, guard);
+
+    /* spawn all threads (they stay in the new queue) */
+    t_start = now();
+    for (i = 0; i < threads; i++) {
+        if (pth_spawn(attr, sleeper, NULL) == NULL) {
+            fprintf(stderr, "bench_rss: pth_spawn failed after %ld threads: %s\n",
+                    i, strerror(errno));
+            threads = i;
+            break;
+        }
+    }
+    t_spawn = now() - t_start;
+
+    /* let every thread run once and fall asleep */
+    t_start = now();
+    while (pth_ctrl(PTH_CTRL_GETTHREADS_WAITING) < threads)
+        pth_yield(NULL);
+    t_sleep = now() - t_start;
+    rss_idle = rss_kb();
+
+    printf("rss.threads %ld count\n", threads);
+    printf("rss.stacksize %ld bytes\n", stacksize);
+    printf("rss.guard %d bool\n", guard);
+    printf("rss.spawn_rate %.0f threads/s\n", threads / (t_spawn > 0 ? t_spawn : 1e-9));
+    printf("rss.sleep_time %.3f s\n", t_sleep);
+    printf("rss.base %ld KB\n", rss_base);
+    printf("rss.idle %ld KB\n", rss_idle);
+    printf("rss.per_thread %.0f bytes\n",
+           threads > 0 ? (double)(rss_idle - rss_base) * 1024 / threads : 0.0);
+
+    /* the sleepers are simply torn down with the process */
+    exit(0);
+}
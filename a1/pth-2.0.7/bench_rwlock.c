@@ -0,0 +1,150 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  bench_rwlock.c: Pth benchmark program (read-mostly rwlock load)
+*/
+                             /* ``Many readers, few writers --
+                                  the fate of every good book.'' */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "pth.h"
+
+/*
+ * Usage: bench_rwlock [-r readers] [-w writers] [-t seconds] [-P]
+ *
+ * Runs the given number of readers (default 1000) which repeatedly
+ * hold a shared lock across a context switch, and a few writers
+ * (default 4) which take the lock exclusively every 10ms. Reports
+ * the read and write throughput and how long writers had to wait.
+ * With -P the classic priority scheduling policy is used instead of
+ * the lottery.
+ */
+
+static pth_rwlock_t lock = PTH_RWLOCK_INIT;
+static volatile int stop = FALSE;
+static long read_ops = 0;
+static long write_ops = 0;
+static double write_wait_sum = 0.0;
+static double write_wait_max = 0.0;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void *reader(void *arg)
+{
+    while (!stop) {
+        pth_rwlock_acquire(&lock, PTH_RWLOCK_RD, FALSE, NULL);
+        pth_yield(NULL);
+        pth_rwlock_release(&lock);
+        read_ops++;
+        pth_yield(NULL);
+    }
+    return NULL;
+}
+
+static void *writer(void *arg)
+{
+    double t, wait;
+
+    while (!stop) {
+        pth_nap(pth_time(0, 10000));
+        t = now();
+        pth_rwlock_acquire(&lock, PTH_RWLOCK_RW, FALSE, NULL);
+        wait = now() - t;
+        pth_yield(NULL);
+        pth_rwlock_release(&lock);
+        write_ops++;
+        write_wait_sum += wait;
+        if (wait > write_wait_max)
+            write_wait_max = wait;
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pth_attr_t attr;
+    pth_t *tids;
+    long readers, writers, seconds, i;
+    double t_start, t_run;
+    int c;
+
+    readers = 1000;
+    writers = 4;
+    seconds = 2;
+    while ((c = getopt(argc, argv, "r:w:t:P")) != -1) {
+        switch (c) {
+            case 'r': readers = atol(optarg); break;
+            case 'w': writers = atol(optarg); break;
+            case 't': seconds = atol(optarg); break;
+            case 'P': pth_init(); pth_ctrl(PTH_CTRL_SCHEDPOLICY, PTH_SCHED_PRIORITY); break;
+            default:
+                fprintf(stderr, "usage: %s [-r readers] [-w writers] [-t seconds] [-P]\n", argv[0]);
+                exit(1);
+        }
+    }
+
+    pth_init();
+    if ((tids = (pth_t *)malloc((readers + writers) * sizeof(pth_t))) == NULL) {
+        fprintf(stderr, "bench_rwlock: out of memory\n");
+        exit(1);
+    }
+    attr = pth_attr_new();
+    pth_attr_set(attr, PTH_ATTR_STACK_SIZE, (unsigned int)PTH_STACK_SIZE_SMALL);
+    for (i = 0; i < readers + writers; i++) {
+        tids[i] = pth_spawn(attr, i < readers ? reader : writer, NULL);
+        if (tids[i] == NULL) {
+            fprintf(stderr, "bench_rwlock: pth_spawn failed: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    pth_attr_destroy(attr);
+
+    t_start = now();
+    pth_nap(pth_time(seconds, 0));
+    stop = TRUE;
+    for (i = 0; i < readers + writers; i++)
+        pth_join(tids[i], NULL);
+    t_run = now() - t_start;
+
+    printf("rwlock.readers %ld count\n", readers);
+    printf("rwlock.writers %ld count\n", writers);
+    printf("rwlock.read_rate %.0f ops/s\n", read_ops / t_run);
+    printf("rwlock.write_rate %.0f ops/s\n", write_ops / t_run);
+    printf("rwlock.write_wait_avg %.3f ms\n",
+           write_ops > 0 ? write_wait_sum / write_ops * 1000 : 0.0);
+    printf("rwlock.write_wait_max %.3f ms\n", write_wait_max * 1000);
+
+    free(tids);
+    pth_kill();
+    return 0;
+}
@@ -0,0 +1,402 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  bench_sched.c: Pth benchmark program (scheduler and synchronization latencies)
+*/
+                             /* ``The cheapest, fastest and most
+                                  reliable components are those
+                                  that aren't there.''
+                                          -- Gordon Bell */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "pth.h"
+
+/*
+ * Usage: bench_sched [-n rounds] [-f threads] [-t seconds]
+ *
+ * Measures the basic costs of the library, each with the given number
+ * of rounds (default 100000): the latency of a context switch between
+ * two yielding threads, the throughput of pth_spawn(3) plus
+ * pth_join(3) (a tenth of the rounds), the cost of spawning and
+ * finishing a lightweight task with pth_task_spawn(3), the cost of
+ * switching between lightweight tasks (TASKS tasks which share the
+ * rounds), the latency of handing a mutex/condition variable pair over
+ * to another thread, the round trip time of a message between two
+ * message ports (also between BACKGROUND unrelated yielding threads,
+ * without and with wake-affine handoffs, see PTH_CTRL_WAKEAFFINE) and
+ * the cost of making, running and destroying a user-space context (a
+ * tenth of the rounds), once with pth_uctx_make(3) and once from a pool
+ * (see pth_uctx_pool_make(3)).
+ * Finally it runs the given number of CPU-bound threads (default 6)
+ * with priorities cycling through 0, 1 and 2 for the given number of
+ * seconds (default 2) and reports how far the CPU share of each thread
+ * was away from the share the lottery policy promises it (prio+1 over
+ * the sum of prio+1 of all threads), in percentage points.
+ */
+
+#define BURST_USEC 200
+#define TASKS      1000
+#define BACKGROUND 4
+
+static long rounds = 100000;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static pth_t spawn(void *(*func)(void *), void *arg)
+{
+    pth_t tid;
+
+    if ((tid = pth_spawn(PTH_ATTR_DEFAULT, func, arg)) == NULL) {
+        fprintf(stderr, "bench_sched: pth_spawn failed: %s\n", strerror(errno));
+        exit(1);
+    }
+    return tid;
+}
+
+/* context switch: two threads yielding to each other */
+static void *yielder(void *arg)
+{
+    long i;
+
+    for (i = 0; i < rounds; i++)
+        pth_yield(NULL);
+    return NULL;
+}
+
+/* spawn/join: a thread which does nothing */
+static void *nothing(void *arg)
+{
+    return arg;
+}
+
+/* lightweight tasks: one which is done at once and one which yields
+   until its share of the rounds is used up */
+static int task_nothing(pth_task_t task, void *arg)
+{
+    return PTH_TASK_DONE;
+}
+
+static long task_left[TASKS];
+
+static int task_yielder(pth_task_t task, void *arg)
+{
+    long *left = (long *)arg;
+
+    return ((*left)-- > 1 ? PTH_TASK_YIELD : PTH_TASK_DONE);
+}
+
+static void task_drain(void)
+{
+    while (pth_ctrl(PTH_CTRL_GETTASKS) > 0)
+        pth_yield(NULL);
+}
+
+/* user-space contexts: a start function which just returns */
+#define UCTX_STACK (64*1024)
+
+static void uctx_nothing(void *arg)
+{
+    return;
+}
+
+/* mutex/cond handoff: two threads passing a turn flag back and forth */
+static pth_mutex_t hand_mutex = PTH_MUTEX_INIT;
+static pth_cond_t  hand_cond  = PTH_COND_INIT;
+static int         hand_turn  = 0;
+
+static void *hander(void *arg)
+{
+    int side = (int)(long)arg;
+    long i;
+
+    for (i = 0; i < rounds; i++) {
+        pth_mutex_acquire(&hand_mutex, FALSE, NULL);
+        while (hand_turn != side)
+            pth_cond_await(&hand_cond, &hand_mutex, NULL);
+        hand_turn = !side;
+        pth_cond_notify(&hand_cond, FALSE);
+        pth_mutex_release(&hand_mutex);
+    }
+    return NULL;
+}
+
+/* message port ping-pong: the pong side replies to every message */
+static pth_msgport_t mp_ping, mp_pong;
+
+static void *ponger(void *arg)
+{
+    pth_event_t ev;
+    pth_message_t *m;
+    long i;
+
+    ev = pth_event(PTH_EVENT_MSG, mp_pong);
+    for (i = 0; i < rounds; i++) {
+        while ((m = pth_msgport_get(mp_pong)) == NULL)
+            pth_wait(ev);
+        pth_msgport_reply(m);
+    }
+    pth_event_free(ev, PTH_FREE_THIS);
+    return NULL;
+}
+
+static double msgport_rtt(void)
+{
+    pth_event_t ev;
+    pth_message_t msg, *m;
+    pth_t tid;
+    double t_start, t_run;
+    long i;
+
+    mp_ping = pth_msgport_create("bench_ping");
+    mp_pong = pth_msgport_create("bench_pong");
+    ev = pth_event(PTH_EVENT_MSG, mp_ping);
+    memset(&msg, 0, sizeof(msg));
+    msg.m_replyport = mp_ping;
+    tid = spawn(ponger, NULL);
+    t_start = now();
+    for (i = 0; i < rounds; i++) {
+        pth_msgport_put(mp_pong, &msg);
+        while ((m = pth_msgport_get(mp_ping)) == NULL)
+            pth_wait(ev);
+    }
+    t_run = now() - t_start;
+    pth_join(tid, NULL);
+    pth_event_free(ev, PTH_FREE_THIS);
+    pth_msgport_destroy(mp_ping);
+    pth_msgport_destroy(mp_pong);
+    return t_run;
+}
+
+/* unrelated threads which just keep yielding */
+static volatile int bg_stop = FALSE;
+
+static void *background(void *arg)
+{
+    while (!bg_stop)
+        pth_yield(NULL);
+    return NULL;
+}
+
+/* fairness: CPU-bound threads which run in bursts */
+static volatile int stop = FALSE;
+
+static void *burner(void *arg)
+{
+    double t;
+
+    while (!stop) {
+        t = now() + BURST_USEC / 1000000.0;
+        while (now() < t)
+            ;
+        pth_yield(NULL);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pth_attr_t attr;
+    pth_t tid[2], bg[BACKGROUND], *tids;
+    pth_time_t ran;
+    pth_uctx_t uc_main, uc;
+    pth_uctx_pool_t uc_pool;
+    double t_start, t_run, *share, total, weight, err, err_max, err_sum;
+    long fthreads, seconds, spawns, i;
+    int c;
+
+    fthreads = 6;
+    seconds  = 2;
+    while ((c = getopt(argc, argv, "n:f:t:")) != -1) {
+        switch (c) {
+            case 'n': rounds   = atol(optarg); break;
+            case 'f': fthreads = atol(optarg); break;
+            case 't': seconds  = atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n rounds] [-f threads] [-t seconds]\n", argv[0]);
+                exit(1);
+        }
+    }
+    if (rounds < 10 || fthreads < 1) {
+        fprintf(stderr, "bench_sched: need at least 10 rounds and 1 thread\n");
+        exit(1);
+    }
+
+    pth_init();
+    printf("sched.rounds %ld count\n", rounds);
+
+    /* context switch latency */
+    t_start = now();
+    tid[0] = spawn(yielder, NULL);
+    tid[1] = spawn(yielder, NULL);
+    pth_join(tid[0], NULL);
+    pth_join(tid[1], NULL);
+    t_run = now() - t_start;
+    printf("sched.ctxsw %.1f ns\n", t_run * 1e9 / (2 * rounds));
+
+    /* spawn/join throughput */
+    spawns = rounds / 10;
+    t_start = now();
+    for (i = 0; i < spawns; i++)
+        pth_join(spawn(nothing, NULL), NULL);
+    t_run = now() - t_start;
+    printf("sched.spawn_join %.0f threads/s\n", spawns / t_run);
+
+    /* lightweight task spawn and switch costs (in batches of TASKS) */
+    t_start = now();
+    for (i = 0; i < rounds; i++) {
+        if (pth_task_spawn(task_nothing, NULL) == NULL) {
+            fprintf(stderr, "bench_sched: pth_task_spawn failed: %s\n", strerror(errno));
+            exit(1);
+        }
+        if ((i + 1) % TASKS == 0)
+            task_drain();
+    }
+    task_drain();
+    t_run = now() - t_start;
+    printf("sched.task_spawn %.1f ns\n", t_run * 1e9 / rounds);
+    t_start = now();
+    for (i = 0; i < TASKS; i++) {
+        task_left[i] = rounds / TASKS;
+        pth_task_spawn(task_yielder, &task_left[i]);
+    }
+    task_drain();
+    t_run = now() - t_start;
+    printf("sched.task_switch %.1f ns\n", t_run * 1e9 / (rounds / TASKS * TASKS));
+
+    /* mutex/cond handoff latency */
+    t_start = now();
+    tid[0] = spawn(hander, (void *)0);
+    tid[1] = spawn(hander, (void *)1);
+    pth_join(tid[0], NULL);
+    pth_join(tid[1], NULL);
+    t_run = now() - t_start;
+    printf("sched.cond_handoff %.1f ns\n", t_run * 1e9 / (2 * rounds));
+
+    /* message port round trip time, alone and between BACKGROUND
+       unrelated yielding threads without and with wake-affine handoffs */
+    printf("sched.msgport_rtt %.1f ns\n", msgport_rtt() * 1e9 / rounds);
+    bg_stop = FALSE;
+    for (i = 0; i < BACKGROUND; i++)
+        bg[i] = spawn(background, NULL);
+    printf("sched.msgport_rtt_bg %.1f ns\n", msgport_rtt() * 1e9 / rounds);
+    pth_ctrl(PTH_CTRL_WAKEAFFINE, 8);
+    printf("sched.msgport_rtt_bg_affine %.1f ns\n", msgport_rtt() * 1e9 / rounds);
+    pth_ctrl(PTH_CTRL_WAKEAFFINE, 0);
+    bg_stop = TRUE;
+    for (i = 0; i < BACKGROUND; i++)
+        pth_join(bg[i], NULL);
+
+    /* user-space context setup: made from scratch versus from a pool */
+    if (!pth_uctx_create(&uc_main) || !pth_uctx_pool_create(&uc_pool, 1, UCTX_STACK)) {
+        fprintf(stderr, "bench_sched: cannot create user-space contexts: %s\n", strerror(errno));
+        exit(1);
+    }
+    spawns = rounds / 10;
+    t_start = now();
+    for (i = 0; i < spawns; i++) {
+        if (!pth_uctx_create(&uc)
+            || !pth_uctx_make(uc, NULL, UCTX_STACK, NULL, uctx_nothing, NULL, uc_main)) {
+            fprintf(stderr, "bench_sched: pth_uctx_make failed: %s\n", strerror(errno));
+            exit(1);
+        }
+        pth_uctx_switch(uc_main, uc);
+        pth_uctx_destroy(uc);
+    }
+    t_run = now() - t_start;
+    printf("sched.uctx_make %.1f ns\n", t_run * 1e9 / spawns);
+    t_start = now();
+    for (i = 0; i < spawns; i++) {
+        if (!pth_uctx_pool_make(uc_pool, &uc, uctx_nothing, NULL, uc_main)) {
+            fprintf(stderr, "bench_sched: pth_uctx_pool_make failed: %s\n", strerror(errno));
+            exit(1);
+        }
+        pth_uctx_switch(uc_main, uc);
+        pth_uctx_destroy(uc);
+    }
+    t_run = now() - t_start;
+    printf("sched.uctx_pool_make %.1f ns\n", t_run * 1e9 / spawns);
+    pth_uctx_pool_destroy(uc_pool);
+    pth_uctx_destroy(uc_main);
+
+    /* fairness error of the lottery */
+    if (pth_ctrl(PTH_CTRL_SCHEDPOLICY, PTH_SCHED_LOTTERY) == -1) {
+        fprintf(stderr, "bench_sched: cannot select the lottery policy: %s\n", strerror(errno));
+        exit(1);
+    }
+    tids  = (pth_t *)malloc(fthreads * sizeof(pth_t));
+    share = (double *)malloc(fthreads * sizeof(double));
+    if (tids == NULL || share == NULL) {
+        fprintf(stderr, "bench_sched: out of memory\n");
+        exit(1);
+    }
+    attr = pth_attr_new();
+    for (i = 0; i < fthreads; i++) {
+        pth_attr_set(attr, PTH_ATTR_PRIO, (int)(i % 3));
+        if ((tids[i] = pth_spawn(attr, burner, NULL)) == NULL) {
+            fprintf(stderr, "bench_sched: pth_spawn failed: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    pth_nap(pth_time(seconds, 0));
+    stop = TRUE;
+    total = 0.0;
+    for (i = 0; i < fthreads; i++) {
+        pth_attr_t ta = pth_attr_of(tids[i]);
+        pth_attr_get(ta, PTH_ATTR_TIME_RAN, &ran);
+        pth_attr_destroy(ta);
+        share[i] = ran.tv_sec + ran.tv_usec / 1000000.0;
+        total += share[i];
+    }
+    weight = 0.0;
+    for (i = 0; i < fthreads; i++)
+        weight += i % 3 + 1;
+    err_max = err_sum = 0.0;
+    for (i = 0; i < fthreads; i++) {
+        err = share[i] / (total > 0 ? total : 1.0) - (i % 3 + 1) / weight;
+        err = (err < 0 ? -err : err) * 100;
+        err_sum += err;
+        if (err > err_max)
+            err_max = err;
+    }
+    for (i = 0; i < fthreads; i++)
+        pth_join(tids[i], NULL);
+    pth_attr_destroy(attr);
+    printf("sched.fair_threads %ld count\n", fthreads);
+    printf("sched.fair_err_avg %.2f pp\n", err_sum / fthreads);
+    printf("sched.fair_err_max %.2f pp\n", err_max);
+
+    free(tids);
+    free(share);
+    pth_kill();
+    return 0;
+}
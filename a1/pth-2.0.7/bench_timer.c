@@ -0,0 +1,146 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  bench_timer.c: Pth benchmark program (timer-heavy sleeping threads)
+*/
+                             /* ``Time is what keeps everything
+                                  from happening at once.''
+                                          -- Ray Cummings */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "pth.h"
+
+/*
+ * Usage: bench_timer [-n threads] [-s slack] [-t seconds]
+ *
+ * Runs the given number of threads (default 100) which repeatedly
+ * sleep via pth_usleep(3) for 10ms plus a per-thread jitter of up to
+ * 1ms, so their deadlines are spread out. Reports how often the
+ * process actually woke up (voluntary context switches, i.e. blocking
+ * polls of the scheduler) and how late the sleepers were. The -s
+ * option sets the default timer slack in microseconds (default 0).
+ */
+
+static volatile int stop = FALSE;
+static long sleeps = 0;
+static double late_sum = 0.0;
+static double late_max = 0.0;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void *sleeper(void *arg)
+{
+    unsigned int usec;
+    double t, late;
+
+    usec = 10000 + (unsigned int)(long)arg % 1000;
+    while (!stop) {
+        t = now();
+        pth_usleep(usec);
+        late = now() - t - usec / 1000000.0;
+        late_sum += late;
+        if (late > late_max)
+            late_max = late;
+        sleeps++;
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pth_attr_t attr;
+    pth_t *tids;
+    long threads, slack, seconds, i;
+    double t_start, t_run;
+    struct rusage ru_start, ru_stop;
+    long wakeups;
+    int c;
+
+    threads = 100;
+    slack   = 0;
+    seconds = 2;
+    while ((c = getopt(argc, argv, "n:s:t:")) != -1) {
+        switch (c) {
+            case 'n': threads = atol(optarg); break;
+            case 's': slack   = atol(optarg); break;
+            case 't': seconds = atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-n threads] [-s slack] [-t seconds]\n", argv[0]);
+                exit(1);
+        }
+    }
+
+    pth_init();
+    if (pth_ctrl(PTH_CTRL_TIMERSLACK, slack) == -1) {
+        fprintf(stderr, "bench_timer: invalid timer slack: %ld\n", slack);
+        exit(1);
+    }
+    if ((tids = (pth_t *)malloc(threads * sizeof(pth_t))) == NULL) {
+        fprintf(stderr, "bench_timer: out of memory\n");
+        exit(1);
+    }
+    attr = pth_attr_new();
+    pth_attr_set(attr, PTH_ATTR_STACK_SIZE, (unsigned int)PTH_STACK_SIZE_SMALL);
+    for (i = 0; i < threads; i++) {
+        tids[i] = pth_spawn(attr, sleeper, (void *)(i * 7919));
+        if (tids[i] == NULL) {
+            fprintf(stderr, "bench_timer: pth_spawn failed: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    pth_attr_destroy(attr);
+
+    getrusage(RUSAGE_SELF, &ru_start);
+    t_start = now();
+    pth_nap(pth_time(seconds, 0));
+    stop = TRUE;
+    t_run = now() - t_start;
+    getrusage(RUSAGE_SELF, &ru_stop);
+    wakeups = ru_stop.ru_nvcsw - ru_start.ru_nvcsw;
+    for (i = 0; i < threads; i++)
+        pth_join(tids[i], NULL);
+
+    printf("timer.threads %ld count\n", threads);
+    printf("timer.slack %ld us\n", slack);
+    printf("timer.sleep_rate %.0f ops/s\n", sleeps / t_run);
+    printf("timer.wakeup_rate %.0f wakeups/s\n", wakeups / t_run);
+    printf("timer.sleeps_per_wakeup %.1f ratio\n",
+           wakeups > 0 ? (double)sleeps / wakeups : 0.0);
+    printf("timer.late_avg %.3f ms\n", sleeps > 0 ? late_sum / sleeps * 1000 : 0.0);
+    printf("timer.late_max %.3f ms\n", late_max * 1000);
+
+    free(tids);
+    pth_kill();
+    return 0;
+}
@@ -0,0 +1,343 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  bench_trace.c: Pth benchmark program (scheduler tracing cost, replay and analysis)
+*/
+                             /* ``If you can't measure it,
+                                  you can't improve it.''
+                                          -- Lord Kelvin */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+#include "pth.h"
+
+/*
+ * Usage: bench_trace [-n threads] [-d dispatches] [-o file]
+ *        bench_trace -a file
+ *
+ * Without -a, lets the given number of threads (default 100) yield to
+ * each other under the lottery policy until about the given number of
+ * dispatches (default 200000) happened, three times without and three
+ * times with a scheduler trace being recorded, and reports the best
+ * cost of a dispatch in both cases. Then it records a short run of ten threads, replays the
+ * trace in a second run and reports whether the threads ran in the same
+ * order; with -o the recorded trace of this run is also saved to the
+ * given file.
+ *
+ * With -a, analyzes a trace saved with pth_trace_save(3) instead: for
+ * every thread (in spawn order, 1 is the scheduler and 2 is main) it
+ * prints the number of dispatches, the time it ran and the distribution
+ * of the time it waited in the ready queue before being dispatched
+ * (average, median, 90th and 99th percentile and maximum, in
+ * microseconds).
+ */
+
+#define REPLAY_THREADS 10
+#define REPLAY_YIELDS  100
+
+static volatile int stop = FALSE;
+static long yields = 0;
+
+/* the order in which the threads of the replay runs ran */
+static int order[REPLAY_THREADS * REPLAY_YIELDS];
+static int ordered = 0;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void *yielder(void *arg)
+{
+    while (!stop) {
+        pth_yield(NULL);
+        yields++;
+    }
+    return NULL;
+}
+
+static void *orderer(void *arg)
+{
+    int i;
+
+    for (i = 0; i < REPLAY_YIELDS; i++) {
+        order[ordered++] = (int)(long)arg;
+        pth_yield(NULL);
+    }
+    return NULL;
+}
+
+/* the cost of a dispatch, with or without recording a trace */
+static double dispatch_cost(long threads, long dispatches, int tracing)
+{
+    pth_attr_t attr;
+    pth_t *tids;
+    double t_start, t_run;
+    long i;
+
+    pth_init();
+    if ((tids = (pth_t *)malloc(threads * sizeof(pth_t))) == NULL) {
+        fprintf(stderr, "bench_trace: out of memory\n");
+        exit(1);
+    }
+    if (tracing && !pth_trace_start(0)) {
+        fprintf(stderr, "bench_trace: pth_trace_start failed: %s\n", strerror(errno));
+        exit(1);
+    }
+    attr = pth_attr_new();
+    pth_attr_set(attr, PTH_ATTR_STACK_SIZE, (unsigned int)PTH_STACK_SIZE_SMALL);
+    stop = FALSE;
+    for (i = 0; i < threads; i++) {
+        if ((tids[i] = pth_spawn(attr, yielder, NULL)) == NULL) {
+            fprintf(stderr, "bench_trace: pth_spawn failed: %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    pth_attr_destroy(attr);
+    pth_yield(NULL);
+
+    yields = 0;
+    t_start = now();
+    while (yields < dispatches) {
+        pth_yield(NULL);
+        yields++;
+    }
+    t_run = now() - t_start;
+    stop = TRUE;
+    for (i = 0; i < threads; i++)
+        pth_join(tids[i], NULL);
+    pth_trace_stop();
+    free(tids);
+    pth_kill();
+    return t_run * 1e9 / dispatches;
+}
+
+/* one short run, recording into or replaying from fd */
+static void ordered_run(int fd, int replay)
+{
+    pth_t tids[REPLAY_THREADS];
+    int i;
+
+    pth_init();
+    if (replay ? !pth_trace_replay(fd) : !pth_trace_start(0)) {
+        fprintf(stderr, "bench_trace: cannot %s the trace: %s\n",
+                replay ? "replay" : "record", strerror(errno));
+        exit(1);
+    }
+    ordered = 0;
+    for (i = 0; i < REPLAY_THREADS; i++)
+        tids[i] = pth_spawn(PTH_ATTR_DEFAULT, orderer, (void *)(long)i);
+    for (i = 0; i < REPLAY_THREADS; i++)
+        pth_join(tids[i], NULL);
+    if (replay)
+        printf("trace.replay_status %s name\n",
+               pth_trace_status() == PTH_TRACE_DIVERGED ? "diverged" : "replayed");
+    else if (!pth_trace_save(fd)) {
+        fprintf(stderr, "bench_trace: pth_trace_save failed: %s\n", strerror(errno));
+        exit(1);
+    }
+    pth_trace_stop();
+    pth_kill();
+}
+
+/* record and replay a run and compare the orders */
+static void replay_check(const char *file)
+{
+    int recorded[REPLAY_THREADS * REPLAY_YIELDS];
+    char tmp[] = "/tmp/bench_trace.XXXXXX";
+    int fd;
+
+    if (file != NULL)
+        fd = open(file, O_RDWR|O_CREAT|O_TRUNC, 0644);
+    else if ((fd = mkstemp(tmp)) != -1)
+        unlink(tmp);
+    if (fd == -1) {
+        fprintf(stderr, "bench_trace: cannot create trace file: %s\n", strerror(errno));
+        exit(1);
+    }
+    ordered_run(fd, FALSE);
+    memcpy(recorded, order, sizeof(order));
+    lseek(fd, 0, SEEK_SET);
+    ordered_run(fd, TRUE);
+    close(fd);
+    printf("trace.replay_match %d bool\n",
+           memcmp(recorded, order, sizeof(order)) == 0);
+}
+
+/*
+ * the trace analyzer
+ */
+
+typedef struct {
+    long  dispatches;
+    long  ran;        /* microseconds                           */
+    long  ready;      /* time it became ready, or -1            */
+    long *waits;      /* the ready queue waits in microseconds  */
+    long  nwaits;
+    long  maxwaits;
+} thread_t;
+
+static int cmp_long(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void analyze(const char *file)
+{
+    pth_trace_hdr_t hdr;
+    pth_trace_t *r;
+    thread_t *th, *t;
+    unsigned long nth, i, n;
+    long wait;
+    FILE *fp;
+
+    if ((fp = fopen(file, "rb")) == NULL) {
+        fprintf(stderr, "bench_trace: cannot open %s: %s\n", file, strerror(errno));
+        exit(1);
+    }
+    if (   fread(&hdr, sizeof(hdr), 1, fp) != 1
+        || memcmp(hdr.th_magic, "PTHTRACE", 8) != 0
+        || hdr.th_recsize != sizeof(pth_trace_t)) {
+        fprintf(stderr, "bench_trace: %s is no trace of this platform\n", file);
+        exit(1);
+    }
+    if ((r = (pth_trace_t *)malloc(hdr.th_count * sizeof(pth_trace_t) + 1)) == NULL
+        || fread(r, sizeof(pth_trace_t), hdr.th_count, fp) != hdr.th_count) {
+        fprintf(stderr, "bench_trace: cannot read the records of %s\n", file);
+        exit(1);
+    }
+    fclose(fp);
+
+    /* follow every thread through the trace */
+    nth = 0;
+    th = NULL;
+    for (i = 0; i < hdr.th_count; i++) {
+        if (r[i].tr_thread >= nth) {
+            n = r[i].tr_thread + 1;
+            if ((th = (thread_t *)realloc(th, n * sizeof(thread_t))) == NULL) {
+                fprintf(stderr, "bench_trace: out of memory\n");
+                exit(1);
+            }
+            memset(&th[nth], 0, (n - nth) * sizeof(thread_t));
+            for (; nth < n; nth++)
+                th[nth].ready = -1;
+        }
+        t = &th[r[i].tr_thread];
+        if (r[i].tr_type == PTH_TRACE_READY) {
+            t->ready = r[i].tr_time;
+            continue;
+        }
+        t->dispatches++;
+        t->ran += r[i].tr_ran;
+        if (t->ready >= 0) {
+            wait = r[i].tr_time - t->ready;
+            if (t->nwaits == t->maxwaits) {
+                t->maxwaits = (t->maxwaits == 0 ? 64 : t->maxwaits * 2);
+                if ((t->waits = (long *)realloc(t->waits, t->maxwaits * sizeof(long))) == NULL) {
+                    fprintf(stderr, "bench_trace: out of memory\n");
+                    exit(1);
+                }
+            }
+            t->waits[t->nwaits++] = (wait > 0 ? wait : 0);
+        }
+        /* a thread which yielded is immediately ready again */
+        t->ready = (r[i].tr_state == PTH_STATE_READY ? r[i].tr_time + r[i].tr_ran : -1);
+    }
+
+    printf("# %lu records, %lu lost at the beginning\n", hdr.th_count, hdr.th_lost);
+    printf("# %6s %10s %10s %10s %10s %10s %10s %10s\n", "thread", "dispatches",
+           "ran_us", "wait_avg", "wait_p50", "wait_p90", "wait_p99", "wait_max");
+    for (i = 0; i < nth; i++) {
+        t = &th[i];
+        if (t->dispatches == 0)
+            continue;
+        wait = 0;
+        if (t->nwaits > 0) {
+            qsort(t->waits, t->nwaits, sizeof(long), cmp_long);
+            for (n = 0; n < (unsigned long)t->nwaits; n++)
+                wait += t->waits[n];
+            wait /= t->nwaits;
+        }
+#define PCT(p) (t->nwaits > 0 ? t->waits[(t->nwaits - 1) * (p) / 100] : 0)
+        printf("  %6lu %10ld %10ld %10ld %10ld %10ld %10ld %10ld\n", i, t->dispatches,
+               t->ran, wait, PCT(50), PCT(90), PCT(99), PCT(100));
+        free(t->waits);
+    }
+    free(th);
+    free(r);
+}
+
+int main(int argc, char *argv[])
+{
+    long threads, dispatches;
+    char *file, *trace;
+    double off, on, cost;
+    int c;
+
+    threads    = 100;
+    dispatches = 200000;
+    file       = NULL;
+    trace      = NULL;
+    while ((c = getopt(argc, argv, "n:d:o:a:")) != -1) {
+        switch (c) {
+            case 'n': threads    = atol(optarg); break;
+            case 'd': dispatches = atol(optarg); break;
+            case 'o': file       = optarg;       break;
+            case 'a': trace      = optarg;       break;
+            default:
+                fprintf(stderr, "usage: %s [-n threads] [-d dispatches] [-o file]\n"
+                        "       %s -a file\n", argv[0], argv[0]);
+                exit(1);
+        }
+    }
+    if (trace != NULL) {
+        analyze(trace);
+        return 0;
+    }
+
+    /* alternate the runs and take the best of each */
+    off = on = 0.0;
+    for (c = 0; c < 3; c++) {
+        cost = dispatch_cost(threads, dispatches, FALSE);
+        if (off == 0.0 || cost < off)
+            off = cost;
+        cost = dispatch_cost(threads, dispatches, TRUE);
+        if (on == 0.0 || cost < on)
+            on = cost;
+    }
+    printf("trace.threads %ld count\n", threads);
+    printf("trace.dispatch %.1f ns\n", off);
+    printf("trace.dispatch_traced %.1f ns\n", on);
+    printf("trace.overhead %.1f ns\n", on - off);
+    replay_check(file);
+    return 0;
+}
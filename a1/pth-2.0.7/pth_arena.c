@@ -0,0 +1,173 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  pth_arena.c: Pth per-thread arena allocation
+*/
+                             /* ``The cheapest free() is the
+                                  one you never call.''
+                                          -- Anonymous */
+#include "pth_p.h"
+
+/*
+ * Every thread can own an arena: memory which is handed out by just
+ * bumping a pointer through a chunk and which is never freed piece by
+ * piece, but all at once when the thread terminates (or whenever the
+ * thread resets it, e.g. after each request it served). The first chunk
+ * is allocated together with the arena structure and survives resets,
+ * so a thread whose requests fit into it does not call malloc(3) at
+ * all. Further chunks have the same size and are chained behind it;
+ * requests larger than a quarter of a chunk get a chunk of their own,
+ * so they do not waste the rest of the current one.
+ */
+
+#if cpp
+
+/* default chunk size of arenas created on first use */
+#define PTH_ARENA_CHUNK 8192
+
+/* alignment of the handed out memory */
+union pth_arena_align_un {
+    long         a_long;
+    double       a_double;
+    long double  a_ldouble;
+    void        *a_ptr;
+    void       (*a_func)(void);
+};
+#define PTH_ARENA_ALIGN sizeof(union pth_arena_align_un)
+#define PTH_ARENA_ROUND(n) \
+    (((n) + PTH_ARENA_ALIGN - 1) & ~((size_t)PTH_ARENA_ALIGN - 1))
+
+/* header of an additional chunk (the memory follows it) */
+struct pth_arena_chunk_st {
+    struct pth_arena_chunk_st *ac_next;
+};
+
+/* the arena (its first chunk follows it) */
+struct pth_arena_st {
+    char                      *ar_ptr;    /* next free byte in the current chunk */
+    char                      *ar_end;    /* end of the current chunk            */
+    struct pth_arena_chunk_st *ar_chunks; /* additional chunks                   */
+    size_t                     ar_size;   /* size of a chunk                     */
+};
+#define PTH_ARENA_HDR  PTH_ARENA_ROUND(sizeof(struct pth_arena_st))
+#define PTH_ARENA_CHDR PTH_ARENA_ROUND(sizeof(struct pth_arena_chunk_st))
+
+#endif /* cpp */
+
+/* create the arena of a thread with the given chunk size */
+intern int pth_arena_create(pth_t t, size_t size)
+{
+    struct pth_arena_st *ar;
+
+    size = PTH_ARENA_ROUND(size);
+    if ((ar = (struct pth_arena_st *)malloc(PTH_ARENA_HDR + size)) == NULL)
+        return pth_error(FALSE, ENOMEM);
+    ar->ar_ptr    = (char *)ar + PTH_ARENA_HDR;
+    ar->ar_end    = ar->ar_ptr + size;
+    ar->ar_chunks = NULL;
+    ar->ar_size   = size;
+    t->arena = ar;
+    return TRUE;
+}
+
+/* free the additional chunks of an arena */
+static void pth_arena_chunks_free(struct pth_arena_st *ar)
+{
+    struct pth_arena_chunk_st *c;
+
+    while ((c = ar->ar_chunks) != NULL) {
+        ar->ar_chunks = c->ac_next;
+        free(c);
+    }
+    return;
+}
+
+/* free the arena of a thread (on termination) */
+intern void pth_arena_free(pth_t t)
+{
+    if (t->arena == NULL)
+        return;
+    pth_arena_chunks_free(t->arena);
+    free(t->arena);
+    t->arena = NULL;
+    return;
+}
+
+/* the slow path of pth_arena_alloc(): the current chunk is full */
+static void *pth_arena_grow(struct pth_arena_st *ar, size_t size)
+{
+    struct pth_arena_chunk_st *c;
+    char *p;
+
+    if (size > ar->ar_size / 4) {
+        /* a chunk of its own, the current one stays current */
+        if ((c = (struct pth_arena_chunk_st *)malloc(PTH_ARENA_CHDR + size)) == NULL)
+            return pth_error((void *)NULL, ENOMEM);
+        c->ac_next = ar->ar_chunks;
+        ar->ar_chunks = c;
+        return (char *)c + PTH_ARENA_CHDR;
+    }
+    if ((c = (struct pth_arena_chunk_st *)malloc(PTH_ARENA_CHDR + ar->ar_size)) == NULL)
+        return pth_error((void *)NULL, ENOMEM);
+    c->ac_next = ar->ar_chunks;
+    ar->ar_chunks = c;
+    p = (char *)c + PTH_ARENA_CHDR;
+    ar->ar_ptr = p + size;
+    ar->ar_end = p + ar->ar_size;
+    return p;
+}
+
+void *pth_arena_alloc(size_t size)
+{
+    struct pth_arena_st *ar;
+    char *p;
+
+    pth_implicit_init();
+    if (size == 0)
+        size = 1;
+    if (size > (size_t)-1 - PTH_ARENA_CHDR - PTH_ARENA_ALIGN)
+        return pth_error((void *)NULL, ENOMEM);
+    size = PTH_ARENA_ROUND(size);
+    if ((ar = pth_current->arena) == NULL) {
+        if (!pth_arena_create(pth_current, PTH_ARENA_CHUNK))
+            return NULL;
+        ar = pth_current->arena;
+    }
+    if ((size_t)(ar->ar_end - ar->ar_ptr) < size)
+        return pth_arena_grow(ar, size);
+    p = ar->ar_ptr;
+    ar->ar_ptr += size;
+    return p;
+}
+
+void pth_arena_reset(void)
+{
+    struct pth_arena_st *ar;
+
+    pth_implicit_init();
+    if ((ar = pth_current->arena) == NULL)
+        return;
+    pth_arena_chunks_free(ar);
+    ar->ar_ptr = (char *)ar + PTH_ARENA_HDR;
+    ar->ar_end = ar->ar_ptr + ar->ar_size;
+    return;
+}
@@ -43,6 +43,11 @@ struct pth_attr_st {
     unsigned int a_cancelstate;
     unsigned int a_stacksize;
     char        *a_stackaddr;
+    int          a_stackguard;
+    pth_time_t   a_deadline;
+    pth_time_t   a_budget;
+    pth_time_t   a_timerslack;
+    unsigned int a_arenasize;
 };
 
 #endif /* cpp */
@@ -89,8 +94,13 @@ int pth_attr_init(pth_attr_t a)
     a->a_dispatches = 0;
     a->a_joinable = TRUE;
     a->a_cancelstate = PTH_CANCEL_DEFAULT;
-    a->a_stacksize = 64*1024;
+    a->a_stacksize = PTH_STACK_SIZE_DEFAULT;
     a->a_stackaddr = NULL;
+    a->a_stackguard = FALSE;
+    pth_time_set(&a->a_deadline, PTH_TIME_ZERO);
+    pth_time_set(&a->a_budget, PTH_TIME_ZERO);
+    pth_time_usec(&a->a_timerslack, pth_timerslack);
+    a->a_arenasize = 0;
     return TRUE;
 }
 
@@ -140,12 +150,21 @@ intern int pth_attr_ctrl(int cmd, pth_attr_t a, int op, va_list ap)
             if (cmd == PTH_ATTR_SET) {
                 char *src, *dst;
                 src = va_arg(ap, char *);
-                dst = (a->a_tid != NULL ? a->a_tid->name : a->a_name);
+                if (a->a_tid != NULL) {
+                    if (pth_tcb_ext(a->a_tid) == NULL)
+                        return pth_error(FALSE, ENOMEM);
+                    dst = a->a_tid->ext->name;
+                }
+                else
+                    dst = a->a_name;
                 pth_util_cpystrn(dst, src, PTH_TCB_NAMELEN);
             }
             else {
                 char *src, **dst;
-                src = (a->a_tid != NULL ? a->a_tid->name : a->a_name);
+                if (a->a_tid != NULL)
+                    src = (char *)pth_tcb_name(a->a_tid);
+                else
+                    src = a->a_name;
                 dst = va_arg(ap, char **);
                 *dst = src;
             }
@@ -225,13 +244,91 @@ intern int pth_attr_ctrl(int cmd, pth_attr_t a, int op, va_list ap)
             *dst = *src;
             break;
         }
+        case PTH_ATTR_STACK_GUARD: {
+            /* guard page below the stack */
+            int val, *src, *dst;
+            if (cmd == PTH_ATTR_SET) {
+                if (a->a_tid != NULL)
+                    return pth_error(FALSE, EPERM);
+                src = &val; val = va_arg(ap, int);
+                dst = &a->a_stackguard;
+            }
+            else {
+                if (a->a_tid != NULL)
+                    val = (a->a_tid->stackloan == PTH_TCB_STACK_MAPPED);
+                src = (a->a_tid != NULL ? &val : &a->a_stackguard);
+                dst = va_arg(ap, int *);
+            }
+            *dst = *src;
+            break;
+        }
+        case PTH_ATTR_DEADLINE:
+        case PTH_ATTR_BUDGET: {
+            /* deadline scheduling class */
+            pth_time_t val, *src, *dst;
+            if (cmd == PTH_ATTR_SET) {
+                if (a->a_tid != NULL)
+                    return pth_error(FALSE, EPERM);
+                val = va_arg(ap, pth_time_t);
+                if (val.tv_sec < 0 || val.tv_usec < 0 || val.tv_usec >= 1000000)
+                    return pth_error(FALSE, EINVAL);
+                src = &val;
+                dst = (op == PTH_ATTR_DEADLINE ? &a->a_deadline : &a->a_budget);
+            }
+            else {
+                if (a->a_tid != NULL)
+                    src = (op == PTH_ATTR_DEADLINE ? &a->a_tid->dl_period : &a->a_tid->dl_budget);
+                else
+                    src = (op == PTH_ATTR_DEADLINE ? &a->a_deadline : &a->a_budget);
+                dst = va_arg(ap, pth_time_t *);
+            }
+            pth_time_set(dst, src);
+            break;
+        }
+        case PTH_ATTR_TIMER_SLACK: {
+            /* timer coalescing */
+            pth_time_t val, *src, *dst;
+            if (cmd == PTH_ATTR_SET) {
+                val = va_arg(ap, pth_time_t);
+                if (val.tv_sec < 0 || val.tv_usec < 0 || val.tv_usec >= 1000000)
+                    return pth_error(FALSE, EINVAL);
+                src = &val;
+                dst = (a->a_tid != NULL ? &a->a_tid->timerslack : &a->a_timerslack);
+            }
+            else {
+                src = (a->a_tid != NULL ? &a->a_tid->timerslack : &a->a_timerslack);
+                dst = va_arg(ap, pth_time_t *);
+            }
+            pth_time_set(dst, src);
+            break;
+        }
+        case PTH_ATTR_ARENA_SIZE: {
+            /* arena chunk size */
+            unsigned int val, *src, *dst;
+            if (cmd == PTH_ATTR_SET) {
+                if (a->a_tid != NULL)
+                    return pth_error(FALSE, EPERM);
+                src = &val; val = va_arg(ap, unsigned int);
+                dst = &a->a_arenasize;
+            }
+            else {
+                if (a->a_tid != NULL)
+                    val = (a->a_tid->arena != NULL ? (unsigned int)a->a_tid->arena->ar_size : 0);
+                src = (a->a_tid != NULL ? &val : &a->a_arenasize);
+                dst = va_arg(ap, unsigned int *);
+            }
+            *dst = *src;
+            break;
+        }
         case PTH_ATTR_TIME_SPAWN: {
             pth_time_t *dst;
             if (cmd == PTH_ATTR_SET)
                 return pth_error(FALSE, EPERM);
             dst = va_arg(ap, pth_time_t *);
-            if (a->a_tid != NULL)
+            if (a->a_tid != NULL) {
                 pth_time_set(dst, &a->a_tid->spawned);
+                pth_clock_wall(dst);
+            }
             else
                 pth_time_set(dst, PTH_TIME_ZERO);
             break;
@@ -241,8 +338,10 @@ intern int pth_attr_ctrl(int cmd, pth_attr_t a, int op, va_list ap)
             if (cmd == PTH_ATTR_SET)
                 return pth_error(FALSE, EPERM);
             dst = va_arg(ap, pth_time_t *);
-            if (a->a_tid != NULL)
+            if (a->a_tid != NULL) {
                 pth_time_set(dst, &a->a_tid->lastran);
+                pth_clock_wall(dst);
+            }
             else
                 pth_time_set(dst, PTH_TIME_ZERO);
             break;
@@ -258,6 +357,21 @@ intern int pth_attr_ctrl(int cmd, pth_attr_t a, int op, va_list ap)
                 pth_time_set(dst, PTH_TIME_ZERO);
             break;
         }
+        case PTH_ATTR_CPU_TARGET:
+        case PTH_ATTR_CPU_ACTUAL: {
+            /* fair-share lottery accounting (percent of the CPU) */
+            double *dst;
+            if (cmd == PTH_ATTR_SET)
+                return pth_error(FALSE, EPERM);
+            dst = va_arg(ap, double *);
+            if (a->a_tid == NULL)
+                *dst = 0.0;
+            else if (op == PTH_ATTR_CPU_TARGET)
+                *dst = a->a_tid->cpu_rt.target;
+            else
+                *dst = a->a_tid->cpu_rt.actual;
+            break;
+        }
         case PTH_ATTR_START_FUNC: {
             void *(**dst)(void *);
             if (cmd == PTH_ATTR_SET)
@@ -44,7 +44,7 @@ void pth_cancel_point(void)
         && pth_current->cancelstate & PTH_CANCEL_ENABLE) {
         /* avoid looping if cleanup handlers contain cancellation points */
         pth_current->cancelreq = FALSE;
-        pth_debug2("pth_cancel_point: terminating cancelled thread \"%s\"", pth_current->name);
+        pth_debug2("pth_cancel_point: terminating cancelled thread \"%s\"", pth_tcb_name(pth_current));
         pth_exit(PTH_CANCELED);
     }
     return;
@@ -91,11 +91,11 @@ int pth_cancel(pth_t thread)
 
         /* and now either kick it out or move it to dead queue */
         if (!thread->joinable) {
-            pth_debug2("pth_cancel: kicking out cancelled thread \"%s\" immediately", thread->name);
+            pth_debug2("pth_cancel: kicking out cancelled thread \"%s\" immediately", pth_tcb_name(thread));
             pth_tcb_free(thread);
         }
         else {
-            pth_debug2("pth_cancel: moving cancelled thread \"%s\" to dead queue", thread->name);
+            pth_debug2("pth_cancel: moving cancelled thread \"%s\" to dead queue", pth_tcb_name(thread));
             thread->join_arg = PTH_CANCELED;
             thread->state = PTH_STATE_DEAD;
             pth_pqueue_insert(&pth_DQ, PTH_PRIO_STD, thread);
@@ -45,12 +45,14 @@ int pth_cleanup_push(void (*func)(void *), void *arg)
 
     if (func == NULL)
         return pth_error(FALSE, EINVAL);
+    if (pth_tcb_ext(pth_current) == NULL)
+        return pth_error(FALSE, ENOMEM);
     if ((cleanup = (pth_cleanup_t *)malloc(sizeof(pth_cleanup_t))) == NULL)
         return pth_error(FALSE, ENOMEM);
     cleanup->func = func;
     cleanup->arg  = arg;
-    cleanup->next = pth_current->cleanups;
-    pth_current->cleanups = cleanup;
+    cleanup->next = pth_current->ext->cleanups;
+    pth_current->ext->cleanups = cleanup;
     return TRUE;
 }
 
@@ -60,8 +62,8 @@ int pth_cleanup_pop(int execute)
     int rc;
 
     rc = FALSE;
-    if ((cleanup = pth_current->cleanups) != NULL) {
-        pth_current->cleanups = cleanup->next;
+    if (pth_current->ext != NULL && (cleanup = pth_current->ext->cleanups) != NULL) {
+        pth_current->ext->cleanups = cleanup->next;
         if (execute)
             cleanup->func(cleanup->arg);
         free(cleanup);
@@ -74,8 +76,10 @@ intern void pth_cleanup_popall(pth_t t, int execute)
 {
     pth_cleanup_t *cleanup;
 
-    while ((cleanup = t->cleanups) != NULL) {
-        t->cleanups = cleanup->next;
+    if (t->ext == NULL)
+        return;
+    while ((cleanup = t->ext->cleanups) != NULL) {
+        t->ext->cleanups = cleanup->next;
         if (execute)
             cleanup->func(cleanup->arg);
         free(cleanup);
@@ -32,50 +32,141 @@ struct pth_keytab_st {
     void (*destructor)(void *);
 };
 
-static struct pth_keytab_st pth_keytab[PTH_KEY_MAX];
+/* the key table grows on demand; PTH_KEY_MAX is just its initial size */
+static struct pth_keytab_st *pth_keytab      = NULL;
+static int                   pth_keytab_size = 0;
+static int                   pth_keytab_hint = 0;    /* lowest possibly free key */
+static unsigned long        *pth_keytab_dtor = NULL; /* bitmap of keys with destructor */
+
+/* number of bitmap words needed for n keys */
+#define PTH_KEY_WORDS(n) (((n) + PTH_UTIL_WORDBITS - 1) / PTH_UTIL_WORDBITS)
+
+/* grow the key table (and destructor bitmap) to at least n entries */
+static int pth_keytab_grow(int n)
+{
+    struct pth_keytab_st *kt;
+    unsigned long *dt;
+    int size;
+
+    size = (pth_keytab_size > 0 ? pth_keytab_size : PTH_KEY_MAX);
+    while (size < n)
+        size *= 2;
+    if ((kt = (struct pth_keytab_st *)realloc(pth_keytab, sizeof(struct pth_keytab_st) * size)) == NULL)
+        return FALSE;
+    pth_keytab = kt;
+    memset(&kt[pth_keytab_size], 0, sizeof(struct pth_keytab_st) * (size - pth_keytab_size));
+    if ((dt = (unsigned long *)realloc(pth_keytab_dtor, sizeof(unsigned long) * PTH_KEY_WORDS(size))) == NULL)
+        return FALSE;
+    pth_keytab_dtor = dt;
+    memset(&dt[PTH_KEY_WORDS(pth_keytab_size)], 0,
+           sizeof(unsigned long) * (PTH_KEY_WORDS(size) - PTH_KEY_WORDS(pth_keytab_size)));
+    pth_keytab_size = size;
+    return TRUE;
+}
+
+/* release the key table (on pth_kill) */
+intern void pth_key_kill(void)
+{
+    if (pth_keytab != NULL)
+        free(pth_keytab);
+    if (pth_keytab_dtor != NULL)
+        free(pth_keytab_dtor);
+    pth_keytab      = NULL;
+    pth_keytab_dtor = NULL;
+    pth_keytab_size = 0;
+    pth_keytab_hint = 0;
+    return;
+}
 
 int pth_key_create(pth_key_t *key, void (*func)(void *))
 {
+    int k;
+
     if (key == NULL)
         return pth_error(FALSE, EINVAL);
-    for ((*key) = 0; (*key) < PTH_KEY_MAX; (*key)++) {
-        if (pth_keytab[(*key)].used == FALSE) {
-            pth_keytab[(*key)].used = TRUE;
-            pth_keytab[(*key)].destructor = func;
-            return TRUE;
-        }
-    }
-    return pth_error(FALSE, EAGAIN);
+    for (k = pth_keytab_hint; k < pth_keytab_size; k++)
+        if (!pth_keytab[k].used)
+            break;
+    if (k == pth_keytab_size)
+        if (!pth_keytab_grow(k + 1))
+            return pth_error(FALSE, EAGAIN);
+    pth_keytab[k].used = TRUE;
+    pth_keytab[k].destructor = func;
+    if (func != NULL)
+        pth_keytab_dtor[k / PTH_UTIL_WORDBITS] |= (1UL << (k % PTH_UTIL_WORDBITS));
+    pth_keytab_hint = k + 1;
+    *key = k;
+    return TRUE;
 }
 
 int pth_key_delete(pth_key_t key)
 {
-    if (key < 0 || key >= PTH_KEY_MAX)
+    if (key < 0 || key >= pth_keytab_size)
         return pth_error(FALSE, EINVAL);
     if (!pth_keytab[key].used)
         return pth_error(FALSE, ENOENT);
     pth_keytab[key].used = FALSE;
+    pth_keytab_dtor[key / PTH_UTIL_WORDBITS] &= ~(1UL << (key % PTH_UTIL_WORDBITS));
+    if (key < pth_keytab_hint)
+        pth_keytab_hint = key;
+    return TRUE;
+}
+
+/* grow the per-thread value table to cover key; the value array and
+   the bitmap of set slots share one allocation */
+static int pth_key_growdata(pth_t t, pth_key_t key)
+{
+    const void **values;
+    unsigned long *set;
+    int size;
+
+    size = (t->data_size > 0 ? t->data_size : 8);
+    while (size <= key)
+        size *= 2;
+    values = (const void **)calloc(1, sizeof(void *) * size
+                                      + sizeof(unsigned long) * PTH_KEY_WORDS(size));
+    if (values == NULL)
+        return FALSE;
+    set = (unsigned long *)(values + size);
+    if (t->data_value != NULL) {
+        memcpy(values, t->data_value, sizeof(void *) * t->data_size);
+        memcpy(set, t->data_set, sizeof(unsigned long) * PTH_KEY_WORDS(t->data_size));
+        free(t->data_value);
+    }
+    t->data_value = values;
+    t->data_set   = set;
+    t->data_size  = size;
     return TRUE;
 }
 
 int pth_key_setdata(pth_key_t key, const void *value)
 {
-    if (key < 0 || key >= PTH_KEY_MAX)
+    unsigned long bit;
+    int word;
+
+    if (key < 0 || key >= pth_keytab_size)
         return pth_error(FALSE, EINVAL);
     if (!pth_keytab[key].used)
         return pth_error(FALSE, ENOENT);
-    if (pth_current->data_value == NULL) {
-        pth_current->data_value = (const void **)calloc(1, sizeof(void *)*PTH_KEY_MAX);
-        if (pth_current->data_value == NULL)
+    if (key >= pth_current->data_size) {
+        if (value == NULL)
+            return TRUE;
+        if (!pth_key_growdata(pth_current, key))
             return pth_error(FALSE, ENOMEM);
     }
+    word = key / PTH_UTIL_WORDBITS;
+    bit  = (1UL << (key % PTH_UTIL_WORDBITS));
     if (pth_current->data_value[key] == NULL) {
-        if (value != NULL)
+        if (value != NULL) {
             pth_current->data_count++;
+            pth_current->data_set[word] |= bit;
+        }
     }
     else {
-        if (value == NULL)
+        if (value == NULL) {
             pth_current->data_count--;
+            pth_current->data_set[word] &= ~bit;
+        }
     }
     pth_current->data_value[key] = value;
     return TRUE;
@@ -83,11 +174,11 @@ int pth_key_setdata(pth_key_t key, const void *value)
 
 void *pth_key_getdata(pth_key_t key)
 {
-    if (key < 0 || key >= PTH_KEY_MAX)
+    if (key < 0 || key >= pth_keytab_size)
         return pth_error((void *)NULL, EINVAL);
     if (!pth_keytab[key].used)
         return pth_error((void *)NULL, ENOENT);
-    if (pth_current->data_value == NULL)
+    if (key >= pth_current->data_size)
         return (void *)NULL;
     return (void *)pth_current->data_value[key];
 }
@@ -95,39 +186,44 @@ void *pth_key_getdata(pth_key_t key)
 intern void pth_key_destroydata(pth_t t)
 {
     void *data;
+    unsigned long bits;
     int key;
+    int word;
     int itr;
+    int called;
     void (*destructor)(void *);
 
     if (t == NULL)
         return;
     if (t->data_value == NULL)
         return;
-    /* POSIX thread iteration scheme */
-    for (itr = 0; itr < PTH_DESTRUCTOR_ITERATIONS; itr++) {
-        for (key = 0; key < PTH_KEY_MAX; key++) {
-            if (t->data_count > 0) {
-                destructor = NULL;
-                data = NULL;
-                if (pth_keytab[key].used) {
-                    if (t->data_value[key] != NULL) {
-                        data = (void *)t->data_value[key];
-                        t->data_value[key] = NULL;
-                        t->data_count--;
-                        destructor = pth_keytab[key].destructor;
-                    }
-                }
-                if (destructor != NULL)
-                    destructor(data);
+    /* POSIX thread iteration scheme, visiting only the slots which
+       are both set in this thread and have a destructor registered
+       (the table can grow while destructors run, so re-read it) */
+    for (itr = 0; itr < PTH_DESTRUCTOR_ITERATIONS && t->data_count > 0; itr++) {
+        called = FALSE;
+        for (word = 0; word < (int)PTH_KEY_WORDS(t->data_size); word++) {
+            bits = t->data_set[word] & pth_keytab_dtor[word];
+            while (bits != 0) {
+                key = word * PTH_UTIL_WORDBITS + pth_util_ctz(bits);
+                bits &= (bits - 1);
+                data = (void *)t->data_value[key];
+                destructor = pth_keytab[key].destructor;
+                t->data_value[key] = NULL;
+                t->data_set[word] &= ~(1UL << (key % PTH_UTIL_WORDBITS));
+                t->data_count--;
+                destructor(data);
+                called = TRUE;
             }
-            if (t->data_count == 0)
-                break;
         }
-        if (t->data_count == 0)
+        if (!called)
             break;
     }
     free(t->data_value);
     t->data_value = NULL;
+    t->data_set   = NULL;
+    t->data_size  = 0;
+    t->data_count = 0;
     return;
 }
 
@@ -87,7 +87,7 @@ intern void pth_dumpstate(FILE *fp)
     pth_dumpqueue(fp, "READY", &pth_RQ);
     fprintf(fp, "| Thread Queue RUNNING:\n");
     fprintf(fp, "|   1. thread 0x%lx (\"%s\")\n",
-            (unsigned long)pth_current, pth_current->name);
+            (unsigned long)pth_current, pth_tcb_name(pth_current));
     pth_dumpqueue(fp, "WAITING", &pth_WQ);
     pth_dumpqueue(fp, "SUSPENDED", &pth_SQ);
     pth_dumpqueue(fp, "DEAD", &pth_DQ);
@@ -107,7 +107,7 @@ intern void pth_dumpqueue(FILE *fp, const char *qn, pth_pqueue_t *q)
         fprintf(fp, "|   no threads\n");
     i = 1;
     for (t = pth_pqueue_head(q); t != NULL; t = pth_pqueue_walk(q, t, PTH_WALK_NEXT)) {
-        fprintf(fp, "|   %d. thread 0x%lx (\"%s\")\n", i++, (unsigned long)t, t->name);
+        fprintf(fp, "|   %d. thread 0x%lx (\"%s\")\n", i++, (unsigned long)t, pth_tcb_name(t));
     }
     return;
 }
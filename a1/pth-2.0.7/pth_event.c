@@ -41,9 +41,14 @@ struct pth_event_st {
     pth_status_t ev_status;
     int ev_type;
     int ev_goal;
+    int ev_flags;
+    int ev_pidx;  /* first slot in the scheduler's poll array (I/O events) */
+    int ev_pnum;  /* number of slots in the scheduler's poll array         */
+    int ev_errno; /* reason of PTH_STATUS_FAILED (I/O events)              */
     union {
         struct { int fd; }                                          FD;
         struct { int *n; int nfd; fd_set *rfds, *wfds, *efds; }     SELECT;
+        struct { int *n; struct pollfd *pfd; nfds_t nfd; }          POLL;
         struct { sigset_t *sigs; int *sig; }                        SIGS;
         struct { pth_time_t tv; }                                   TIME;
         struct { pth_msgport_t mp; }                                MSG;
@@ -54,8 +59,79 @@ struct pth_event_st {
     } ev_args;
 };
 
+/* event structure flags */
+#define PTH_EVENT_FLAG_EXTERN _BIT(0) /* lives in caller storage (pth_event_init) */
+
+/* maximum number of event structures cached on the free-list */
+#define PTH_EVENT_POOL_MAX 1024
+
 #endif /* cpp */
 
+/* caller-provided storage has to be able to hold an event structure */
+typedef char pth_event_storage_check_t
+    [sizeof(pth_event_storage_t) >= sizeof(struct pth_event_st) ? 1 : -1];
+
+/* free-list of recycled event structures (linked through ev_next) */
+static pth_event_t       pth_event_pool     = NULL;
+static pth_event_stats_t pth_event_counters = { 0, 0, 0, 0 };
+
+/* take an event structure from the free-list or allocate a new one */
+static pth_event_t pth_event_alloc(void)
+{
+    pth_event_t ev;
+
+    if ((ev = pth_event_pool) != NULL) {
+        pth_event_pool = ev->ev_next;
+        pth_event_counters.ev_pooled--;
+        pth_event_counters.ev_reused++;
+    }
+    else {
+        if ((ev = (pth_event_t)malloc(sizeof(struct pth_event_st))) == NULL)
+            return NULL;
+        pth_event_counters.ev_malloc++;
+    }
+    ev->ev_flags = 0;
+    return ev;
+}
+
+/* give an event structure back to the free-list (or to the system) */
+static void pth_event_release(pth_event_t ev)
+{
+    if (ev->ev_flags & PTH_EVENT_FLAG_EXTERN)
+        return;
+    if (pth_event_counters.ev_pooled < PTH_EVENT_POOL_MAX) {
+        ev->ev_next = pth_event_pool;
+        pth_event_pool = ev;
+        pth_event_counters.ev_pooled++;
+    }
+    else {
+        free(ev);
+        pth_event_counters.ev_free++;
+    }
+    return;
+}
+
+/* release all cached event structures (on pth_kill) */
+intern void pth_event_pool_drain(void)
+{
+    pth_event_t ev;
+
+    while ((ev = pth_event_pool) != NULL) {
+        pth_event_pool = ev->ev_next;
+        free(ev);
+        pth_event_counters.ev_free++;
+    }
+    pth_event_counters.ev_pooled = 0;
+    return;
+}
+
+/* query the event allocation counters */
+intern void pth_event_stats(pth_event_stats_t *stats)
+{
+    *stats = pth_event_counters;
+    return;
+}
+
 /* event structure destructor */
 static void pth_event_destructor(void *vp)
 {
@@ -66,60 +142,27 @@ static void pth_event_destructor(void *vp)
     return;
 }
 
-/* event structure constructor */
-pth_event_t pth_event(unsigned long spec, ...)
+/* initialize event specific ingredients and link the event
+   into a new or (with PTH_MODE_CHAIN) an existing event ring */
+static int pth_event_setup(pth_event_t ev, unsigned long spec, va_list ap)
 {
-    pth_event_t ev;
-    pth_key_t *ev_key;
-    va_list ap;
-
-    va_start(ap, spec);
-
-    /* allocate new or reuse static or supplied event structure */
-    if (spec & PTH_MODE_REUSE) {
-        /* reuse supplied event structure */
-        ev = va_arg(ap, pth_event_t);
-    }
-    else if (spec & PTH_MODE_STATIC) {
-        /* reuse static event structure */
-        ev_key = va_arg(ap, pth_key_t *);
-        if (*ev_key == PTH_KEY_INIT)
-            pth_key_create(ev_key, pth_event_destructor);
-        ev = (pth_event_t)pth_key_getdata(*ev_key);
-        if (ev == NULL) {
-            ev = (pth_event_t)malloc(sizeof(struct pth_event_st));
-            pth_key_setdata(*ev_key, ev);
-        }
-    }
-    else {
-        /* allocate new dynamic event structure */
-        ev = (pth_event_t)malloc(sizeof(struct pth_event_st));
-    }
-    if (ev == NULL)
-        return pth_error((pth_event_t)NULL, errno);
+    pth_event_t ch;
 
-    /* create new event ring out of event or insert into existing ring */
-    if (spec & PTH_MODE_CHAIN) {
-        pth_event_t ch = va_arg(ap, pth_event_t);
-        ev->ev_prev = ch->ev_prev;
-        ev->ev_next = ch;
-        ev->ev_prev->ev_next = ev;
-        ev->ev_next->ev_prev = ev;
-    }
-    else {
-        ev->ev_prev = ev;
-        ev->ev_next = ev;
-    }
+    /* the ring to chain into preceeds the event specific arguments */
+    ch = NULL;
+    if (spec & PTH_MODE_CHAIN)
+        ch = va_arg(ap, pth_event_t);
 
     /* initialize common ingredients */
     ev->ev_status = PTH_STATUS_PENDING;
+    ev->ev_errno  = 0;
 
     /* initialize event specific ingredients */
     if (spec & PTH_EVENT_FD) {
         /* filedescriptor event */
         int fd = va_arg(ap, int);
         if (!pth_util_fd_valid(fd))
-            return pth_error((pth_event_t)NULL, EBADF);
+            return pth_error(FALSE, EBADF);
         ev->ev_type = PTH_EVENT_FD;
         ev->ev_goal = (int)(spec & (PTH_UNTIL_FD_READABLE|\
                                     PTH_UNTIL_FD_WRITEABLE|\
@@ -141,6 +184,19 @@ pth_event_t pth_event(unsigned long spec, ...)
         ev->ev_args.SELECT.wfds = wfds;
         ev->ev_args.SELECT.efds = efds;
     }
+    else if (spec & PTH_EVENT_POLL) {
+        /* filedescriptor array poll event */
+        int *n = va_arg(ap, int *);
+        struct pollfd *pfd = va_arg(ap, struct pollfd *);
+        nfds_t nfd = va_arg(ap, nfds_t);
+        if (pfd == NULL && nfd > 0)
+            return pth_error(FALSE, EFAULT);
+        ev->ev_type = PTH_EVENT_POLL;
+        ev->ev_goal = (int)(spec & (PTH_UNTIL_OCCURRED));
+        ev->ev_args.POLL.n   = n;
+        ev->ev_args.POLL.pfd = pfd;
+        ev->ev_args.POLL.nfd = nfd;
+    }
     else if (spec & PTH_EVENT_SIGS) {
         /* signal set event */
         sigset_t *sigs = va_arg(ap, sigset_t *);
@@ -196,6 +252,11 @@ pth_event_t pth_event(unsigned long spec, ...)
         ev->ev_goal = goal;
         ev->ev_args.TID.tid = tid;
     }
+    else if (spec & PTH_EVENT_WAKEUP) {
+        /* wakeup event (see pth_wakeup) */
+        ev->ev_type = PTH_EVENT_WAKEUP;
+        ev->ev_goal = (int)(spec & (PTH_UNTIL_OCCURRED));
+    }
     else if (spec & PTH_EVENT_FUNC) {
         /* custom function event */
         ev->ev_type = PTH_EVENT_FUNC;
@@ -205,14 +266,91 @@ pth_event_t pth_event(unsigned long spec, ...)
         ev->ev_args.FUNC.tv    = va_arg(ap, pth_time_t);
     }
     else
-        return pth_error((pth_event_t)NULL, EINVAL);
+        return pth_error(FALSE, EINVAL);
 
+    /* create new event ring out of event or insert into existing ring */
+    if (ch != NULL) {
+        ev->ev_prev = ch->ev_prev;
+        ev->ev_next = ch;
+        ev->ev_prev->ev_next = ev;
+        ev->ev_next->ev_prev = ev;
+    }
+    else {
+        ev->ev_prev = ev;
+        ev->ev_next = ev;
+    }
+    return TRUE;
+}
+
+/* event structure constructor */
+pth_event_t pth_event(unsigned long spec, ...)
+{
+    pth_event_t ev;
+    pth_key_t *ev_key;
+    int fresh;
+    va_list ap;
+
+    va_start(ap, spec);
+
+    /* allocate new or reuse static or supplied event structure */
+    fresh = FALSE;
+    if (spec & PTH_MODE_REUSE) {
+        /* reuse supplied event structure */
+        ev = va_arg(ap, pth_event_t);
+    }
+    else if (spec & PTH_MODE_STATIC) {
+        /* reuse static event structure */
+        ev_key = va_arg(ap, pth_key_t *);
+        if (*ev_key == PTH_KEY_INIT)
+            pth_key_create(ev_key, pth_event_destructor);
+        ev = (pth_event_t)pth_key_getdata(*ev_key);
+        if (ev == NULL) {
+            ev = pth_event_alloc();
+            pth_key_setdata(*ev_key, ev);
+        }
+    }
+    else {
+        /* allocate new dynamic event structure */
+        ev = pth_event_alloc();
+        fresh = TRUE;
+    }
+    if (ev == NULL) {
+        va_end(ap);
+        return pth_error((pth_event_t)NULL, errno);
+    }
+
+    /* initialize event and link it into its ring */
+    if (!pth_event_setup(ev, spec, ap)) {
+        va_end(ap);
+        if (fresh)
+            pth_shield { pth_event_release(ev); }
+        return NULL;
+    }
     va_end(ap);
 
     /* return event */
     return ev;
 }
 
+/* event structure constructor operating on caller-provided storage */
+pth_event_t pth_event_init(pth_event_storage_t *storage, unsigned long spec, ...)
+{
+    pth_event_t ev;
+    va_list ap;
+
+    if (storage == NULL || (spec & (PTH_MODE_REUSE|PTH_MODE_STATIC)))
+        return pth_error((pth_event_t)NULL, EINVAL);
+    ev = (pth_event_t)storage;
+    ev->ev_flags = PTH_EVENT_FLAG_EXTERN;
+    va_start(ap, spec);
+    if (!pth_event_setup(ev, spec, ap)) {
+        va_end(ap);
+        return NULL;
+    }
+    va_end(ap);
+    return ev;
+}
+
 /* determine type of event */
 unsigned long pth_event_typeof(pth_event_t ev)
 {
@@ -334,6 +472,19 @@ pth_event_t pth_event_isolate(pth_event_t ev)
     return ring;
 }
 
+/* cut the events from evf up to evl out of their ring and close
+   them into a ring of their own again (undoes a pth_event_concat) */
+intern void pth_event_cut(pth_event_t evf, pth_event_t evl)
+{
+    if (evf->ev_prev == evl)
+        return;
+    evf->ev_prev->ev_next = evl->ev_next;
+    evl->ev_next->ev_prev = evf->ev_prev;
+    evf->ev_prev = evl;
+    evl->ev_next = evf;
+    return;
+}
+
 /* determine status of the event */
 pth_status_t pth_event_status(pth_event_t ev)
 {
@@ -369,13 +520,13 @@ int pth_event_free(pth_event_t ev, int mode)
     if (mode == PTH_FREE_THIS) {
         ev->ev_prev->ev_next = ev->ev_next;
         ev->ev_next->ev_prev = ev->ev_prev;
-        free(ev);
+        pth_event_release(ev);
     }
     else if (mode == PTH_FREE_ALL) {
         evc = ev;
         do {
             evn = evc->ev_next;
-            free(evc);
+            pth_event_release(evc);
             evc = evn;
         } while (evc != ev);
     }
@@ -391,12 +542,13 @@ int pth_wait(pth_event_t ev_ring)
     /* at least a waiting ring is required */
     if (ev_ring == NULL)
         return pth_error(-1, EINVAL);
-    pth_debug2("pth_wait: enter from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_wait: enter from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* mark all events in waiting ring as still pending */
     ev = ev_ring;
     do {
         ev->ev_status = PTH_STATUS_PENDING;
+        ev->ev_errno  = 0;
         pth_debug2("pth_wait: waiting on event 0x%lx", (unsigned long)ev);
         ev = ev->ev_next;
     } while (ev != ev_ring);
@@ -427,7 +579,7 @@ int pth_wait(pth_event_t ev_ring)
     } while (ev != ev_ring);
 
     /* leave to current thread with number of occurred events */
-    pth_debug2("pth_wait: leave to thread \"%s\"", pth_current->name);
+    pth_debug2("pth_wait: leave to thread \"%s\"", pth_tcb_name(pth_current));
     return nonpending;
 }
 
@@ -89,6 +89,9 @@ pid_t pth_fork(void)
         /* kick out all threads except for the current one and the scheduler */
         pth_scheduler_drop();
 
+        /* the tasks went away together with their carrier thread */
+        pth_task_kill();
+
         /* run child handlers in FIFO order */
         for (i = 0; i <= pth_atfork_idx-1; i++)
             if (pth_atfork_list[i].child != NULL)
@@ -191,7 +191,7 @@ pid_t pth_waitpid(pid_t wpid, int *status, int options)
     static pth_key_t ev_key = PTH_KEY_INIT;
     pid_t pid;
 
-    pth_debug2("pth_waitpid: called from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_waitpid: called from thread \"%s\"", pth_tcb_name(pth_current));
 
     for (;;) {
         /* do a non-blocking poll for the pid */
@@ -207,7 +207,7 @@ pid_t pth_waitpid(pid_t wpid, int *status, int options)
         pth_wait(ev);
     }
 
-    pth_debug2("pth_waitpid: leave to thread \"%s\"", pth_current->name);
+    pth_debug2("pth_waitpid: leave to thread \"%s\"", pth_tcb_name(pth_current));
     return pid;
 }
 
@@ -299,7 +299,7 @@ int pth_select_ev(int nfd, fd_set *rfds, fd_set *wfds,
     int rc;
 
     pth_implicit_init();
-    pth_debug2("pth_select_ev: called from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_select_ev: called from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* POSIX.1-2001/SUSv3 compliance */
     if (nfd < 0 || nfd > FD_SETSIZE)
@@ -403,7 +403,7 @@ int pth_select_ev(int nfd, fd_set *rfds, fd_set *wfds,
 
     /* select return code semantics */
     if (pth_event_status(ev_select) == PTH_STATUS_FAILED)
-        return pth_error(-1, EBADF);
+        return pth_error(-1, ev_select->ev_errno != 0 ? ev_select->ev_errno : EBADF);
     selected = FALSE;
     if (pth_event_status(ev_select) == PTH_STATUS_OCCURRED)
         selected = TRUE;
@@ -460,131 +460,76 @@ int pth_poll(struct pollfd *pfd, nfds_t nfd, int timeout)
     return pth_poll_ev(pfd, nfd, timeout, NULL);
 }
 
-/* Pth variant of poll(2) with extra events:
-   NOTICE: THIS HAS TO BE BASED ON pth_select(2) BECAUSE
-           INTERNALLY THE SCHEDULER IS ONLY select(2) BASED!! */
+/* Pth variant of poll(2) with extra events */
 int pth_poll_ev(struct pollfd *pfd, nfds_t nfd, int timeout, pth_event_t ev_extra)
 {
-    fd_set rfds, wfds, efds, xfds;
-    struct timeval tv, *ptv;
-    int maxfd, rc, n;
-    unsigned int i;
-    char data[64];
+    pth_event_t ev;
+    pth_event_t ev_poll;
+    pth_event_t ev_timeout;
+    static pth_key_t ev_key_poll    = PTH_KEY_INIT;
+    static pth_key_t ev_key_timeout = PTH_KEY_INIT;
+    nfds_t i;
+    int selected;
+    int rc;
 
     pth_implicit_init();
-    pth_debug2("pth_poll_ev: called from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_poll_ev: called from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* argument sanity checks */
-    if (pfd == NULL)
+    if (pfd == NULL && nfd > 0)
         return pth_error(-1, EFAULT);
-    if (nfd < 0 || nfd > FD_SETSIZE)
-        return pth_error(-1, EINVAL);
-
-    /* convert timeout number into a timeval structure */
-    ptv = &tv;
-    if (timeout == 0) {
-        /* return immediately */
-        ptv->tv_sec  = 0;
-        ptv->tv_usec = 0;
-    }
-    else if (timeout == INFTIM /* (-1) */) {
-        /* wait forever */
-        ptv = NULL;
-    }
-    else if (timeout > 0) {
-        /* return after timeout */
-        ptv->tv_sec  = (timeout / 1000);
-        ptv->tv_usec = (timeout % 1000) * 1000;
-    }
-    else
+    if (timeout < 0 && timeout != INFTIM /* (-1) */)
         return pth_error(-1, EINVAL);
 
-    /* create fd sets and determine max fd */
-    maxfd = -1;
-    FD_ZERO(&rfds);
-    FD_ZERO(&wfds);
-    FD_ZERO(&efds);
-    FD_ZERO(&xfds);
-    for (i = 0; i < nfd; i++) {
-        /* convert into fd_sets but remember that BSD select(2) says
-           "the only exceptional condition detectable is out-of-band
-           data received on a socket", hence we push POLLWRBAND events
-           onto wfds instead of efds. Additionally, remember invalid
-           filedescriptors in an extra fd_set xfds. */
-        if (!pth_util_fd_valid(pfd[i].fd)) {
-            FD_SET(pfd[i].fd, &xfds);
-            continue;
-        }
-        if (pfd[i].events & (POLLIN|POLLRDNORM))
-            FD_SET(pfd[i].fd, &rfds);
-        if (pfd[i].events & (POLLOUT|POLLWRNORM|POLLWRBAND))
-            FD_SET(pfd[i].fd, &wfds);
-        if (pfd[i].events & (POLLPRI|POLLRDBAND))
-            FD_SET(pfd[i].fd, &efds);
-        if (   pfd[i].fd >= maxfd
-            && (pfd[i].events & (POLLIN|POLLOUT|POLLPRI|
-                                 POLLRDNORM|POLLRDBAND|
-                                 POLLWRNORM|POLLWRBAND)))
-            maxfd = pfd[i].fd;
-    }
+    /* now directly poll the descriptors to avoid unnecessary (and
+       resource consuming because of context switches, etc) event
+       handling through the scheduler */
+    while ((rc = pth_sc(poll)(pfd, nfd, 0)) < 0 && errno == EINTR) ;
+    if (rc < 0)
+        /* pass-through immediate error */
+        return pth_error(-1, errno);
+    else if (rc > 0 || timeout == 0)
+        /* pass-through immediate success */
+        return rc;
 
-    /* examine fd sets with pth_select(3) */
+    /* suspend current thread until one descriptor
+       is ready or the timeout occurred */
     rc = -1;
-    if (maxfd != -1) {
-        rc = pth_select_ev(maxfd+1, &rfds, &wfds, &efds, ptv, ev_extra);
-        if (rc < 0)
-            return pth_error(-1, errno);
-        else if (rc == 0)
-            return 0;
+    ev = ev_poll = pth_event(PTH_EVENT_POLL|PTH_MODE_STATIC,
+                             &ev_key_poll, &rc, pfd, nfd);
+    if (ev == NULL)
+        return pth_error(-1, errno);
+    ev_timeout = NULL;
+    if (timeout != INFTIM) {
+        ev_timeout = pth_event(PTH_EVENT_TIME|PTH_MODE_STATIC, &ev_key_timeout,
+                               pth_timeout(timeout / 1000, (timeout % 1000) * 1000));
+        pth_event_concat(ev, ev_timeout, NULL);
     }
+    if (ev_extra != NULL)
+        pth_event_concat(ev, ev_extra, NULL);
+    pth_wait(ev);
+    if (ev_extra != NULL)
+        pth_event_isolate(ev_extra);
+    if (timeout != INFTIM)
+        pth_event_isolate(ev_timeout);
 
-    /* POSIX.1-2001/SUSv3 compliant result establishment */
-    n = 0;
-    for (i = 0; i < nfd; i++) {
-        pfd[i].revents = 0;
-        if (FD_ISSET(pfd[i].fd, &xfds)) {
-            if (pfd[i].fd >= 0) {
-                pfd[i].revents |= POLLNVAL;
-                n++;
-            }
-            continue;
-        }
-        if (maxfd == -1)
-            continue;
-        if (FD_ISSET(pfd[i].fd, &rfds)) {
-            if (pfd[i].events & POLLIN)
-                pfd[i].revents |= POLLIN;
-            if (pfd[i].events & POLLRDNORM)
-                pfd[i].revents |= POLLRDNORM;
-            n++;
-            /* support for POLLHUP */
-            if (   recv(pfd[i].fd, data, sizeof(data), MSG_PEEK) == -1
-                && (   errno == ESHUTDOWN    || errno == ECONNRESET
-                    || errno == ECONNABORTED || errno == ENETRESET    )) {
-                pfd[i].revents &= ~(POLLIN);
-                pfd[i].revents &= ~(POLLRDNORM);
-                pfd[i].revents |= POLLHUP;
-            }
-        }
-        else if (FD_ISSET(pfd[i].fd, &wfds)) {
-            if (pfd[i].events & POLLOUT)
-                pfd[i].revents |= POLLOUT;
-            if (pfd[i].events & POLLWRNORM)
-                pfd[i].revents |= POLLWRNORM;
-            if (pfd[i].events & POLLWRBAND)
-                pfd[i].revents |= POLLWRBAND;
-            n++;
-        }
-        else if (FD_ISSET(pfd[i].fd, &efds)) {
-            if (pfd[i].events & POLLPRI)
-                pfd[i].revents |= POLLPRI;
-            if (pfd[i].events & POLLRDBAND)
-                pfd[i].revents |= POLLRDBAND;
-            n++;
-        }
+    /* poll return code semantics */
+    if (pth_event_status(ev_poll) == PTH_STATUS_FAILED)
+        return pth_error(-1, ev_poll->ev_errno != 0 ? ev_poll->ev_errno : ENOMEM);
+    selected = FALSE;
+    if (pth_event_status(ev_poll) == PTH_STATUS_OCCURRED)
+        selected = TRUE;
+    else if (   timeout != INFTIM
+             && pth_event_status(ev_timeout) == PTH_STATUS_OCCURRED) {
+        selected = TRUE;
+        for (i = 0; i < nfd; i++)
+            pfd[i].revents = 0;
+        rc = 0;
     }
+    if (ev_extra != NULL && !selected)
+        return pth_error(-1, EINTR);
 
-    return n;
+    return rc;
 }
 
 /* Pth variant of connect(2) */
@@ -603,7 +548,7 @@ int pth_connect_ev(int s, const struct sockaddr *addr, socklen_t addrlen, pth_ev
     int fdmode;
 
     pth_implicit_init();
-    pth_debug2("pth_connect_ev: enter from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_connect_ev: enter from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* POSIX compliance */
     if (!pth_util_fd_valid(s))
@@ -641,7 +586,7 @@ int pth_connect_ev(int s, const struct sockaddr *addr, socklen_t addrlen, pth_ev
         return pth_error(rv, err);
     }
 
-    pth_debug2("pth_connect_ev: leave to thread \"%s\"", pth_current->name);
+    pth_debug2("pth_connect_ev: leave to thread \"%s\"", pth_tcb_name(pth_current));
     return rv;
 }
 
@@ -651,6 +596,44 @@ int pth_accept(int s, struct sockaddr *addr, socklen_t *addrlen)
     return pth_accept_ev(s, addr, addrlen, NULL);
 }
 
+/* delay accept(2) while overloaded (false if an extra event occurred) */
+static int pth_accept_delay(pth_event_t ev_extra)
+{
+    pth_event_t ev;
+    static pth_key_t ev_key = PTH_KEY_INIT;
+    pth_time_t until, now, step, tick;
+
+    pth_admit_delayed++;
+    pth_time_usec(&until, pth_admit_wait);
+    pth_time_set(&now, PTH_TIME_NOW);
+    pth_time_add(&until, &now);
+    pth_time_usec(&tick, 10000);
+    for (;;) {
+        /* re-check every 10ms, as the load averages change per tick */
+        if (pth_time_cmp(&now, &until) >= 0)
+            break;
+        pth_time_set(&step, &until);
+        pth_time_sub(&step, &now);
+        if (pth_time_cmp(&step, &tick) > 0)
+            pth_time_set(&step, &tick);
+        pth_time_add(&step, &now);
+        if ((ev = pth_event(PTH_EVENT_TIME|PTH_MODE_STATIC, &ev_key, step)) == NULL)
+            return TRUE;
+        if (ev_extra != NULL)
+            pth_event_concat(ev, ev_extra, NULL);
+        pth_wait(ev);
+        if (ev_extra != NULL) {
+            pth_event_isolate(ev);
+            if (pth_event_status(ev) != PTH_STATUS_OCCURRED)
+                return FALSE;
+        }
+        if (!pth_sched_overloaded())
+            break;
+        pth_time_set(&now, PTH_TIME_NOW);
+    }
+    return TRUE;
+}
+
 /* Pth variant of accept(2) with extra events */
 int pth_accept_ev(int s, struct sockaddr *addr, socklen_t *addrlen, pth_event_t ev_extra)
 {
@@ -660,7 +643,7 @@ int pth_accept_ev(int s, struct sockaddr *addr, socklen_t *addrlen, pth_event_t
     int rv;
 
     pth_implicit_init();
-    pth_debug2("pth_accept_ev: enter from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_accept_ev: enter from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* POSIX compliance */
     if (!pth_util_fd_valid(s))
@@ -670,28 +653,48 @@ int pth_accept_ev(int s, struct sockaddr *addr, socklen_t *addrlen, pth_event_t
     if ((fdmode = pth_fdmode(s, PTH_FDMODE_NONBLOCK)) == PTH_FDMODE_ERROR)
         return pth_error(-1, EBADF);
 
+    /* hold back new connections while the scheduler is overloaded */
+    if (pth_admit_action == PTH_ADMIT_DELAY && pth_sched_overloaded()) {
+        if (fdmode == PTH_FDMODE_NONBLOCK) {
+            pth_fdmode(s, fdmode);
+            return pth_error(-1, EAGAIN);
+        }
+        if (!pth_accept_delay(ev_extra)) {
+            pth_fdmode(s, fdmode);
+            return pth_error(-1, EINTR);
+        }
+    }
+
     /* poll socket via accept */
     ev = NULL;
-    while ((rv = pth_sc(accept)(s, addr, addrlen)) == -1
-           && (errno == EAGAIN || errno == EWOULDBLOCK)
-           && fdmode != PTH_FDMODE_NONBLOCK) {
-        /* do lazy event allocation */
-        if (ev == NULL) {
-            if ((ev = pth_event(PTH_EVENT_FD|PTH_UNTIL_FD_READABLE|PTH_MODE_STATIC, &ev_key, s)) == NULL)
-                return pth_error(-1, errno);
-            if (ev_extra != NULL)
-                pth_event_concat(ev, ev_extra, NULL);
-        }
-        /* wait until accept has a chance */
-        pth_wait(ev);
-        /* check for the extra events */
-        if (ev_extra != NULL) {
-            pth_event_isolate(ev);
-            if (pth_event_status(ev) != PTH_STATUS_OCCURRED) {
-                pth_fdmode(s, fdmode);
-                return pth_error(-1, EINTR);
+    for (;;) {
+        while ((rv = pth_sc(accept)(s, addr, addrlen)) == -1
+               && (errno == EAGAIN || errno == EWOULDBLOCK)
+               && fdmode != PTH_FDMODE_NONBLOCK) {
+            /* do lazy event allocation */
+            if (ev == NULL) {
+                if ((ev = pth_event(PTH_EVENT_FD|PTH_UNTIL_FD_READABLE|PTH_MODE_STATIC, &ev_key, s)) == NULL)
+                    return pth_error(-1, errno);
+                if (ev_extra != NULL)
+                    pth_event_concat(ev, ev_extra, NULL);
+            }
+            /* wait until accept has a chance */
+            pth_wait(ev);
+            /* check for the extra events */
+            if (ev_extra != NULL) {
+                pth_event_isolate(ev);
+                if (pth_event_status(ev) != PTH_STATUS_OCCURRED) {
+                    pth_fdmode(s, fdmode);
+                    return pth_error(-1, EINTR);
+                }
             }
         }
+        /* shed the connection right away while the scheduler is overloaded */
+        if (rv == -1 || pth_admit_action != PTH_ADMIT_SHED || !pth_sched_overloaded())
+            break;
+        pth_sc(close)(rv);
+        pth_admit_shed++;
+        pth_debug1("pth_accept_ev: shed a connection");
     }
 
     /* restore filedescriptor mode */
@@ -701,7 +704,7 @@ int pth_accept_ev(int s, struct sockaddr *addr, socklen_t *addrlen, pth_event_t
             pth_fdmode(rv, fdmode);
     }
 
-    pth_debug2("pth_accept_ev: leave to thread \"%s\"", pth_current->name);
+    pth_debug2("pth_accept_ev: leave to thread \"%s\"", pth_tcb_name(pth_current));
     return rv;
 }
 
@@ -714,15 +717,13 @@ ssize_t pth_read(int fd, void *buf, size_t nbytes)
 /* Pth variant of read(2) with extra event(s) */
 ssize_t pth_read_ev(int fd, void *buf, size_t nbytes, pth_event_t ev_extra)
 {
-    struct timeval delay;
     pth_event_t ev;
     static pth_key_t ev_key = PTH_KEY_INIT;
-    fd_set fds;
     int fdmode;
     int n;
 
     pth_implicit_init();
-    pth_debug2("pth_read_ev: enter from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_read_ev: enter from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* POSIX compliance */
     if (nbytes == 0)
@@ -740,12 +741,7 @@ ssize_t pth_read_ev(int fd, void *buf, size_t nbytes, pth_event_t ev_extra)
         /* now directly poll filedescriptor for readability
            to avoid unneccessary (and resource consuming because of context
            switches, etc) event handling through the scheduler */
-        FD_ZERO(&fds);
-        FD_SET(fd, &fds);
-        delay.tv_sec  = 0;
-        delay.tv_usec = 0;
-        while ((n = pth_sc(select)(fd+1, &fds, NULL, NULL, &delay)) < 0
-               && errno == EINTR) ;
+        n = pth_util_fd_poll(fd, POLLIN);
         if (n < 0 && (errno == EINVAL || errno == EBADF))
             return pth_error(-1, errno);
 
@@ -772,7 +768,7 @@ ssize_t pth_read_ev(int fd, void *buf, size_t nbytes, pth_event_t ev_extra)
     while ((n = pth_sc(read)(fd, buf, nbytes)) < 0
            && errno == EINTR) ;
 
-    pth_debug2("pth_read_ev: leave to thread \"%s\"", pth_current->name);
+    pth_debug2("pth_read_ev: leave to thread \"%s\"", pth_tcb_name(pth_current));
     return n;
 }
 
@@ -785,17 +781,15 @@ ssize_t pth_write(int fd, const void *buf, size_t nbytes)
 /* Pth variant of write(2) with extra event(s) */
 ssize_t pth_write_ev(int fd, const void *buf, size_t nbytes, pth_event_t ev_extra)
 {
-    struct timeval delay;
     pth_event_t ev;
     static pth_key_t ev_key = PTH_KEY_INIT;
-    fd_set fds;
     int fdmode;
     ssize_t rv;
     ssize_t s;
     int n;
 
     pth_implicit_init();
-    pth_debug2("pth_write_ev: enter from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_write_ev: enter from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* POSIX compliance */
     if (nbytes == 0)
@@ -813,12 +807,7 @@ ssize_t pth_write_ev(int fd, const void *buf, size_t nbytes, pth_event_t ev_extr
         /* now directly poll filedescriptor for writeability
            to avoid unneccessary (and resource consuming because of context
            switches, etc) event handling through the scheduler */
-        FD_ZERO(&fds);
-        FD_SET(fd, &fds);
-        delay.tv_sec  = 0;
-        delay.tv_usec = 0;
-        while ((n = pth_sc(select)(fd+1, NULL, &fds, NULL, &delay)) < 0
-               && errno == EINTR) ;
+        n = pth_util_fd_poll(fd, POLLOUT);
         if (n < 0 && (errno == EINVAL || errno == EBADF))
             return pth_error(-1, errno);
 
@@ -873,7 +862,7 @@ ssize_t pth_write_ev(int fd, const void *buf, size_t nbytes, pth_event_t ev_extr
     /* restore filedescriptor mode */
     pth_shield { pth_fdmode(fd, fdmode); }
 
-    pth_debug2("pth_write_ev: leave to thread \"%s\"", pth_current->name);
+    pth_debug2("pth_write_ev: leave to thread \"%s\"", pth_tcb_name(pth_current));
     return rv;
 }
 
@@ -886,15 +875,13 @@ ssize_t pth_readv(int fd, const struct iovec *iov, int iovcnt)
 /* Pth variant of readv(2) with extra event(s) */
 ssize_t pth_readv_ev(int fd, const struct iovec *iov, int iovcnt, pth_event_t ev_extra)
 {
-    struct timeval delay;
     pth_event_t ev;
     static pth_key_t ev_key = PTH_KEY_INIT;
-    fd_set fds;
     int fdmode;
     int n;
 
     pth_implicit_init();
-    pth_debug2("pth_readv_ev: enter from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_readv_ev: enter from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* POSIX compliance */
     if (iovcnt <= 0 || iovcnt > UIO_MAXIOV)
@@ -912,12 +899,7 @@ ssize_t pth_readv_ev(int fd, const struct iovec *iov, int iovcnt, pth_event_t ev
         /* first directly poll filedescriptor for readability
            to avoid unneccessary (and resource consuming because of context
            switches, etc) event handling through the scheduler */
-        FD_ZERO(&fds);
-        FD_SET(fd, &fds);
-        delay.tv_sec  = 0;
-        delay.tv_usec = 0;
-        while ((n = pth_sc(select)(fd+1, &fds, NULL, NULL, &delay)) < 0
-               && errno == EINTR) ;
+        n = pth_util_fd_poll(fd, POLLIN);
 
         /* if filedescriptor is still not readable,
            let thread sleep until it is or event occurs */
@@ -947,7 +929,7 @@ ssize_t pth_readv_ev(int fd, const struct iovec *iov, int iovcnt, pth_event_t ev
            && errno == EINTR) ;
 #endif
 
-    pth_debug2("pth_readv_ev: leave to thread \"%s\"", pth_current->name);
+    pth_debug2("pth_readv_ev: leave to thread \"%s\"", pth_tcb_name(pth_current));
     return n;
 }
 
@@ -1004,10 +986,8 @@ ssize_t pth_writev(int fd, const struct iovec *iov, int iovcnt)
 /* Pth variant of writev(2) with extra event(s) */
 ssize_t pth_writev_ev(int fd, const struct iovec *iov, int iovcnt, pth_event_t ev_extra)
 {
-    struct timeval delay;
     pth_event_t ev;
     static pth_key_t ev_key = PTH_KEY_INIT;
-    fd_set fds;
     int fdmode;
     struct iovec *liov;
     int liovcnt;
@@ -1020,7 +1000,7 @@ ssize_t pth_writev_ev(int fd, const struct iovec *iov, int iovcnt, pth_event_t e
     int tiovcnt;
 
     pth_implicit_init();
-    pth_debug2("pth_writev_ev: enter from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_writev_ev: enter from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* POSIX compliance */
     if (iovcnt <= 0 || iovcnt > UIO_MAXIOV)
@@ -1057,12 +1037,7 @@ ssize_t pth_writev_ev(int fd, const struct iovec *iov, int iovcnt, pth_event_t e
         /* first directly poll filedescriptor for writeability
            to avoid unneccessary (and resource consuming because of context
            switches, etc) event handling through the scheduler */
-        FD_ZERO(&fds);
-        FD_SET(fd, &fds);
-        delay.tv_sec  = 0;
-        delay.tv_usec = 0;
-        while ((n = pth_sc(select)(fd+1, NULL, &fds, NULL, &delay)) < 0
-               && errno == EINTR) ;
+        n = pth_util_fd_poll(fd, POLLOUT);
 
         for (;;) {
             /* if filedescriptor is still not writeable,
@@ -1130,7 +1105,7 @@ ssize_t pth_writev_ev(int fd, const struct iovec *iov, int iovcnt, pth_event_t e
     /* restore filedescriptor mode */
     pth_shield { pth_fdmode(fd, fdmode); }
 
-    pth_debug2("pth_writev_ev: leave to thread \"%s\"", pth_current->name);
+    pth_debug2("pth_writev_ev: leave to thread \"%s\"", pth_tcb_name(pth_current));
     return rv;
 }
 
@@ -1315,15 +1290,13 @@ ssize_t pth_recvfrom(int s, void *buf, size_t len, int flags, struct sockaddr *f
 /* Pth variant of SUSv2 recvfrom(2) with extra event(s) */
 ssize_t pth_recvfrom_ev(int fd, void *buf, size_t nbytes, int flags, struct sockaddr *from, socklen_t *fromlen, pth_event_t ev_extra)
 {
-    struct timeval delay;
     pth_event_t ev;
     static pth_key_t ev_key = PTH_KEY_INIT;
-    fd_set fds;
     int fdmode;
     int n;
 
     pth_implicit_init();
-    pth_debug2("pth_recvfrom_ev: enter from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_recvfrom_ev: enter from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* POSIX compliance */
     if (nbytes == 0)
@@ -1343,12 +1316,7 @@ ssize_t pth_recvfrom_ev(int fd, void *buf, size_t nbytes, int flags, struct sock
            switches, etc) event handling through the scheduler */
         if (!pth_util_fd_valid(fd))
             return pth_error(-1, EBADF);
-        FD_ZERO(&fds);
-        FD_SET(fd, &fds);
-        delay.tv_sec  = 0;
-        delay.tv_usec = 0;
-        while ((n = pth_sc(select)(fd+1, &fds, NULL, NULL, &delay)) < 0
-               && errno == EINTR) ;
+        n = pth_util_fd_poll(fd, POLLIN);
         if (n < 0 && (errno == EINVAL || errno == EBADF))
             return pth_error(-1, errno);
 
@@ -1375,7 +1343,7 @@ ssize_t pth_recvfrom_ev(int fd, void *buf, size_t nbytes, int flags, struct sock
     while ((n = pth_sc(recvfrom)(fd, buf, nbytes, flags, from, fromlen)) < 0
            && errno == EINTR) ;
 
-    pth_debug2("pth_recvfrom_ev: leave to thread \"%s\"", pth_current->name);
+    pth_debug2("pth_recvfrom_ev: leave to thread \"%s\"", pth_tcb_name(pth_current));
     return n;
 }
 
@@ -1400,17 +1368,15 @@ ssize_t pth_sendto(int s, const void *buf, size_t len, int flags, const struct s
 /* Pth variant of SUSv2 sendto(2) with extra event(s) */
 ssize_t pth_sendto_ev(int fd, const void *buf, size_t nbytes, int flags, const struct sockaddr *to, socklen_t tolen, pth_event_t ev_extra)
 {
-    struct timeval delay;
     pth_event_t ev;
     static pth_key_t ev_key = PTH_KEY_INIT;
-    fd_set fds;
     int fdmode;
     ssize_t rv;
     ssize_t s;
     int n;
 
     pth_implicit_init();
-    pth_debug2("pth_sendto_ev: enter from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_sendto_ev: enter from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* POSIX compliance */
     if (nbytes == 0)
@@ -1432,12 +1398,7 @@ ssize_t pth_sendto_ev(int fd, const void *buf, size_t nbytes, int flags, const s
             pth_fdmode(fd, fdmode);
             return pth_error(-1, EBADF);
         }
-        FD_ZERO(&fds);
-        FD_SET(fd, &fds);
-        delay.tv_sec  = 0;
-        delay.tv_usec = 0;
-        while ((n = pth_sc(select)(fd+1, NULL, &fds, NULL, &delay)) < 0
-               && errno == EINTR) ;
+        n = pth_util_fd_poll(fd, POLLOUT);
         if (n < 0 && (errno == EINVAL || errno == EBADF))
             return pth_error(-1, errno);
 
@@ -1492,7 +1453,7 @@ ssize_t pth_sendto_ev(int fd, const void *buf, size_t nbytes, int flags, const s
     /* restore filedescriptor mode */
     pth_shield { pth_fdmode(fd, fdmode); }
 
-    pth_debug2("pth_sendto_ev: leave to thread \"%s\"", pth_current->name);
+    pth_debug2("pth_sendto_ev: leave to thread \"%s\"", pth_tcb_name(pth_current));
     return rv;
 }
 
@@ -37,6 +37,10 @@ long pth_version(void)
 
 /* implicit initialization support */
 intern int pth_initialized = FALSE;
+
+/* spawn number of the last spawned thread */
+static unsigned long pth_serial = 0;
+
 #if cpp
 #define pth_implicit_init() \
     if (!pth_initialized) \
@@ -69,9 +73,15 @@ int pth_init(void)
 
     pth_debug1("pth_init: enter");
 
+    /* restart the thread numbering */
+    pth_serial = 0;
+
     /* initialize syscall wrapping */
     pth_syscall_init();
 
+    /* settle the scheduler clock before anything is accounted */
+    pth_clock_init();
+
     /* initialize the scheduler */
     if (!pth_scheduler_init()) {
         pth_shield { pth_syscall_kill(); }
@@ -90,7 +100,7 @@ int pth_init(void)
     pth_attr_set(t_attr, PTH_ATTR_NAME,         "**SCHEDULER**");
     pth_attr_set(t_attr, PTH_ATTR_JOINABLE,     FALSE);
     pth_attr_set(t_attr, PTH_ATTR_CANCEL_STATE, PTH_CANCEL_DISABLE);
-    pth_attr_set(t_attr, PTH_ATTR_STACK_SIZE,   64*1024);
+    pth_attr_set(t_attr, PTH_ATTR_STACK_SIZE,   PTH_STACK_SIZE_DEFAULT);
     pth_attr_set(t_attr, PTH_ATTR_STACK_ADDR,   NULL);
     pth_sched = pth_spawn(t_attr, pth_scheduler, NULL);
     if (pth_sched == NULL) {
@@ -148,6 +158,10 @@ int pth_kill(void)
     pth_initialized = FALSE;
     pth_tcb_free(pth_sched);
     pth_tcb_free(pth_main);
+    pth_key_kill();
+    pth_event_pool_drain();
+    pth_trace_kill();
+    pth_task_kill();
     pth_syscall_kill();
 #ifdef PTH_EX
     __ex_ctx       = __ex_ctx_default;
@@ -179,6 +193,8 @@ long pth_ctrl(unsigned long query, ...)
         if (query & PTH_CTRL_GETTHREADS_DEAD)
             rc += pth_pqueue_elements(&pth_DQ);
     }
+    else if (query & PTH_CTRL_GETTASKS)
+        rc = pth_task_count;
     else if (query & PTH_CTRL_GETAVLOAD) {
         float *pload = va_arg(ap, float *);
         *pload = pth_loadval;
@@ -189,7 +205,7 @@ long pth_ctrl(unsigned long query, ...)
     }
     else if (query & PTH_CTRL_GETNAME) {
         pth_t t = va_arg(ap, pth_t);
-        rc = (long)t->name;
+        rc = (long)pth_tcb_name(t);
     }
     else if (query & PTH_CTRL_DUMPSTATE) {
         FILE *fp = va_arg(ap, FILE *);
@@ -199,6 +215,117 @@ long pth_ctrl(unsigned long query, ...)
         int favournew = va_arg(ap, int);
         pth_favournew = (favournew ? 1 : 0);
     }
+    else if (query & PTH_CTRL_GETEVENTSTATS) {
+        pth_event_stats_t *stats = va_arg(ap, pth_event_stats_t *);
+        pth_event_stats(stats);
+    }
+    else if (query & PTH_CTRL_SCHEDPOLICY) {
+        int policy = va_arg(ap, int);
+        rc = pth_schedpolicy;
+        if (policy == PTH_SCHED_LOTTERY || policy == PTH_SCHED_PRIORITY)
+            pth_schedpolicy = policy;
+        else if (policy != -1)
+            rc = -1;
+    }
+    else if (query & PTH_CTRL_CLOCKSOURCE) {
+        int source = va_arg(ap, int);
+        rc = pth_clock_source;
+        if (source != -1 && !pth_clock_select(source)) {
+            va_end(ap);
+            return -1; /* errno tells EINVAL or ENOSYS */
+        }
+    }
+    else if (query & (PTH_CTRL_TICKETSCALE|PTH_CTRL_TICKETEXP)) {
+        int val = va_arg(ap, int);
+        int *knob = (query & PTH_CTRL_TICKETSCALE ? &pth_ticketscale : &pth_ticketexp);
+        int max = (query & PTH_CTRL_TICKETSCALE ? 100 : 3);
+        double tk, base;
+        int i;
+        rc = *knob;
+        if (val >= 1 && val <= max) {
+            /* reject combinations which could hand out too many tickets */
+            base = 100.0 * (query & PTH_CTRL_TICKETSCALE ? val : pth_ticketscale);
+            tk = base;
+            for (i = 1; i < (query & PTH_CTRL_TICKETEXP ? val : pth_ticketexp); i++)
+                tk *= base;
+            if (tk <= PTH_PQUEUE_TK_MAX)
+                *knob = val;
+            else
+                rc = -1;
+        }
+        else if (val != -1)
+            rc = -1;
+    }
+    else if (query & PTH_CTRL_EVBATCH) {
+        int batch = va_arg(ap, int);
+        rc = pth_evbatch;
+        if (batch >= 0)
+            pth_evbatch = batch;
+        else if (batch != -1)
+            rc = -1;
+    }
+    else if (query & PTH_CTRL_EVBUDGET) {
+        long budget = va_arg(ap, long);
+        rc = pth_evbudget;
+        if (budget >= 0 && budget <= INT_MAX)
+            pth_evbudget = budget;
+        else if (budget != -1)
+            rc = -1;
+    }
+    else if (query & PTH_CTRL_BUSYPOLL) {
+        long spin = va_arg(ap, long);
+        rc = pth_busypoll;
+        if (spin >= 0 && spin <= 1000000)
+            pth_busypoll = spin;
+        else if (spin != -1)
+            rc = -1;
+    }
+    else if (query & PTH_CTRL_WAKEAFFINE) {
+        int chain = va_arg(ap, int);
+        rc = pth_wakeaffine;
+        if (chain >= 0)
+            pth_wakeaffine = chain;
+        else if (chain != -1)
+            rc = -1;
+    }
+    else if (query & PTH_CTRL_GETLOADSTATS) {
+        pth_load_stats_t *stats = va_arg(ap, pth_load_stats_t *);
+        int reset = va_arg(ap, int);
+        pth_sched_loadstats(stats);
+        if (reset)
+            pth_qdelay_reset();
+    }
+    else if (query & PTH_CTRL_ADMISSION) {
+        const pth_admission_t *adm = va_arg(ap, const pth_admission_t *);
+        pth_admission_t *oadm = va_arg(ap, pth_admission_t *);
+        if (adm != NULL && (   adm->ad_load < 0 || adm->ad_qdelay < 0 || adm->ad_wait < 0
+                            || (   adm->ad_action != PTH_ADMIT_OFF
+                                && adm->ad_action != PTH_ADMIT_DELAY
+                                && adm->ad_action != PTH_ADMIT_SHED))) {
+            va_end(ap);
+            return pth_error(-1, EINVAL);
+        }
+        if (oadm != NULL) {
+            oadm->ad_action = pth_admit_action;
+            oadm->ad_load   = pth_admit_load;
+            oadm->ad_qdelay = pth_admit_qdelay;
+            oadm->ad_wait   = pth_admit_wait;
+        }
+        if (adm != NULL) {
+            pth_admit_action = adm->ad_action;
+            pth_admit_load   = adm->ad_load;
+            pth_admit_qdelay = adm->ad_qdelay;
+            pth_admit_wait   = adm->ad_wait;
+        }
+    }
+    else if (query & PTH_CTRL_TIMERSLACK) {
+        long slack = va_arg(ap, long);
+        rc = (int)pth_timerslack;
+        if (slack >= 0 && slack <= INT_MAX)
+            pth_timerslack = slack;
+        else if (slack != -1)
+            rc = -1;
+    }
     else
         rc = -1;
     va_end(ap);
@@ -226,6 +353,7 @@ pth_t pth_spawn(pth_attr_t attr, void *(*func)(void *), void *arg)
     pth_t t;
     unsigned int stacksize;
     void *stackaddr;
+    int stackguard;
     pth_time_t ts;
 
     pth_debug1("pth_spawn: enter");
@@ -239,9 +367,10 @@ pth_t pth_spawn(pth_attr_t attr, void *(*func)(void *), void *arg)
         func = NULL;
 
     /* allocate a new thread control block */
-    stacksize = (attr == PTH_ATTR_DEFAULT ? 64*1024 : attr->a_stacksize);
-    stackaddr = (attr == PTH_ATTR_DEFAULT ? NULL    : attr->a_stackaddr);
-    if ((t = pth_tcb_alloc(stacksize, stackaddr)) == NULL)
+    stacksize  = (attr == PTH_ATTR_DEFAULT ? PTH_STACK_SIZE_DEFAULT : attr->a_stacksize);
+    stackaddr  = (attr == PTH_ATTR_DEFAULT ? NULL : attr->a_stackaddr);
+    stackguard = (attr == PTH_ATTR_DEFAULT ? FALSE : attr->a_stackguard);
+    if ((t = pth_tcb_alloc(stacksize, stackaddr, stackguard)) == NULL)
         return pth_error((pth_t)NULL, errno);
     
     /* initilize attributes for fair-share lottery */
@@ -250,14 +379,42 @@ pth_t pth_spawn(pth_attr_t attr, void *(*func)(void *), void *arg)
     (t->cpu_rt).target = 0;
     (t->cpu_rt).actual = 0;    
 
+    /* threads belong to the fair-share class unless a deadline is
+       given; the first dispatch opens the first deadline period */
+    pth_time_set(&t->dl_period, PTH_TIME_ZERO);
+    pth_time_set(&t->dl_budget, PTH_TIME_ZERO);
+    pth_time_set(&t->dl_deadline, PTH_TIME_ZERO);
+    pth_time_set(&t->dl_used, PTH_TIME_ZERO);
+
     /* configure remaining attributes */
+    t->parent = NULL;
     if (attr != PTH_ATTR_DEFAULT) {
         /* overtake fields from the attribute structure */
         t->prio        = attr->a_prio;
         t->joinable    = attr->a_joinable;
         t->cancelstate = attr->a_cancelstate;
         t->dispatches  = attr->a_dispatches;
-        pth_util_cpystrn(t->name, attr->a_name, PTH_TCB_NAMELEN);
+        pth_time_set(&t->dl_period, &attr->a_deadline);
+        pth_time_set(&t->dl_budget, &attr->a_budget);
+        pth_time_set(&t->timerslack, &attr->a_timerslack);
+        if (pth_tcb_is_deadline(t) && pth_time_equal(t->dl_budget, pth_time_zero)) {
+            /* by default a deadline thread may use half of its period */
+            pth_time_set(&t->dl_budget, &t->dl_period);
+            pth_time_div(&t->dl_budget, 2);
+        }
+        /* threads get their arena right away when asked to */
+        if (attr->a_arenasize > 0 && !pth_arena_create(t, attr->a_arenasize)) {
+            pth_shield { pth_tcb_free(t); }
+            return pth_error((pth_t)NULL, ENOMEM);
+        }
+        /* the default name "unknown" needs no extension */
+        if (strcmp(attr->a_name, "unknown") != 0) {
+            if (pth_tcb_ext(t) == NULL) {
+                pth_shield { pth_tcb_free(t); }
+                return pth_error((pth_t)NULL, ENOMEM);
+            }
+            pth_util_cpystrn(t->ext->name, attr->a_name, PTH_TCB_NAMELEN);
+        }
     }
     else if (pth_current != NULL) {
         /* overtake some fields from the parent thread */
@@ -265,9 +422,9 @@ pth_t pth_spawn(pth_attr_t attr, void *(*func)(void *), void *arg)
         t->joinable    = pth_current->joinable;
         t->cancelstate = pth_current->cancelstate;
         t->dispatches  = 0;
-        pth_snprintf(t->name, PTH_TCB_NAMELEN, "%s.child@%d=0x%lx",
-                     pth_current->name, (unsigned int)time(NULL),
-                     (unsigned long)pth_current);
+        pth_time_usec(&t->timerslack, pth_timerslack);
+        /* named after the parent, but only when asked for (pth_tcb_name) */
+        t->parent      = pth_current;
     }
     else {
         /* defaults */
@@ -275,21 +432,29 @@ pth_t pth_spawn(pth_attr_t attr, void *(*func)(void *), void *arg)
         t->joinable    = TRUE;
         t->cancelstate = PTH_CANCEL_DEFAULT;
         t->dispatches  = 0;
-        pth_snprintf(t->name, PTH_TCB_NAMELEN,
+        pth_time_usec(&t->timerslack, pth_timerslack);
+        if (pth_tcb_ext(t) == NULL) {
+            pth_shield { pth_tcb_free(t); }
+            return pth_error((pth_t)NULL, ENOMEM);
+        }
+        pth_snprintf(t->ext->name, PTH_TCB_NAMELEN,
                      "user/%x", (unsigned int)time(NULL));
     }
 
+    /* number the threads in spawn order */
+    t->serial = ++pth_serial;
+
     /* initialize the time points and ranges */
-    pth_time_set(&ts, PTH_TIME_NOW);
+    pth_clock_now(&ts);
     pth_time_set(&t->spawned, &ts);
     pth_time_set(&t->lastran, &ts);
+    pth_time_set(&t->readied, &ts);
     pth_time_set(&t->running, PTH_TIME_ZERO);
 
     /* initialize events */
     t->events = NULL;
 
     /* clear raised signals */
-    sigemptyset(&t->sigpending);
     t->sigpendcnt = 0;
 
     /* remember the start routine and arguments for our trampoline */
@@ -301,11 +466,12 @@ pth_t pth_spawn(pth_attr_t attr, void *(*func)(void *), void *arg)
 
     /* initialize thread specific storage */
     t->data_value = NULL;
+    t->data_set   = NULL;
+    t->data_size  = 0;
     t->data_count = 0;
 
     /* initialize cancellation stuff */
     t->cancelreq   = FALSE;
-    t->cleanups    = NULL;
 
     /* initialize mutex stuff */
     pth_ring_init(&t->mutexring);
@@ -360,8 +526,10 @@ int pth_raise(pth_t t, int sig)
             return FALSE;
         if (sa.sa_handler == SIG_IGN)
             return TRUE; /* fine, nothing to do, sig is globally ignored */
-        if (!sigismember(&t->sigpending, sig)) {
-            sigaddset(&t->sigpending, sig);
+        if (pth_tcb_ext(t) == NULL)
+            return pth_error(FALSE, ENOMEM);
+        if (!sigismember(&t->ext->sigpending, sig)) {
+            sigaddset(&t->ext->sigpending, sig);
             t->sigpendcnt++;
         }
         pth_yield(t);
@@ -369,14 +537,32 @@ int pth_raise(pth_t t, int sig)
     }
 }
 
+/* make a thread's wakeup event occur (callable from any thread) */
+int pth_wakeup(pth_t t)
+{
+    if (t == NULL)
+        return pth_error(FALSE, EINVAL);
+#ifdef PTH_ATOMIC
+    /* a wakeup which is still on its way covers this one, too */
+    if (!pth_atomic_cas(&t->wk_posted, FALSE, TRUE))
+        return TRUE;
+#endif
+    t->wk_node.rn_prev = NULL;
+    if (!pth_inbox_push(&t->wk_node)) {
+        pth_shield { t->wk_posted = FALSE; }
+        return FALSE;
+    }
+    return TRUE;
+}
+
 /* check whether a thread exists */
 intern int pth_thread_exists(pth_t t)
 {
-    if (!pth_pqueue_contains(&pth_NQ, t))
-        if (!pth_pqueue_contains(&pth_RQ, t))
-            if (!pth_pqueue_contains(&pth_WQ, t))
-                if (!pth_pqueue_contains(&pth_SQ, t))
-                    if (!pth_pqueue_contains(&pth_DQ, t))
+    if (!pth_pqueue_find(&pth_NQ, t))
+        if (!pth_pqueue_find(&pth_RQ, t))
+            if (!pth_pqueue_find(&pth_WQ, t))
+                if (!pth_pqueue_find(&pth_SQ, t))
+                    if (!pth_pqueue_find(&pth_DQ, t))
                         return pth_error(FALSE, ESRCH); /* not found */
     return TRUE;
 }
@@ -385,15 +571,21 @@ intern int pth_thread_exists(pth_t t)
 intern void pth_thread_cleanup(pth_t thread)
 {
     /* run the cleanup handlers */
-    if (thread->cleanups != NULL)
+    if (thread->ext != NULL && thread->ext->cleanups != NULL)
         pth_cleanup_popall(thread, TRUE);
 
     /* run the specific data destructors */
     if (thread->data_value != NULL)
         pth_key_destroydata(thread);
 
-    /* release still acquired mutex variables */
+    /* release still acquired mutex variables and read-write locks */
     pth_mutex_releaseall(thread);
+    pth_rwlock_releaseall(thread);
+
+    /* release the arena (after the handlers and destructors above,
+       which may still use memory from it) */
+    if (thread->arena != NULL)
+        pth_arena_free(thread);
 
     return;
 }
@@ -429,7 +621,7 @@ void pth_exit(void *value)
 {
     pth_event_t ev;
 
-    pth_debug2("pth_exit: marking thread \"%s\" as dead", pth_current->name);
+    pth_debug2("pth_exit: marking thread \"%s\" as dead", pth_tcb_name(pth_current));
 
     /* the main thread is special, because its termination
        would terminate the whole process, so we have to delay 
@@ -454,7 +646,7 @@ void pth_exit(void *value)
          */
         pth_current->join_arg = value;
         pth_current->state = PTH_STATE_DEAD;
-        pth_debug2("pth_exit: switching from thread \"%s\" to scheduler", pth_current->name);
+        pth_debug2("pth_exit: switching from thread \"%s\" to scheduler", pth_tcb_name(pth_current));
         pth_mctx_switch(&pth_current->mctx, &pth_sched->mctx);
     }
     else {
@@ -476,7 +668,7 @@ int pth_join(pth_t tid, void **value)
     pth_event_t ev;
     static pth_key_t ev_key = PTH_KEY_INIT;
 
-    pth_debug2("pth_join: joining thread \"%s\"", tid == NULL ? "-ANY-" : tid->name);
+    pth_debug2("pth_join: joining thread \"%s\"", tid == NULL ? "-ANY-" : pth_tcb_name(tid));
     if (tid == pth_current)
         return pth_error(FALSE, EDEADLK);
     if (tid != NULL && !tid->joinable)
@@ -505,7 +697,7 @@ int pth_yield(pth_t to)
 {
     pth_pqueue_t *q = NULL;
 
-    pth_debug2("pth_yield: enter from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_yield: enter from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* a given thread has to be new or ready or we ignore the request */
     if (to != NULL) {
@@ -525,13 +717,13 @@ int pth_yield(pth_t to)
     /* switch to scheduler */
     if (to != NULL)
         pth_debug2("pth_yield: give up control to scheduler "
-                   "in favour of thread \"%s\"", to->name);
+                   "in favour of thread \"%s\"", pth_tcb_name(to));
     else
         pth_debug1("pth_yield: give up control to scheduler");
     pth_mctx_switch(&pth_current->mctx, &pth_sched->mctx);
     pth_debug1("pth_yield: got back control from scheduler");
 
-    pth_debug2("pth_yield: leave to thread \"%s\"", pth_current->name);
+    pth_debug2("pth_yield: leave to thread \"%s\"", pth_tcb_name(pth_current));
     return TRUE;
 }
 
@@ -556,7 +748,7 @@ int pth_suspend(pth_t t)
         return pth_error(FALSE, ESRCH);
     pth_pqueue_delete(q, t);
     pth_pqueue_insert(&pth_SQ, PTH_PRIO_STD, t);
-    pth_debug2("pth_suspend: suspend thread \"%s\"\n", t->name);
+    pth_debug2("pth_suspend: suspend thread \"%s\"\n", pth_tcb_name(t));
     return TRUE;
 }
 
@@ -578,8 +770,14 @@ int pth_resume(pth_t t)
         case PTH_STATE_WAITING: q = &pth_WQ; break;
         default:                q = NULL;
     }
+    if (q == &pth_RQ) {
+        pth_clock_now(&t->readied);
+        pth_sched_release(t, &t->readied);
+    }
     pth_pqueue_insert(q, PTH_PRIO_STD, t);
-    pth_debug2("pth_resume: resume thread \"%s\"\n", t->name);
+    if (q == &pth_RQ && pth_trace_recording())
+        pth_trace_ready(t);
+    pth_debug2("pth_resume: resume thread \"%s\"\n", pth_tcb_name(t));
     return TRUE;
 }
 
@@ -37,10 +37,153 @@ struct pth_msgport_st {
     pth_ring_t     mp_queue; /* queue of messages pending on port */
 };
 
+/* atomic pointer and integer exchange (for the inbox) */
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+#define PTH_ATOMIC 1
+#define pth_atomic_cas(ptr,oldval,newval) \
+    __sync_bool_compare_and_swap((ptr), (oldval), (newval))
+#endif
+
 #endif /* cpp */
 
 static pth_ring_t pth_msgport = PTH_RING_INIT;
 
+/*
+ * The inbox: a lock-free list through which other (native) threads
+ * hand messages and wakeups over to the scheduler. Posters only push
+ * onto the list head and kick the inbox descriptor (an eventfd(2),
+ * else a pipe) which the event manager polls. The scheduler takes the
+ * whole list at once and delivers it in posting order. An inbox entry
+ * is a ring node: messages travel through their m_node with the
+ * target port in rn_prev, thread wakeups through wk_node with a NULL
+ * rn_prev.
+ */
+static pth_ringnode_t *volatile pth_inbox = NULL;
+static int pth_inbox_fd[2] = { -1, -1 }; /* read and write side */
+
+/* create the inbox descriptor */
+intern int pth_inbox_init(void)
+{
+#if defined(HAVE_SYS_EVENTFD_H) && defined(EFD_NONBLOCK)
+    if ((pth_inbox_fd[0] = eventfd(0, EFD_NONBLOCK)) != -1) {
+        pth_inbox_fd[1] = pth_inbox_fd[0];
+        return TRUE;
+    }
+#endif
+    if (pipe(pth_inbox_fd) == -1)
+        return pth_error(FALSE, errno);
+    if (   pth_fdmode(pth_inbox_fd[0], PTH_FDMODE_NONBLOCK) == PTH_FDMODE_ERROR
+        || pth_fdmode(pth_inbox_fd[1], PTH_FDMODE_NONBLOCK) == PTH_FDMODE_ERROR) {
+        pth_shield { pth_inbox_kill(); }
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* remove the inbox descriptor (pending entries are dropped) */
+intern void pth_inbox_kill(void)
+{
+    if (pth_inbox_fd[1] != pth_inbox_fd[0])
+        close(pth_inbox_fd[1]);
+    if (pth_inbox_fd[0] != -1)
+        close(pth_inbox_fd[0]);
+    pth_inbox_fd[0] = pth_inbox_fd[1] = -1;
+    pth_inbox = NULL;
+    return;
+}
+
+/* push an entry into the inbox (callable from any thread) */
+intern int pth_inbox_push(pth_ringnode_t *rn)
+{
+#ifdef PTH_ATOMIC
+    pth_ringnode_t *head;
+    char c = 1;
+#ifdef HAVE_SYS_EVENTFD_H
+    unsigned long long one = 1;
+#endif
+
+    if (pth_inbox_fd[1] == -1)
+        return pth_error(FALSE, EINVAL);
+    do {
+        head = pth_inbox;
+        rn->rn_next = head;
+    } while (!pth_atomic_cas(&pth_inbox, head, rn));
+
+    /* only the first entry has to wake up the scheduler, it will
+       see the later ones when it takes over the list */
+    if (head == NULL) {
+#ifdef HAVE_SYS_EVENTFD_H
+        if (pth_inbox_fd[1] == pth_inbox_fd[0])
+            pth_sc(write)(pth_inbox_fd[1], &one, sizeof(one));
+        else
+#endif
+            pth_sc(write)(pth_inbox_fd[1], &c, sizeof(c));
+    }
+    return TRUE;
+#else
+    return pth_error(FALSE, ENOSYS);
+#endif
+}
+
+/* the descriptor which gets readable on new inbox entries */
+intern int pth_inbox_getfd(void)
+{
+    return pth_inbox_fd[0];
+}
+
+/* whether entries are waiting in the inbox */
+intern int pth_inbox_pending(void)
+{
+    return (pth_inbox != NULL);
+}
+
+/* reset the inbox descriptor after it became readable */
+intern void pth_inbox_clear(void)
+{
+    char minibuf[64];
+
+    while (pth_sc(read)(pth_inbox_fd[0], minibuf, sizeof(minibuf)) > 0)
+        ;
+    return;
+}
+
+/* take over the inbox and deliver its entries (scheduler side) */
+intern int pth_inbox_drain(void)
+{
+#ifdef PTH_ATOMIC
+    pth_ringnode_t *list, *rn, *next;
+    pth_t t;
+    int n;
+
+    do {
+        list = pth_inbox;
+    } while (list != NULL && !pth_atomic_cas(&pth_inbox, list, NULL));
+
+    /* the list is in LIFO order, so first reverse it */
+    rn = NULL;
+    while (list != NULL) {
+        next = list->rn_next;
+        list->rn_next = rn;
+        rn = list;
+        list = next;
+    }
+    for (n = 0; rn != NULL; rn = next, n++) {
+        next = rn->rn_next;
+        if (rn->rn_prev != NULL)
+            pth_ring_append(&((pth_msgport_t)rn->rn_prev)->mp_queue, rn);
+        else {
+            t = (pth_t)((char *)rn - offsetof(struct pth_st, wk_node));
+            t->wk_pending = TRUE;
+            /* from now on a new wakeup has to travel again */
+            pth_atomic_cas(&t->wk_posted, TRUE, FALSE);
+        }
+    }
+    return n;
+#else
+    return 0;
+#endif
+}
+
 /* create a new message port */
 pth_msgport_t pth_msgport_create(const char *name)
 {
@@ -126,6 +269,15 @@ int pth_msgport_put(pth_msgport_t mp, pth_message_t *m)
     return TRUE;
 }
 
+/* put a message on a port from outside of Pth (e.g. another native thread) */
+int pth_msgport_post(pth_msgport_t mp, pth_message_t *m)
+{
+    if (mp == NULL || m == NULL)
+        return pth_error(FALSE, EINVAL);
+    m->m_node.rn_prev = (pth_ringnode_t *)mp;
+    return pth_inbox_push(&m->m_node);
+}
+
 /* get top message from a port */
 pth_message_t *pth_msgport_get(pth_msgport_t mp)
 {
@@ -29,83 +29,271 @@
 
 #if cpp
 
-/* thread priority queue */
+/*
+ * Thread priority queue
+ *
+ * Threads are kept in an array of circular FIFOs, one per queue key,
+ * plus a bitmap of the occupied FIFOs. The key of a queued thread is
+ * its priority minus the queue epoch at insertion time, so aging all
+ * queued threads (pth_pqueue_increase) is just an increment of the
+ * epoch. The keys of all queued threads always fit into a window of
+ * PTH_PQUEUE_SLOTS consecutive values below the top key; threads
+ * which fall out of the window when a higher key is inserted are
+ * merged into its lowest slot (in order, so FIFO fairness is kept).
+ */
+#define PTH_PQUEUE_SLOTS 64 /* a power of two */
+#define PTH_PQUEUE_WORDS ((PTH_PQUEUE_SLOTS + PTH_UTIL_WORDBITS - 1) / PTH_UTIL_WORDBITS)
+
 struct pth_pqueue_st {
-    pth_t q_head;
+    pth_t q_slot[PTH_PQUEUE_SLOTS];       /* heads of the per-key FIFOs */
+    unsigned long q_map[PTH_PQUEUE_WORDS]; /* bitmap of occupied slots */
+    int q_top;                /* highest occupied key (when q_num > 0) */
+    int q_epoch;              /* aging offset: priority = key + q_epoch */
     int q_num;
+    int q_ndl;                /* number of deadline class threads */
     unsigned long total_prio; /* keep track of total priority of all threads */
     unsigned long total_tk;   /* keep track of total tickets distributed */
 };
 typedef struct pth_pqueue_st pth_pqueue_t;
 
+/* most lottery tickets a thread may hold, i.e. one 100 percentage points
+   behind its target share; the positive errors of all ready threads add
+   up to at most 100 points, so this also bounds the total (and keeps it
+   within a long and a single rand(3) draw on every platform) */
+#define PTH_PQUEUE_TK_MAX 2147483647.0
+
 #endif /* cpp */
 
+/* slot of a key and bitmap manipulation */
+#define PTH_PQUEUE_SLOT(k) ((int)((unsigned int)(k) & (PTH_PQUEUE_SLOTS - 1)))
+#define PTH_PQUEUE_MAPSET(q,i) \
+    ((q)->q_map[(i) / PTH_UTIL_WORDBITS] |= (1UL << ((i) % PTH_UTIL_WORDBITS)))
+#define PTH_PQUEUE_MAPCLR(q,i) \
+    ((q)->q_map[(i) / PTH_UTIL_WORDBITS] &= ~(1UL << ((i) % PTH_UTIL_WORDBITS)))
+
+/* the epoch is renormalized before it could overflow */
+#define PTH_PQUEUE_EPOCH_MAX (1 << 30)
+
 /* initialize a priority queue; O(1) */
 intern void pth_pqueue_init(pth_pqueue_t *q)
 {
     if (q != NULL) {
-        q->q_head = NULL;
-        q->q_num  = 0;
+        memset(q->q_slot, 0, sizeof(q->q_slot));
+        memset(q->q_map, 0, sizeof(q->q_map));
+        q->q_top   = 0;
+        q->q_epoch = 0;
+        q->q_num   = 0;
+        q->q_ndl   = 0;
         q->total_prio = 0;
         q->total_tk = 0;
     }
     return;
 }
 
-/* insert thread into priority queue; O(n) */
-intern void pth_pqueue_insert(pth_pqueue_t *q, int prio, pth_t t)
+/* find the highest occupied key in [lo,hi]; returns lo-1 if there
+   is none. Visits at most one bitmap word per step; O(1) */
+static int pth_pqueue_scan_down(pth_pqueue_t *q, int hi, int lo)
 {
-    pth_t c;
-    int p;
+    unsigned long w;
+    int i, b;
 
-    if (q == NULL)
-        return;
-    if (q->q_head == NULL || q->q_num == 0) {
-        /* add as first element */
-        t->q_prev = t;
-        t->q_next = t;
-        t->q_prio = prio;
-        q->q_head = t;
+    while (hi >= lo) {
+        i = PTH_PQUEUE_SLOT(hi);
+        b = i % PTH_UTIL_WORDBITS;
+        w = q->q_map[i / PTH_UTIL_WORDBITS];
+        if (b < (int)PTH_UTIL_WORDBITS - 1)
+            w &= ((1UL << (b + 1)) - 1);
+        if (w != 0) {
+            hi -= (b - pth_util_fls(w));
+            return (hi >= lo ? hi : lo - 1);
+        }
+        hi -= (b + 1);
     }
-    else if (q->q_head->q_prio < prio) {
-        /* add as new head of queue */
-        t->q_prev = q->q_head->q_prev;
-        t->q_next = q->q_head;
-        t->q_prev->q_next = t;
-        t->q_next->q_prev = t;
-        t->q_prio = prio;
-        t->q_next->q_prio = prio - t->q_next->q_prio;
-        q->q_head = t;
+    return lo - 1;
+}
+
+/* find the lowest occupied key in [lo,hi]; returns hi+1 if there is none; O(1) */
+static int pth_pqueue_scan_up(pth_pqueue_t *q, int lo, int hi)
+{
+    unsigned long w;
+    int i, b;
+
+    while (lo <= hi) {
+        i = PTH_PQUEUE_SLOT(lo);
+        b = i % PTH_UTIL_WORDBITS;
+        w = q->q_map[i / PTH_UTIL_WORDBITS] >> b;
+        if (w != 0) {
+            lo += pth_util_ctz(w);
+            return (lo <= hi ? lo : hi + 1);
+        }
+        lo += (PTH_UTIL_WORDBITS - b);
+    }
+    return hi + 1;
+}
+
+/* append a circular list of threads to the FIFO of a slot; O(1) */
+static void pth_pqueue_append(pth_pqueue_t *q, int i, pth_t l)
+{
+    pth_t h, lt;
+
+    if ((h = q->q_slot[i]) == NULL) {
+        q->q_slot[i] = l;
+        PTH_PQUEUE_MAPSET(q, i);
     }
     else {
-        /* insert after elements with greater or equal priority */
-        c = q->q_head;
-        p = c->q_prio;
-        while ((p - c->q_next->q_prio) >= prio && c->q_next != q->q_head) {
+        lt = l->q_prev;
+        h->q_prev->q_next = l;
+        l->q_prev = h->q_prev;
+        lt->q_next = h;
+        h->q_prev = lt;
+    }
+    return;
+}
+
+/* move the window up so that key becomes its top: threads whose keys
+   drop out of the window are merged into its new lowest slot; O(moved) */
+static void pth_pqueue_raise(pth_pqueue_t *q, int key)
+{
+    pth_t merged, l, c;
+    int bottom, k, i;
+
+    bottom = key - PTH_PQUEUE_SLOTS + 1;
+    merged = NULL;
+    k = pth_pqueue_scan_down(q, pth_util_min(q->q_top, bottom - 1),
+                             q->q_top - PTH_PQUEUE_SLOTS + 1);
+    while (k >= q->q_top - PTH_PQUEUE_SLOTS + 1) {
+        i = PTH_PQUEUE_SLOT(k);
+        l = q->q_slot[i];
+        q->q_slot[i] = NULL;
+        PTH_PQUEUE_MAPCLR(q, i);
+        c = l;
+        do {
+            c->q_prio = bottom;
             c = c->q_next;
-            p -= c->q_prio;
+        } while (c != l);
+        if (merged == NULL)
+            merged = l;
+        else {
+            /* append l behind merged */
+            pth_t mt = merged->q_prev, lt = l->q_prev;
+            mt->q_next = l;
+            l->q_prev = mt;
+            lt->q_next = merged;
+            merged->q_prev = lt;
         }
-        t->q_prev = c;
-        t->q_next = c->q_next;
-        t->q_prev->q_next = t;
-        t->q_next->q_prev = t;
-        t->q_prio = p - prio;
-        if (t->q_next != q->q_head)
-            t->q_next->q_prio -= t->q_prio;
+        k = pth_pqueue_scan_down(q, k - 1, q->q_top - PTH_PQUEUE_SLOTS + 1);
     }
+    if (merged != NULL)
+        pth_pqueue_append(q, PTH_PQUEUE_SLOT(bottom), merged);
+    q->q_top = key;
+    return;
+}
+
+/* renormalize keys and epoch; O(n), but only every 2^30 agings */
+static void pth_pqueue_renormalize(pth_pqueue_t *q)
+{
+    pth_t t;
+    int i;
+
+    for (i = 0; i < PTH_PQUEUE_SLOTS; i++) {
+        if ((t = q->q_slot[i]) != NULL) {
+            do {
+                t->q_prio += q->q_epoch;
+                t = t->q_next;
+            } while (t != q->q_slot[i]);
+        }
+    }
+    /* the slot of a key changes by the epoch, so rotate the slots */
+    {
+        pth_t slot[PTH_PQUEUE_SLOTS];
+        memcpy(slot, q->q_slot, sizeof(slot));
+        memset(q->q_slot, 0, sizeof(q->q_slot));
+        memset(q->q_map, 0, sizeof(q->q_map));
+        for (i = 0; i < PTH_PQUEUE_SLOTS; i++) {
+            if (slot[i] != NULL) {
+                q->q_slot[PTH_PQUEUE_SLOT(slot[i]->q_prio)] = slot[i];
+                PTH_PQUEUE_MAPSET(q, PTH_PQUEUE_SLOT(slot[i]->q_prio));
+            }
+        }
+    }
+    q->q_top += q->q_epoch;
+    q->q_epoch = 0;
+    return;
+}
+
+/* insert thread into priority queue; O(1) */
+intern void pth_pqueue_insert(pth_pqueue_t *q, int prio, pth_t t)
+{
+    int key;
+
+    if (q == NULL)
+        return;
+    key = prio - q->q_epoch;
+    if (q->q_num == 0)
+        q->q_top = key;
+    else if (key > q->q_top)
+        pth_pqueue_raise(q, key);
+    else if (key < q->q_top - PTH_PQUEUE_SLOTS + 1)
+        key = q->q_top - PTH_PQUEUE_SLOTS + 1;
+    t->q_prio = key;
+    t->q_next = t;
+    t->q_prev = t;
+    pth_pqueue_append(q, PTH_PQUEUE_SLOT(key), t);
+    t->q_queue = q;
     q->q_num++;
+    if (pth_tcb_is_deadline(t))
+        q->q_ndl++;
     q->total_prio += t->prio + 1;
     return;
 }
 
-/* Update actual CPU usage of each thread in the queue passed into the function */
-intern void pth_pqueue_update_a_rt(pth_pqueue_t *q)
+/* remove thread from priority queue; O(1) */
+intern void pth_pqueue_delete(pth_pqueue_t *q, pth_t t)
+{
+    int i;
+
+    if (q == NULL || t == NULL || t->q_queue != q)
+        return;
+    i = PTH_PQUEUE_SLOT(t->q_prio);
+    if (t->q_next == t) {
+        /* remove the last element of its FIFO */
+        q->q_slot[i] = NULL;
+        PTH_PQUEUE_MAPCLR(q, i);
+    }
+    else {
+        t->q_prev->q_next = t->q_next;
+        t->q_next->q_prev = t->q_prev;
+        if (q->q_slot[i] == t)
+            q->q_slot[i] = t->q_next;
+    }
+    q->q_num--;
+    if (pth_tcb_is_deadline(t))
+        q->q_ndl--;
+    q->total_prio -= (t->prio + 1);
+    if (q->q_num == 0) {
+        /* an empty queue restarts aging */
+        q->q_epoch = 0;
+        q->total_prio = 0;
+    }
+    else if (t->q_prio == q->q_top && q->q_slot[i] == NULL)
+        q->q_top = pth_pqueue_scan_down(q, q->q_top - 1,
+                                        q->q_top - PTH_PQUEUE_SLOTS + 1);
+    t->q_next  = NULL;
+    t->q_prev  = NULL;
+    t->q_prio  = 0;
+    t->q_queue = NULL;
+    return;
+}
+
+/* Update actual CPU usage of each thread in the queue passed into the function
+   (now is the current time of the scheduler clock) */
+intern void pth_pqueue_update_a_rt(pth_pqueue_t *q, pth_time_t *now)
 {
     pth_t c;
-    for (c = q->q_head; c != NULL; 
+    for (c = pth_pqueue_head(q); c != NULL; 
         c = pth_pqueue_walk(q, c, PTH_WALK_NEXT)) {
         pth_time_t lifetime;
-        pth_time_set(&lifetime, PTH_TIME_NOW);
+        pth_time_set(&lifetime, now);
         pth_time_sub(&lifetime, &c->spawned);
 	if (pth_time_t2d(&lifetime) != 0) 
             (c->cpu_rt).actual = pth_time_t2d(&c->running) 
@@ -120,7 +308,9 @@ intern void pth_pqueue_issue_tk(pth_pqueue_t *q)
     long offset = 0;
     pth_t c;
     double err;
-    for (c = q->q_head; c != NULL; 
+    unsigned long base;
+    int i;
+    for (c = pth_pqueue_head(q); c != NULL; 
         c = pth_pqueue_walk(q, c, PTH_WALK_NEXT)) {
         err = (c->cpu_rt).target - (c->cpu_rt).actual;
 	/* Greedy threads are penalised by not being given any ticket */
@@ -131,9 +321,12 @@ intern void pth_pqueue_issue_tk(pth_pqueue_t *q)
 	else {
 		/* Policy for assigning tickets is changed slightly 
 		   for better fairshare implmentation 
+		   (by default (err*5)^2, see PTH_CTRL_TICKETSCALE/TICKETEXP)
 		*/
-		(c->tk).tk_num = ((unsigned long)(err * 5)) 
-			* ((unsigned long)(err * 5)); 
+		base = (unsigned long)(err * pth_ticketscale);
+		(c->tk).tk_num = base;
+		for (i = 1; i < pth_ticketexp; i++)
+			(c->tk).tk_num *= base; 
 		(c->tk).offset = offset;
 	}
         offset += (c->tk).tk_num;
@@ -147,52 +340,31 @@ intern void pth_pqueue_calc_target(pth_pqueue_t *q)
 {
     double base = 100.0 / q->total_prio;
     pth_t c;    
-    for (c = q->q_head; c != NULL; 
+    for (c = pth_pqueue_head(q); c != NULL; 
             c = pth_pqueue_walk(q, c, PTH_WALK_NEXT))
         (c->cpu_rt).target = base * (c->prio + 1);
     return;
 }
 
 /* To remove the thread with wining ticket from the queue passed into the function */
-intern pth_t pth_pqueue_deltk(pth_pqueue_t *q, int ltr_num) 
+intern pth_t pth_pqueue_deltk(pth_pqueue_t *q, long ltr_num) 
 {
-    pth_t t;
+    pth_t t, c;
 
     if (q == NULL)
         return NULL;
-    if (q->q_head == NULL)
-        t = NULL;
-    else if (q->q_head->q_next == q->q_head) {
-        /* remove the last element and make queue empty */
-        t = q->q_head;
-        t->q_next = NULL;
-        t->q_prev = NULL;
-        t->q_prio = 0;
-        q->q_head = NULL;
-        q->q_num  = 0;
-        q->total_prio = 0;
-    }
-    else {
-	/* Remove the thread with winning ticket */
-        pth_t c;
-        for (c = q->q_head; c != NULL; 
-            c = pth_pqueue_walk(q, c, PTH_WALK_NEXT)) {
-            if (ltr_num >= (c->tk).offset && 
-		ltr_num < ((c->tk).offset + (c->tk).tk_num)) {
-                t = c;
-                break;
-            }
-        }
-        t->q_prev->q_next = t->q_next;
-        t->q_next->q_prev = t->q_prev;
-        t->q_next->q_prio = t->q_prio - t->q_next->q_prio;
-        t->q_prio = 0;
-        if (q->q_head == t) {
-            q->q_head = t->q_next;
+    /* Find the thread with winning ticket */
+    t = NULL;
+    for (c = pth_pqueue_head(q); c != NULL; 
+        c = pth_pqueue_walk(q, c, PTH_WALK_NEXT)) {
+        if (ltr_num >= (c->tk).offset && 
+	    ltr_num < ((c->tk).offset + (long)(c->tk).tk_num)) {
+            t = c;
+            break;
         }
-        q->q_num--;
-        q->total_prio -= (t->prio + 1);
     }
+    if (t != NULL)
+        pth_pqueue_delete(q, t);
     return t;
 }
 
@@ -201,81 +373,31 @@ intern pth_t pth_pqueue_delmax(pth_pqueue_t *q)
 {
     pth_t t;
 
-    if (q == NULL)
+    if (q == NULL || q->q_num == 0)
         return NULL;
-    if (q->q_head == NULL)
-        t = NULL;
-    else if (q->q_head->q_next == q->q_head) {
-        /* remove the last element and make queue empty */
-        t = q->q_head;
-        t->q_next = NULL;
-        t->q_prev = NULL;
-        t->q_prio = 0;
-        q->q_head = NULL;
-        q->q_num  = 0;
-    }
-    else {
-        /* remove head of queue */
-        t = q->q_head;
-        t->q_prev->q_next = t->q_next;
-        t->q_next->q_prev = t->q_prev;
-        t->q_next->q_prio = t->q_prio - t->q_next->q_prio;
-        t->q_prio = 0;
-        q->q_head = t->q_next;
-        q->q_num--;
-    }
+    t = q->q_slot[PTH_PQUEUE_SLOT(q->q_top)];
+    pth_pqueue_delete(q, t);
     return t;
 }
 
-/* remove thread from priority queue; O(n) */
-intern void pth_pqueue_delete(pth_pqueue_t *q, pth_t t)
-{
-    if (q == NULL)
-        return;
-    if (q->q_head == NULL)
-        return;
-    else if (q->q_head == t) {
-        if (t->q_next == t) {
-            /* remove the last element and make queue empty */
-            t->q_next = NULL;
-            t->q_prev = NULL;
-            t->q_prio = 0;
-            q->q_head = NULL;
-            q->q_num  = 0;
-        }
-        else {
-            /* remove head of queue */
-            t->q_prev->q_next = t->q_next;
-            t->q_next->q_prev = t->q_prev;
-            t->q_next->q_prio = t->q_prio - t->q_next->q_prio;
-            t->q_prio = 0;
-            q->q_head = t->q_next;
-            q->q_num--;
-        }
-    }
-    else {
-        t->q_prev->q_next = t->q_next;
-        t->q_next->q_prev = t->q_prev;
-        if (t->q_next != q->q_head)
-            t->q_next->q_prio += t->q_prio;
-        t->q_prio = 0;
-        q->q_num--;
-    }
-    return;
-}
+/* return number of deadline class threads in priority queue: O(1) */
+#if cpp
+#define pth_pqueue_deadlines(q) \
+    ((q)->q_ndl)
+#endif
 
 /* determine priority required to favorite a thread; O(1) */
 #if cpp
 #define pth_pqueue_favorite_prio(q) \
-    ((q)->q_head != NULL ? (q)->q_head->q_prio + 1 : PTH_PRIO_MAX)
+    ((q)->q_num > 0 ? (q)->q_top + (q)->q_epoch + 1 : PTH_PRIO_MAX)
 #endif
 
-/* move a thread inside queue to the top; O(n) */
+/* move a thread inside queue to the top; O(1) */
 intern int pth_pqueue_favorite(pth_pqueue_t *q, pth_t t)
 {
     if (q == NULL)
         return FALSE;
-    if (q->q_head == NULL || q->q_num == 0)
+    if (q->q_num == 0)
         return FALSE;
     /* element is already at top */
     if (q->q_num == 1)
@@ -291,10 +413,12 @@ intern void pth_pqueue_increase(pth_pqueue_t *q)
 {
     if (q == NULL)
         return;
-    if (q->q_head == NULL)
+    if (q->q_num == 0)
         return;
     /* <grin> yes, that's all ;-) */
-    q->q_head->q_prio += 1;
+    q->q_epoch++;
+    if (q->q_epoch >= PTH_PQUEUE_EPOCH_MAX)
+        pth_pqueue_renormalize(q);
     return;
 }
 
@@ -307,53 +431,69 @@ intern void pth_pqueue_increase(pth_pqueue_t *q)
 /* walk to first thread in queue; O(1) */
 #if cpp
 #define pth_pqueue_head(q) \
-    ((q) == NULL ? NULL : (q)->q_head)
+    ((q) == NULL || (q)->q_num == 0 ? NULL : \
+     (q)->q_slot[(int)((unsigned int)(q)->q_top & (PTH_PQUEUE_SLOTS - 1))])
 #endif
 
-/* walk to last thread in queue */
+/* walk to last thread in queue; O(1) */
 intern pth_t pth_pqueue_tail(pth_pqueue_t *q)
 {
-    if (q == NULL)
-        return NULL;
-    if (q->q_head == NULL)
+    int k;
+
+    if (q == NULL || q->q_num == 0)
         return NULL;
-    return q->q_head->q_prev;
+    k = pth_pqueue_scan_up(q, q->q_top - PTH_PQUEUE_SLOTS + 1, q->q_top);
+    return q->q_slot[PTH_PQUEUE_SLOT(k)]->q_prev;
 }
 
 /* walk to next or previous thread in queue; O(1) */
 intern pth_t pth_pqueue_walk(pth_pqueue_t *q, pth_t t, int direction)
 {
     pth_t tn;
+    int k;
 
     if (q == NULL || t == NULL)
         return NULL;
     tn = NULL;
     if (direction == PTH_WALK_PREV) {
-        if (t != q->q_head)
+        if (t != q->q_slot[PTH_PQUEUE_SLOT(t->q_prio)])
             tn = t->q_prev;
+        else {
+            /* tail of the next higher occupied FIFO */
+            k = pth_pqueue_scan_up(q, t->q_prio + 1, q->q_top);
+            if (k <= q->q_top)
+                tn = q->q_slot[PTH_PQUEUE_SLOT(k)]->q_prev;
+        }
     }
     else if (direction == PTH_WALK_NEXT) {
         tn = t->q_next;
-        if (tn == q->q_head)
-            tn = NULL;
+        if (tn == q->q_slot[PTH_PQUEUE_SLOT(t->q_prio)]) {
+            /* head of the next lower occupied FIFO */
+            k = pth_pqueue_scan_down(q, t->q_prio - 1, q->q_top - PTH_PQUEUE_SLOTS + 1);
+            if (k >= q->q_top - PTH_PQUEUE_SLOTS + 1)
+                tn = q->q_slot[PTH_PQUEUE_SLOT(k)];
+            else
+                tn = NULL;
+        }
     }
     return tn;
 }
 
-/* check whether a thread is in a queue; O(n) */
-intern int pth_pqueue_contains(pth_pqueue_t *q, pth_t t)
+/* check whether a thread is in a queue; O(1) */
+#if cpp
+#define pth_pqueue_contains(q,t) \
+    ((t) != NULL && (t)->q_queue == (q))
+#endif
+
+/* check whether a thread handle (which may be stale) is in a queue
+   without dereferencing it; O(n) */
+intern int pth_pqueue_find(pth_pqueue_t *q, pth_t t)
 {
-    pth_t tc;
-    int found;
-
-    found = FALSE;
-    for (tc = pth_pqueue_head(q); tc != NULL;
-         tc = pth_pqueue_walk(q, tc, PTH_WALK_NEXT)) {
-        if (tc == t) {
-            found = TRUE;
-            break;
-        }
-    }
-    return found;
+    pth_t c;
+
+    for (c = pth_pqueue_head(q); c != NULL; c = pth_pqueue_walk(q, c, PTH_WALK_NEXT))
+        if (c == t)
+            return TRUE;
+    return FALSE;
 }
 
@@ -39,15 +39,50 @@ intern pth_pqueue_t pth_SQ;         /* queue of suspended threads            */
 intern pth_pqueue_t pth_DQ;         /* queue of terminated threads           */
 intern int          pth_favournew;  /* favour new threads on startup         */
 intern float        pth_loadval;    /* average scheduler load value          */
+intern float        pth_loadfast;   /* the same over a 100ms time constant   */
+intern int          pth_schedpolicy = PTH_SCHED_LOTTERY; /* ready queue policy */
+intern long         pth_timerslack  = 0; /* default timer slack in microseconds */
+intern int          pth_ticketscale = 5; /* lottery tickets: (err*scale)^exp    */
+intern int          pth_ticketexp   = 2;
+intern int          pth_evbatch     = 1; /* dispatches between event manager polls (0 = by budget) */
+intern long         pth_evbudget    = 0; /* or microseconds between them (0 = none) */
+intern long         pth_busypoll    = 0; /* microseconds to spin before sleeping    */
+intern int          pth_wakeaffine  = 0; /* consecutive wake-affine dispatches (0 = off) */
+intern pth_t        pth_wakee       = NULL; /* thread the last one made ready to run    */
+intern pth_time_t  *pth_sched_waitlimit = NULL; /* latest return of a waiting event manager */
+static int          pth_affinechain = 0; /* wake-affine dispatches in a row so far     */
+static long         pth_busygap     = 0; /* average wait for arrivals in microseconds */
+static int          pth_busyback    = 0; /* sleeps without spinning after a vain spin */
+static int          pth_busyskip    = 0; /* sleeps left until spinning again          */
 
 static int          pth_sigpipe[2]; /* internal signal occurrence pipe       */
 static sigset_t     pth_sigpending; /* mask of pending signals               */
 static sigset_t     pth_sigblock;   /* mask of signals we block in scheduler */
 static sigset_t     pth_sigcatch;   /* mask of signals we have to catch      */
 static sigset_t     pth_sigraised;  /* mask of raised signals                */
+static int          pth_sigfd = -1; /* signalfd replacing pipe and handler   */
+static sigset_t     pth_sigfdmask;  /* signals the signalfd currently takes  */
+
+static struct pollfd *pth_pollfd;  /* descriptors the eventmanager polls   */
+static int          pth_pollfd_size; /* number of allocated pth_pollfd slots */
 
 static pth_time_t   pth_loadticknext;
-static pth_time_t   pth_loadtickgap = PTH_TIME(1,0);
+static pth_time_t   pth_loadtickgap = PTH_TIME(0,100000);
+
+/* queueing delays are counted in buckets of a quarter of a power of two */
+#define PTH_QDELAY_BUCKETS 128
+
+intern long         pth_qdelay_avg  = 0; /* average ready queue wait in microseconds */
+static long         pth_qdelay_max  = 0; /* longest ready queue wait since reset     */
+static unsigned long pth_qdelay_samples = 0;
+static unsigned long pth_qdelay_hist[PTH_QDELAY_BUCKETS];
+
+intern int          pth_admit_action = PTH_ADMIT_OFF; /* admission control (see pth_accept) */
+intern float        pth_admit_load   = 0; /* fast load average to stop admitting at  */
+intern long         pth_admit_qdelay = 0; /* or average ready queue wait (usec)      */
+intern long         pth_admit_wait   = 0; /* longest delay of a connection (usec)    */
+intern unsigned long pth_admit_delayed = 0;
+intern unsigned long pth_admit_shed    = 0;
 
 /* initialize the scheduler ingredients */
 intern int pth_scheduler_init(void)
@@ -60,6 +95,23 @@ intern int pth_scheduler_init(void)
     if (pth_fdmode(pth_sigpipe[1], PTH_FDMODE_NONBLOCK) == PTH_FDMODE_ERROR)
         return pth_error(FALSE, errno);
 
+    /* where available, receive the signals awaited by events through
+       a signalfd, so no signal actions have to be replaced on every
+       event manager pass (the signal pipe stays as the fallback) */
+    sigemptyset(&pth_sigfdmask);
+#if defined(HAVE_SYS_SIGNALFD_H) && defined(SFD_NONBLOCK)
+    pth_sigfd = signalfd(-1, &pth_sigfdmask, SFD_NONBLOCK);
+#endif
+
+    /* create the inbox for wakeups from other threads */
+    if (!pth_inbox_init())
+        return FALSE;
+
+    /* create the poll array (its first slots are the signal pipe and the inbox) */
+    pth_pollfd_size = 64;
+    if ((pth_pollfd = (struct pollfd *)malloc(pth_pollfd_size * sizeof(struct pollfd))) == NULL)
+        return pth_error(FALSE, ENOMEM);
+
     /* initialize the essential threads */
     pth_sched   = NULL;
     pth_current = NULL;
@@ -76,7 +128,9 @@ intern int pth_scheduler_init(void)
 
     /* initialize load support */
     pth_loadval = 1.0;
-    pth_time_set(&pth_loadticknext, PTH_TIME_NOW);
+    pth_loadfast = 1.0;
+    pth_clock_now(&pth_loadticknext);
+    pth_qdelay_reset();
 
     return TRUE;
 }
@@ -122,6 +176,18 @@ intern void pth_scheduler_kill(void)
     /* remove the internal signal pipe */
     close(pth_sigpipe[0]);
     close(pth_sigpipe[1]);
+    if (pth_sigfd != -1) {
+        close(pth_sigfd);
+        pth_sigfd = -1;
+    }
+
+    /* remove the inbox */
+    pth_inbox_kill();
+
+    /* remove the poll array */
+    free(pth_pollfd);
+    pth_pollfd = NULL;
+    pth_pollfd_size = 0;
     return;
 }
 
@@ -129,39 +195,260 @@ intern void pth_scheduler_kill(void)
  * Update the average scheduler load.
  *
  * This is called on every context switch, but we have to adjust the
- * average load value every second, only. If we're called more than
- * once per second we handle this by just calculating anything once
- * and then do NOPs until the next ticks is over. If the scheduler
- * waited for more than once second (or a thread CPU burst lasted for
- * more than once second) we simulate the missing calculations. That's
- * no problem because we can assume that the number of ready threads
- * then wasn't changed dramatically (or more context switched would have
- * been occurred and we would have been given more chances to operate).
- * The actual average load is calculated through an exponential average
- * formula.
+ * average load value every 100 milliseconds, only. If we're called more
+ * often we handle this by just calculating anything once and then do
+ * NOPs until the next ticks is over. If the scheduler waited for longer
+ * than a tick (or a thread CPU burst lasted for longer) we simulate the
+ * missing calculations (up to a minute of them, after which the averages
+ * have converged anyway). That's no problem because we can assume that
+ * the number of ready threads then wasn't changed dramatically (or more
+ * context switched would have been occurred and we would have been given
+ * more chances to operate). The actual average loads are calculated
+ * through exponential average formulas: pth_loadval weights the ticks
+ * such that it still decays by a quarter per second, while pth_loadfast
+ * decays by a quarter per tick and so follows load changes quickly.
  */
 #define pth_scheduler_load(now) \
     if (pth_time_cmp((now), &pth_loadticknext) >= 0) { \
         pth_time_t ttmp; \
         int numready; \
+        int ticks; \
         numready = pth_pqueue_elements(&pth_RQ); \
         pth_time_set(&ttmp, (now)); \
+        ticks = 0; \
         do { \
-            pth_loadval = (numready*0.25) + (pth_loadval*0.75); \
+            pth_loadval  = (numready*0.0284) + (pth_loadval*0.9716); \
+            pth_loadfast = (numready*0.25)   + (pth_loadfast*0.75); \
             pth_time_sub(&ttmp, &pth_loadtickgap); \
-        } while (pth_time_cmp(&ttmp, &pth_loadticknext) >= 0); \
+        } while (pth_time_cmp(&ttmp, &pth_loadticknext) >= 0 && ++ticks < 600); \
         pth_time_set(&pth_loadticknext, (now)); \
         pth_time_add(&pth_loadticknext, &pth_loadtickgap); \
     }
 
+/*
+ * Account the queueing delay of a dispatched thread, i.e. how long it
+ * waited in the ready queue. An exponential average (weighting each
+ * dispatch by an eighth) serves the admission control, a histogram with
+ * four buckets per power of two microseconds (so percentiles are off by
+ * at most an eighth) serves pth_ctrl(PTH_CTRL_GETLOADSTATS).
+ */
+static int pth_qdelay_bucket(long usec)
+{
+    int e;
+
+    if (usec < 4)
+        return (int)usec;
+    for (e = 2; (usec >> (e + 1)) != 0; e++)
+        ;
+    return 4 * (e - 1) + (int)((usec >> (e - 2)) & 3);
+}
+
+static long pth_qdelay_value(int bucket)
+{
+    long lo;
+    int e;
+
+    if (bucket < 4)
+        return bucket;
+    e = bucket / 4 + 1;
+    lo = (4L + (bucket & 3)) << (e - 2);
+    return lo + ((1L << (e - 2)) >> 1);
+}
+
+static void pth_qdelay_account(pth_t t, pth_time_t *now)
+{
+    long usec;
+
+    usec = (now->tv_sec - t->readied.tv_sec) * 1000000
+         + (now->tv_usec - t->readied.tv_usec);
+    if (usec < 0)
+        usec = 0;
+    else if (usec > 0x3fffffffL)
+        usec = 0x3fffffffL;
+    pth_qdelay_avg += (usec - pth_qdelay_avg) / 8;
+    if (usec > pth_qdelay_max)
+        pth_qdelay_max = usec;
+    pth_qdelay_hist[pth_qdelay_bucket(usec)]++;
+    pth_qdelay_samples++;
+    return;
+}
+
+/* forget the queueing delays and admission counters seen so far */
+intern void pth_qdelay_reset(void)
+{
+    memset(pth_qdelay_hist, 0, sizeof(pth_qdelay_hist));
+    pth_qdelay_samples = 0;
+    pth_qdelay_max     = 0;
+    pth_admit_delayed  = 0;
+    pth_admit_shed     = 0;
+    return;
+}
+
+/* the queueing delay below which the given per mille of the samples are */
+static long pth_qdelay_percentile(int permille)
+{
+    unsigned long want, seen;
+    int i;
+
+    if (pth_qdelay_samples == 0)
+        return 0;
+    want = (pth_qdelay_samples * permille + 999) / 1000;
+    seen = 0;
+    for (i = 0; i < PTH_QDELAY_BUCKETS; i++) {
+        seen += pth_qdelay_hist[i];
+        if (seen >= want)
+            break;
+    }
+    if (i == PTH_QDELAY_BUCKETS || pth_qdelay_value(i) > pth_qdelay_max)
+        return pth_qdelay_max;
+    return pth_qdelay_value(i);
+}
+
+/* fill in the load statistics (see PTH_CTRL_GETLOADSTATS) */
+intern void pth_sched_loadstats(pth_load_stats_t *stats)
+{
+    stats->ls_load        = pth_loadval;
+    stats->ls_load_fast   = pth_loadfast;
+    stats->ls_qdelay_avg  = pth_qdelay_avg;
+    stats->ls_qdelay_p50  = pth_qdelay_percentile(500);
+    stats->ls_qdelay_p90  = pth_qdelay_percentile(900);
+    stats->ls_qdelay_p99  = pth_qdelay_percentile(990);
+    stats->ls_qdelay_max  = pth_qdelay_max;
+    stats->ls_samples     = pth_qdelay_samples;
+    stats->ls_delayed     = pth_admit_delayed;
+    stats->ls_shed        = pth_admit_shed;
+    return;
+}
+
+/* whether new work should currently be held back (see pth_accept_ev) */
+intern int pth_sched_overloaded(void)
+{
+    if (pth_admit_action == PTH_ADMIT_OFF)
+        return FALSE;
+    if (pth_admit_load > 0 && pth_loadfast >= pth_admit_load)
+        return TRUE;
+    if (pth_admit_qdelay > 0 && pth_qdelay_avg >= pth_admit_qdelay)
+        return TRUE;
+    return FALSE;
+}
+
+/* whether the batch of dispatches between two event manager polls is
+   complete: after the number of dispatches or the time budget, whichever
+   comes first (a batch of 0 leaves it to the budget, and without a budget
+   either the event manager is polled after every dispatch) */
+static int pth_scheduler_batch_done(int batched, pth_time_t *now, pth_time_t *evpass)
+{
+    pth_time_t spent;
+
+    if (pth_evbatch > 0 && batched >= pth_evbatch)
+        return TRUE;
+    if (pth_evbudget == 0)
+        return (pth_evbatch == 0);
+    pth_time_set(&spent, now);
+    pth_time_sub(&spent, evpass);
+    return (spent.tv_sec * 1000000 + spent.tv_usec >= pth_evbudget);
+}
+
+/*
+ * A deadline class thread became ready at the given time (it was
+ * spawned, woken up or resumed): if its period has elapsed, the next
+ * one starts at this release time.
+ */
+intern void pth_sched_release(pth_t t, pth_time_t *now)
+{
+    if (!pth_tcb_is_deadline(t))
+        return;
+    if (pth_time_cmp(now, &t->dl_deadline) >= 0) {
+        pth_time_set(&t->dl_deadline, now);
+        pth_time_add(&t->dl_deadline, &t->dl_period);
+        pth_time_set(&t->dl_used, PTH_TIME_ZERO);
+    }
+    return;
+}
+
+/*
+ * Pick the deadline class thread to run next: the ready one with the
+ * earliest absolute deadline which has budget left in its current
+ * period. The periods of a thread which stayed ready past its deadline
+ * follow on directly from that deadline, so they do not depend on when
+ * the queue is scanned. Threads which used up their budget stay in the
+ * ready queue, but only take part in the regular selection until their
+ * period ends, so they cannot starve the fair-share class.
+ */
+static pth_t pth_sched_edf(pth_time_t *now)
+{
+    pth_time_t gap, step;
+    long n;
+    pth_t t, best;
+
+    if (pth_pqueue_deadlines(&pth_RQ) == 0)
+        return NULL;
+    best = NULL;
+    for (t = pth_pqueue_head(&pth_RQ); t != NULL;
+         t = pth_pqueue_walk(&pth_RQ, t, PTH_WALK_NEXT)) {
+        if (!pth_tcb_is_deadline(t))
+            continue;
+        if (pth_time_cmp(now, &t->dl_deadline) >= 0) {
+            /* skip to the period containing now */
+            pth_time_set(&gap, now);
+            pth_time_sub(&gap, &t->dl_deadline);
+            n = (gap.tv_sec * 1000000 + gap.tv_usec)
+                / (t->dl_period.tv_sec * 1000000 + t->dl_period.tv_usec) + 1;
+            pth_time_set(&step, &t->dl_period);
+            pth_time_mul(&step, (int)n);
+            pth_time_add(&t->dl_deadline, &step);
+            pth_time_set(&t->dl_used, PTH_TIME_ZERO);
+        }
+        if (pth_time_cmp(&t->dl_used, &t->dl_budget) >= 0)
+            continue;
+        if (best == NULL || pth_time_cmp(&t->dl_deadline, &best->dl_deadline) < 0)
+            best = t;
+    }
+    if (best != NULL)
+        pth_pqueue_delete(&pth_RQ, best);
+    return best;
+}
+
+/*
+ * Pick the thread the previously running one made ready to run (see
+ * PTH_CTRL_WAKEAFFINE), so a producer which wakes its consumer and then
+ * blocks or yields hands the CPU over directly instead of through the
+ * draw. The running time is accounted as for any other dispatch, and
+ * with the lottery only a thread which holds tickets (i.e. is not ahead
+ * of its target share) is picked, so the handoffs cannot push a pair
+ * beyond its shares. A chain of handoffs is broken after the configured
+ * number, so the other ready threads still get their regular chances
+ * (the scheduler counts the chain and restarts it on every other pick).
+ */
+static pth_t pth_sched_affine(void)
+{
+    pth_t t;
+
+    t = pth_wakee;
+    if (   t == NULL
+        || pth_affinechain >= pth_wakeaffine
+        || !pth_pqueue_contains(&pth_RQ, t)
+        || (pth_schedpolicy == PTH_SCHED_LOTTERY && (t->tk).tk_num == 0))
+        return NULL;
+    pth_pqueue_delete(&pth_RQ, t);
+    return t;
+}
+
 /* the heart of this library: the thread scheduler */
 intern void *pth_scheduler(void *dummy)
 {
     sigset_t sigs;
     pth_time_t running;
     pth_time_t snapshot;
+    pth_time_t now;
+    pth_time_t evpass;
     struct sigaction sa;
     sigset_t ss;
+    long ltr_num;
+    unsigned long ntickets;
+    int batched;
+    int nready;
+    int affine;
     int sig;
     pth_t t;
 
@@ -177,8 +464,11 @@ intern void *pth_scheduler(void *dummy)
     sigfillset(&sigs);
     pth_sc(sigprocmask)(SIG_SETMASK, &sigs, NULL);
 
-    /* initialize the snapshot time for bootstrapping the loop */
-    pth_time_set(&snapshot, PTH_TIME_NOW);
+    /* initialize the snapshot time for bootstrapping the loop
+       (the scheduler's time accounting uses the scheduler clock only) */
+    pth_clock_now(&snapshot);
+    pth_time_set(&evpass, &snapshot);
+    batched = 0;
 
     /*
      * endless scheduler loop
@@ -191,31 +481,67 @@ intern void *pth_scheduler(void *dummy)
         while ((t = pth_pqueue_tail(&pth_NQ)) != NULL) {
             pth_pqueue_delete(&pth_NQ, t);
             t->state = PTH_STATE_READY;
+            pth_time_set(&t->readied, &snapshot);
+            pth_sched_release(t, &snapshot);
             if (pth_favournew)
                 pth_pqueue_insert(&pth_RQ, pth_pqueue_favorite_prio(&pth_RQ), t);
             else
                 pth_pqueue_insert(&pth_RQ, PTH_PRIO_STD, t);
-            pth_debug2("pth_scheduler: new thread \"%s\" moved to top of ready queue", t->name);
+            if (pth_trace_recording())
+                pth_trace_ready(t);
+            pth_debug2("pth_scheduler: new thread \"%s\" moved to top of ready queue", pth_tcb_name(t));
         }
         
-        /* Calculate thread target runtime for ready queue */
-        pth_pqueue_calc_target(&pth_RQ); 
+        if (pth_schedpolicy == PTH_SCHED_LOTTERY) {
+            /* Calculate thread target runtime for ready queue */
+            pth_pqueue_calc_target(&pth_RQ); 
 
-        /* Assign tikets to threads in ready queue */
-        pth_pqueue_issue_tk(&pth_RQ);
+            /* Assign tikets to threads in ready queue */
+            pth_pqueue_issue_tk(&pth_RQ);
+        }
 
         /*
-         * Update average scheduler load
+         * Read the clock once for this pass and
+         * update average scheduler load
          */
-        pth_scheduler_load(&snapshot);
+        pth_clock_now(&now);
+        pth_scheduler_load(&now);
 
         /*
          * Find next thread in ready queue
          */
-        /* generate lottery number randomly */
-        /* pth_current = pth_pqueue_delmax(&pth_RQ); */
-        int ltr_num = rand() % pth_RQ.total_tk;
-        pth_current = pth_pqueue_deltk(&pth_RQ, ltr_num); 
+        /* deadline class threads with budget left preempt the draw;
+           then generate lottery number randomly; when no thread holds a
+           ticket (e.g. with many threads each target share is too small
+           to earn one) fall back to the head of the ready queue */
+        ltr_num = -1;
+        ntickets = 0;
+        affine = FALSE;
+        nready = pth_pqueue_elements(&pth_RQ);
+        if (   pth_trace_mode == PTH_TRACE_REPLAYING
+            && (pth_current = pth_trace_pick()) != NULL)
+            pth_debug2("pth_scheduler: thread \"%s\" dispatched by the replayed trace",
+                       pth_tcb_name(pth_current));
+        else if ((pth_current = pth_sched_edf(&now)) != NULL)
+            pth_debug2("pth_scheduler: deadline thread \"%s\" preempts the lottery",
+                       pth_tcb_name(pth_current));
+        else if (pth_wakee != NULL && (pth_current = pth_sched_affine()) != NULL) {
+            pth_debug2("pth_scheduler: thread \"%s\" woken by the previous one runs next",
+                       pth_tcb_name(pth_current));
+            affine = TRUE;
+        }
+        else if (pth_schedpolicy == PTH_SCHED_LOTTERY && pth_RQ.total_tk > 0) {
+            ntickets = pth_RQ.total_tk;
+            ltr_num = rand();
+            if (pth_RQ.total_tk > RAND_MAX)
+                ltr_num = ltr_num * ((long)RAND_MAX + 1) + rand();
+            ltr_num %= pth_RQ.total_tk;
+            pth_current = pth_pqueue_deltk(&pth_RQ, ltr_num); 
+        }
+        else
+            pth_current = pth_pqueue_delmax(&pth_RQ);
+        pth_wakee = NULL; /* a wakeup is only followed right after it */
+        pth_affinechain = (affine ? pth_affinechain + 1 : 0);
 	  
         if (pth_current == NULL) {
             fprintf(stderr, "**Pth** SCHEDULER INTERNAL ERROR: "
@@ -223,7 +549,7 @@ intern void *pth_scheduler(void *dummy)
             abort();
         }
         pth_debug4("pth_scheduler: thread \"%s\" selected (prio=%d, qprio=%d)",
-                   pth_current->name, pth_current->prio, pth_current->q_prio);
+                   pth_tcb_name(pth_current), pth_current->prio, pth_current->q_prio);
 
         /*
          * Raise additionally thread-specific signals
@@ -238,7 +564,7 @@ intern void *pth_scheduler(void *dummy)
         if (pth_current->sigpendcnt > 0) {
             sigpending(&pth_sigpending);
             for (sig = 1; sig < PTH_NSIG; sig++)
-                if (sigismember(&pth_current->sigpending, sig))
+                if (sigismember(&pth_current->ext->sigpending, sig))
                     if (!sigismember(&pth_sigpending, sig))
                         kill(getpid(), sig);
         }
@@ -248,10 +574,11 @@ intern void *pth_scheduler(void *dummy)
          * and perform a context switch to it
          */
         pth_debug3("pth_scheduler: switching to thread 0x%lx (\"%s\")",
-                   (unsigned long)pth_current, pth_current->name);
+                   (unsigned long)pth_current, pth_tcb_name(pth_current));
 
         /* update thread times */
-        pth_time_set(&pth_current->lastran, PTH_TIME_NOW);
+        pth_time_set(&pth_current->lastran, &now);
+        pth_qdelay_account(pth_current, &now);
 
         /* update scheduler times */
         pth_time_set(&running, &pth_current->lastran);
@@ -263,9 +590,9 @@ intern void *pth_scheduler(void *dummy)
         pth_mctx_switch(&pth_sched->mctx, &pth_current->mctx);
 
         /* update scheduler times */
-        pth_time_set(&snapshot, PTH_TIME_NOW);
+        pth_clock_now(&snapshot);
         pth_debug3("pth_scheduler: cameback from thread 0x%lx (\"%s\")",
-                   (unsigned long)pth_current, pth_current->name);
+                   (unsigned long)pth_current, pth_tcb_name(pth_current));
 
         /*
          * Calculate and update the time the previous thread was running
@@ -273,21 +600,29 @@ intern void *pth_scheduler(void *dummy)
         pth_time_set(&running, &snapshot);
         pth_time_sub(&running, &pth_current->lastran);
         pth_time_add(&pth_current->running, &running);
+        if (pth_tcb_is_deadline(pth_current)) {
+            /* charge the budget of the current deadline period */
+            pth_time_add(&pth_current->dl_used, &running);
+        }
+
+        if (pth_trace_recording())
+            pth_trace_dispatch(pth_current, &now, &running, ltr_num, ntickets, nready);
 
         /* Update actual time of all threads in ready queue */
-        pth_pqueue_update_a_rt(&pth_RQ);
+        if (pth_schedpolicy == PTH_SCHED_LOTTERY)
+            pth_pqueue_update_a_rt(&pth_RQ, &snapshot);
         
         pth_debug3("pth_scheduler: thread \"%s\" ran %.6f",
-                   pth_current->name, pth_time_t2d(&running));
+                   pth_tcb_name(pth_current), pth_time_t2d(&running));
         /* Additional debugging code */
-        pth_debug2("pth_scheduler: lottery number %d",
+        pth_debug2("pth_scheduler: lottery number %ld",
                    ltr_num);
-        pth_debug2("pth_scheduler: total ticket %d",
+        pth_debug2("pth_scheduler: total ticket %lu",
                    pth_RQ.total_tk);
-        pth_debug3("pth_scheduler: thread has %d offset and %d tickets",
+        pth_debug3("pth_scheduler: thread has %ld offset and %lu tickets",
                    (pth_current->tk).offset, (pth_current->tk).tk_num);
-        pth_debug3("pth_scheduler: thread has %.6f running time and %.6f lifetime",
-                   pth_time_t2d(&pth_current->running), pth_time_t2d(&lifetime));
+        pth_debug3("pth_scheduler: thread has %.6f running time and %.6f cpu share",
+                   pth_time_t2d(&pth_current->running), (pth_current->cpu_rt).actual);
         pth_debug2("pth_scheduler: thread has %.6f target runtime",
                    (pth_current->cpu_rt).target);
         pth_debug2("pth_scheduler: thread has %.6f actual runtime",
@@ -310,10 +645,10 @@ intern void *pth_scheduler(void *dummy)
             sigset_t sigstillpending;
             sigpending(&sigstillpending);
             for (sig = 1; sig < PTH_NSIG; sig++) {
-                if (sigismember(&pth_current->sigpending, sig)) {
+                if (sigismember(&pth_current->ext->sigpending, sig)) {
                     if (!sigismember(&sigstillpending, sig)) {
                         /* thread (and perhaps also process) signal delivered */
-                        sigdelset(&pth_current->sigpending, sig);
+                        sigdelset(&pth_current->ext->sigpending, sig);
                         pth_current->sigpendcnt--;
                     }
                     else if (!sigismember(&pth_sigpending, sig)) {
@@ -330,7 +665,7 @@ intern void *pth_scheduler(void *dummy)
         if (pth_current->stackguard != NULL) {
             if (*pth_current->stackguard != 0xDEAD) {
                 pth_debug3("pth_scheduler: stack overflow detected for thread 0x%lx (\"%s\")",
-                           (unsigned long)pth_current, pth_current->name);
+                           (unsigned long)pth_current, pth_tcb_name(pth_current));
                 /*
                  * if the application doesn't catch SIGSEGVs, we terminate
                  * manually with a SIGSEGV now, but output a reasonable message.
@@ -338,7 +673,7 @@ intern void *pth_scheduler(void *dummy)
                 if (sigaction(SIGSEGV, NULL, &sa) == 0) {
                     if (sa.sa_handler == SIG_DFL) {
                         fprintf(stderr, "**Pth** STACK OVERFLOW: thread pid_t=0x%lx, name=\"%s\"\n",
-                                (unsigned long)pth_current, pth_current->name);
+                                (unsigned long)pth_current, pth_tcb_name(pth_current));
                         kill(getpid(), SIGSEGV);
                         sigfillset(&ss);
                         sigdelset(&ss, SIGSEGV);
@@ -360,7 +695,7 @@ intern void *pth_scheduler(void *dummy)
          * If previous thread is now marked as dead, kick it out
          */
         if (pth_current->state == PTH_STATE_DEAD) {
-            pth_debug2("pth_scheduler: marking thread \"%s\" as dead", pth_current->name);
+            pth_debug2("pth_scheduler: marking thread \"%s\" as dead", pth_tcb_name(pth_current));
             if (!pth_current->joinable)
                 pth_tcb_free(pth_current);
             else
@@ -374,7 +709,7 @@ intern void *pth_scheduler(void *dummy)
          */
         if (pth_current != NULL && pth_current->state == PTH_STATE_WAITING) {
             pth_debug2("pth_scheduler: moving thread \"%s\" to waiting queue",
-                       pth_current->name);
+                       pth_tcb_name(pth_current));
             pth_pqueue_insert(&pth_WQ, pth_current->prio, pth_current);
             pth_current = NULL;
         }
@@ -384,10 +719,13 @@ intern void *pth_scheduler(void *dummy)
          * priorities to avoid starvation and insert last running
          * thread back into this queue, too.
          */
-	/* Disable this auto-increment mechanism */
-        /* pth_pqueue_increase(&pth_RQ); */
-        if (pth_current != NULL)
+	/* Disable this auto-increment mechanism for the lottery */
+        if (pth_schedpolicy == PTH_SCHED_PRIORITY)
+            pth_pqueue_increase(&pth_RQ);
+        if (pth_current != NULL) {
+            pth_time_set(&pth_current->readied, &snapshot);
             pth_pqueue_insert(&pth_RQ, pth_current->prio, pth_current);
+        }
 
         /*
          * Manage the events in the waiting queue, i.e. decide whether their
@@ -395,23 +733,264 @@ intern void *pth_scheduler(void *dummy)
          * we have already no new or ready threads.
          */
         if (   pth_pqueue_elements(&pth_RQ) == 0
-            && pth_pqueue_elements(&pth_NQ) == 0)
+            && pth_pqueue_elements(&pth_NQ) == 0) {
             /* still no NEW or READY threads, so we have to wait for new work */
-            pth_sched_eventmanager(&snapshot, FALSE /* wait */);
-        else
-            /* already NEW or READY threads exists, so just poll for even more work */
-            pth_sched_eventmanager(&snapshot, TRUE  /* poll */);
+            pth_sched_eventmanager(FALSE /* wait */);
+            batched = 0;
+            pth_time_set(&evpass, &snapshot);
+        }
+        else if (pth_scheduler_batch_done(++batched, &snapshot, &evpass)) {
+            /* already NEW or READY threads exists, so just poll for even more work
+               (when batching only after some dispatches or the time budget) */
+            pth_sched_eventmanager(TRUE  /* poll */);
+            batched = 0;
+            pth_time_set(&evpass, &snapshot);
+        }
     }
 
     /* NOTREACHED */
     return NULL;
 }
 
+/* poll(2) results which satisfy select(2) style readiness */
+#define PTH_POLL_READABLE  (POLLIN|POLLHUP|POLLERR)
+#define PTH_POLL_WRITEABLE (POLLOUT|POLLHUP|POLLERR)
+#define PTH_POLL_EXCEPTION (POLLPRI)
+
+/* append a descriptor to the poll array; returns its slot or -1 */
+static int pth_sched_pollfd(int *npfd, int fd, short events)
+{
+    struct pollfd *pfd;
+    int size;
+
+    if (*npfd == pth_pollfd_size) {
+        size = pth_pollfd_size * 2;
+        if ((pfd = (struct pollfd *)realloc(pth_pollfd, size * sizeof(struct pollfd))) == NULL)
+            return -1;
+        pth_pollfd = pfd;
+        pth_pollfd_size = size;
+    }
+    pth_pollfd[*npfd].fd      = fd;
+    pth_pollfd[*npfd].events  = events;
+    pth_pollfd[*npfd].revents = 0;
+    return (*npfd)++;
+}
+
+/* assemble the poll array slots of an I/O event; FALSE if out of memory */
+static int pth_sched_ioevent_prepare(pth_event_t ev, int *npfd)
+{
+    struct pollfd *pfd;
+    short events;
+    int fd;
+    nfds_t i;
+
+    ev->ev_pidx = *npfd;
+    ev->ev_pnum = 0;
+    if (ev->ev_type == PTH_EVENT_FD) {
+        events = 0;
+        if (ev->ev_goal & PTH_UNTIL_FD_READABLE)
+            events |= POLLIN;
+        if (ev->ev_goal & PTH_UNTIL_FD_WRITEABLE)
+            events |= POLLOUT;
+        if (ev->ev_goal & PTH_UNTIL_FD_EXCEPTION)
+            events |= POLLPRI;
+        if (pth_sched_pollfd(npfd, ev->ev_args.FD.fd, events) == -1)
+            return FALSE;
+        ev->ev_pnum = 1;
+    }
+    else if (ev->ev_type == PTH_EVENT_SELECT) {
+        for (fd = 0; fd < ev->ev_args.SELECT.nfd; fd++) {
+            events = 0;
+            if (ev->ev_args.SELECT.rfds != NULL && FD_ISSET(fd, ev->ev_args.SELECT.rfds))
+                events |= POLLIN;
+            if (ev->ev_args.SELECT.wfds != NULL && FD_ISSET(fd, ev->ev_args.SELECT.wfds))
+                events |= POLLOUT;
+            if (ev->ev_args.SELECT.efds != NULL && FD_ISSET(fd, ev->ev_args.SELECT.efds))
+                events |= POLLPRI;
+            if (events == 0)
+                continue;
+            if (pth_sched_pollfd(npfd, fd, events) == -1)
+                break;
+            ev->ev_pnum++;
+        }
+        if (fd < ev->ev_args.SELECT.nfd) {
+            *npfd = ev->ev_pidx;
+            return FALSE;
+        }
+    }
+    else if (ev->ev_type == PTH_EVENT_POLL) {
+        /* negative descriptors are copied, too; poll(2) ignores them */
+        pfd = ev->ev_args.POLL.pfd;
+        for (i = 0; i < ev->ev_args.POLL.nfd; i++) {
+            if (pth_sched_pollfd(npfd, pfd[i].fd, pfd[i].events) == -1) {
+                *npfd = ev->ev_pidx;
+                return FALSE;
+            }
+        }
+        ev->ev_pnum = (int)ev->ev_args.POLL.nfd;
+    }
+    return TRUE;
+}
+
+/* late handling of an I/O event from its poll array slots */
+static void pth_sched_ioevent_check(pth_event_t ev, int rc)
+{
+    struct pollfd *pfd;
+    short re;
+    int i, n, rc2;
+
+    pfd = &pth_pollfd[ev->ev_pidx];
+    if (rc < 0) {
+        /* the poll as a whole failed, so re-check just this event */
+        while ((rc2 = pth_sc(poll)(pfd, (nfds_t)ev->ev_pnum, 0)) < 0
+               && errno == EINTR) ;
+        if (rc2 < 0) {
+            ev->ev_status = PTH_STATUS_FAILED;
+            ev->ev_errno  = errno;
+            return;
+        }
+    }
+    if (ev->ev_type == PTH_EVENT_FD) {
+        re = pfd->revents;
+        if (re & POLLNVAL) {
+            ev->ev_status = PTH_STATUS_FAILED;
+            ev->ev_errno  = EBADF;
+        }
+        else if (   (   ev->ev_goal & PTH_UNTIL_FD_READABLE
+                     && re & PTH_POLL_READABLE)
+                 || (   ev->ev_goal & PTH_UNTIL_FD_WRITEABLE
+                     && re & PTH_POLL_WRITEABLE)
+                 || (   ev->ev_goal & PTH_UNTIL_FD_EXCEPTION
+                     && re & PTH_POLL_EXCEPTION))
+            ev->ev_status = PTH_STATUS_OCCURRED;
+    }
+    else if (ev->ev_type == PTH_EVENT_SELECT) {
+        /* select(2) semantics: bad descriptors fail the whole event,
+           else the sets are reduced to the ready descriptors (if any) */
+        n = 0;
+        for (i = 0; i < ev->ev_pnum; i++) {
+            re = pfd[i].revents;
+            if (re & POLLNVAL) {
+                ev->ev_status = PTH_STATUS_FAILED;
+                ev->ev_errno  = EBADF;
+                return;
+            }
+            if ((pfd[i].events & POLLIN)  && (re & PTH_POLL_READABLE))  n++;
+            if ((pfd[i].events & POLLOUT) && (re & PTH_POLL_WRITEABLE)) n++;
+            if ((pfd[i].events & POLLPRI) && (re & PTH_POLL_EXCEPTION)) n++;
+        }
+        if (n == 0)
+            return;
+        for (i = 0; i < ev->ev_pnum; i++) {
+            re = pfd[i].revents;
+            if ((pfd[i].events & POLLIN) && !(re & PTH_POLL_READABLE))
+                FD_CLR(pfd[i].fd, ev->ev_args.SELECT.rfds);
+            if ((pfd[i].events & POLLOUT) && !(re & PTH_POLL_WRITEABLE))
+                FD_CLR(pfd[i].fd, ev->ev_args.SELECT.wfds);
+            if ((pfd[i].events & POLLPRI) && !(re & PTH_POLL_EXCEPTION))
+                FD_CLR(pfd[i].fd, ev->ev_args.SELECT.efds);
+        }
+        if (ev->ev_args.SELECT.n != NULL)
+            *(ev->ev_args.SELECT.n) = n;
+        ev->ev_status = PTH_STATUS_OCCURRED;
+    }
+    else if (ev->ev_type == PTH_EVENT_POLL) {
+        /* poll(2) semantics: report all slots with any result */
+        n = 0;
+        for (i = 0; i < ev->ev_pnum; i++)
+            if (pfd[i].revents != 0)
+                n++;
+        if (n == 0)
+            return;
+        for (i = 0; i < ev->ev_pnum; i++)
+            ev->ev_args.POLL.pfd[i].revents = pfd[i].revents;
+        if (ev->ev_args.POLL.n != NULL)
+            *(ev->ev_args.POLL.n) = n;
+        ev->ev_status = PTH_STATUS_OCCURRED;
+    }
+    return;
+}
+
+/* let the signalfd take exactly the signals to catch for events */
+static void pth_sched_sigfd_update(void)
+{
+#if defined(HAVE_SYS_SIGNALFD_H) && defined(SFD_NONBLOCK)
+    if (signalfd(pth_sigfd, &pth_sigcatch, SFD_NONBLOCK) == -1) {
+        /* fall back to the signal pipe for good */
+        close(pth_sigfd);
+        pth_sigfd = -1;
+        return;
+    }
+    memcpy(&pth_sigfdmask, &pth_sigcatch, sizeof(sigset_t));
+#endif
+    return;
+}
+
+/* remember the signals which arrived through the signalfd as raised */
+static void pth_sched_sigfd_drain(void)
+{
+#if defined(HAVE_SYS_SIGNALFD_H) && defined(SFD_NONBLOCK)
+    struct signalfd_siginfo si[8];
+    ssize_t n;
+    int i;
+
+    while ((n = pth_sc(read)(pth_sigfd, si, sizeof(si))) > 0)
+        for (i = 0; i < (int)(n / sizeof(si[0])); i++)
+            sigaddset(&pth_sigraised, (int)si[i].ssi_signo);
+#endif
+    return;
+}
+
+/* the poll(2) timeout in milliseconds until a timer (rounded up, so
+   we never wake up too early) */
+static int pth_sched_pollms(pth_time_t *timer, pth_time_t *now)
+{
+    pth_time_t delay;
+
+    pth_time_set(&delay, timer);
+    pth_time_sub(&delay, now);
+    if (delay.tv_sec < 0)
+        return 0;
+    else if (delay.tv_sec >= INT_MAX / 1000 - 1)
+        return INT_MAX;
+    return (int)(delay.tv_sec * 1000 + (delay.tv_usec + 999) / 1000);
+}
+
+/*
+ * Spin with non-blocking polls for up to the given number of
+ * microseconds (or until the timer, if any, is due earlier). An event
+ * which arrives meanwhile then costs no sleep and wakeup in the kernel.
+ */
+static int pth_sched_spinpoll(int npfd, long usec, pth_time_t *timer)
+{
+    pth_time_t end, now;
+    int rc;
+
+    pth_time_set(&end, PTH_TIME_NOW);
+    end.tv_sec  += usec / 1000000;
+    end.tv_usec += usec % 1000000;
+    if (end.tv_usec >= 1000000) {
+        end.tv_sec++;
+        end.tv_usec -= 1000000;
+    }
+    if (timer != NULL && pth_time_cmp(timer, &end) < 0)
+        pth_time_set(&end, timer);
+    do {
+        if ((rc = pth_sc(poll)(pth_pollfd, (nfds_t)npfd, 0)) > 0
+            || (rc < 0 && errno != EINTR))
+            return rc;
+        pth_time_set(&now, PTH_TIME_NOW);
+    } while (pth_time_cmp(&now, &end) < 0);
+    return 0;
+}
+
 /*
  * Look whether some events already occurred (or failed) and move
  * corresponding threads from waiting queue back to ready queue.
+ * Timer events are absolute times of day, so unlike the scheduler
+ * we need the time of day here, but only if there are timers at all.
  */
-intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
+intern void pth_sched_eventmanager(int dopoll)
 {
     pth_t nexttimer_thread;
     pth_event_t nexttimer_ev;
@@ -422,17 +1001,25 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
     pth_t tlast;
     int this_occurred;
     int any_occurred;
-    fd_set rfds;
-    fd_set wfds;
-    fd_set efds;
-    struct timeval delay;
-    struct timeval *pdelay;
+    pth_time_t now;
+    int havenow;
+    pth_time_t *wakeup;
+    pth_time_t woken;
+    pth_time_t idle;
+    pth_time_t readied;
+    int havereadied;
+    int timeout;
+    int sleepms;
+    int spin;
     sigset_t oss;
     struct sigaction sa;
     struct sigaction osa[1+PTH_NSIG];
+    sigset_t *lastsigs;
+    int havepending;
+    int ncatch;
     char minibuf[128];
     int loop_repeat;
-    int fdmax;
+    int npfd;
     int rc;
     int sig;
     int n;
@@ -443,15 +1030,27 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
     /* entry point for internal looping in event handling */
     loop_entry:
     loop_repeat = FALSE;
-
-    /* initialize fd sets */
-    FD_ZERO(&rfds);
-    FD_ZERO(&wfds);
-    FD_ZERO(&efds);
-    fdmax = -1;
-
-    /* initialize signal status */
-    sigpending(&pth_sigpending);
+    havenow = FALSE;
+    havereadied = FALSE;
+
+    /* deliver what other threads posted to us in the meantime */
+    pth_inbox_drain();
+
+    /* initialize the poll array with the slot for the signals (filled
+       in below if any are awaited) and the inbox */
+    npfd = 2;
+    pth_pollfd[0].fd      = -1;
+    pth_pollfd[0].events  = POLLIN;
+    pth_pollfd[0].revents = 0;
+    pth_pollfd[1].fd      = pth_inbox_getfd();
+    pth_pollfd[1].events  = POLLIN;
+    pth_pollfd[1].revents = 0;
+
+    /* initialize signal status (the pending signals are only
+       determined when a thread waits for signals at all) */
+    havepending = FALSE;
+    lastsigs = NULL;
+    ncatch = 0;
     sigfillset(&pth_sigblock);
     sigemptyset(&pth_sigcatch);
     sigemptyset(&pth_sigraised);
@@ -466,10 +1065,14 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
     for (t = pth_pqueue_head(&pth_WQ); t != NULL;
          t = pth_pqueue_walk(&pth_WQ, t, PTH_WALK_NEXT)) {
 
-        /* determine signals we block */
-        for (sig = 1; sig < PTH_NSIG; sig++)
-            if (!sigismember(&(t->mctx.sigs), sig))
-                sigdelset(&pth_sigblock, sig);
+        /* determine signals we block (most threads share the same
+           mask, so skip the masks we have just looked at) */
+        if (lastsigs == NULL || memcmp(lastsigs, &(t->mctx.sigs), sizeof(sigset_t)) != 0) {
+            for (sig = 1; sig < PTH_NSIG; sig++)
+                if (!sigismember(&(t->mctx.sigs), sig))
+                    sigdelset(&pth_sigblock, sig);
+            lastsigs = &(t->mctx.sigs);
+        }
 
         /* cancellation support */
         if (t->cancelreq == TRUE)
@@ -484,38 +1087,31 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
             if (ev->ev_status == PTH_STATUS_PENDING) {
                 this_occurred = FALSE;
 
-                /* Filedescriptor I/O */
-                if (ev->ev_type == PTH_EVENT_FD) {
+                /* Filedescriptor, Filedescriptor Set and Poll I/O */
+                if (   ev->ev_type == PTH_EVENT_FD
+                    || ev->ev_type == PTH_EVENT_SELECT
+                    || ev->ev_type == PTH_EVENT_POLL) {
                     /* filedescriptors are checked later all at once.
-                       Here we only assemble them in the fd sets */
-                    if (ev->ev_goal & PTH_UNTIL_FD_READABLE)
-                        FD_SET(ev->ev_args.FD.fd, &rfds);
-                    if (ev->ev_goal & PTH_UNTIL_FD_WRITEABLE)
-                        FD_SET(ev->ev_args.FD.fd, &wfds);
-                    if (ev->ev_goal & PTH_UNTIL_FD_EXCEPTION)
-                        FD_SET(ev->ev_args.FD.fd, &efds);
-                    if (fdmax < ev->ev_args.FD.fd)
-                        fdmax = ev->ev_args.FD.fd;
-                }
-                /* Filedescriptor Set Select I/O */
-                else if (ev->ev_type == PTH_EVENT_SELECT) {
-                    /* filedescriptors are checked later all at once.
-                       Here we only merge the fd sets. */
-                    pth_util_fds_merge(ev->ev_args.SELECT.nfd,
-                                       ev->ev_args.SELECT.rfds, &rfds,
-                                       ev->ev_args.SELECT.wfds, &wfds,
-                                       ev->ev_args.SELECT.efds, &efds);
-                    if (fdmax < ev->ev_args.SELECT.nfd-1)
-                        fdmax = ev->ev_args.SELECT.nfd-1;
+                       Here we only assemble them in the poll array */
+                    if (!pth_sched_ioevent_prepare(ev, &npfd)) {
+                        pth_debug2("pth_sched_eventmanager: [I/O] event failed for thread \"%s\"", pth_tcb_name(t));
+                        ev->ev_status = PTH_STATUS_FAILED;
+                        ev->ev_errno  = ENOMEM;
+                        any_occurred = TRUE;
+                    }
                 }
                 /* Signal Set */
                 else if (ev->ev_type == PTH_EVENT_SIGS) {
+                    if (!havepending) {
+                        sigpending(&pth_sigpending);
+                        havepending = TRUE;
+                    }
                     for (sig = 1; sig < PTH_NSIG; sig++) {
                         if (sigismember(ev->ev_args.SIGS.sigs, sig)) {
                             /* thread signal handling */
-                            if (sigismember(&t->sigpending, sig)) {
+                            if (t->sigpendcnt > 0 && sigismember(&t->ext->sigpending, sig)) {
                                 *(ev->ev_args.SIGS.sig) = sig;
-                                sigdelset(&t->sigpending, sig);
+                                sigdelset(&t->ext->sigpending, sig);
                                 t->sigpendcnt--;
                                 this_occurred = TRUE;
                             }
@@ -528,26 +1124,45 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
                                 this_occurred = TRUE;
                             }
                             else {
-                                sigdelset(&pth_sigblock, sig);
                                 sigaddset(&pth_sigcatch, sig);
+                                ncatch++;
                             }
                         }
                     }
                 }
                 /* Timer */
                 else if (ev->ev_type == PTH_EVENT_TIME) {
-                    if (pth_time_cmp(&(ev->ev_args.TIME.tv), now) < 0)
+                    if (!havenow) {
+                        pth_time_set(&now, PTH_TIME_NOW);
+                        havenow = TRUE;
+                    }
+                    if (pth_time_cmp(&(ev->ev_args.TIME.tv), &now) < 0)
                         this_occurred = TRUE;
                     else {
-                        /* remember the timer which will be elapsed next */
+                        /* remember the timer which will be elapsed next. A
+                           timer may fire up to the thread's slack late, so
+                           we sleep until the end of the earliest slack window
+                           and then fire all timers whose time has come */
+                        pth_time_t tv;
+                        pth_time_set(&tv, &(ev->ev_args.TIME.tv));
+                        if (t->timerslack.tv_sec != 0 || t->timerslack.tv_usec != 0) {
+                            pth_time_add(&tv, &t->timerslack);
+                        }
                         if ((nexttimer_thread == NULL && nexttimer_ev == NULL) ||
-                            pth_time_cmp(&(ev->ev_args.TIME.tv), &nexttimer_value) < 0) {
+                            pth_time_cmp(&tv, &nexttimer_value) < 0) {
                             nexttimer_thread = t;
                             nexttimer_ev = ev;
-                            pth_time_set(&nexttimer_value, &(ev->ev_args.TIME.tv));
+                            pth_time_set(&nexttimer_value, &tv);
                         }
                     }
                 }
+                /* Wakeup */
+                else if (ev->ev_type == PTH_EVENT_WAKEUP) {
+                    if (t->wk_pending) {
+                        t->wk_pending = FALSE;
+                        this_occurred = TRUE;
+                    }
+                }
                 /* Message Port Arrivals */
                 else if (ev->ev_type == PTH_EVENT_MSG) {
                     if (pth_ring_elements(&(ev->ev_args.MSG.mp->mp_queue)) > 0)
@@ -585,7 +1200,11 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
                         this_occurred = TRUE;
                     else {
                         pth_time_t tv;
-                        pth_time_set(&tv, now);
+                        if (!havenow) {
+                            pth_time_set(&now, PTH_TIME_NOW);
+                            havenow = TRUE;
+                        }
+                        pth_time_set(&tv, &now);
                         pth_time_add(&tv, &(ev->ev_args.FUNC.tv));
                         if ((nexttimer_thread == NULL && nexttimer_ev == NULL) ||
                             pth_time_cmp(&tv, &nexttimer_value) < 0) {
@@ -598,9 +1217,15 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
 
                 /* tag event if it has occurred */
                 if (this_occurred) {
-                    pth_debug2("pth_sched_eventmanager: [non-I/O] event occurred for thread \"%s\"", t->name);
+                    pth_debug2("pth_sched_eventmanager: [non-I/O] event occurred for thread \"%s\"", pth_tcb_name(t));
                     ev->ev_status = PTH_STATUS_OCCURRED;
                     any_occurred = TRUE;
+                    /* messages, mutexes, conditions and terminations are
+                       caused by the threads which ran since the last pass */
+                    if (   pth_wakeaffine > 0 && pth_wakee == NULL
+                        && (   ev->ev_type == PTH_EVENT_MSG || ev->ev_type == PTH_EVENT_MUTEX
+                            || ev->ev_type == PTH_EVENT_COND || ev->ev_type == PTH_EVENT_TID))
+                        pth_wakee = t;
                 }
             }
         } while ((ev = ev->ev_next) != evh);
@@ -608,39 +1233,64 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
     if (any_occurred)
         dopoll = TRUE;
 
+    /* the time to wake up at: the next timer, unless the caller wants
+       to be back earlier (see pth_sched_waitlimit) */
+    wakeup = (nexttimer_ev != NULL ? &nexttimer_value : NULL);
+    if (   !dopoll && pth_sched_waitlimit != NULL
+        && (wakeup == NULL || pth_time_cmp(pth_sched_waitlimit, wakeup) < 0)) {
+        wakeup = pth_sched_waitlimit;
+        if (!havenow) {
+            pth_time_set(&now, PTH_TIME_NOW);
+            havenow = TRUE;
+        }
+    }
+
     /* now decide how to poll for fd I/O and timers */
     if (dopoll) {
         /* do a polling with immediate timeout,
-           i.e. check the fd sets only without blocking */
-        pth_time_set(&delay, PTH_TIME_ZERO);
-        pdelay = &delay;
+           i.e. check the descriptors only without blocking */
+        timeout = 0;
     }
-    else if (nexttimer_ev != NULL) {
+    else if (wakeup != NULL) {
         /* do a polling with a timeout set to the next timer,
-           i.e. wait for the fd sets or the next timer */
-        pth_time_set(&delay, &nexttimer_value);
-        pth_time_sub(&delay, now);
-        pdelay = &delay;
+           i.e. wait for the descriptors or the next timer */
+        timeout = pth_sched_pollms(wakeup, &now);
     }
     else {
         /* do a polling without a timeout,
-           i.e. wait for the fd sets only with blocking */
-        pdelay = NULL;
+           i.e. wait for the descriptors only with blocking */
+        timeout = -1;
     }
 
-    /* clear pipe and let select() wait for the read-part of the pipe */
-    while (pth_sc(read)(pth_sigpipe[0], minibuf, sizeof(minibuf)) > 0) ;
-    FD_SET(pth_sigpipe[0], &rfds);
-    if (fdmax < pth_sigpipe[0])
-        fdmax = pth_sigpipe[0];
+    /* the signalfd takes exactly the signals to catch, so its mask has
+       to be changed only when the set of awaited signals changes */
+    if (pth_sigfd != -1 && memcmp(&pth_sigcatch, &pth_sigfdmask, sizeof(sigset_t)) != 0)
+        pth_sched_sigfd_update();
 
-    /* replace signal actions for signals we've to catch for events */
-    for (sig = 1; sig < PTH_NSIG; sig++) {
-        if (sigismember(&pth_sigcatch, sig)) {
-            sa.sa_handler = pth_sched_eventmanager_sighandler;
-            sigfillset(&sa.sa_mask);
-            sa.sa_flags = 0;
-            sigaction(sig, &sa, &osa[sig]);
+    if (ncatch > 0) {
+        if (pth_sigfd != -1) {
+            /* let poll() wait for the signalfd, where the signals to
+               catch arrive only as long as they stay blocked */
+            pth_pollfd[0].fd = pth_sigfd;
+            for (sig = 1; sig < PTH_NSIG; sig++)
+                if (sigismember(&pth_sigcatch, sig))
+                    sigaddset(&pth_sigblock, sig);
+        }
+        else {
+            /* clear pipe and let poll() wait for the read-part of the pipe */
+            while (pth_sc(read)(pth_sigpipe[0], minibuf, sizeof(minibuf)) > 0) ;
+            pth_pollfd[0].fd = pth_sigpipe[0];
+
+            /* replace signal actions for signals we've to catch for events */
+            for (sig = 1; sig < PTH_NSIG; sig++) {
+                if (sigismember(&pth_sigcatch, sig)) {
+                    sigdelset(&pth_sigblock, sig);
+                    sa.sa_handler = pth_sched_eventmanager_sighandler;
+                    sigfillset(&sa.sa_mask);
+                    sa.sa_flags = 0;
+                    sigaction(sig, &sa, &osa[sig]);
+                }
+            }
         }
     }
 
@@ -649,21 +1299,63 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
        handler for signals not catched by events */
     pth_sc(sigprocmask)(SIG_SETMASK, &pth_sigblock, &oss);
 
+    /* before going to sleep, spin for a while when events recently
+       arrived within that while (and so probably do again). After a
+       spin in vain (e.g. because the other side cannot run while we
+       spin on a single CPU) we sleep right away for exponentially
+       more times before we try again */
+    rc = 0;
+    sleepms = timeout;
+    spin = (timeout != 0 && pth_busypoll > 0);
+    if (spin) {
+        pth_time_set(&idle, PTH_TIME_NOW);
+        if (pth_busyskip > 0)
+            pth_busyskip--;
+        else if (pth_busygap <= pth_busypoll) {
+            rc = pth_sched_spinpoll(npfd, pth_busypoll, wakeup);
+            if (rc != 0)
+                pth_busyback = 0;
+            else {
+                if (pth_busyback < 1024)
+                    pth_busyback = (pth_busyback == 0 ? 1 : pth_busyback * 2);
+                pth_busyskip = pth_busyback;
+                if (wakeup != NULL) {
+                    pth_time_set(&now, PTH_TIME_NOW);
+                    sleepms = pth_sched_pollms(wakeup, &now);
+                }
+            }
+        }
+    }
+
     /* now do the polling for filedescriptor I/O and timers
        WHEN THE SCHEDULER SLEEPS AT ALL, THEN HERE!! */
-    rc = -1;
-    if (!(dopoll && fdmax == -1))
-        while ((rc = pth_sc(select)(fdmax+1, &rfds, &wfds, &efds, pdelay)) < 0
+    if (rc == 0)
+        while ((rc = pth_sc(poll)(pth_pollfd, (nfds_t)npfd, sleepms)) < 0
                && errno == EINTR) ;
 
     /* restore signal mask and actions and handle signals */
     pth_sc(sigprocmask)(SIG_SETMASK, &oss, NULL);
-    for (sig = 1; sig < PTH_NSIG; sig++)
-        if (sigismember(&pth_sigcatch, sig))
-            sigaction(sig, &osa[sig], NULL);
+    if (ncatch > 0) {
+        if (pth_sigfd != -1) {
+            if (rc > 0 && (pth_pollfd[0].revents & POLLIN))
+                pth_sched_sigfd_drain();
+        }
+        else {
+            for (sig = 1; sig < PTH_NSIG; sig++)
+                if (sigismember(&pth_sigcatch, sig))
+                    sigaction(sig, &osa[sig], NULL);
+        }
+    }
+
+    /* if other threads posted to us, repeat the event handling
+       to deliver it (a later post makes the inbox readable again) */
+    if (rc > 0 && (pth_pollfd[1].revents & POLLIN))
+        pth_inbox_clear();
+    if (pth_inbox_pending())
+        loop_repeat = TRUE;
 
     /* if the timer elapsed, handle it */
-    if (!dopoll && rc == 0 && nexttimer_ev != NULL) {
+    if (!dopoll && rc == 0 && wakeup == &nexttimer_value) {
         if (nexttimer_ev->ev_type == PTH_EVENT_FUNC) {
             /* it was an implicit timer event for a function event,
                so repeat the event handling for rechecking the function */
@@ -672,23 +1364,29 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
         else {
             /* it was an explicit timer event, standing for its own */
             pth_debug2("pth_sched_eventmanager: [timeout] event occurred for thread \"%s\"",
-                       nexttimer_thread->name);
+                       pth_tcb_name(nexttimer_thread));
             nexttimer_ev->ev_status = PTH_STATUS_OCCURRED;
         }
     }
 
-    /* if the internal signal pipe was used, adjust the select() results */
-    if (!dopoll && rc > 0 && FD_ISSET(pth_sigpipe[0], &rfds)) {
-        FD_CLR(pth_sigpipe[0], &rfds);
-        rc--;
+    /* if we slept, all timers which elapsed meanwhile fire right now
+       together with the one we waited for */
+    if (timeout != 0)
+        pth_time_set(&woken, PTH_TIME_NOW);
+
+    /* adapt the spinning to how long we waited for an arrival
+       (an exponential average over the last eight or so) */
+    if (spin && rc > 0) {
+        pth_time_sub(&woken, &idle);
+        pth_busygap += ((woken.tv_sec * 1000000 + woken.tv_usec) - pth_busygap) / 8;
+        pth_time_add(&woken, &idle);
     }
 
-    /* if an error occurred, avoid confusion in the cleanup loop */
-    if (rc <= 0) {
-        FD_ZERO(&rfds);
-        FD_ZERO(&wfds);
-        FD_ZERO(&efds);
-    }
+    /* if an error occurred, avoid confusion in the cleanup loop
+       (the I/O events are then re-checked one by one) */
+    if (rc < 0)
+        for (n = 2; n < npfd; n++)
+            pth_pollfd[n].revents = 0;
 
     /* now comes the final cleanup loop where we've to
        do two jobs: first we've to do the late handling of the fd I/O events and
@@ -709,91 +1407,26 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
                  * Late handling for still not occured events
                  */
                 if (ev->ev_status == PTH_STATUS_PENDING) {
-                    /* Filedescriptor I/O */
-                    if (ev->ev_type == PTH_EVENT_FD) {
-                        if (   (   ev->ev_goal & PTH_UNTIL_FD_READABLE
-                                && FD_ISSET(ev->ev_args.FD.fd, &rfds))
-                            || (   ev->ev_goal & PTH_UNTIL_FD_WRITEABLE
-                                && FD_ISSET(ev->ev_args.FD.fd, &wfds))
-                            || (   ev->ev_goal & PTH_UNTIL_FD_EXCEPTION
-                                && FD_ISSET(ev->ev_args.FD.fd, &efds)) ) {
+                    /* Filedescriptor, Filedescriptor Set and Poll I/O */
+                    if (   ev->ev_type == PTH_EVENT_FD
+                        || ev->ev_type == PTH_EVENT_SELECT
+                        || ev->ev_type == PTH_EVENT_POLL) {
+                        pth_sched_ioevent_check(ev, rc);
+                        if (ev->ev_status == PTH_STATUS_OCCURRED) {
                             pth_debug2("pth_sched_eventmanager: "
-                                       "[I/O] event occurred for thread \"%s\"", t->name);
-                            ev->ev_status = PTH_STATUS_OCCURRED;
+                                       "[I/O] event occurred for thread \"%s\"", pth_tcb_name(t));
                         }
-                        else if (rc < 0) {
-                            /* re-check particular filedescriptor */
-                            int rc2;
-                            if (ev->ev_goal & PTH_UNTIL_FD_READABLE)
-                                FD_SET(ev->ev_args.FD.fd, &rfds);
-                            if (ev->ev_goal & PTH_UNTIL_FD_WRITEABLE)
-                                FD_SET(ev->ev_args.FD.fd, &wfds);
-                            if (ev->ev_goal & PTH_UNTIL_FD_EXCEPTION)
-                                FD_SET(ev->ev_args.FD.fd, &efds);
-                            pth_time_set(&delay, PTH_TIME_ZERO);
-                            while ((rc2 = pth_sc(select)(ev->ev_args.FD.fd+1, &rfds, &wfds, &efds, &delay)) < 0
-                                   && errno == EINTR) ;
-                            if (rc2 > 0) {
-                                /* cleanup afterwards for next iteration */
-                                FD_CLR(ev->ev_args.FD.fd, &rfds);
-                                FD_CLR(ev->ev_args.FD.fd, &wfds);
-                                FD_CLR(ev->ev_args.FD.fd, &efds);
-                            } else if (rc2 < 0) {
-                                /* cleanup afterwards for next iteration */
-                                FD_ZERO(&rfds);
-                                FD_ZERO(&wfds);
-                                FD_ZERO(&efds);
-                                ev->ev_status = PTH_STATUS_FAILED;
-                                pth_debug2("pth_sched_eventmanager: "
-                                           "[I/O] event failed for thread \"%s\"", t->name);
-                            }
+                        else if (ev->ev_status == PTH_STATUS_FAILED) {
+                            pth_debug2("pth_sched_eventmanager: "
+                                       "[I/O] event failed for thread \"%s\"", pth_tcb_name(t));
                         }
                     }
-                    /* Filedescriptor Set I/O */
-                    else if (ev->ev_type == PTH_EVENT_SELECT) {
-                        if (pth_util_fds_test(ev->ev_args.SELECT.nfd,
-                                              ev->ev_args.SELECT.rfds, &rfds,
-                                              ev->ev_args.SELECT.wfds, &wfds,
-                                              ev->ev_args.SELECT.efds, &efds)) {
-                            n = pth_util_fds_select(ev->ev_args.SELECT.nfd,
-                                                    ev->ev_args.SELECT.rfds, &rfds,
-                                                    ev->ev_args.SELECT.wfds, &wfds,
-                                                    ev->ev_args.SELECT.efds, &efds);
-                            if (ev->ev_args.SELECT.n != NULL)
-                                *(ev->ev_args.SELECT.n) = n;
-                            ev->ev_status = PTH_STATUS_OCCURRED;
+                    /* Timer */
+                    else if (ev->ev_type == PTH_EVENT_TIME) {
+                        if (timeout != 0 && pth_time_cmp(&(ev->ev_args.TIME.tv), &woken) < 0) {
                             pth_debug2("pth_sched_eventmanager: "
-                                       "[I/O] event occurred for thread \"%s\"", t->name);
-                        }
-                        else if (rc < 0) {
-                            /* re-check particular filedescriptor set */
-                            int rc2;
-                            fd_set *prfds = NULL;
-                            fd_set *pwfds = NULL;
-                            fd_set *pefds = NULL;
-                            fd_set trfds;
-                            fd_set twfds;
-                            fd_set tefds;
-                            if (ev->ev_args.SELECT.rfds) {
-                                memcpy(&trfds, ev->ev_args.SELECT.rfds, sizeof(rfds));
-                                prfds = &trfds;
-                            }
-                            if (ev->ev_args.SELECT.wfds) {
-                                memcpy(&twfds, ev->ev_args.SELECT.wfds, sizeof(wfds));
-                                pwfds = &twfds;
-                            }
-                            if (ev->ev_args.SELECT.efds) {
-                                memcpy(&tefds, ev->ev_args.SELECT.efds, sizeof(efds));
-                                pefds = &tefds;
-                            }
-                            pth_time_set(&delay, PTH_TIME_ZERO);
-                            while ((rc2 = pth_sc(select)(ev->ev_args.SELECT.nfd+1, prfds, pwfds, pefds, &delay)) < 0
-                                   && errno == EINTR) ;
-                            if (rc2 < 0) {
-                                ev->ev_status = PTH_STATUS_FAILED;
-                                pth_debug2("pth_sched_eventmanager: "
-                                           "[I/O] event failed for thread \"%s\"", t->name);
-                            }
+                                       "[timeout] event occurred for thread \"%s\"", pth_tcb_name(t));
+                            ev->ev_status = PTH_STATUS_OCCURRED;
                         }
                     }
                     /* Signal Set */
@@ -804,7 +1437,7 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
                                     if (ev->ev_args.SIGS.sig != NULL)
                                         *(ev->ev_args.SIGS.sig) = sig;
                                     pth_debug2("pth_sched_eventmanager: "
-                                               "[signal] event occurred for thread \"%s\"", t->name);
+                                               "[signal] event occurred for thread \"%s\"", pth_tcb_name(t));
                                     sigdelset(&pth_sigraised, sig);
                                     ev->ev_status = PTH_STATUS_OCCURRED;
                                 }
@@ -835,7 +1468,7 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
 
         /* cancellation support */
         if (t->cancelreq == TRUE) {
-            pth_debug2("pth_sched_eventmanager: cancellation request pending for thread \"%s\"", t->name);
+            pth_debug2("pth_sched_eventmanager: cancellation request pending for thread \"%s\"", pth_tcb_name(t));
             any_occurred = TRUE;
         }
 
@@ -854,22 +1487,53 @@ intern void pth_sched_eventmanager(pth_time_t *now, int dopoll)
         if (any_occurred) {
             pth_pqueue_delete(&pth_WQ, tlast);
             tlast->state = PTH_STATE_READY;
+            if (!havereadied) {
+                pth_clock_now(&readied);
+                havereadied = TRUE;
+            }
+            pth_time_set(&tlast->readied, &readied);
+            pth_sched_release(tlast, &readied);
             pth_pqueue_insert(&pth_RQ, tlast->prio+1, tlast);
+            if (pth_trace_recording())
+                pth_trace_ready(tlast);
             pth_debug2("pth_sched_eventmanager: thread \"%s\" moved from waiting "
-                       "to ready queue", tlast->name);
+                       "to ready queue", pth_tcb_name(tlast));
         }
     }
 
     /* perhaps we have to internally loop... */
-    if (loop_repeat) {
-        pth_time_set(now, PTH_TIME_NOW);
+    if (loop_repeat)
         goto loop_entry;
-    }
 
     pth_debug1("pth_sched_eventmanager: leaving");
     return;
 }
 
+/*
+ * Directly move a thread waiting for the given event into the ready
+ * queue, for primitives which hand a resource over to a particular
+ * waiter. A thread which is not waiting (e.g. suspended) finds the
+ * event in its own ring later through the event manager.
+ */
+intern void pth_sched_handoff(pth_t t, pth_event_t ev)
+{
+    if (t->state != PTH_STATE_WAITING || !pth_pqueue_contains(&pth_WQ, t))
+        return;
+    ev->ev_status = PTH_STATUS_OCCURRED;
+    pth_pqueue_delete(&pth_WQ, t);
+    t->state = PTH_STATE_READY;
+    pth_clock_now(&t->readied);
+    pth_sched_release(t, &t->readied);
+    pth_pqueue_insert(&pth_RQ, t->prio+1, t);
+    if (pth_wakeaffine > 0 && pth_wakee == NULL)
+        pth_wakee = t;
+    if (pth_trace_recording())
+        pth_trace_ready(t);
+    pth_debug2("pth_sched_handoff: thread \"%s\" moved from waiting "
+               "to ready queue", pth_tcb_name(t));
+    return;
+}
+
 intern void pth_sched_eventmanager_sighandler(int sig)
 {
     char c;
@@ -47,7 +47,7 @@ int pth_mutex_acquire(pth_mutex_t *mutex, int tryonly, pth_event_t ev_extra)
     static pth_key_t ev_key = PTH_KEY_INIT;
     pth_event_t ev;
 
-    pth_debug2("pth_mutex_acquire: called from thread \"%s\"", pth_current->name);
+    pth_debug2("pth_mutex_acquire: called from thread \"%s\"", pth_tcb_name(pth_current));
 
     /* consistency checks */
     if (mutex == NULL)
@@ -146,46 +146,315 @@ intern void pth_mutex_releaseall(pth_t thread)
 **  Read-Write Locks
 */
 
+/*
+ * Read-write locks keep a reader count and an explicit FIFO of waiting
+ * threads. Admission is phase-fair: new readers queue up behind a
+ * waiting writer, and a leaving writer admits all queued readers in one
+ * batch. So writers wait for at most one reader phase and readers for
+ * at most one writer phase. Waiters are handed the lock directly by the
+ * releasing thread, so they never have to re-contend for it.
+ */
+struct pth_rwlock_waiter_st {
+    struct pth_rwlock_waiter_st *rww_next;
+    pth_t                        rww_tid;
+    int                          rww_op;
+    int                          rww_granted;
+    pth_event_t                  rww_ev;
+};
+
+/*
+ * Every thread notes the read-write locks it holds (read locks with a
+ * count, since a thread may hold a read lock more than once), so they
+ * are released when it terminates, like its mutexes are. The note is
+ * made before the lock is taken, so running out of memory fails the
+ * acquisition instead of leaving a lock behind.
+ */
+struct pth_rwlock_hold_st {
+    pth_rwlock_t  *rh_rwlock;
+    int            rh_op;
+    unsigned long  rh_count;
+};
+
+/* note that a thread holds (or is about to hold) a lock; FALSE if out of memory */
+static int pth_rwlock_hold(pth_t t, pth_rwlock_t *rwlock, int op)
+{
+    struct pth_tcb_ext_st *ext;
+    struct pth_rwlock_hold_st *rh;
+    int i, size;
+
+    if ((ext = pth_tcb_ext(t)) == NULL)
+        return FALSE;
+    for (i = 0; i < ext->rwheld_num; i++) {
+        rh = &ext->rwheld[i];
+        if (rh->rh_rwlock == rwlock && rh->rh_op == op) {
+            rh->rh_count++;
+            return TRUE;
+        }
+    }
+    if (ext->rwheld_num == ext->rwheld_size) {
+        size = (ext->rwheld_size > 0 ? ext->rwheld_size * 2 : 4);
+        rh = (struct pth_rwlock_hold_st *)realloc(ext->rwheld,
+                  sizeof(struct pth_rwlock_hold_st) * size);
+        if (rh == NULL)
+            return FALSE;
+        ext->rwheld = rh;
+        ext->rwheld_size = size;
+    }
+    rh = &ext->rwheld[ext->rwheld_num++];
+    rh->rh_rwlock = rwlock;
+    rh->rh_op     = op;
+    rh->rh_count  = 1;
+    return TRUE;
+}
+
+/* how often a thread holds a lock in the given mode */
+static unsigned long pth_rwlock_held(pth_t t, pth_rwlock_t *rwlock, int op)
+{
+    int i;
+
+    if (t->ext == NULL)
+        return 0;
+    for (i = 0; i < t->ext->rwheld_num; i++)
+        if (t->ext->rwheld[i].rh_rwlock == rwlock && t->ext->rwheld[i].rh_op == op)
+            return t->ext->rwheld[i].rh_count;
+    return 0;
+}
+
+/* drop a note of pth_rwlock_hold(); FALSE if the thread holds no such lock */
+static int pth_rwlock_unhold(pth_t t, pth_rwlock_t *rwlock, int op)
+{
+    struct pth_rwlock_hold_st *rh;
+    int i;
+
+    if (t->ext == NULL)
+        return FALSE;
+    for (i = 0; i < t->ext->rwheld_num; i++) {
+        rh = &t->ext->rwheld[i];
+        if (rh->rh_rwlock == rwlock && rh->rh_op == op) {
+            if (--rh->rh_count == 0)
+                *rh = t->ext->rwheld[--t->ext->rwheld_num];
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
 int pth_rwlock_init(pth_rwlock_t *rwlock)
 {
     if (rwlock == NULL)
         return pth_error(FALSE, EINVAL);
     rwlock->rw_state = PTH_RWLOCK_INITIALIZED;
+    rwlock->rw_mode = PTH_RWLOCK_RD;
     rwlock->rw_readers = 0;
-    pth_mutex_init(&(rwlock->rw_mutex_rd));
-    pth_mutex_init(&(rwlock->rw_mutex_rw));
+    rwlock->rw_writer = NULL;
+    rwlock->rw_writers_waiting = 0;
+    rwlock->rw_head = NULL;
+    rwlock->rw_tail = NULL;
     return TRUE;
 }
 
+/* remove a waiter from the FIFO of a read-write lock */
+static void pth_rwlock_unlink(pth_rwlock_t *rwlock, struct pth_rwlock_waiter_st *w)
+{
+    struct pth_rwlock_waiter_st **pw, *prev;
+
+    prev = NULL;
+    for (pw = &rwlock->rw_head; *pw != NULL; pw = &(*pw)->rww_next) {
+        if (*pw == w) {
+            *pw = w->rww_next;
+            if (rwlock->rw_tail == w)
+                rwlock->rw_tail = prev;
+            if (w->rww_op == PTH_RWLOCK_RW)
+                rwlock->rw_writers_waiting--;
+            return;
+        }
+        prev = *pw;
+    }
+    return;
+}
+
+/* hand the lock over to a waiter and make it ready */
+static void pth_rwlock_grant(pth_rwlock_t *rwlock, struct pth_rwlock_waiter_st *w)
+{
+    pth_rwlock_unlink(rwlock, w);
+    if (w->rww_op == PTH_RWLOCK_RW) {
+        rwlock->rw_mode = PTH_RWLOCK_RW;
+        rwlock->rw_writer = w->rww_tid;
+    }
+    else {
+        rwlock->rw_mode = PTH_RWLOCK_RD;
+        rwlock->rw_readers++;
+    }
+    w->rww_granted = TRUE;
+    pth_sched_handoff(w->rww_tid, w->rww_ev);
+    return;
+}
+
+/* admit waiters after the lock state changed */
+static void pth_rwlock_admit(pth_rwlock_t *rwlock, int writer_left)
+{
+    struct pth_rwlock_waiter_st *w, *wn;
+
+    if (rwlock->rw_writer != NULL || rwlock->rw_head == NULL)
+        return;
+    if (   writer_left
+        || (rwlock->rw_readers == 0 && rwlock->rw_head->rww_op == PTH_RWLOCK_RD)
+        || (rwlock->rw_readers > 0 && rwlock->rw_writers_waiting == 0)) {
+        /* start a reader phase: admit all queued readers at once */
+        for (w = rwlock->rw_head; w != NULL; w = wn) {
+            wn = w->rww_next;
+            if (w->rww_op == PTH_RWLOCK_RD)
+                pth_rwlock_grant(rwlock, w);
+        }
+    }
+    if (rwlock->rw_readers == 0 && rwlock->rw_head != NULL)
+        /* start a writer phase with the first queued writer */
+        pth_rwlock_grant(rwlock, rwlock->rw_head);
+    return;
+}
+
+/* whether a queued waiter was handed the lock */
+static int pth_rwlock_granted(void *arg)
+{
+    return ((struct pth_rwlock_waiter_st *)arg)->rww_granted;
+}
+
+/* dequeue a waiter (or give back its lock) when it is cancelled */
+static void pth_rwlock_cleanup_handler(void *_cleanvec)
+{
+    pth_rwlock_t *rwlock = (pth_rwlock_t *)(((void **)_cleanvec)[0]);
+    struct pth_rwlock_waiter_st *w = (struct pth_rwlock_waiter_st *)(((void **)_cleanvec)[1]);
+
+    pth_rwlock_unhold(w->rww_tid, rwlock, w->rww_op);
+    if (!w->rww_granted) {
+        pth_rwlock_unlink(rwlock, w);
+        pth_rwlock_admit(rwlock, FALSE);
+    }
+    else if (w->rww_op == PTH_RWLOCK_RW) {
+        rwlock->rw_writer = NULL;
+        pth_rwlock_admit(rwlock, TRUE);
+    }
+    else {
+        rwlock->rw_readers--;
+        pth_rwlock_admit(rwlock, FALSE);
+    }
+    return;
+}
+
+/* release the read-write locks still held by a terminating thread */
+intern void pth_rwlock_releaseall(pth_t thread)
+{
+    struct pth_rwlock_hold_st *rh;
+    pth_rwlock_t *rwlock;
+
+    if (thread == NULL || thread->ext == NULL)
+        return;
+    while (thread->ext->rwheld_num > 0) {
+        rh = &thread->ext->rwheld[--thread->ext->rwheld_num];
+        rwlock = rh->rh_rwlock;
+        if (rh->rh_op == PTH_RWLOCK_RW) {
+            if (rwlock->rw_writer == thread) {
+                rwlock->rw_writer = NULL;
+                pth_rwlock_admit(rwlock, TRUE);
+            }
+        }
+        else if (rwlock->rw_writer == NULL && rwlock->rw_readers > 0) {
+            if (rwlock->rw_readers > rh->rh_count)
+                rwlock->rw_readers -= rh->rh_count;
+            else
+                rwlock->rw_readers = 0;
+            pth_rwlock_admit(rwlock, FALSE);
+        }
+    }
+    return;
+}
+
 int pth_rwlock_acquire(pth_rwlock_t *rwlock, int op, int tryonly, pth_event_t ev_extra)
 {
+    struct pth_rwlock_waiter_st w;
+    pth_event_storage_t evs;
+    void *cleanvec[2];
+    pth_event_t ev;
+    int reenter;
+
     /* consistency checks */
     if (rwlock == NULL)
         return pth_error(FALSE, EINVAL);
     if (!(rwlock->rw_state & PTH_RWLOCK_INITIALIZED))
         return pth_error(FALSE, EDEADLK);
+    op = (op == PTH_RWLOCK_RW ? PTH_RWLOCK_RW : PTH_RWLOCK_RD);
+
+    /* a thread may take a lock it holds again in the same mode (without
+       waiting, else it would wait for itself), but not in the other one */
+    if (pth_rwlock_held(pth_current, rwlock,
+                        op == PTH_RWLOCK_RW ? PTH_RWLOCK_RD : PTH_RWLOCK_RW) > 0)
+        return pth_error(FALSE, EDEADLK);
+    reenter = (pth_rwlock_held(pth_current, rwlock, op) > 0);
+    if (!pth_rwlock_hold(pth_current, rwlock, op))
+        return pth_error(FALSE, ENOMEM);
+    if (reenter) {
+        if (op == PTH_RWLOCK_RD)
+            rwlock->rw_readers++;
+        return TRUE;
+    }
 
-    /* acquire lock */
+    /* acquire lock immediately if the current phase allows it */
     if (op == PTH_RWLOCK_RW) {
-        /* read-write lock is simple */
-        if (!pth_mutex_acquire(&(rwlock->rw_mutex_rw), tryonly, ev_extra))
-            return FALSE;
-        rwlock->rw_mode = PTH_RWLOCK_RW;
+        if (rwlock->rw_writer == NULL && rwlock->rw_readers == 0 && rwlock->rw_head == NULL) {
+            rwlock->rw_mode = PTH_RWLOCK_RW;
+            rwlock->rw_writer = pth_current;
+            return TRUE;
+        }
     }
     else {
-        /* read-only lock is more complicated to get right */
-        if (!pth_mutex_acquire(&(rwlock->rw_mutex_rd), tryonly, ev_extra))
-            return FALSE;
-        rwlock->rw_readers++;
-        if (rwlock->rw_readers == 1) {
-            if (!pth_mutex_acquire(&(rwlock->rw_mutex_rw), tryonly, ev_extra)) {
-                rwlock->rw_readers--;
-                pth_shield { pth_mutex_release(&(rwlock->rw_mutex_rd)); }
-                return FALSE;
-            }
+        /* readers do not pass a waiting writer */
+        if (rwlock->rw_writer == NULL && rwlock->rw_writers_waiting == 0) {
+            rwlock->rw_mode = PTH_RWLOCK_RD;
+            rwlock->rw_readers++;
+            return TRUE;
         }
-        rwlock->rw_mode = PTH_RWLOCK_RD;
-        pth_mutex_release(&(rwlock->rw_mutex_rd));
+    }
+    if (tryonly) {
+        pth_rwlock_unhold(pth_current, rwlock, op);
+        return pth_error(FALSE, EBUSY);
+    }
+
+    /* else queue up and wait until the lock is handed over to us */
+    w.rww_next    = NULL;
+    w.rww_tid     = pth_current;
+    w.rww_op      = op;
+    w.rww_granted = FALSE;
+    cleanvec[0] = rwlock;
+    cleanvec[1] = &w;
+    if (!pth_cleanup_push(pth_rwlock_cleanup_handler, cleanvec)) {
+        pth_rwlock_unhold(pth_current, rwlock, op);
+        return pth_error(FALSE, ENOMEM);
+    }
+    w.rww_ev      = ev = pth_event_init(&evs, PTH_EVENT_FUNC, pth_rwlock_granted,
+                                        (void *)&w, pth_time(60, 0));
+    if (rwlock->rw_tail != NULL)
+        rwlock->rw_tail->rww_next = &w;
+    else
+        rwlock->rw_head = &w;
+    rwlock->rw_tail = &w;
+    if (w.rww_op == PTH_RWLOCK_RW)
+        rwlock->rw_writers_waiting++;
+    if (ev_extra != NULL)
+        pth_event_concat(ev, ev_extra, NULL);
+    while (!w.rww_granted) {
+        pth_wait(ev);
+        if (ev_extra != NULL && !w.rww_granted)
+            break;
+    }
+    pth_cleanup_pop(FALSE);
+    if (ev_extra != NULL)
+        pth_event_isolate(ev);
+    if (!w.rww_granted) {
+        /* the extra events occurred first */
+        pth_rwlock_unlink(rwlock, &w);
+        pth_rwlock_admit(rwlock, FALSE);
+        pth_rwlock_unhold(pth_current, rwlock, op);
+        return pth_error(FALSE, EINTR);
     }
     return TRUE;
 }
@@ -198,26 +467,23 @@ int pth_rwlock_release(pth_rwlock_t *rwlock)
     if (!(rwlock->rw_state & PTH_RWLOCK_INITIALIZED))
         return pth_error(FALSE, EDEADLK);
 
-    /* release lock */
-    if (rwlock->rw_mode == PTH_RWLOCK_RW) {
-        /* read-write unlock is simple */
-        if (!pth_mutex_release(&(rwlock->rw_mutex_rw)))
-            return FALSE;
+    /* release lock and admit the next phase */
+    if (rwlock->rw_writer != NULL) {
+        if (rwlock->rw_writer != pth_current)
+            return pth_error(FALSE, EACCES);
+        pth_rwlock_unhold(pth_current, rwlock, PTH_RWLOCK_RW);
+        if (pth_rwlock_held(pth_current, rwlock, PTH_RWLOCK_RW) > 0)
+            return TRUE; /* still held from an outer acquisition */
+        rwlock->rw_writer = NULL;
+        pth_rwlock_admit(rwlock, TRUE);
     }
     else {
-        /* read-only unlock is more complicated to get right */
-        if (!pth_mutex_acquire(&(rwlock->rw_mutex_rd), FALSE, NULL))
-            return FALSE;
+        if (rwlock->rw_readers == 0)
+            return pth_error(FALSE, EDEADLK);
+        if (!pth_rwlock_unhold(pth_current, rwlock, PTH_RWLOCK_RD))
+            return pth_error(FALSE, EACCES);
         rwlock->rw_readers--;
-        if (rwlock->rw_readers == 0) {
-            if (!pth_mutex_release(&(rwlock->rw_mutex_rw))) {
-                rwlock->rw_readers++;
-                pth_shield { pth_mutex_release(&(rwlock->rw_mutex_rd)); }
-                return FALSE;
-            }
-        }
-        rwlock->rw_mode = PTH_RWLOCK_RD;
-        pth_mutex_release(&(rwlock->rw_mutex_rd));
+        pth_rwlock_admit(rwlock, FALSE);
     }
     return TRUE;
 }
@@ -324,28 +590,206 @@ int pth_cond_notify(pth_cond_t *cond, int broadcast)
     return TRUE;
 }
 
+/*
+**  Counting Semaphores
+**
+**  A semaphore keeps a count of available units and an explicit FIFO
+**  of waiting threads. A released unit is handed over directly to the
+**  first waiter, which is moved straight into the ready queue, so
+**  waiters are served in order and never have to re-contend for it.
+*/
+
+struct pth_sem_waiter_st {
+    struct pth_sem_waiter_st *smw_next;
+    pth_t                     smw_tid;
+    int                       smw_granted;
+    pth_event_t               smw_ev;
+};
+
+int pth_sem_init(pth_sem_t *sem, unsigned int value)
+{
+    if (sem == NULL)
+        return pth_error(FALSE, EINVAL);
+    sem->sm_state = PTH_SEM_INITIALIZED;
+    sem->sm_value = value;
+    sem->sm_head  = NULL;
+    sem->sm_tail  = NULL;
+    return TRUE;
+}
+
+/* remove a waiter from the FIFO of a semaphore */
+static void pth_sem_unlink(pth_sem_t *sem, struct pth_sem_waiter_st *w)
+{
+    struct pth_sem_waiter_st **pw, *prev;
+
+    prev = NULL;
+    for (pw = &sem->sm_head; *pw != NULL; pw = &(*pw)->smw_next) {
+        if (*pw == w) {
+            *pw = w->smw_next;
+            if (sem->sm_tail == w)
+                sem->sm_tail = prev;
+            return;
+        }
+        prev = *pw;
+    }
+    return;
+}
+
+/* hand available units over to the queued waiters */
+static void pth_sem_admit(pth_sem_t *sem)
+{
+    struct pth_sem_waiter_st *w;
+
+    while (sem->sm_value > 0 && (w = sem->sm_head) != NULL) {
+        sem->sm_head = w->smw_next;
+        if (sem->sm_head == NULL)
+            sem->sm_tail = NULL;
+        sem->sm_value--;
+        w->smw_granted = TRUE;
+        pth_sched_handoff(w->smw_tid, w->smw_ev);
+    }
+    return;
+}
+
+/* whether a queued waiter was handed a unit */
+static int pth_sem_granted(void *arg)
+{
+    return ((struct pth_sem_waiter_st *)arg)->smw_granted;
+}
+
+/* dequeue a waiter (or give back its unit) when it is cancelled */
+static void pth_sem_cleanup_handler(void *_cleanvec)
+{
+    pth_sem_t *sem = (pth_sem_t *)(((void **)_cleanvec)[0]);
+    struct pth_sem_waiter_st *w = (struct pth_sem_waiter_st *)(((void **)_cleanvec)[1]);
+
+    if (!w->smw_granted)
+        pth_sem_unlink(sem, w);
+    else {
+        sem->sm_value++;
+        pth_sem_admit(sem);
+    }
+    return;
+}
+
+int pth_sem_acquire(pth_sem_t *sem, int tryonly, pth_event_t ev_extra)
+{
+    struct pth_sem_waiter_st w;
+    pth_event_storage_t evs;
+    void *cleanvec[2];
+    pth_event_t ev;
+
+    /* consistency checks */
+    if (sem == NULL)
+        return pth_error(FALSE, EINVAL);
+    if (!(sem->sm_state & PTH_SEM_INITIALIZED))
+        return pth_error(FALSE, EDEADLK);
+
+    /* take a unit immediately if nobody is queued before us */
+    if (sem->sm_value > 0 && sem->sm_head == NULL) {
+        sem->sm_value--;
+        return TRUE;
+    }
+    if (tryonly)
+        return pth_error(FALSE, EBUSY);
+
+    /* else queue up and wait until a unit is handed over to us */
+    w.smw_next    = NULL;
+    w.smw_tid     = pth_current;
+    w.smw_granted = FALSE;
+    w.smw_ev      = ev = pth_event_init(&evs, PTH_EVENT_FUNC, pth_sem_granted,
+                                        (void *)&w, pth_time(60, 0));
+    if (sem->sm_tail != NULL)
+        sem->sm_tail->smw_next = &w;
+    else
+        sem->sm_head = &w;
+    sem->sm_tail = &w;
+    if (ev_extra != NULL)
+        pth_event_concat(ev, ev_extra, NULL);
+    cleanvec[0] = sem;
+    cleanvec[1] = &w;
+    pth_cleanup_push(pth_sem_cleanup_handler, cleanvec);
+    while (!w.smw_granted) {
+        pth_wait(ev);
+        if (ev_extra != NULL && !w.smw_granted)
+            break;
+    }
+    pth_cleanup_pop(FALSE);
+    if (ev_extra != NULL)
+        pth_event_isolate(ev);
+    if (!w.smw_granted) {
+        /* the extra events occurred first */
+        pth_sem_unlink(sem, &w);
+        return pth_error(FALSE, EINTR);
+    }
+    return TRUE;
+}
+
+int pth_sem_release(pth_sem_t *sem, unsigned int count)
+{
+    /* consistency checks */
+    if (sem == NULL || count == 0)
+        return pth_error(FALSE, EINVAL);
+    if (!(sem->sm_state & PTH_SEM_INITIALIZED))
+        return pth_error(FALSE, EDEADLK);
+    if (sem->sm_value > UINT_MAX - count)
+        return pth_error(FALSE, ERANGE);
+
+    /* add the units and hand them over to the first waiters */
+    sem->sm_value += count;
+    pth_sem_admit(sem);
+    return TRUE;
+}
+
+int pth_sem_value(pth_sem_t *sem, unsigned int *value)
+{
+    if (sem == NULL || value == NULL)
+        return pth_error(FALSE, EINVAL);
+    if (!(sem->sm_state & PTH_SEM_INITIALIZED))
+        return pth_error(FALSE, EDEADLK);
+    *value = sem->sm_value;
+    return TRUE;
+}
+
 /*
 **  Barriers
+**
+**  Threads which wait at a barrier link themselves into a list. The
+**  last arriving thread moves all of them into the ready queue in a
+**  single pass instead of broadcasting a condition which every waiter
+**  would have to recheck in the event manager.
 */
 
+struct pth_barrier_waiter_st {
+    struct pth_barrier_waiter_st *brw_next;
+    pth_t                         brw_tid;
+    int                           brw_released;
+    pth_event_t                   brw_ev;
+};
+
 int pth_barrier_init(pth_barrier_t *barrier, int threshold)
 {
     if (barrier == NULL || threshold <= 0)
         return pth_error(FALSE, EINVAL);
-    if (!pth_mutex_init(&(barrier->br_mutex)))
-        return FALSE;
-    if (!pth_cond_init(&(barrier->br_cond)))
-        return FALSE;
     barrier->br_state     = PTH_BARRIER_INITIALIZED;
     barrier->br_threshold = threshold;
     barrier->br_count     = threshold;
     barrier->br_cycle     = FALSE;
+    barrier->br_waiters   = NULL;
     return TRUE;
 }
 
+/* whether a waiting thread was released from the barrier */
+static int pth_barrier_released(void *arg)
+{
+    return ((struct pth_barrier_waiter_st *)arg)->brw_released;
+}
+
 int pth_barrier_reach(pth_barrier_t *barrier)
 {
-    int cancel, cycle;
+    struct pth_barrier_waiter_st w, *wp, *wn;
+    pth_event_storage_t evs;
+    int cancel;
     int rv;
 
     if (barrier == NULL)
@@ -353,30 +797,35 @@ int pth_barrier_reach(pth_barrier_t *barrier)
     if (!(barrier->br_state & PTH_BARRIER_INITIALIZED))
         return pth_error(FALSE, EINVAL);
 
-    if (!pth_mutex_acquire(&(barrier->br_mutex), FALSE, NULL))
-        return FALSE;
-    cycle = barrier->br_cycle;
     if (--(barrier->br_count) == 0) {
-        /* last thread reached the barrier */
+        /* last thread reached the barrier: release all waiters at once */
         barrier->br_cycle   = !(barrier->br_cycle);
         barrier->br_count   = barrier->br_threshold;
-        if ((rv = pth_cond_notify(&(barrier->br_cond), TRUE)))
-            rv = PTH_BARRIER_TAILLIGHT;
+        wp = barrier->br_waiters;
+        barrier->br_waiters = NULL;
+        for (; wp != NULL; wp = wn) {
+            wn = wp->brw_next;
+            wp->brw_released = TRUE;
+            pth_sched_handoff(wp->brw_tid, wp->brw_ev);
+        }
+        rv = PTH_BARRIER_TAILLIGHT;
     }
     else {
         /* wait until remaining threads have reached the barrier, too */
-        pth_cancel_state(PTH_CANCEL_DISABLE, &cancel);
-        if (barrier->br_threshold == barrier->br_count)
+        if (barrier->br_threshold - 1 == barrier->br_count)
             rv = PTH_BARRIER_HEADLIGHT;
         else
             rv = TRUE;
-        while (cycle == barrier->br_cycle) {
-            if (!(rv = pth_cond_await(&(barrier->br_cond), &(barrier->br_mutex), NULL)))
-                break;
-        }
+        w.brw_tid      = pth_current;
+        w.brw_released = FALSE;
+        w.brw_ev       = pth_event_init(&evs, PTH_EVENT_FUNC, pth_barrier_released,
+                                        (void *)&w, pth_time(60, 0));
+        w.brw_next     = barrier->br_waiters;
+        barrier->br_waiters = &w;
+        pth_cancel_state(PTH_CANCEL_DISABLE, &cancel);
+        while (!w.brw_released)
+            pth_wait(w.brw_ev);
         pth_cancel_state(cancel, NULL);
     }
-    pth_mutex_release(&(barrier->br_mutex));
     return rv;
 }
-
@@ -0,0 +1,241 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  pth_task.c: Pth lightweight (stackless) tasks
+*/
+                             /* ``Perfection is achieved, not when
+                                  there is nothing more to add, but
+                                  when there is nothing left to
+                                  take away.''
+                                          -- Antoine de Saint-Exupery */
+#include "pth_p.h"
+
+/*
+ * A task is a function which is called again and again until it
+ * reports that it is done, i.e. a state machine which keeps its state
+ * in its argument instead of on a stack. All tasks are run one after
+ * the other by a single carrier thread on its stack, so a task costs
+ * just a small pooled structure and switching between tasks is a
+ * function call. A task waits for events by handing its event ring
+ * to the carrier, which concatenates the rings of all waiting tasks
+ * behind its own event and waits for the whole ring with pth_wait(3).
+ * So the regular scheduler and event manager drive the tasks, too.
+ */
+
+#if cpp
+
+struct pth_task_st {
+    pth_task_t      tk_next;     /* link in ready, waiting or free list */
+    int           (*tk_func)(pth_task_t, void *);
+    void           *tk_arg;
+    pth_event_t     tk_ev;       /* first event of the awaited ring     */
+    pth_event_t     tk_evlast;   /* last event of the awaited ring      */
+};
+
+#endif /* cpp */
+
+/* number of tasks which are not yet done */
+intern long pth_task_count = 0;
+
+static pth_t      pth_task_carrier = NULL; /* the thread running all tasks    */
+static pth_task_t pth_task_head    = NULL; /* tasks ready to run (FIFO)       */
+static pth_task_t pth_task_tail    = NULL;
+static pth_task_t pth_task_waiting = NULL; /* tasks waiting for their events  */
+static pth_task_t pth_task_pool    = NULL; /* recycled task structures        */
+static pth_event_storage_t pth_task_evs;   /* the carrier's own event         */
+static pth_event_t pth_task_ev     = NULL;
+
+/* append a task to the ready list */
+static void pth_task_ready(pth_task_t task)
+{
+    task->tk_next = NULL;
+    if (pth_task_tail != NULL)
+        pth_task_tail->tk_next = task;
+    else
+        pth_task_head = task;
+    pth_task_tail = task;
+    return;
+}
+
+/* the carrier's own event: it occurs when there are tasks to run */
+static int pth_task_runnable(void *arg)
+{
+    (void)arg;
+    return (pth_task_head != NULL);
+}
+
+/* run a task once and act upon its result */
+static void pth_task_run(pth_task_t task)
+{
+    int rc;
+
+    task->tk_ev = NULL;
+    rc = task->tk_func(task, task->tk_arg);
+    if (rc == PTH_TASK_WAIT && task->tk_ev != NULL) {
+        /* hang the awaited ring into the carrier's ring */
+        task->tk_evlast = pth_event_walk(task->tk_ev, PTH_WALK_PREV);
+        pth_event_concat(pth_task_ev, task->tk_ev, NULL);
+        task->tk_next = pth_task_waiting;
+        pth_task_waiting = task;
+    }
+    else if (rc == PTH_TASK_YIELD || rc == PTH_TASK_WAIT)
+        pth_task_ready(task);
+    else {
+        /* done, so recycle the structure */
+        task->tk_next = pth_task_pool;
+        pth_task_pool = task;
+        pth_task_count--;
+    }
+    return;
+}
+
+/* move the waiting tasks whose events occurred to the ready list */
+static void pth_task_collect(void)
+{
+    pth_task_t task, *tp;
+    pth_event_t ev;
+    int occurred;
+
+    tp = &pth_task_waiting;
+    while ((task = *tp) != NULL) {
+        occurred = FALSE;
+        for (ev = task->tk_ev; ; ev = pth_event_walk(ev, PTH_WALK_NEXT)) {
+            if (pth_event_status(ev) != PTH_STATUS_PENDING)
+                occurred = TRUE;
+            if (ev == task->tk_evlast)
+                break;
+        }
+        if (occurred) {
+            *tp = task->tk_next;
+            pth_event_cut(task->tk_ev, task->tk_evlast);
+            pth_task_ready(task);
+        }
+        else
+            tp = &task->tk_next;
+    }
+    return;
+}
+
+/* the carrier thread */
+static void *pth_task_loop(void *arg)
+{
+    pth_task_t task, last;
+
+    (void)arg;
+    for (;;) {
+        /* run the tasks which are ready now; tasks which become
+           ready meanwhile wait for the next round, so the carrier
+           passes through the scheduler between two rounds */
+        last = pth_task_tail;
+        while ((task = pth_task_head) != NULL) {
+            if ((pth_task_head = task->tk_next) == NULL)
+                pth_task_tail = NULL;
+            pth_task_run(task);
+            if (task == last)
+                break;
+        }
+
+        /* wait for the events of the waiting tasks (or return right
+           away through our own event when tasks are ready to run) */
+        pth_wait(pth_task_ev);
+        pth_task_collect();
+    }
+
+    /* NOTREACHED */
+    return NULL;
+}
+
+/* spawn the carrier thread */
+static int pth_task_start(void)
+{
+    pth_attr_t attr;
+
+    pth_task_ev = pth_event_init(&pth_task_evs, PTH_EVENT_FUNC, pth_task_runnable,
+                                 NULL, pth_time(60, 0));
+    if (pth_task_ev == NULL)
+        return FALSE;
+    if ((attr = pth_attr_new()) == NULL)
+        return FALSE;
+    pth_attr_set(attr, PTH_ATTR_NAME,         "**TASKS**");
+    pth_attr_set(attr, PTH_ATTR_JOINABLE,     FALSE);
+    pth_attr_set(attr, PTH_ATTR_CANCEL_STATE, PTH_CANCEL_DISABLE);
+    pth_task_carrier = pth_spawn(attr, pth_task_loop, NULL);
+    pth_shield { pth_attr_destroy(attr); }
+    return (pth_task_carrier != NULL);
+}
+
+pth_task_t pth_task_spawn(int (*func)(pth_task_t, void *), void *arg)
+{
+    pth_task_t task;
+
+    pth_implicit_init();
+    if (func == NULL)
+        return pth_error((pth_task_t)NULL, EINVAL);
+    if (pth_task_carrier == NULL && !pth_task_start())
+        return NULL;
+    if ((task = pth_task_pool) != NULL)
+        pth_task_pool = task->tk_next;
+    else if ((task = (pth_task_t)malloc(sizeof(struct pth_task_st))) == NULL)
+        return pth_error((pth_task_t)NULL, ENOMEM);
+    task->tk_func = func;
+    task->tk_arg  = arg;
+    task->tk_ev   = NULL;
+    pth_task_ready(task);
+    pth_task_count++;
+
+    /* wake up the carrier directly if it is idle */
+    pth_sched_handoff(pth_task_carrier, pth_task_ev);
+    return task;
+}
+
+int pth_task_await(pth_task_t task, pth_event_t ev)
+{
+    if (task == NULL || ev == NULL)
+        return pth_error(PTH_TASK_DONE, EINVAL);
+    task->tk_ev = ev;
+    return PTH_TASK_WAIT;
+}
+
+/* release all task structures (on pth_kill) */
+intern void pth_task_kill(void)
+{
+    pth_task_t task;
+
+    while ((task = pth_task_head) != NULL) {
+        pth_task_head = task->tk_next;
+        free(task);
+    }
+    while ((task = pth_task_waiting) != NULL) {
+        pth_task_waiting = task->tk_next;
+        pth_event_cut(task->tk_ev, task->tk_evlast);
+        free(task);
+    }
+    while ((task = pth_task_pool) != NULL) {
+        pth_task_pool = task->tk_next;
+        free(task);
+    }
+    pth_task_tail    = NULL;
+    pth_task_carrier = NULL;
+    pth_task_ev      = NULL;
+    pth_task_count   = 0;
+    return;
+}
@@ -42,6 +42,25 @@ struct pth_cpu_rt {
     double 	   actual;		/* Actual CPU usage 			 */
 };
 
+/* cold thread control block ingredients, allocated on first use */
+struct pth_tcb_ext_st {
+    char           name[PTH_TCB_NAMELEN];/* name of thread (mainly for debugging)       */
+    sigset_t       sigpending;           /* set    of pending signals                   */
+    pth_cleanup_t *cleanups;             /* stack of thread cleanup handlers            */
+    struct pth_rwlock_hold_st *rwheld;   /* read-write locks held (see pth_sync.c)      */
+    int            rwheld_num;           /* number of entries used in rwheld            */
+    int            rwheld_size;          /* number of entries allocated in rwheld       */
+};
+
+/* whether a thread belongs to the deadline class */
+#define pth_tcb_is_deadline(t) \
+    ((t)->dl_period.tv_sec != 0 || (t)->dl_period.tv_usec != 0)
+
+/* stack types */
+#define PTH_TCB_STACK_MALLOC 0           /* allocated with malloc(3)                    */
+#define PTH_TCB_STACK_LOANED 1           /* supplied by the application                 */
+#define PTH_TCB_STACK_MAPPED 2           /* mmap(2)'ed with a guard page                */
+
     /* thread control block */
 struct pth_st {
     /* Required to implement fair-share lottery scheduling */
@@ -51,26 +70,40 @@ struct pth_st {
     /* priority queue handling */
     pth_t          q_next;               /* next thread in pool                         */
     pth_t          q_prev;               /* previous thread in pool                     */
-    int            q_prio;               /* (relative) priority of thread when queued   */
+    int            q_prio;               /* priority key of thread when queued          */
+    struct pth_pqueue_st *q_queue;       /* queue the thread is currently in            */
 
     /* standard thread control block ingredients */
     int            prio;                 /* base priority of thread                     */
-    char           name[PTH_TCB_NAMELEN];/* name of thread (mainly for debugging)       */
     int            dispatches;           /* total number of thread dispatches           */
+    unsigned long  serial;               /* spawn number (identifies it in traces)      */
+    pth_t          parent;               /* spawning thread when named after it         */
     pth_state_t    state;                /* current state indicator for thread          */
 
+    /* deadline class (dl_period is zero for the fair-share class) */
+    pth_time_t     dl_period;            /* relative deadline and budget period         */
+    pth_time_t     dl_budget;            /* CPU time allowed per period                 */
+    pth_time_t     dl_deadline;          /* absolute deadline of the current period     */
+    pth_time_t     dl_used;              /* CPU time consumed in the current period     */
+
     /* timing */
     pth_time_t     spawned;              /* time point at which thread was spawned      */
     pth_time_t     lastran;              /* time point at which thread was last running */
+    pth_time_t     readied;              /* time point at which thread became ready     */
     pth_time_t     running;              /* time range the thread was already running   */
+    pth_time_t     timerslack;           /* how late its timers may fire (coalescing)   */
 
     /* event handling */
     pth_event_t    events;               /* events the tread is waiting for             */
 
-    /* per-thread signal handling */
-    sigset_t       sigpending;           /* set    of pending signals                   */
+    /* per-thread signal handling (the set itself lives in the extension) */
     int            sigpendcnt;           /* number of pending signals                   */
 
+    /* wakeups posted through the inbox (see pth_wakeup) */
+    pth_ringnode_t wk_node;              /* inbox link of a posted wakeup               */
+    volatile int   wk_posted;            /* wakeup is still travelling in the inbox     */
+    int            wk_pending;           /* wakeup arrived but was not yet consumed     */
+
     /* machine context */
     pth_mctx_t     mctx;                 /* last saved machine state of thread          */
     char          *stack;                /* pointer to thread stack                     */
@@ -86,16 +119,23 @@ struct pth_st {
 
     /* per-thread specific storage */
     const void   **data_value;           /* thread specific  values                     */
+    unsigned long *data_set;             /* bitmap of set slots (shares data_value)     */
+    int            data_size;            /* number of slots in data_value               */
     int            data_count;           /* number of stored values                     */
 
+    /* per-thread arena allocation */
+    struct pth_arena_st *arena;          /* memory released on termination (or NULL)   */
+
     /* cancellation support */
     int            cancelreq;            /* cancellation request is pending             */
     unsigned int   cancelstate;          /* cancellation state of thread                */
-    pth_cleanup_t *cleanups;             /* stack of thread cleanup handlers            */
 
     /* mutex ring */
     pth_ring_t     mutexring;            /* ring of aquired mutex structures            */
 
+    /* rarely used ingredients */
+    struct pth_tcb_ext_st *ext;          /* lazily allocated cold ingredients           */
+
 #ifdef PTH_EX
     /* per-thread exception handling */
     ex_ctx_t       ex_ctx;               /* exception handling context                  */
@@ -116,9 +156,11 @@ intern const char *pth_state_names[] = {
 #endif
 
 /* allocate a thread control block */
-intern pth_t pth_tcb_alloc(unsigned int stacksize, void *stackaddr)
+intern pth_t pth_tcb_alloc(unsigned int stacksize, void *stackaddr, int stackguard)
 {
     pth_t t;
+    size_t pagesize;
+    char *map;
 
     if (stacksize > 0 && stacksize < SIGSTKSZ)
         stacksize = SIGSTKSZ;
@@ -127,10 +169,43 @@ intern pth_t pth_tcb_alloc(unsigned int stacksize, void *stackaddr)
     t->stacksize  = stacksize;
     t->stack      = NULL;
     t->stackguard = NULL;
-    t->stackloan  = (stackaddr != NULL ? TRUE : FALSE);
+    t->stackloan  = (stackaddr != NULL ? PTH_TCB_STACK_LOANED : PTH_TCB_STACK_MALLOC);
+    t->ext        = NULL;
+    t->arena      = NULL;
+    t->q_queue    = NULL;
+    t->wk_posted  = FALSE;
+    t->wk_pending = FALSE;
     if (stacksize > 0) { /* stacksize == 0 means "main" thread */
         if (stackaddr != NULL)
             t->stack = (char *)(stackaddr);
+#if defined(MAP_ANON) || defined(MAP_ANONYMOUS)
+        else if (stackguard) {
+            /* map the stack with an inaccessible page at the end
+               it grows to, so an overflow faults immediately */
+            pagesize = (size_t)getpagesize();
+            stacksize = ((stacksize + pagesize - 1) / pagesize) * pagesize;
+            map = (char *)mmap(NULL, stacksize + pagesize, PROT_READ|PROT_WRITE,
+#if defined(MAP_ANONYMOUS)
+                               MAP_PRIVATE|MAP_ANONYMOUS,
+#else
+                               MAP_PRIVATE|MAP_ANON,
+#endif
+                               -1, 0);
+            if (map == (char *)MAP_FAILED) {
+                pth_shield { free(t); }
+                return NULL;
+            }
+#if PTH_STACKGROWTH < 0
+            mprotect(map, pagesize, PROT_NONE);
+            t->stack = map + pagesize;
+#else
+            mprotect(map + stacksize, pagesize, PROT_NONE);
+            t->stack = map;
+#endif
+            t->stacksize = stacksize;
+            t->stackloan = PTH_TCB_STACK_MAPPED;
+        }
+#endif
         else {
             if ((t->stack = (char *)malloc(stacksize)) == NULL) {
                 pth_shield { free(t); }
@@ -149,18 +224,85 @@ intern pth_t pth_tcb_alloc(unsigned int stacksize, void *stackaddr)
     return t;
 }
 
+/* return the extension of a thread control block, allocating it on demand */
+intern struct pth_tcb_ext_st *pth_tcb_ext(pth_t t)
+{
+    if (t->ext == NULL) {
+        if ((t->ext = (struct pth_tcb_ext_st *)malloc(sizeof(struct pth_tcb_ext_st))) == NULL)
+            return NULL;
+        t->ext->name[0] = NUL;
+        sigemptyset(&t->ext->sigpending);
+        t->ext->cleanups = NULL;
+        t->ext->rwheld = NULL;
+        t->ext->rwheld_num = 0;
+        t->ext->rwheld_size = 0;
+    }
+    return t->ext;
+}
+
+/* name of a thread; children spawned with PTH_ATTR_DEFAULT get theirs on demand */
+intern const char *pth_tcb_name(pth_t t)
+{
+    pth_time_t age;
+    const char *parent;
+    int ok;
+
+    if (t->ext != NULL && t->ext->name[0] != NUL)
+        return t->ext->name;
+    if (t->parent == NULL)
+        return "unknown";
+    pth_shield {
+        ok = (pth_tcb_ext(t) != NULL);
+        parent = "unknown";
+        if (ok && (t->parent == pth_current || pth_thread_exists(t->parent)))
+            parent = pth_tcb_name(t->parent);
+    }
+    if (!ok)
+        return "unknown";
+    /* the spawn time in seconds since the epoch, as before */
+    pth_clock_now(&age);
+    pth_time_sub(&age, &t->spawned);
+    pth_snprintf(t->ext->name, PTH_TCB_NAMELEN, "%s.child@%d=0x%lx", parent,
+                 (unsigned int)(time(NULL) - age.tv_sec), (unsigned long)t->parent);
+    return t->ext->name;
+}
+
 /* free a thread control block */
 intern void pth_tcb_free(pth_t t)
 {
+    size_t pagesize;
+
     if (t == NULL)
         return;
-    if (t->stack != NULL && !t->stackloan)
-        free(t->stack);
+    if (t->wk_posted)
+        pth_inbox_drain(); /* the inbox must not point into freed memory */
+    if (pth_wakee == t)
+        pth_wakee = NULL;
+    if (t->stack != NULL) {
+        if (t->stackloan == PTH_TCB_STACK_MALLOC)
+            free(t->stack);
+#if defined(MAP_ANON) || defined(MAP_ANONYMOUS)
+        else if (t->stackloan == PTH_TCB_STACK_MAPPED) {
+            pagesize = (size_t)getpagesize();
+#if PTH_STACKGROWTH < 0
+            munmap(t->stack - pagesize, t->stacksize + pagesize);
+#else
+            munmap(t->stack, t->stacksize + pagesize);
+#endif
+        }
+#endif
+    }
     if (t->data_value != NULL)
         free(t->data_value);
-    if (t->cleanups != NULL)
-        pth_cleanup_popall(t, FALSE);
+    if (t->arena != NULL)
+        pth_arena_free(t);
+    if (t->ext != NULL) {
+        if (t->ext->cleanups != NULL)
+            pth_cleanup_popall(t, FALSE);
+        if (t->ext->rwheld != NULL)
+            free(t->ext->rwheld);
+        free(t->ext);
+    }
     free(t);
     return;
 }
-
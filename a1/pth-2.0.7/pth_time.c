@@ -69,6 +69,13 @@ intern void pth_time_usleep(unsigned long usec)
             (t1)->tv_usec = (t2)->tv_usec; \
         } \
     } while (0)
+
+/* set a time value from a number of microseconds */
+#define pth_time_usec(t,usec) \
+    do { \
+        (t)->tv_sec  = (usec) / 1000000; \
+        (t)->tv_usec = (usec) % 1000000; \
+    } while (0)
 #endif /* cpp */
 
 /* time value constructor */
@@ -94,6 +101,94 @@ pth_time_t pth_timeout(long sec, long usec)
     return tv;
 }
 
+/*
+ * The scheduler clock: all internal time accounting (CPU usage,
+ * lottery shares, deadline periods, load average) uses a monotonic
+ * clock, which is cheaper to read than the time of day and not
+ * disturbed when the time of day is stepped. Timer events still use
+ * the time of day, because their time points come from the
+ * application. Without clock_gettime(2), or when the monotonic clock
+ * cannot be read at initialization, the time of day is used for good:
+ * the clocks have different origins, so they must never be mixed.
+ */
+#if defined(CLOCK_MONOTONIC)
+intern int pth_clock_source = PTH_CLOCK_MONOTONIC;
+static clockid_t pth_clock_id = CLOCK_MONOTONIC;
+#else
+intern int pth_clock_source = PTH_CLOCK_TIMEOFDAY;
+#endif
+
+/* select the scheduler clock (after checking that it can be read) */
+intern int pth_clock_select(int source)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clockid_t id;
+#endif
+
+    if (source != PTH_CLOCK_MONOTONIC && source != PTH_CLOCK_COARSE)
+        return pth_error(FALSE, EINVAL);
+    if (pth_clock_source == PTH_CLOCK_TIMEOFDAY)
+        return pth_error(FALSE, ENOSYS);
+#if defined(CLOCK_MONOTONIC)
+    if (source == PTH_CLOCK_MONOTONIC)
+        id = CLOCK_MONOTONIC;
+    else {
+#if defined(CLOCK_MONOTONIC_COARSE)
+        id = CLOCK_MONOTONIC_COARSE;
+#else
+        return pth_error(FALSE, ENOSYS);
+#endif
+    }
+    if (clock_gettime(id, &ts) != 0)
+        return pth_error(FALSE, ENOSYS);
+    pth_clock_id = id;
+#endif
+    pth_clock_source = source;
+    return TRUE;
+}
+
+/* check the scheduler clock once, else fall back to the time of day */
+intern void pth_clock_init(void)
+{
+    if (pth_clock_source != PTH_CLOCK_TIMEOFDAY) {
+        pth_shield {
+            if (!pth_clock_select(pth_clock_source))
+                pth_clock_source = PTH_CLOCK_TIMEOFDAY;
+        }
+    }
+    return;
+}
+
+/* read the scheduler clock */
+intern void pth_clock_now(pth_time_t *t)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (pth_clock_source != PTH_CLOCK_TIMEOFDAY) {
+        clock_gettime(pth_clock_id, &ts);
+        t->tv_sec  = ts.tv_sec;
+        t->tv_usec = ts.tv_nsec / 1000;
+        return;
+    }
+#endif
+    __gettimeofday(t);
+    return;
+}
+
+/* convert a time point of the scheduler clock into a time of day */
+intern void pth_clock_wall(pth_time_t *t)
+{
+    pth_time_t now, wall;
+
+    pth_clock_now(&now);
+    pth_time_set(&wall, PTH_TIME_NOW);
+    pth_time_sub(&wall, &now);
+    pth_time_add(t, &wall);
+    return;
+}
+
 /* calculate: t1 <=> t2 */
 intern int pth_time_cmp(pth_time_t *t1, pth_time_t *t2)
 {
@@ -0,0 +1,297 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  pth_trace.c: Pth scheduler record/replay tracing
+*/
+                             /* ``Those who cannot remember the
+                                  past are condemned to repeat it.''
+                                          -- George Santayana */
+#include "pth_p.h"
+
+#if cpp
+
+/* default number of records in the trace ring */
+#define PTH_TRACE_ENTRIES 65536
+
+/* how long a replay waits for the next recorded thread to become ready (seconds) */
+#define PTH_TRACE_PATIENCE 1
+
+/* whether the scheduler has to record its decisions */
+#define pth_trace_recording() (pth_trace_mode == PTH_TRACE_RECORDING)
+
+#endif /* cpp */
+
+/* PTH_TRACE_OFF, PTH_TRACE_RECORDING or PTH_TRACE_REPLAYING */
+intern int pth_trace_mode = PTH_TRACE_OFF;
+
+static int          pth_trace_result = PTH_TRACE_OFF; /* how the last replay ended       */
+static int          pth_trace_saved  = FALSE; /* whether the ring holds a recording     */
+static pth_trace_t *pth_trace_ring   = NULL;  /* the record ring or the replayed trace  */
+static unsigned long pth_trace_size  = 0;     /* number of slots/records in it          */
+static unsigned long pth_trace_next  = 0;     /* records written/replay position        */
+static int          pth_trace_woken  = 0;     /* threads made ready since last dispatch */
+static pth_time_t   pth_trace_epoch;          /* scheduler clock when tracing started   */
+
+/* microseconds since the trace started */
+static long pth_trace_usec(pth_time_t *t)
+{
+    return (t->tv_sec - pth_trace_epoch.tv_sec) * 1000000
+           + (t->tv_usec - pth_trace_epoch.tv_usec);
+}
+
+/* write or read a whole buffer */
+static int pth_trace_io(int fd, char *buf, size_t n, int writing)
+{
+    ssize_t rc;
+
+    while (n > 0) {
+        if (writing)
+            rc = pth_sc(write)(fd, buf, n);
+        else
+            rc = pth_sc(read)(fd, buf, n);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0) {
+            if (rc == 0)
+                errno = EIO;
+            return FALSE;
+        }
+        buf += rc;
+        n   -= rc;
+    }
+    return TRUE;
+}
+
+/* replace the ring */
+static void pth_trace_reset(pth_trace_t *ring, unsigned long size)
+{
+    if (pth_trace_ring != NULL)
+        free(pth_trace_ring);
+    pth_trace_ring  = ring;
+    pth_trace_size  = size;
+    pth_trace_next  = 0;
+    pth_trace_woken = 0;
+    pth_trace_saved = FALSE;
+    return;
+}
+
+/* start recording the scheduler decisions into a ring of the given size */
+int pth_trace_start(unsigned int entries)
+{
+    pth_trace_t *ring;
+
+    pth_implicit_init();
+    if (pth_trace_mode != PTH_TRACE_OFF)
+        return pth_error(FALSE, EBUSY);
+    if (entries == 0)
+        entries = PTH_TRACE_ENTRIES;
+    if ((ring = (pth_trace_t *)malloc(entries * sizeof(pth_trace_t))) == NULL)
+        return pth_error(FALSE, ENOMEM);
+    /* touch all pages now instead of while recording */
+    memset(ring, 0, entries * sizeof(pth_trace_t));
+    pth_trace_reset(ring, entries);
+    pth_trace_saved  = TRUE;
+    pth_trace_result = PTH_TRACE_OFF;
+    pth_clock_now(&pth_trace_epoch);
+    pth_trace_mode = PTH_TRACE_RECORDING;
+    return TRUE;
+}
+
+/* stop recording or replaying */
+int pth_trace_stop(void)
+{
+    if (pth_trace_mode == PTH_TRACE_REPLAYING)
+        pth_trace_result = PTH_TRACE_OFF;
+    pth_trace_mode = PTH_TRACE_OFF;
+    return TRUE;
+}
+
+/* write the recorded trace to a file descriptor */
+int pth_trace_save(int fd)
+{
+    pth_trace_hdr_t hdr;
+    unsigned long first;
+
+    if (!pth_trace_saved)
+        return pth_error(FALSE, EINVAL);
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.th_magic, "PTHTRACE", 8);
+    hdr.th_recsize = sizeof(pth_trace_t);
+    if (pth_trace_next > pth_trace_size) {
+        hdr.th_count = pth_trace_size;
+        hdr.th_lost  = pth_trace_next - pth_trace_size;
+    }
+    else
+        hdr.th_count = pth_trace_next;
+    /* oldest record first */
+    first = (hdr.th_lost > 0 ? pth_trace_next % pth_trace_size : 0);
+    if (   !pth_trace_io(fd, (char *)&hdr, sizeof(hdr), TRUE)
+        || !pth_trace_io(fd, (char *)&pth_trace_ring[first],
+                         (hdr.th_count - first) * sizeof(pth_trace_t), TRUE)
+        || !pth_trace_io(fd, (char *)pth_trace_ring,
+                         first * sizeof(pth_trace_t), TRUE))
+        return pth_error(FALSE, errno);
+    return TRUE;
+}
+
+/* load a saved trace and force its dispatch order from now on */
+int pth_trace_replay(int fd)
+{
+    pth_trace_hdr_t hdr;
+    pth_trace_t *ring;
+
+    pth_implicit_init();
+    if (pth_trace_mode != PTH_TRACE_OFF)
+        return pth_error(FALSE, EBUSY);
+    if (!pth_trace_io(fd, (char *)&hdr, sizeof(hdr), FALSE))
+        return pth_error(FALSE, errno);
+    /* a trace which lost its beginning cannot be replayed */
+    if (   memcmp(hdr.th_magic, "PTHTRACE", 8) != 0
+        || hdr.th_recsize != sizeof(pth_trace_t)
+        || hdr.th_lost != 0)
+        return pth_error(FALSE, EINVAL);
+    if ((ring = (pth_trace_t *)malloc(hdr.th_count * sizeof(pth_trace_t) + 1)) == NULL)
+        return pth_error(FALSE, ENOMEM);
+    if (!pth_trace_io(fd, (char *)ring, hdr.th_count * sizeof(pth_trace_t), FALSE)) {
+        pth_shield { free(ring); }
+        return pth_error(FALSE, errno);
+    }
+    pth_trace_reset(ring, hdr.th_count);
+    pth_trace_result = PTH_TRACE_OFF;
+    pth_trace_mode = PTH_TRACE_REPLAYING;
+    return TRUE;
+}
+
+/* the current tracing state, or how the last replay ended */
+int pth_trace_status(void)
+{
+    if (pth_trace_mode != PTH_TRACE_OFF)
+        return pth_trace_mode;
+    return pth_trace_result;
+}
+
+/* release the trace on library shutdown */
+intern void pth_trace_kill(void)
+{
+    pth_trace_reset(NULL, 0);
+    pth_trace_mode   = PTH_TRACE_OFF;
+    pth_trace_result = PTH_TRACE_OFF;
+    return;
+}
+
+/* record that a thread became ready to run */
+intern void pth_trace_ready(pth_t t)
+{
+    pth_trace_t *r;
+    pth_time_t now;
+
+    pth_clock_now(&now);
+    r = &pth_trace_ring[pth_trace_next++ % pth_trace_size];
+    r->tr_type    = PTH_TRACE_READY;
+    r->tr_state   = t->state;
+    r->tr_thread  = t->serial;
+    r->tr_time    = pth_trace_usec(&now);
+    r->tr_ran     = 0;
+    r->tr_tickets = 0;
+    r->tr_draw    = -1;
+    r->tr_ready   = 0;
+    r->tr_fired   = 0;
+    pth_trace_woken++;
+    return;
+}
+
+/* record a dispatch of a thread after it came back to the scheduler */
+intern void pth_trace_dispatch(pth_t t, pth_time_t *start, pth_time_t *ran,
+                               long draw, unsigned long tickets, int ready)
+{
+    pth_trace_t *r;
+
+    /* the run during which the trace was started is not part of it */
+    if (pth_time_cmp(start, &pth_trace_epoch) < 0)
+        return;
+    r = &pth_trace_ring[pth_trace_next++ % pth_trace_size];
+    r->tr_type    = PTH_TRACE_DISPATCH;
+    r->tr_state   = t->state;
+    r->tr_thread  = t->serial;
+    r->tr_time    = pth_trace_usec(start);
+    r->tr_ran     = ran->tv_sec * 1000000 + ran->tv_usec;
+    r->tr_tickets = (draw >= 0 ? tickets : 0);
+    r->tr_draw    = draw;
+    r->tr_ready   = ready;
+    r->tr_fired   = pth_trace_woken;
+    pth_trace_woken = 0;
+    return;
+}
+
+/* find a thread by its spawn number in a queue */
+static pth_t pth_trace_find(pth_pqueue_t *q, unsigned long serial)
+{
+    pth_t t;
+
+    for (t = pth_pqueue_head(q); t != NULL; t = pth_pqueue_walk(q, t, PTH_WALK_NEXT))
+        if (t->serial == serial)
+            return t;
+    return NULL;
+}
+
+/* take the thread the replayed trace dispatched next out of the ready
+   queue; NULL when the trace is exhausted or the run diverged from it */
+intern pth_t pth_trace_pick(void)
+{
+    pth_trace_t *r;
+    pth_time_t limit, now;
+    pth_t t;
+
+    while (   pth_trace_next < pth_trace_size
+           && pth_trace_ring[pth_trace_next].tr_type != PTH_TRACE_DISPATCH)
+        pth_trace_next++;
+    if (pth_trace_next == pth_trace_size) {
+        pth_trace_mode   = PTH_TRACE_OFF;
+        pth_trace_result = PTH_TRACE_REPLAYED;
+        return NULL;
+    }
+    r = &pth_trace_ring[pth_trace_next];
+    pth_time_set(&limit, PTH_TIME_NOW);
+    limit.tv_sec += PTH_TRACE_PATIENCE;
+    for (;;) {
+        if ((t = pth_trace_find(&pth_RQ, r->tr_thread)) != NULL) {
+            pth_pqueue_delete(&pth_RQ, t);
+            pth_trace_next++;
+            return t;
+        }
+        /* the thread may wait for an event which occurs a bit later
+           than in the recorded run, so give it some time (sleeping in
+           the event manager until something happens or it is over) */
+        pth_time_set(&now, PTH_TIME_NOW);
+        if (   pth_trace_find(&pth_WQ, r->tr_thread) == NULL
+            || pth_time_cmp(&now, &limit) >= 0)
+            break;
+        pth_sched_waitlimit = &limit;
+        pth_sched_eventmanager(FALSE /* wait */);
+        pth_sched_waitlimit = NULL;
+    }
+    pth_debug2("pth_trace_pick: run diverged from the trace at record %lu",
+               pth_trace_next);
+    pth_trace_mode   = PTH_TRACE_OFF;
+    pth_trace_result = PTH_TRACE_DIVERGED;
+    return NULL;
+}
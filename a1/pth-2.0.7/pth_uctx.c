@@ -37,6 +37,20 @@ struct pth_uctx_st {
     size_t      uc_stack_len; /* size of stack area */
     int         uc_mctx_set;  /* whether uc_mctx is set */
     pth_mctx_t  uc_mctx;      /* saved underlying machine context */
+    pth_uctx_pool_t uc_pool;  /* pool the context belongs to (or NULL) */
+    pth_uctx_t  uc_next;      /* next free context of the pool */
+    int         uc_parked;    /* whether the pool trampoline waits for a start function */
+    void      (*uc_func)(void *); /* start function of a pooled context */
+    void       *uc_arg;       /* argument of the start function */
+    pth_uctx_t  uc_after;     /* successor of a pooled context */
+};
+
+/* user-space context pool structure */
+struct pth_uctx_pool_st {
+    pth_uctx_t  up_free;      /* list of free contexts */
+    int         up_total;     /* number of contexts of the pool */
+    int         up_out;       /* number of contexts handed out */
+    size_t      up_stack;     /* stack size of the contexts */
 };
 
 /* create user-space context structure */
@@ -60,6 +74,12 @@ pth_uctx_create(
     uctx->uc_stack_len = 0;
     uctx->uc_mctx_set  = FALSE;
     memset((void *)&uctx->uc_mctx, 0, sizeof(pth_mctx_t));
+    uctx->uc_pool      = NULL;
+    uctx->uc_next      = NULL;
+    uctx->uc_parked    = FALSE;
+    uctx->uc_func      = NULL;
+    uctx->uc_arg       = NULL;
+    uctx->uc_after     = NULL;
 
     /* pass result to caller */
     *puctx = uctx;
@@ -121,6 +141,8 @@ pth_uctx_make(
     /* argument sanity checking */
     if (uctx == NULL || start_func == NULL || sk_size < 16*1024)
         return pth_error(FALSE, EINVAL);
+    if (uctx->uc_pool != NULL)
+        return pth_error(FALSE, EPERM);
 
     /* configure run-time stack */
     if (sk_addr == NULL) {
@@ -162,6 +184,212 @@ pth_uctx_make(
     return TRUE;
 }
 
+/*
+ * A pool of user-space contexts keeps the contexts together with their
+ * (pre-faulted) stacks and a trampoline which never returns: it calls
+ * the start function, and when that returns it parks itself by saving
+ * its machine context just before it switches to the successor. Making
+ * a pooled context therefore only stores the next start function; the
+ * machine context setup (which with some methods costs a number of
+ * system calls) and the trampoline step are done just once per context,
+ * unless a context was given back while its start function was still
+ * running.
+ */
+
+/* trampoline function for pooled contexts */
+static void pth_uctx_pool_trampoline(void)
+{
+    volatile pth_uctx_t uctx;
+    pth_uctx_t uctx_after;
+
+    /* move context information from global to local storage */
+    uctx = pth_uctx_trampoline_ctx.uctx_this;
+
+    /* switch back to parent */
+    pth_mctx_switch(&(uctx->uc_mctx), pth_uctx_trampoline_ctx.mctx_parent);
+
+    for (;;) {
+        /* enter start function */
+        uctx->uc_parked = FALSE;
+        (*uctx->uc_func)(uctx->uc_arg);
+        uctx->uc_parked = TRUE;
+
+        /* park and switch to successor user-space context */
+        if ((uctx_after = uctx->uc_after) == NULL)
+            break;
+        uctx->uc_mctx_set = FALSE;
+        pth_mctx_switch(&(uctx->uc_mctx), &(uctx_after->uc_mctx));
+    }
+
+    /* terminate process (the only reasonable thing to do here) */
+    exit(0);
+
+    /* NOTREACHED */
+    return;
+}
+
+/* set up the machine context of a pooled context and park it */
+static int pth_uctx_pool_boot(pth_uctx_t uctx)
+{
+    pth_mctx_t mctx_parent;
+
+    if (!pth_mctx_set(&uctx->uc_mctx, pth_uctx_pool_trampoline,
+                      uctx->uc_stack_ptr, uctx->uc_stack_ptr+uctx->uc_stack_len))
+        return pth_error(FALSE, errno);
+    pth_uctx_trampoline_ctx.mctx_parent = &mctx_parent;
+    pth_uctx_trampoline_ctx.uctx_this   = uctx;
+    pth_mctx_switch(&mctx_parent, &(uctx->uc_mctx));
+    uctx->uc_parked   = TRUE;
+    uctx->uc_mctx_set = FALSE;
+    return TRUE;
+}
+
+/* create a context of a pool (with its stack pre-faulted) */
+static pth_uctx_t pth_uctx_pool_new(pth_uctx_pool_t pool)
+{
+    pth_uctx_t uctx;
+    size_t pagesize, i;
+
+    if (!pth_uctx_create(&uctx))
+        return NULL;
+    if ((uctx->uc_stack_ptr = (char *)malloc(pool->up_stack)) == NULL) {
+        free(uctx);
+        return pth_error((pth_uctx_t)NULL, ENOMEM);
+    }
+    uctx->uc_stack_own = TRUE;
+    uctx->uc_stack_len = pool->up_stack;
+    pagesize = (size_t)getpagesize();
+    for (i = 0; i < uctx->uc_stack_len; i += pagesize)
+        uctx->uc_stack_ptr[i] = NUL;
+    if (!pth_uctx_pool_boot(uctx)) {
+        free(uctx->uc_stack_ptr);
+        free(uctx);
+        return NULL;
+    }
+    uctx->uc_pool = pool;
+    pool->up_total++;
+    return uctx;
+}
+
+/* create user-space context pool */
+int
+pth_uctx_pool_create(
+    pth_uctx_pool_t *ppool,
+    int n, size_t sk_size)
+{
+    pth_uctx_pool_t pool;
+    pth_uctx_t uctx;
+    int i;
+
+    /* argument sanity checking */
+    if (ppool == NULL || n < 0 || sk_size < 16*1024)
+        return pth_error(FALSE, EINVAL);
+
+    /* allocate the pool structure */
+    if ((pool = (pth_uctx_pool_t)malloc(sizeof(struct pth_uctx_pool_st))) == NULL)
+        return pth_error(FALSE, errno);
+    pool->up_free  = NULL;
+    pool->up_total = 0;
+    pool->up_out   = 0;
+    pool->up_stack = sk_size;
+
+    /* create the contexts in advance */
+    for (i = 0; i < n; i++) {
+        if ((uctx = pth_uctx_pool_new(pool)) == NULL) {
+            pth_shield { pth_uctx_pool_destroy(pool); }
+            return FALSE;
+        }
+        uctx->uc_next = pool->up_free;
+        pool->up_free = uctx;
+    }
+
+    /* pass result to caller */
+    *ppool = pool;
+
+    return TRUE;
+}
+
+/* make setup of a user-space context from a pool */
+int
+pth_uctx_pool_make(
+    pth_uctx_pool_t pool,
+    pth_uctx_t *puctx,
+    void (*start_func)(void *), void *start_arg,
+    pth_uctx_t uctx_after)
+{
+    pth_uctx_t uctx;
+
+    /* argument sanity checking */
+    if (pool == NULL || puctx == NULL || start_func == NULL)
+        return pth_error(FALSE, EINVAL);
+
+    /* take a free context or create another one */
+    if ((uctx = pool->up_free) != NULL)
+        pool->up_free = uctx->uc_next;
+    else if ((uctx = pth_uctx_pool_new(pool)) == NULL)
+        return FALSE;
+    uctx->uc_next = NULL;
+    pool->up_out++;
+
+    /* arm the parked trampoline with the start function */
+    uctx->uc_func     = start_func;
+    uctx->uc_arg      = start_arg;
+    uctx->uc_after    = uctx_after;
+    uctx->uc_mctx_set = TRUE;
+
+    /* pass result to caller */
+    *puctx = uctx;
+
+    return TRUE;
+}
+
+/* give a pooled user-space context back to its pool */
+static int pth_uctx_pool_put(pth_uctx_t uctx)
+{
+    pth_uctx_pool_t pool = uctx->uc_pool;
+
+    /* a context given back while it was running has to start over */
+    if (!uctx->uc_parked && !pth_uctx_pool_boot(uctx)) {
+        free(uctx->uc_stack_ptr);
+        free(uctx);
+        pool->up_total--;
+        pool->up_out--;
+        return FALSE;
+    }
+    uctx->uc_func     = NULL;
+    uctx->uc_arg      = NULL;
+    uctx->uc_after    = NULL;
+    uctx->uc_mctx_set = FALSE;
+    uctx->uc_next     = pool->up_free;
+    pool->up_free     = uctx;
+    pool->up_out--;
+    return TRUE;
+}
+
+/* destroy user-space context pool */
+int
+pth_uctx_pool_destroy(
+    pth_uctx_pool_t pool)
+{
+    pth_uctx_t uctx;
+
+    /* argument sanity checking */
+    if (pool == NULL)
+        return pth_error(FALSE, EINVAL);
+    if (pool->up_out > 0)
+        return pth_error(FALSE, EBUSY);
+
+    /* deallocate the contexts and the pool structure */
+    while ((uctx = pool->up_free) != NULL) {
+        pool->up_free = uctx->uc_next;
+        free(uctx->uc_stack_ptr);
+        free(uctx);
+    }
+    free(pool);
+
+    return TRUE;
+}
+
 /* switch from current to other user-space context */
 int
 pth_uctx_switch(
@@ -190,6 +418,14 @@ pth_uctx_destroy(
     if (uctx == NULL)
         return pth_error(FALSE, EINVAL);
 
+    /* pooled contexts are recycled instead (but only once: a context
+       already back in its pool has no start function) */
+    if (uctx->uc_pool != NULL) {
+        if (uctx->uc_func == NULL)
+            return pth_error(FALSE, EINVAL);
+        return pth_uctx_pool_put(uctx);
+    }
+
     /* deallocate dynamically allocated stack */
     if (uctx->uc_stack_own && uctx->uc_stack_ptr != NULL)
         free(uctx->uc_stack_ptr);
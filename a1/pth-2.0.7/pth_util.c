@@ -33,6 +33,39 @@
         ((a) > (b) ? (b) : (a))
 #endif
 
+/* number of bits in a bitmap word */
+#if cpp
+#define PTH_UTIL_WORDBITS (sizeof(unsigned long) * 8)
+#endif
+
+/* index of the lowest set bit in a (non-zero) bitmap word */
+intern int pth_util_ctz(unsigned long w)
+{
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+    return __builtin_ctzl(w);
+#else
+    int n;
+
+    for (n = 0; (w & 1) == 0; n++)
+        w >>= 1;
+    return n;
+#endif
+}
+
+/* index of the highest set bit in a (non-zero) bitmap word */
+intern int pth_util_fls(unsigned long w)
+{
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+    return (int)PTH_UTIL_WORDBITS - 1 - __builtin_clzl(w);
+#else
+    int n;
+
+    for (n = -1; w != 0; n++)
+        w >>= 1;
+    return n;
+#endif
+}
+
 /* delete a pending signal */
 static void pth_util_sigdelete_sighandler(int _sig)
 {
@@ -91,94 +124,30 @@ intern char *pth_util_cpystrn(char *dst, const char *src, size_t dst_size)
     return d;
 }
 
-/* check whether a file-descriptor is valid */
+/* check whether a file-descriptor is valid
+   (descriptors are polled, so there is no FD_SETSIZE ceiling) */
 intern int pth_util_fd_valid(int fd)
 {
-    if (fd < 0 || fd >= FD_SETSIZE)
+    if (fd < 0)
         return FALSE;
     if (fcntl(fd, F_GETFL) == -1 && errno == EBADF)
         return FALSE;
     return TRUE;
 }
 
-/* merge input fd set into output fds */
-intern void pth_util_fds_merge(int nfd,
-                               fd_set *ifds1, fd_set *ofds1,
-                               fd_set *ifds2, fd_set *ofds2,
-                               fd_set *ifds3, fd_set *ofds3)
-{
-    register int s;
-
-    for (s = 0; s < nfd; s++) {
-        if (ifds1 != NULL)
-            if (FD_ISSET(s, ifds1))
-                FD_SET(s, ofds1);
-        if (ifds2 != NULL)
-            if (FD_ISSET(s, ifds2))
-                FD_SET(s, ofds2);
-        if (ifds3 != NULL)
-            if (FD_ISSET(s, ifds3))
-                FD_SET(s, ofds3);
-    }
-    return;
-}
-
-/* test whether fds in the input fd sets occurred in the output fds */
-intern int pth_util_fds_test(int nfd,
-                             fd_set *ifds1, fd_set *ofds1,
-                             fd_set *ifds2, fd_set *ofds2,
-                             fd_set *ifds3, fd_set *ofds3)
+/* poll a single file-descriptor without blocking; returns 1 if it is
+   ready for the given poll(2) events, 0 if not and -1 on error */
+intern int pth_util_fd_poll(int fd, short events)
 {
-    register int s;
-
-    for (s = 0; s < nfd; s++) {
-        if (ifds1 != NULL)
-            if (FD_ISSET(s, ifds1) && FD_ISSET(s, ofds1))
-                return TRUE;
-        if (ifds2 != NULL)
-            if (FD_ISSET(s, ifds2) && FD_ISSET(s, ofds2))
-                return TRUE;
-        if (ifds3 != NULL)
-            if (FD_ISSET(s, ifds3) && FD_ISSET(s, ofds3))
-                return TRUE;
-    }
-    return FALSE;
-}
-
-/*
- * clear fds in input fd sets if not occurred in output fd sets and return
- * number of remaining input fds. This number uses BSD select(2) semantics: a
- * fd in two set counts twice!
- */
-intern int pth_util_fds_select(int nfd,
-                               fd_set *ifds1, fd_set *ofds1,
-                               fd_set *ifds2, fd_set *ofds2,
-                               fd_set *ifds3, fd_set *ofds3)
-{
-    register int s;
-    register int n;
-
-    n = 0;
-    for (s = 0; s < nfd; s++) {
-        if (ifds1 != NULL && FD_ISSET(s, ifds1)) {
-            if (!FD_ISSET(s, ofds1))
-               FD_CLR(s, ifds1);
-            else
-               n++;
-        }
-        if (ifds2 != NULL && FD_ISSET(s, ifds2)) {
-            if (!FD_ISSET(s, ofds2))
-                FD_CLR(s, ifds2);
-            else
-                n++;
-        }
-        if (ifds3 != NULL && FD_ISSET(s, ifds3)) {
-            if (!FD_ISSET(s, ofds3))
-                FD_CLR(s, ifds3);
-            else
-                n++;
-        }
-    }
+    struct pollfd pfd;
+    int n;
+
+    pfd.fd      = fd;
+    pfd.events  = events;
+    pfd.revents = 0;
+    while ((n = pth_sc(poll)(&pfd, 1, 0)) < 0 && errno == EINTR) ;
+    if (n > 0 && (pfd.revents & POLLNVAL))
+        return pth_error(-1, EBADF);
     return n;
 }
 
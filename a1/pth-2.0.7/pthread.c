@@ -1023,6 +1023,114 @@ int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
     return OK;
 }
 
+/*
+**  SEMAPHORE ROUTINES
+*/
+
+int __pthread_sem_init(sem_t *sem, int pshared, unsigned int value)
+{
+    pth_sem_t *s;
+
+    pthread_initialize();
+    if (sem == NULL)
+        return pth_error(-1, EINVAL);
+    if (pshared)
+        /* not supported */
+        return pth_error(-1, ENOSYS);
+    if ((s = (pth_sem_t *)malloc(sizeof(pth_sem_t))) == NULL)
+        return -1;
+    if (!pth_sem_init(s, value)) {
+        free(s);
+        return -1;
+    }
+    (*sem) = (sem_t)s;
+    return OK;
+}
+
+int __pthread_sem_destroy(sem_t *sem)
+{
+    if (sem == NULL || *sem == NULL)
+        return pth_error(-1, EINVAL);
+    if (((pth_sem_t *)(*sem))->sm_head != NULL)
+        return pth_error(-1, EBUSY);
+    free(*sem);
+    *sem = NULL;
+    return OK;
+}
+
+int __pthread_sem_wait(sem_t *sem)
+{
+    if (sem == NULL || *sem == NULL)
+        return pth_error(-1, EINVAL);
+    if (!pth_sem_acquire((pth_sem_t *)(*sem), FALSE, NULL))
+        return -1;
+    return OK;
+}
+
+int __pthread_sem_trywait(sem_t *sem)
+{
+    if (sem == NULL || *sem == NULL)
+        return pth_error(-1, EINVAL);
+    if (!pth_sem_acquire((pth_sem_t *)(*sem), TRUE, NULL)) {
+        if (errno == EBUSY)
+            return pth_error(-1, EAGAIN);
+        return -1;
+    }
+    return OK;
+}
+
+int __pthread_sem_timedwait(sem_t *sem, const struct timespec *abstime)
+{
+    pth_event_t ev;
+    static pth_key_t ev_key = PTH_KEY_INIT;
+
+    if (sem == NULL || *sem == NULL || abstime == NULL)
+        return pth_error(-1, EINVAL);
+#ifdef __amigaos__
+    if (abstime->ts_sec < 0 || abstime->ts_nsec < 0 || abstime->ts_nsec >= 1000000000)
+#else
+    if (abstime->tv_sec < 0 || abstime->tv_nsec < 0 || abstime->tv_nsec >= 1000000000)
+#endif
+        return pth_error(-1, EINVAL);
+    ev = pth_event(PTH_EVENT_TIME|PTH_MODE_STATIC, &ev_key,
+#ifdef __amigaos__
+                   pth_time(abstime->ts_sec, (abstime->ts_nsec)/1000)
+#else
+                   pth_time(abstime->tv_sec, (abstime->tv_nsec)/1000)
+#endif
+    );
+    if (!pth_sem_acquire((pth_sem_t *)(*sem), FALSE, ev)) {
+        if (pth_event_status(ev) == PTH_STATUS_OCCURRED)
+            return pth_error(-1, ETIMEDOUT);
+        return -1;
+    }
+    return OK;
+}
+
+int __pthread_sem_post(sem_t *sem)
+{
+    if (sem == NULL || *sem == NULL)
+        return pth_error(-1, EINVAL);
+    if (!pth_sem_release((pth_sem_t *)(*sem), 1)) {
+        if (errno == ERANGE)
+            return pth_error(-1, EOVERFLOW);
+        return -1;
+    }
+    return OK;
+}
+
+int __pthread_sem_getvalue(sem_t *sem, int *value)
+{
+    unsigned int v;
+
+    if (sem == NULL || *sem == NULL || value == NULL)
+        return pth_error(-1, EINVAL);
+    if (!pth_sem_value((pth_sem_t *)(*sem), &v))
+        return -1;
+    *value = (v > INT_MAX ? INT_MAX : (int)v);
+    return OK;
+}
+
 /*
 **  POSIX 1003.1j
 */
@@ -29,4 +29,7 @@
 ssize_t pth_readline(int, void *, size_t);
 ssize_t pth_readline_ev(int, void *, size_t, pth_event_t);
 
+int test_native_spawn(void *(*)(void *), void *);
+int test_native_join(void);
+
 #endif /* _TEST_COMMON_H_ */
@@ -29,64 +29,294 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
 #include <time.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <signal.h>
 #include <netdb.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
 #include "pth.h"
 
-#include "test_common.h"
-
 /*
- * The HTTP request handler
+ * Usage: test_httpd [-q] [-s size] [-f file] <port>
+ *
+ * The server speaks HTTP/1.1 with persistent connections: every
+ * connection is served by its own thread, which reads whatever the
+ * client sent into a buffer, answers all complete (possibly pipelined)
+ * requests found there and writes the collected responses with a single
+ * write. The body of "GET /" is a constant text (or -s bytes), "GET
+ * /<n>" returns n bytes and "GET /file" the file given with -f, sent
+ * with sendfile(2) where available. "HEAD" works likewise. HTTP/1.0
+ * clients and "Connection: close" get the connection closed after the
+ * response. With -q neither connections nor the ticker are reported,
+ * as needed when it serves as the counterpart of bench_http.
  */
 
-#define MAXREQLINE 1024
+#define MAXREQUEST  8192             /* request buffer (and max request size) */
+#define MAXRESPONSE 16384            /* collected responses before a write    */
+#define MAXBODY     (64*1024*1024)   /* largest body of "GET /<n>"           */
+#define CHUNK       65536            /* pattern the bodies are written from   */
 
-static void *handler(void *_arg)
+static int verbose = TRUE;
+static long body_size = -1;          /* size of "GET /" (-1: the text below)  */
+static char *body_file = NULL;
+static char body_chunk[CHUNK];
+
+static const char body_text[] =
+    "Just a trivial test for GNU Pth\n"
+    "to show that it's serving data.\r\n";
+
+/* the state of a connection */
+struct conn {
+    int    fd;
+    char   in[MAXREQUEST];           /* received, but not yet handled          */
+    int    in_len;
+    char   out[MAXRESPONSE];         /* response headers (and small bodies)    */
+    int    out_len;
+};
+
+/* write the collected responses */
+static int flush_out(struct conn *c)
 {
-    int fd = (int)((long)_arg);
-    char caLine[MAXREQLINE];
-    char str[1024];
-    int n;
+    if (c->out_len > 0 && pth_write(c->fd, c->out, c->out_len) != c->out_len)
+        return FALSE;
+    c->out_len = 0;
+    return TRUE;
+}
 
-    /* read request */
-    for (;;) {
-        n = pth_readline(fd, caLine, MAXREQLINE);
-        if (n < 0) {
-            fprintf(stderr, "read error: errno=%d\n", errno);
-            close(fd);
-            return NULL;
+/* write a body of the given size from the pattern */
+static int write_body(struct conn *c, long size)
+{
+    long n;
+
+    if (size <= (long)sizeof(c->out) - c->out_len) {
+        /* small bodies go out together with the headers */
+        memcpy(c->out + c->out_len, body_chunk, size);
+        c->out_len += size;
+        return TRUE;
+    }
+    if (!flush_out(c))
+        return FALSE;
+    for (; size > 0; size -= n) {
+        n = (size < CHUNK ? size : CHUNK);
+        if (pth_write(c->fd, body_chunk, n) != n)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* send a file, without copying it through user space where possible */
+static int write_file(struct conn *c, int file, off_t size)
+{
+    off_t off = 0;
+    char buf[CHUNK];
+    ssize_t n;
+
+    if (!flush_out(c))
+        return FALSE;
+#ifdef __linux__
+    {
+        pth_event_t ev;
+        int mode;
+
+        mode = pth_fdmode(c->fd, PTH_FDMODE_NONBLOCK);
+        ev = pth_event(PTH_EVENT_FD|PTH_UNTIL_FD_WRITEABLE, c->fd);
+        while (off < size) {
+            if ((n = sendfile(c->fd, file, &off, (size_t)(size - off))) > 0)
+                continue;
+            if (n == -1 && errno == EAGAIN) {
+                pth_wait(ev);
+                continue;
+            }
+            if (n == -1 && errno == EINTR)
+                continue;
+            break; /* unsupported or failed: copy the rest */
         }
-        if (n == 0)
-            break;
-        if (n == 1 && caLine[0] == '\n')
-            break;
-        caLine[n-1] = NUL;
+        pth_event_free(ev, PTH_FREE_THIS);
+        pth_fdmode(c->fd, mode);
+    }
+#endif
+    while (off < size) {
+        if ((n = pth_pread(file, buf, sizeof(buf), off)) <= 0)
+            return FALSE;
+        if (pth_write(c->fd, buf, n) != n)
+            return FALSE;
+        off += n;
+    }
+    return TRUE;
+}
+
+/* append a response header */
+static int add_header(struct conn *c, int status, const char *reason,
+                      long length, int keepalive)
+{
+    int n;
+
+    if (c->out_len > (int)sizeof(c->out) - 256 && !flush_out(c))
+        return FALSE;
+    n = sprintf(c->out + c->out_len,
+                "HTTP/1.1 %d %s\r\n"
+                "Server: test_httpd/%x\r\n"
+                "Content-Type: text/plain\r\n"
+                "Content-Length: %ld\r\n"
+                "%s"
+                "\r\n",
+                status, reason, PTH_VERSION, length,
+                keepalive ? "" : "Connection: close\r\n");
+    c->out_len += n;
+    return TRUE;
+}
+
+/* whether a header line has the given name and a value containing a token */
+static int header_has(const char *line, const char *name, const char *token)
+{
+    size_t n = strlen(name), t = strlen(token);
+    const char *cp;
+
+    if (strncasecmp(line, name, n) != 0 || line[n] != ':')
+        return FALSE;
+    for (cp = line + n + 1; *cp != NUL && *cp != '\r' && *cp != '\n'; cp++)
+        if (strncasecmp(cp, token, t) == 0)
+            return TRUE;
+    return FALSE;
+}
+
+/* handle one complete request; returns whether to keep the connection */
+static int handle(struct conn *c, char *req)
+{
+    char method[16], path[256], version[16];
+    char *line;
+    int keepalive, head;
+    long size;
+    struct stat st;
+    int file;
+
+    if (sscanf(req, "%15s %255s %15s", method, path, version) != 3) {
+        add_header(c, 400, "Bad Request", 0, FALSE);
+        return FALSE;
+    }
+    keepalive = (strcmp(version, "HTTP/1.0") != 0);
+    for (line = strchr(req, '\n'); line != NULL; line = strchr(line, '\n')) {
+        line++;
+        if (header_has(line, "Connection", "close"))
+            keepalive = FALSE;
+        else if (header_has(line, "Connection", "keep-alive"))
+            keepalive = TRUE;
+    }
+    head = (strcmp(method, "HEAD") == 0);
+    if (!head && strcmp(method, "GET") != 0) {
+        add_header(c, 501, "Not Implemented", 0, FALSE);
+        return FALSE;
     }
 
     /* simulate a little bit of processing ;) */
     pth_yield(NULL);
 
-    /* generate response */
-    sprintf(str, "HTTP/1.0 200 Ok\r\n"
-                 "Server: test_httpd/%x\r\n"
-                 "Connection: close\r\n"
-                 "Content-type: text/plain\r\n"
-                 "\r\n"
-                 "Just a trivial test for GNU Pth\n"
-                 "to show that it's serving data.\r\n", PTH_VERSION);
-    pth_write(fd, str, strlen(str));
+    if (strcmp(path, "/") == 0 && body_size < 0) {
+        if (!add_header(c, 200, "Ok", (long)strlen(body_text), keepalive))
+            return FALSE;
+        if (!head) {
+            if (c->out_len + strlen(body_text) > sizeof(c->out) && !flush_out(c))
+                return FALSE;
+            memcpy(c->out + c->out_len, body_text, strlen(body_text));
+            c->out_len += strlen(body_text);
+        }
+    }
+    else if (strcmp(path, "/file") == 0) {
+        if (body_file == NULL || (file = open(body_file, O_RDONLY)) == -1) {
+            add_header(c, 404, "Not Found", 0, keepalive);
+            return keepalive;
+        }
+        if (fstat(file, &st) == -1
+            || !add_header(c, 200, "Ok", (long)st.st_size, keepalive)
+            || (!head && !write_file(c, file, st.st_size))) {
+            close(file);
+            return FALSE;
+        }
+        close(file);
+    }
+    else {
+        size = (strcmp(path, "/") == 0 ? body_size : atol(path + 1));
+        if (size < 0 || size > MAXBODY) {
+            add_header(c, 404, "Not Found", 0, keepalive);
+            return keepalive;
+        }
+        if (!add_header(c, 200, "Ok", size, keepalive)
+            || (!head && !write_body(c, size)))
+            return FALSE;
+    }
+    return keepalive;
+}
+
+/*
+ * The HTTP connection handler
+ */
+
+static void *handler(void *_arg)
+{
+    struct conn *c;
+    char *end, *req;
+    int keepalive;
+    ssize_t n;
+    int one = 1;
+
+    if ((c = (struct conn *)malloc(sizeof(struct conn))) == NULL) {
+        close((int)((long)_arg));
+        return NULL;
+    }
+    c->fd = (int)((long)_arg);
+    c->in_len = 0;
+    c->out_len = 0;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, (void *)&one, sizeof(one));
+
+    keepalive = TRUE;
+    while (keepalive) {
+        /* read whatever arrived */
+        if (c->in_len == (int)sizeof(c->in) - 1) {
+            add_header(c, 413, "Request Entity Too Large", 0, FALSE);
+            break;
+        }
+        n = pth_read(c->fd, c->in + c->in_len, sizeof(c->in) - 1 - c->in_len);
+        if (n <= 0) {
+            if (n < 0 && verbose)
+                fprintf(stderr, "read error: errno=%d\n", errno);
+            break;
+        }
+        c->in_len += n;
+        c->in[c->in_len] = NUL;
+
+        /* answer all complete requests */
+        req = c->in;
+        while (keepalive && (end = strstr(req, "\r\n\r\n")) != NULL) {
+            *end = NUL;
+            keepalive = handle(c, req);
+            req = end + 4;
+        }
+        c->in_len -= (req - c->in);
+        memmove(c->in, req, c->in_len + 1);
+
+        /* and write their responses at once */
+        if (!flush_out(c))
+            break;
+    }
+    flush_out(c);
 
     /* close connection and let thread die */
-    fprintf(stderr, "connection shutdown (fd: %d)\n", fd);
-    close(fd);
+    if (verbose)
+        fprintf(stderr, "connection shutdown (fd: %d)\n", c->fd);
+    close(c->fd);
+    free(c);
     return NULL;
 }
 
@@ -131,7 +361,8 @@ static void myexit(int sig)
     close(s);
     pth_attr_destroy(attr);
     pth_kill();
-    fprintf(stderr, "**Break\n");
+    if (verbose)
+        fprintf(stderr, "**Break\n");
     exit(0);
 }
 
@@ -143,41 +374,61 @@ int main(int argc, char *argv[])
     socklen_t peer_len;
     int sr;
     int port;
-
-    /* initialize scheduler */
-    pth_init();
-    signal(SIGPIPE, SIG_IGN);
-    signal(SIGINT,  myexit);
-    signal(SIGTERM, myexit);
+    int one = 1;
+    int ch;
 
     /* argument line parsing */
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
+    while ((ch = getopt(argc, argv, "qs:f:")) != -1) {
+        switch (ch) {
+            case 'q': verbose   = FALSE;        break;
+            case 's': body_size = atol(optarg); break;
+            case 'f': body_file = optarg;       break;
+            default:
+                fprintf(stderr, "Usage: %s [-q] [-s size] [-f file] <port>\n", argv[0]);
+                exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-q] [-s size] [-f file] <port>\n", argv[0]);
         exit(1);
     }
-    port = atoi(argv[1]);
+    port = atoi(argv[optind]);
     if (port <= 0 || port >= 65535) {
         fprintf(stderr, "Illegal port: %d\n", port);
         exit(1);
     }
+    if (body_size > MAXBODY) {
+        fprintf(stderr, "Illegal body size: %ld\n", body_size);
+        exit(1);
+    }
+    memset(body_chunk, 'x', sizeof(body_chunk));
 
-    fprintf(stderr, "This is TEST_HTTPD, a Pth test using socket I/O.\n");
-    fprintf(stderr, "\n");
-    fprintf(stderr, "Multiple connections are accepted on the specified port.\n");
-    fprintf(stderr, "For each connection a separate thread is spawned which\n");
-    fprintf(stderr, "reads a HTTP request the socket and writes back a constant\n");
-    fprintf(stderr, "(and useless) HTTP response to the socket.\n");
-    fprintf(stderr, "Additionally a useless ticker thread awakens every 5s.\n");
-    fprintf(stderr, "Watch the average scheduler load the ticker displays.\n");
-    fprintf(stderr, "Hit CTRL-C for stopping this test.\n");
-    fprintf(stderr, "\n");
+    /* initialize scheduler */
+    pth_init();
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT,  myexit);
+    signal(SIGTERM, myexit);
 
-    /* run a just for fun ticker thread */
     attr = pth_attr_new();
-    pth_attr_set(attr, PTH_ATTR_NAME, "ticker");
-    pth_attr_set(attr, PTH_ATTR_JOINABLE, FALSE);
-    pth_attr_set(attr, PTH_ATTR_STACK_SIZE, 64*1024);
-    pth_spawn(attr, ticker, NULL);
+    if (verbose) {
+        fprintf(stderr, "This is TEST_HTTPD, a Pth test using socket I/O.\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "Multiple connections are accepted on the specified port.\n");
+        fprintf(stderr, "For each connection a separate thread is spawned which\n");
+        fprintf(stderr, "reads HTTP requests from the socket and writes back constant\n");
+        fprintf(stderr, "(and useless) HTTP responses to the socket, as long as the\n");
+        fprintf(stderr, "client keeps the connection open.\n");
+        fprintf(stderr, "Additionally a useless ticker thread awakens every 5s.\n");
+        fprintf(stderr, "Watch the average scheduler load the ticker displays.\n");
+        fprintf(stderr, "Hit CTRL-C for stopping this test.\n");
+        fprintf(stderr, "\n");
+
+        /* run a just for fun ticker thread */
+        pth_attr_set(attr, PTH_ATTR_NAME, "ticker");
+        pth_attr_set(attr, PTH_ATTR_JOINABLE, FALSE);
+        pth_attr_set(attr, PTH_ATTR_STACK_SIZE, 64*1024);
+        pth_spawn(attr, ticker, NULL);
+    }
 
     /* create TCP socket */
     if ((pe = getprotobyname("tcp")) == NULL) {
@@ -188,25 +439,30 @@ int main(int argc, char *argv[])
         perror("socket");
         exit(1);
     }
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (void *)&one, sizeof(one));
 
     /* bind socket to port */
     sar.sin_family      = AF_INET;
     sar.sin_addr.s_addr = INADDR_ANY;
     sar.sin_port        = htons(port);
     if (bind(s, (struct sockaddr *)&sar, sizeof(struct sockaddr_in)) == -1) {
-        perror("socket");
+        perror("bind");
         exit(1);
     }
 
-    /* start listening on the socket with a queue of 10 */
+    /* start listening on the socket */
     if (listen(s, REQ_MAX) == -1) {
         perror("listen");
         exit(1);
     }
 
-    /* finally loop for requests */
+    /* finally loop for requests (the connection state lives on the
+       heap, so the handlers get along with a small stack) */
     pth_attr_set(attr, PTH_ATTR_NAME, "handler");
-    fprintf(stderr, "listening on port %d (max %d simultaneous connections)\n", port, REQ_MAX);
+    pth_attr_set(attr, PTH_ATTR_JOINABLE, FALSE);
+    pth_attr_set(attr, PTH_ATTR_STACK_SIZE, 64*1024 + CHUNK);
+    if (verbose)
+        fprintf(stderr, "listening on port %d (max %d simultaneous connections)\n", port, REQ_MAX);
     for (;;) {
         /* accept next connection */
         peer_len = sizeof(peer_addr);
@@ -217,14 +473,15 @@ int main(int argc, char *argv[])
         }
         if (pth_ctrl(PTH_CTRL_GETTHREADS) >= REQ_MAX) {
             fprintf(stderr, "currently no more connections acceptable\n");
+            close(sr);
             continue;
         }
-        fprintf(stderr, "connection established (fd: %d, ip: %s, port: %d)\n",
-                sr, inet_ntoa(peer_addr.sin_addr), ntohs(peer_addr.sin_port));
+        if (verbose)
+            fprintf(stderr, "connection established (fd: %d, ip: %s, port: %d)\n",
+                    sr, inet_ntoa(peer_addr.sin_addr), ntohs(peer_addr.sin_port));
 
         /* spawn new handling thread for connection */
         pth_spawn(attr, handler, (void *)((long)sr));
     }
 
 }
-
@@ -0,0 +1,48 @@
+/*
+**  GNU Pth - The GNU Portable Threads
+**  Copyright (c) 1999-2006 Ralf S. Engelschall <rse@engelschall.com>
+**
+**  This file is part of GNU Pth, a non-preemptive thread scheduling
+**  library which can be found at http://www.gnu.org/software/pth/.
+**
+**  This library is free software; you can redistribute it and/or
+**  modify it under the terms of the GNU Lesser General Public
+**  License as published by the Free Software Foundation; either
+**  version 2.1 of the License, or (at your option) any later version.
+**
+**  This library is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**  Lesser General Public License for more details.
+**
+**  You should have received a copy of the GNU Lesser General Public
+**  License along with this library; if not, write to the Free Software
+**  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+**  USA, or contact Ralf S. Engelschall <rse@engelschall.com>.
+**
+**  test_native.c: Pth test program stuff running in native threads
+*/
+                             /* ``Any sufficiently advanced technology
+                                  is indistinguishable from magic.''
+                                           -- Arthur C. Clarke */
+/*
+ * This is compiled without the build directory in the include path
+ * (see Makefile.in), so <pthread.h> is the one of the system and not
+ * the one of the Pth Pthread library, which may sit in the same place.
+ */
+#include <stddef.h>
+#include <pthread.h>
+
+static pthread_t test_native_thread;
+
+/* run a function in a native thread of the process */
+int test_native_spawn(void *(*func)(void *), void *arg)
+{
+    return (pthread_create(&test_native_thread, NULL, func, arg) == 0);
+}
+
+/* wait for the native thread to terminate */
+int test_native_join(void)
+{
+    return (pthread_join(test_native_thread, NULL) == 0);
+}
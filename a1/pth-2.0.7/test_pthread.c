@@ -58,10 +58,22 @@ static void *child(void *_arg)
     return _arg;
 }
 
+static void *poster(void *_arg)
+{
+    sem_t *sem = (sem_t *)_arg;
+
+    fprintf(stderr, "poster: posting\n");
+    if (sem_post(sem) != 0)
+        die("sem_post");
+    return NULL;
+}
+
 int main(int argc, char *argv[])
 {
     pthread_attr_t thread_attr;
     pthread_t thread[4];
+    sem_t sem;
+    int value;
     char *rc;
 
     fprintf(stderr, "main: init\n");
@@ -105,6 +117,33 @@ int main(int argc, char *argv[])
         die("pthread_join");
     fprintf(stderr, "main: joined thread: %s\n", rc);
 
+    fprintf(stderr, "main: initializing semaphore\n");
+    if (sem_init(&sem, 0, 1) != 0)
+        die("sem_init");
+    if (sem_getvalue(&sem, &value) != 0 || value != 1)
+        die("sem_getvalue");
+    fprintf(stderr, "main: taking the unit without waiting\n");
+    if (sem_trywait(&sem) != 0)
+        die("sem_trywait");
+    if (sem_trywait(&sem) != -1 || errno != EAGAIN)
+        die("sem_trywait on empty semaphore");
+    if (sem_getvalue(&sem, &value) != 0 || value != 0)
+        die("sem_getvalue");
+    fprintf(stderr, "main: waiting for a unit posted by another thread\n");
+    if (pthread_create(&thread[0], NULL, poster, (void *)&sem) != 0)
+        die("pthread_create");
+    if (sem_wait(&sem) != 0)
+        die("sem_wait");
+    if (pthread_join(thread[0], NULL) != 0)
+        die("pthread_join");
+    if (sem_post(&sem) != 0 || sem_getvalue(&sem, &value) != 0 || value != 1)
+        die("sem_post");
+    fprintf(stderr, "main: destroying semaphore\n");
+    if (sem_destroy(&sem) != 0)
+        die("sem_destroy");
+    if (sem_trywait(&sem) != -1 || errno != EINVAL)
+        die("sem_trywait on destroyed semaphore");
+
     fprintf(stderr, "main: exit\n");
     return 0;
 }
@@ -32,9 +32,16 @@
 #include <ctype.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include "pth.h"
 
+#include "test_common.h"
+
 #define FAILED_IF(expr) \
      if (expr) { \
          fprintf(stderr, "*** ERROR, TEST FAILED:\n*** errno=%d\n\n", errno); \
@@ -55,6 +62,360 @@ static void *t1_func(void *arg)
     return (void *)val;
 }
 
+static int key_destroyed = 0;
+
+static void key_destructor(void *data)
+{
+    key_destroyed += (int)(long)data;
+}
+
+static void *t3_func(void *arg)
+{
+    pth_key_t *keys = (pth_key_t *)arg;
+    int i;
+
+    for (i = 0; i < PTH_KEY_MAX * 2; i += 3)
+        FAILED_IF(!pth_key_setdata(keys[i], (void *)1))
+    FAILED_IF(pth_key_getdata(keys[PTH_KEY_MAX * 2 - 1]) != NULL)
+    FAILED_IF(pth_key_getdata(keys[PTH_KEY_MAX * 2 - 2]) != (void *)1)
+    return NULL;
+}
+
+static int prio_runs = 0;
+
+static void *t4_func(void *arg)
+{
+    int i;
+
+    (void)arg;
+    for (i = 0; i < 10; i++) {
+        prio_runs++;
+        pth_yield(NULL);
+    }
+    return NULL;
+}
+
+static int edf_fair_runs = 0;
+static int edf_fair_seen = -1;
+
+static void *t5_func(void *arg)
+{
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        if ((long)arg)
+            edf_fair_runs++;
+        pth_yield(NULL);
+    }
+    if (!(long)arg)
+        edf_fair_seen = edf_fair_runs;
+    return NULL;
+}
+
+static void *t6_func(void *arg)
+{
+    int fd = (int)(long)arg;
+
+    pth_nap(pth_time(0, 20000));
+    FAILED_IF(pth_write(fd, "x", 1) != 1)
+    return NULL;
+}
+
+static pth_rwlock_t rw_lock = PTH_RWLOCK_INIT;
+static int rw_writer_done = FALSE;
+static int rw_active = 0;
+static int rw_active_max = 0;
+
+static void *rw_writer(void *arg)
+{
+    (void)arg;
+    FAILED_IF(!pth_rwlock_acquire(&rw_lock, PTH_RWLOCK_RW, FALSE, NULL))
+    FAILED_IF(rw_active != 0)
+    pth_yield(NULL);
+    rw_writer_done = TRUE;
+    FAILED_IF(!pth_rwlock_release(&rw_lock))
+    return NULL;
+}
+
+/* terminates while holding the lock */
+static void *rw_holder(void *arg)
+{
+    FAILED_IF(!pth_rwlock_acquire(&rw_lock, (int)(long)arg, FALSE, NULL))
+    if ((int)(long)arg == PTH_RWLOCK_RD)
+        FAILED_IF(!pth_rwlock_acquire(&rw_lock, PTH_RWLOCK_RD, FALSE, NULL))
+    return NULL;
+}
+
+static void *rw_reader(void *arg)
+{
+    int i;
+
+    (void)arg;
+    FAILED_IF(!pth_rwlock_acquire(&rw_lock, PTH_RWLOCK_RD, FALSE, NULL))
+    FAILED_IF(!rw_writer_done)
+    if (++rw_active > rw_active_max)
+        rw_active_max = rw_active;
+    for (i = 0; i < 100 && rw_active < 3; i++)
+        pth_yield(NULL);
+    rw_active--;
+    FAILED_IF(!pth_rwlock_release(&rw_lock))
+    return NULL;
+}
+
+#define INBOX_MSGS 100
+static pth_message_t inbox_msg[INBOX_MSGS];
+static pth_msgport_t inbox_port;
+static pth_t inbox_target;
+
+/* runs in a native thread, outside of the Pth scheduler */
+static void *inbox_poster(void *arg)
+{
+    int i;
+
+    (void)arg;
+    for (i = 0; i < INBOX_MSGS; i++) {
+        inbox_msg[i].m_data = (void *)(long)i;
+        FAILED_IF(!pth_msgport_post(inbox_port, &inbox_msg[i]))
+        if (i % 10 == 0)
+            usleep(1000);
+    }
+    FAILED_IF(!pth_wakeup(inbox_target))
+    return NULL;
+}
+
+static pth_time_t slack_woken[2];
+
+static void *slack_sleeper(void *arg)
+{
+    pth_event_t ev;
+
+    ev = pth_event(PTH_EVENT_TIME, *(pth_time_t *)arg);
+    pth_wait(ev);
+    pth_event_free(ev, PTH_FREE_THIS);
+    gettimeofday(&slack_woken[(pth_time_t *)arg - slack_woken], NULL);
+    return NULL;
+}
+
+static int tickets_stop = FALSE;
+
+static void *tickets_yielder(void *arg)
+{
+    (void)arg;
+    while (!tickets_stop)
+        pth_yield(NULL);
+    return NULL;
+}
+
+static pth_sem_t sync_sem = PTH_SEM_INIT(0);
+static pth_barrier_t sync_barrier = PTH_BARRIER_INIT(4);
+static long sync_order[3];
+static int sync_served = 0;
+
+static void *sem_waiter(void *arg)
+{
+    FAILED_IF(!pth_sem_acquire(&sync_sem, FALSE, NULL))
+    sync_order[sync_served++] = (long)arg;
+    return NULL;
+}
+
+static void *barrier_reacher(void *arg)
+{
+    int rv1, rv2;
+
+    (void)arg;
+    rv1 = pth_barrier_reach(&sync_barrier);
+    rv2 = pth_barrier_reach(&sync_barrier);
+    return (void *)(long)(rv1 == FALSE || rv2 == FALSE ? 0 : rv1);
+}
+
+static int task_rounds[100];
+static int task_runs = 0;
+
+static int task_yielder(pth_task_t task, void *arg)
+{
+    int *left = (int *)arg;
+
+    (void)task;
+    task_runs++;
+    return ((*left)-- > 0 ? PTH_TASK_YIELD : PTH_TASK_DONE);
+}
+
+struct task_echo_st {
+    pth_msgport_t mp;
+    pth_event_t   ev;
+    int           served;
+};
+
+static int task_echo(pth_task_t task, void *arg)
+{
+    struct task_echo_st *te = (struct task_echo_st *)arg;
+    pth_message_t *m;
+
+    while ((m = pth_msgport_get(te->mp)) != NULL) {
+        pth_msgport_reply(m);
+        if (++te->served == 10)
+            return PTH_TASK_DONE;
+    }
+    return pth_task_await(task, te->ev);
+}
+
+static int task_timer(pth_task_t task, void *arg)
+{
+    pth_event_t ev = (pth_event_t)arg;
+
+    if (pth_event_status(ev) == PTH_STATUS_OCCURRED)
+        return PTH_TASK_DONE;
+    return pth_task_await(task, ev);
+}
+
+static int batch_napped = FALSE;
+
+static void *batch_napper(void *arg)
+{
+    (void)arg;
+    pth_nap(pth_time(0, 10000));
+    batch_napped = TRUE;
+    return NULL;
+}
+
+static void *arena_worker(void *arg)
+{
+    char *p[64], *first, *big;
+    unsigned int size;
+    pth_attr_t attr;
+    int i;
+
+    (void)arg;
+    attr = pth_attr_of(pth_self());
+    pth_attr_get(attr, PTH_ATTR_ARENA_SIZE, &size);
+    pth_attr_destroy(attr);
+    if (size != 1024)
+        return (void *)1;
+    for (i = 0; i < 64; i++) {
+        if ((p[i] = (char *)pth_arena_alloc(i + 1)) == NULL)
+            return (void *)2;
+        if (((unsigned long)p[i] % sizeof(double)) != 0)
+            return (void *)3;
+        memset(p[i], i, i + 1);
+    }
+    for (i = 0; i < 64; i++)
+        if (p[i][0] != (char)i || p[i][i] != (char)i)
+            return (void *)4;
+    if ((big = (char *)pth_arena_alloc(4000)) == NULL)
+        return (void *)5;
+    memset(big, 'x', 4000);
+    pth_arena_reset();
+    if ((first = (char *)pth_arena_alloc(1)) != p[0])
+        return (void *)6;
+    /* the rest is released when we terminate */
+    for (i = 0; i < 100; i++)
+        if (pth_arena_alloc(100) == NULL)
+            return (void *)7;
+    return NULL;
+}
+
+static int sigwaiter_got[3];
+
+static void *sigwaiter(void *arg)
+{
+    sigset_t ss;
+    int i;
+
+    (void)arg;
+    sigemptyset(&ss);
+    sigaddset(&ss, SIGUSR1);
+    sigaddset(&ss, SIGUSR2);
+    for (i = 0; i < 3; i++)
+        if (pth_sigwait(&ss, &sigwaiter_got[i]) != 0)
+            break;
+    return NULL;
+}
+
+static pth_uctx_t uctx_main, uctx_pooled[3];
+static int uctx_steps[3];
+
+static void uctx_worker(void *arg)
+{
+    int n = (int)(long)arg;
+
+    uctx_steps[n]++;
+    pth_uctx_switch(uctx_pooled[n], uctx_main);
+    uctx_steps[n]++;
+    return;
+}
+
+static volatile int spinner_stop;
+
+static void *spinner(void *arg)
+{
+    struct timeval tv0, tv;
+
+    (void)arg;
+    while (!spinner_stop) {
+        gettimeofday(&tv0, NULL);
+        do {
+            gettimeofday(&tv, NULL);
+        } while ((tv.tv_sec - tv0.tv_sec) * 1000000 + (tv.tv_usec - tv0.tv_usec) < 1000);
+        pth_yield(NULL);
+    }
+    return NULL;
+}
+
+static struct sockaddr_in admit_addr;
+
+static void *admit_client(void *arg)
+{
+    int *fd = (int *)arg;
+
+    /* the first connection arrives while the spinners overload us */
+    if ((fd[0] = socket(AF_INET, SOCK_STREAM, 0)) == -1
+        || pth_connect(fd[0], (struct sockaddr *)&admit_addr, sizeof(admit_addr)) == -1)
+        return (void *)1;
+    pth_nap(pth_time(0, 100000));
+    spinner_stop = TRUE;
+    pth_nap(pth_time(1, 0));
+    if ((fd[1] = socket(AF_INET, SOCK_STREAM, 0)) == -1
+        || pth_connect(fd[1], (struct sockaddr *)&admit_addr, sizeof(admit_addr)) == -1)
+        return (void *)1;
+    return NULL;
+}
+
+static volatile int affine_stop;
+static volatile long affine_bgruns;
+static pth_msgport_t affine_mp;
+
+static void *affine_bg(void *arg)
+{
+    (void)arg;
+    while (!affine_stop) {
+        affine_bgruns++;
+        pth_yield(NULL);
+    }
+    return NULL;
+}
+
+static void *affine_pong(void *arg)
+{
+    pth_event_t ev;
+    pth_message_t *m;
+    long *direct = (long *)arg;
+
+    ev = pth_event(PTH_EVENT_MSG, affine_mp);
+    for (;;) {
+        while ((m = pth_msgport_get(affine_mp)) == NULL)
+            pth_wait(ev);
+        if (m->m_data == NULL)
+            break;
+        /* no background thread ran since the ping was put */
+        if (*(long *)m->m_data == affine_bgruns)
+            (*direct)++;
+        pth_msgport_reply(m);
+    }
+    pth_msgport_reply(m);
+    pth_event_free(ev, PTH_FREE_THIS);
+    return NULL;
+}
+
 static void *t2_func(void *arg)
 {
     long val;
@@ -109,11 +470,14 @@ int main(int argc, char *argv[])
         pth_attr_t attr;
         pth_t tid;
         void *val;
+        char *name;
         int rc;
 
         fprintf(stderr, "Creating attribute object\n");
         attr = pth_attr_new();
         FAILED_IF(attr == NULL)
+        rc = pth_attr_get(attr, PTH_ATTR_NAME, &name);
+        FAILED_IF(rc == FALSE || strcmp(name, "unknown") != 0)
         rc = pth_attr_set(attr, PTH_ATTR_NAME, "test1");
         FAILED_IF(rc == FALSE)
         rc = pth_attr_set(attr, PTH_ATTR_PRIO, PTH_PRIO_MAX);
@@ -132,13 +496,19 @@ int main(int argc, char *argv[])
 
     fprintf(stderr, "\n=== TESTING NESTED THREAD OPERATION ===\n\n");
     {
+        pth_attr_t attr;
         pth_t tid;
         void *val;
+        char *name;
         int rc;
 
         fprintf(stderr, "Spawning thread 1\n");
         tid = pth_spawn(PTH_ATTR_DEFAULT, t2_func, (void *)(1));
         FAILED_IF(tid == NULL)
+        attr = pth_attr_of(tid);
+        rc = pth_attr_get(attr, PTH_ATTR_NAME, &name);
+        FAILED_IF(rc == FALSE || strncmp(name, "main.child@", 11) != 0)
+        pth_attr_destroy(attr);
 
         rc = pth_join(tid, &val);
         fprintf(stderr, "Joined thread 1\n");
@@ -146,6 +516,817 @@ int main(int argc, char *argv[])
         FAILED_IF(val != (void *)(1*2*3*4*5*6*7*8*9))
     }
 
+    fprintf(stderr, "\n=== TESTING THREAD SPECIFIC DATA ===\n\n");
+    {
+        static pth_key_t keys[PTH_KEY_MAX * 2];
+        pth_t tid;
+        int i, rc;
+
+        fprintf(stderr, "Creating %d keys\n", PTH_KEY_MAX * 2);
+        for (i = 0; i < PTH_KEY_MAX * 2; i++) {
+            rc = pth_key_create(&keys[i], (i % 2 == 0 ? key_destructor : NULL));
+            FAILED_IF(rc == FALSE)
+        }
+        fprintf(stderr, "Running destructors on thread termination\n");
+        tid = pth_spawn(PTH_ATTR_DEFAULT, t3_func, keys);
+        FAILED_IF(tid == NULL)
+        rc = pth_join(tid, NULL);
+        FAILED_IF(rc == FALSE)
+        /* every 3rd key is set, every 2nd one has a destructor */
+        FAILED_IF(key_destroyed != (PTH_KEY_MAX * 2 + 5) / 6)
+        for (i = 0; i < PTH_KEY_MAX * 2; i++)
+            FAILED_IF(!pth_key_delete(keys[i]))
+    }
+
+    fprintf(stderr, "\n=== TESTING EVENT ALLOCATION ===\n\n");
+    {
+        pth_event_stats_t st1, st2;
+        pth_event_storage_t evs_fd, evs_tm;
+        pth_event_t ev;
+        int i, rc, fds[2];
+
+        fprintf(stderr, "Recycling dynamic events through the free-list\n");
+        ev = pth_event(PTH_EVENT_TIME, pth_timeout(0, 1));
+        FAILED_IF(ev == NULL)
+        pth_event_free(ev, PTH_FREE_ALL);
+        pth_ctrl(PTH_CTRL_GETEVENTSTATS, &st1);
+        for (i = 0; i < 100; i++) {
+            ev = pth_event(PTH_EVENT_TIME, pth_timeout(0, 1));
+            FAILED_IF(ev == NULL)
+            pth_event_free(ev, PTH_FREE_ALL);
+        }
+        pth_ctrl(PTH_CTRL_GETEVENTSTATS, &st2);
+        FAILED_IF(st2.ev_malloc != st1.ev_malloc)
+        FAILED_IF(st2.ev_reused - st1.ev_reused != 100)
+
+        fprintf(stderr, "Waiting on caller-provided events\n");
+        rc = pipe(fds);
+        FAILED_IF(rc == -1)
+        ev = pth_event_init(&evs_fd, PTH_EVENT_FD|PTH_UNTIL_FD_READABLE, fds[0]);
+        FAILED_IF(ev == NULL)
+        FAILED_IF(pth_event_init(&evs_tm, PTH_EVENT_TIME|PTH_MODE_CHAIN,
+                                 ev, pth_timeout(0, 10000)) == NULL)
+        pth_ctrl(PTH_CTRL_GETEVENTSTATS, &st1);
+        rc = pth_wait(ev);
+        FAILED_IF(rc != 1)
+        FAILED_IF(pth_event_status((pth_event_t)&evs_fd) != PTH_STATUS_PENDING)
+        FAILED_IF(pth_event_status((pth_event_t)&evs_tm) != PTH_STATUS_OCCURRED)
+        pth_event_free(ev, PTH_FREE_ALL);
+        pth_ctrl(PTH_CTRL_GETEVENTSTATS, &st2);
+        FAILED_IF(st2.ev_malloc != st1.ev_malloc)
+        FAILED_IF(st2.ev_pooled != st1.ev_pooled)
+        FAILED_IF(pth_event_init(&evs_fd, PTH_EVENT_TIME|PTH_MODE_STATIC,
+                                 NULL, pth_timeout(0, 1)) != NULL)
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    fprintf(stderr, "\n=== TESTING PRIORITY SCHEDULING ===\n\n");
+    {
+        pth_attr_t attr;
+        pth_t tids[100];
+        int i, rc;
+
+        fprintf(stderr, "Switching to the priority policy\n");
+        FAILED_IF(pth_ctrl(PTH_CTRL_SCHEDPOLICY, PTH_SCHED_PRIORITY) != PTH_SCHED_LOTTERY)
+        FAILED_IF(pth_ctrl(PTH_CTRL_SCHEDPOLICY, -1) != PTH_SCHED_PRIORITY)
+        FAILED_IF(pth_ctrl(PTH_CTRL_SCHEDPOLICY, 42) != -1)
+        fprintf(stderr, "Running 100 threads of mixed priorities\n");
+        attr = pth_attr_new();
+        for (i = 0; i < 100; i++) {
+            pth_attr_set(attr, PTH_ATTR_PRIO, PTH_PRIO_MIN + i % (PTH_PRIO_MAX - PTH_PRIO_MIN + 1));
+            tids[i] = pth_spawn(attr, t4_func, NULL);
+            FAILED_IF(tids[i] == NULL)
+        }
+        pth_attr_destroy(attr);
+        for (i = 0; i < 100; i++) {
+            rc = pth_join(tids[i], NULL);
+            FAILED_IF(rc == FALSE)
+        }
+        FAILED_IF(prio_runs != 1000)
+        FAILED_IF(pth_ctrl(PTH_CTRL_SCHEDPOLICY, PTH_SCHED_LOTTERY) != PTH_SCHED_PRIORITY)
+    }
+
+    fprintf(stderr, "\n=== TESTING DEADLINE SCHEDULING ===\n\n");
+    {
+        pth_attr_t attr;
+        pth_time_t tv;
+        pth_t tids[11];
+        int i, rc;
+
+        fprintf(stderr, "Running a deadline thread among 10 fair-share threads\n");
+        attr = pth_attr_new();
+        for (i = 0; i < 10; i++) {
+            tids[i] = pth_spawn(attr, t5_func, (void *)1);
+            FAILED_IF(tids[i] == NULL)
+        }
+        FAILED_IF(pth_attr_set(attr, PTH_ATTR_DEADLINE, pth_time(0, 1000000)) != FALSE
+                  || errno != EINVAL)
+        FAILED_IF(pth_attr_set(attr, PTH_ATTR_BUDGET, pth_time(0, 1000000)) != FALSE
+                  || errno != EINVAL)
+        FAILED_IF(pth_attr_set(attr, PTH_ATTR_DEADLINE, pth_time(1, 0)) == FALSE)
+        tids[10] = pth_spawn(attr, t5_func, (void *)0);
+        FAILED_IF(tids[10] == NULL)
+        pth_attr_destroy(attr);
+        attr = pth_attr_of(tids[10]);
+        FAILED_IF(pth_attr_get(attr, PTH_ATTR_BUDGET, &tv) == FALSE)
+        FAILED_IF(tv.tv_sec != 0 || tv.tv_usec != 500000)
+        FAILED_IF(pth_attr_set(attr, PTH_ATTR_DEADLINE, pth_time(2, 0)) != FALSE)
+        pth_attr_destroy(attr);
+        for (i = 0; i < 11; i++) {
+            rc = pth_join(tids[i], NULL);
+            FAILED_IF(rc == FALSE)
+        }
+        /* the deadline thread always ran first, so the others could at
+           most take one turn each between its own turns */
+        FAILED_IF(edf_fair_seen < 0 || edf_fair_seen > 10)
+    }
+
+    fprintf(stderr, "\n=== TESTING POLL ===\n\n");
+    {
+        struct pollfd pfd[3];
+        struct rlimit rl;
+        pth_t tid;
+        char c;
+        int fds[2], rfd, wfd, rc;
+
+        rc = pipe(fds);
+        FAILED_IF(rc == -1)
+        rfd = fds[0];
+        wfd = fds[1];
+        /* move the pipe beyond FD_SETSIZE if the limits allow it */
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < FD_SETSIZE + 16
+            && rl.rlim_max >= FD_SETSIZE + 16) {
+            rl.rlim_cur = FD_SETSIZE + 16;
+            setrlimit(RLIMIT_NOFILE, &rl);
+        }
+        if (dup2(fds[0], FD_SETSIZE + 4) != -1 && dup2(fds[1], FD_SETSIZE + 5) != -1) {
+            close(fds[0]);
+            close(fds[1]);
+            rfd = FD_SETSIZE + 4;
+            wfd = FD_SETSIZE + 5;
+        }
+        fprintf(stderr, "Polling descriptor %d until it gets readable\n", rfd);
+        pfd[0].fd = rfd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = -1;
+        pfd[1].events = POLLIN;
+        pfd[2].fd = wfd;
+        pfd[2].events = 0;
+        tid = pth_spawn(PTH_ATTR_DEFAULT, t6_func, (void *)(long)wfd);
+        FAILED_IF(tid == NULL)
+        rc = pth_poll(pfd, 3, 5000);
+        FAILED_IF(rc != 1)
+        FAILED_IF(!(pfd[0].revents & POLLIN))
+        FAILED_IF(pfd[1].revents != 0 || pfd[2].revents != 0)
+        FAILED_IF(pth_read(rfd, &c, 1) != 1 || c != 'x')
+        FAILED_IF(!pth_join(tid, NULL))
+        fprintf(stderr, "Polling with a timeout\n");
+        rc = pth_poll(pfd, 1, 10);
+        FAILED_IF(rc != 0 || pfd[0].revents != 0)
+        close(rfd);
+        close(wfd);
+    }
+
+    fprintf(stderr, "\n=== TESTING READ-WRITE LOCKS ===\n\n");
+    {
+        pth_t tids[4];
+        void *val;
+        int i;
+
+        fprintf(stderr, "Queueing a writer behind a reader\n");
+        FAILED_IF(!pth_rwlock_acquire(&rw_lock, PTH_RWLOCK_RD, FALSE, NULL))
+        tids[0] = pth_spawn(PTH_ATTR_DEFAULT, rw_writer, NULL);
+        FAILED_IF(tids[0] == NULL)
+        while (rw_lock.rw_writers_waiting == 0)
+            pth_yield(NULL);
+        fprintf(stderr, "Re-entering a held read lock past the waiting writer\n");
+        FAILED_IF(!pth_rwlock_acquire(&rw_lock, PTH_RWLOCK_RD, FALSE, NULL))
+        FAILED_IF(rw_lock.rw_readers != 2)
+        FAILED_IF(pth_rwlock_acquire(&rw_lock, PTH_RWLOCK_RW, TRUE, NULL) || errno != EDEADLK)
+        FAILED_IF(!pth_rwlock_release(&rw_lock))
+        fprintf(stderr, "Readers do not pass the waiting writer\n");
+        for (i = 1; i < 4; i++) {
+            tids[i] = pth_spawn(PTH_ATTR_DEFAULT, rw_reader, NULL);
+            FAILED_IF(tids[i] == NULL)
+        }
+        while (pth_ctrl(PTH_CTRL_GETTHREADS_NEW|PTH_CTRL_GETTHREADS_READY) > 0)
+            pth_yield(NULL);
+        FAILED_IF(!pth_rwlock_release(&rw_lock))
+        fprintf(stderr, "Admitting the queued readers in one batch\n");
+        for (i = 0; i < 4; i++)
+            FAILED_IF(!pth_join(tids[i], NULL))
+        FAILED_IF(rw_active_max != 3)
+        FAILED_IF(rw_lock.rw_readers != 0 || rw_lock.rw_writer != NULL || rw_lock.rw_head != NULL)
+        FAILED_IF(pth_rwlock_release(&rw_lock) || errno != EDEADLK)
+        fprintf(stderr, "Re-entering a held read-write lock\n");
+        FAILED_IF(!pth_rwlock_acquire(&rw_lock, PTH_RWLOCK_RW, FALSE, NULL))
+        FAILED_IF(!pth_rwlock_acquire(&rw_lock, PTH_RWLOCK_RW, FALSE, NULL))
+        FAILED_IF(pth_rwlock_acquire(&rw_lock, PTH_RWLOCK_RD, FALSE, NULL) || errno != EDEADLK)
+        FAILED_IF(!pth_rwlock_release(&rw_lock))
+        FAILED_IF(rw_lock.rw_writer != pth_self())
+        FAILED_IF(!pth_rwlock_release(&rw_lock))
+        FAILED_IF(rw_lock.rw_writer != NULL)
+        fprintf(stderr, "Releasing the locks of terminated threads\n");
+        tids[0] = pth_spawn(PTH_ATTR_DEFAULT, rw_holder, (void *)(long)PTH_RWLOCK_RW);
+        FAILED_IF(tids[0] == NULL)
+        FAILED_IF(!pth_join(tids[0], NULL))
+        FAILED_IF(!pth_rwlock_acquire(&rw_lock, PTH_RWLOCK_RD, TRUE, NULL))
+        tids[0] = pth_spawn(PTH_ATTR_DEFAULT, rw_holder, (void *)(long)PTH_RWLOCK_RD);
+        FAILED_IF(tids[0] == NULL)
+        FAILED_IF(!pth_join(tids[0], NULL))
+        FAILED_IF(rw_lock.rw_readers != 1)
+        FAILED_IF(!pth_rwlock_release(&rw_lock))
+        FAILED_IF(!pth_rwlock_acquire(&rw_lock, PTH_RWLOCK_RW, TRUE, NULL))
+        tids[0] = pth_spawn(PTH_ATTR_DEFAULT, rw_holder, (void *)(long)PTH_RWLOCK_RD);
+        FAILED_IF(tids[0] == NULL)
+        while (rw_lock.rw_head == NULL)
+            pth_yield(NULL);
+        fprintf(stderr, "Releasing the lock handed to a cancelled waiter\n");
+        FAILED_IF(!pth_rwlock_release(&rw_lock))
+        FAILED_IF(!pth_cancel(tids[0]))
+        FAILED_IF(!pth_join(tids[0], &val) || val != PTH_CANCELED)
+        FAILED_IF(rw_lock.rw_readers != 0 || rw_lock.rw_writer != NULL || rw_lock.rw_head != NULL)
+    }
+
+    fprintf(stderr, "\n=== TESTING CROSS-THREAD INBOX ===\n\n");
+    {
+        pth_message_t *m;
+        pth_event_t ev, evt;
+        long i;
+
+        fprintf(stderr, "Receiving messages posted by a native thread\n");
+        inbox_port = pth_msgport_create("inbox");
+        FAILED_IF(inbox_port == NULL)
+        inbox_target = pth_self();
+        FAILED_IF(!test_native_spawn(inbox_poster, NULL))
+        ev = pth_event(PTH_EVENT_MSG, inbox_port);
+        evt = pth_event(PTH_EVENT_TIME, pth_timeout(5, 0));
+        pth_event_concat(ev, evt, NULL);
+        for (i = 0; i < INBOX_MSGS; ) {
+            FAILED_IF(pth_wait(ev) < 1 || pth_event_status(evt) == PTH_STATUS_OCCURRED)
+            while ((m = pth_msgport_get(inbox_port)) != NULL)
+                FAILED_IF((long)m->m_data != i++)
+        }
+        pth_event_free(ev, PTH_FREE_ALL);
+        fprintf(stderr, "Waking up from a native thread\n");
+        ev = pth_event(PTH_EVENT_WAKEUP);
+        evt = pth_event(PTH_EVENT_TIME, pth_timeout(5, 0));
+        pth_event_concat(ev, evt, NULL);
+        pth_wait(ev);
+        FAILED_IF(pth_event_status(ev) != PTH_STATUS_OCCURRED)
+        FAILED_IF(!test_native_join())
+        pth_event_free(ev, PTH_FREE_ALL);
+        fprintf(stderr, "A wakeup is consumed by its event\n");
+        ev = pth_event(PTH_EVENT_WAKEUP);
+        evt = pth_event(PTH_EVENT_TIME, pth_timeout(0, 20000));
+        pth_event_concat(ev, evt, NULL);
+        pth_wait(ev);
+        FAILED_IF(pth_event_status(ev) == PTH_STATUS_OCCURRED)
+        FAILED_IF(!pth_wakeup(pth_self()))
+        pth_wait(ev);
+        FAILED_IF(pth_event_status(ev) != PTH_STATUS_OCCURRED)
+        pth_event_free(ev, PTH_FREE_ALL);
+        pth_msgport_destroy(inbox_port);
+    }
+
+    fprintf(stderr, "\n=== TESTING TIMER SLACK ===\n\n");
+    {
+        pth_attr_t attr;
+        pth_time_t tv, start;
+        pth_t tids[2];
+        long d;
+        int i;
+
+        fprintf(stderr, "Setting the default and per-thread timer slack\n");
+        FAILED_IF(pth_ctrl(PTH_CTRL_TIMERSLACK, 100000L) != 0)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TIMERSLACK, -1L) != 100000)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TIMERSLACK, -2L) != -1 || errno != EINVAL)
+        attr = pth_attr_new();
+        FAILED_IF(pth_attr_get(attr, PTH_ATTR_TIMER_SLACK, &tv) == FALSE)
+        FAILED_IF(tv.tv_sec != 0 || tv.tv_usec != 100000)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TIMERSLACK, 0L) != 100000)
+        FAILED_IF(pth_attr_set(attr, PTH_ATTR_TIMER_SLACK, pth_time(-1, 0)) != FALSE)
+        FAILED_IF(pth_attr_set(attr, PTH_ATTR_TIMER_SLACK, pth_time(0, 1000000)) != FALSE
+                  || errno != EINVAL)
+        FAILED_IF(pth_attr_get(attr, PTH_ATTR_TIMER_SLACK, &tv) == FALSE)
+        FAILED_IF(tv.tv_sec != 0 || tv.tv_usec != 100000)
+        fprintf(stderr, "Coalescing timers 20ms apart into one wakeup\n");
+        gettimeofday(&start, NULL);
+        slack_woken[0] = pth_timeout(0, 10000);
+        slack_woken[1] = pth_timeout(0, 30000);
+        for (i = 0; i < 2; i++) {
+            tids[i] = pth_spawn(attr, slack_sleeper, &slack_woken[i]);
+            FAILED_IF(tids[i] == NULL)
+        }
+        pth_attr_destroy(attr);
+        for (i = 0; i < 2; i++)
+            FAILED_IF(!pth_join(tids[i], NULL))
+        d = (slack_woken[1].tv_sec - slack_woken[0].tv_sec) * 1000000
+            + (slack_woken[1].tv_usec - slack_woken[0].tv_usec);
+        FAILED_IF(d < -5000 || d > 5000)
+        d = (slack_woken[0].tv_sec - start.tv_sec) * 1000000
+            + (slack_woken[0].tv_usec - start.tv_usec);
+        FAILED_IF(d < 30000)
+    }
+
+    fprintf(stderr, "\n=== TESTING SCHEDULER CLOCK ===\n\n");
+    {
+        pth_attr_t attr;
+        pth_time_t tv, spawned;
+        long src;
+
+        fprintf(stderr, "Selecting the clock source\n");
+        FAILED_IF(pth_ctrl(PTH_CTRL_CLOCKSOURCE, -1) != PTH_CLOCK_MONOTONIC)
+        FAILED_IF(pth_ctrl(PTH_CTRL_CLOCKSOURCE, 42) != -1 || errno != EINVAL)
+        FAILED_IF(pth_ctrl(PTH_CTRL_CLOCKSOURCE, PTH_CLOCK_TIMEOFDAY) != -1 || errno != EINVAL)
+        src = pth_ctrl(PTH_CTRL_CLOCKSOURCE, PTH_CLOCK_COARSE);
+        FAILED_IF(src == -1 && errno != ENOSYS)
+        FAILED_IF(src != -1 && pth_ctrl(PTH_CTRL_CLOCKSOURCE, PTH_CLOCK_MONOTONIC) != PTH_CLOCK_COARSE)
+        pth_yield(NULL);
+        fprintf(stderr, "Thread times are reported as times of day\n");
+        attr = pth_attr_of(pth_self());
+        FAILED_IF(pth_attr_get(attr, PTH_ATTR_TIME_SPAWN, &spawned) == FALSE)
+        FAILED_IF(pth_attr_get(attr, PTH_ATTR_TIME_LAST, &tv) == FALSE)
+        pth_attr_destroy(attr);
+        FAILED_IF(spawned.tv_sec > tv.tv_sec + 1)
+        gettimeofday(&tv, NULL);
+        FAILED_IF(spawned.tv_sec > tv.tv_sec || spawned.tv_sec < tv.tv_sec - 600)
+    }
+
+    fprintf(stderr, "\n=== TESTING LOTTERY TICKETS ===\n\n");
+    {
+        pth_attr_t attr;
+        pth_t tids[2];
+        double target[2], actual;
+        int i;
+
+        fprintf(stderr, "Tuning the ticket formula\n");
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETSCALE, -1) != 5)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETEXP, -1) != 2)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETSCALE, 0) != -1 || errno != EINVAL)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETEXP, 4) != -1 || errno != EINVAL)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETSCALE, 100) != 5)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETEXP, 3) != -1 || errno != EINVAL)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETSCALE, 5) != 100)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETEXP, 3) != 2)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETSCALE, 13) != -1 || errno != EINVAL)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETSCALE, 12) != 5)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETEXP, 2) != 3)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETSCALE, 5) != 12)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETSCALE, 10) != 5)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETEXP, 1) != 2)
+        fprintf(stderr, "Target shares follow the priorities\n");
+        attr = pth_attr_new();
+        FAILED_IF(pth_attr_get(attr, PTH_ATTR_CPU_TARGET, &target[0]) == FALSE)
+        FAILED_IF(target[0] != 0.0)
+        FAILED_IF(pth_attr_set(attr, PTH_ATTR_CPU_ACTUAL, 1.0) != FALSE || errno != EPERM)
+        for (i = 0; i < 2; i++) {
+            pth_attr_set(attr, PTH_ATTR_PRIO, i * 2);
+            tids[i] = pth_spawn(attr, tickets_yielder, NULL);
+            FAILED_IF(tids[i] == NULL)
+        }
+        pth_attr_destroy(attr);
+        for (i = 0; i < 20; i++)
+            pth_yield(NULL);
+        for (i = 0; i < 2; i++) {
+            attr = pth_attr_of(tids[i]);
+            FAILED_IF(pth_attr_get(attr, PTH_ATTR_CPU_TARGET, &target[i]) == FALSE)
+            FAILED_IF(pth_attr_get(attr, PTH_ATTR_CPU_ACTUAL, &actual) == FALSE)
+            FAILED_IF(actual < 0.0 || actual > 100.0)
+            pth_attr_destroy(attr);
+        }
+        FAILED_IF(target[0] <= 0.0 || target[1] < target[0] * 3 - 0.01 || target[1] > target[0] * 3 + 0.01)
+        tickets_stop = TRUE;
+        for (i = 0; i < 2; i++)
+            FAILED_IF(!pth_join(tids[i], NULL))
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETSCALE, 5) != 10)
+        FAILED_IF(pth_ctrl(PTH_CTRL_TICKETEXP, 2) != 1)
+    }
+
+    fprintf(stderr, "\n=== TESTING SCHEDULER TRACE ===\n\n");
+    {
+        pth_trace_hdr_t hdr;
+        pth_trace_t rec;
+        int fds[2];
+        int i;
+
+        fprintf(stderr, "Recording into a small ring\n");
+        FAILED_IF(pth_trace_status() != PTH_TRACE_OFF)
+        FAILED_IF(!pth_trace_start(4))
+        FAILED_IF(pth_trace_start(4) || errno != EBUSY)
+        FAILED_IF(pth_trace_status() != PTH_TRACE_RECORDING)
+        for (i = 0; i < 10; i++)
+            pth_yield(NULL);
+        FAILED_IF(!pth_trace_stop())
+        FAILED_IF(pipe(fds) == -1)
+        FAILED_IF(!pth_trace_save(fds[1]))
+        FAILED_IF(read(fds[0], &hdr, sizeof(hdr)) != sizeof(hdr))
+        FAILED_IF(memcmp(hdr.th_magic, "PTHTRACE", 8) != 0)
+        FAILED_IF(hdr.th_count != 4 || hdr.th_lost == 0)
+        for (i = 0; i < 4; i++) {
+            FAILED_IF(read(fds[0], &rec, sizeof(rec)) != sizeof(rec))
+            FAILED_IF(rec.tr_type != PTH_TRACE_DISPATCH || rec.tr_thread != 2)
+            FAILED_IF(rec.tr_draw >= 0 && (unsigned long)rec.tr_draw >= rec.tr_tickets)
+        }
+        fprintf(stderr, "Replaying needs the beginning of the trace\n");
+        FAILED_IF(!pth_trace_save(fds[1]))
+        FAILED_IF(pth_trace_replay(fds[0]) || errno != EINVAL)
+        close(fds[0]);
+        close(fds[1]);
+        FAILED_IF(!pth_trace_start(0))
+        for (i = 0; i < 10; i++)
+            pth_yield(NULL);
+        pth_trace_stop();
+        FAILED_IF(pipe(fds) == -1)
+        FAILED_IF(!pth_trace_save(fds[1]))
+        FAILED_IF(!pth_trace_replay(fds[0]))
+        FAILED_IF(pth_trace_save(fds[1]) || errno != EINVAL)
+        for (i = 0; i < 10; i++)
+            pth_yield(NULL);
+        for (i = 0; i < 10 && pth_trace_status() == PTH_TRACE_REPLAYING; i++)
+            pth_yield(NULL);
+        FAILED_IF(pth_trace_status() != PTH_TRACE_REPLAYED)
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    fprintf(stderr, "\n=== TESTING SEMAPHORES AND BARRIERS ===\n\n");
+    {
+        pth_t tids[3];
+        pth_event_t ev;
+        unsigned int value;
+        void *rv;
+        long i;
+        int headlights;
+
+        fprintf(stderr, "Semaphore units are handed over in FIFO order\n");
+        FAILED_IF(pth_sem_acquire(&sync_sem, TRUE, NULL) || errno != EBUSY)
+        ev = pth_event(PTH_EVENT_TIME, pth_timeout(0, 10000));
+        FAILED_IF(pth_sem_acquire(&sync_sem, FALSE, ev) || errno != EINTR)
+        pth_event_free(ev, PTH_FREE_THIS);
+        for (i = 0; i < 3; i++) {
+            FAILED_IF((tids[i] = pth_spawn(PTH_ATTR_DEFAULT, sem_waiter, (void *)i)) == NULL)
+            while (pth_ctrl(PTH_CTRL_GETTHREADS_WAITING) < i + 1)
+                pth_yield(NULL);
+        }
+        for (i = 0; i < 3; i++) {
+            FAILED_IF(!pth_sem_release(&sync_sem, 1))
+            FAILED_IF(!pth_sem_value(&sync_sem, &value) || value != 0)
+            FAILED_IF(!pth_join(tids[i], NULL))
+            FAILED_IF(sync_served != i + 1 || sync_order[i] != i)
+        }
+        FAILED_IF(!pth_sem_release(&sync_sem, 2))
+        FAILED_IF(!pth_sem_value(&sync_sem, &value) || value != 2)
+        FAILED_IF(!pth_sem_acquire(&sync_sem, TRUE, NULL))
+        FAILED_IF(!pth_sem_acquire(&sync_sem, TRUE, NULL))
+        FAILED_IF(!pth_sem_value(&sync_sem, &value) || value != 0)
+
+        fprintf(stderr, "The last thread at a barrier releases all others\n");
+        for (i = 0; i < 3; i++)
+            FAILED_IF((tids[i] = pth_spawn(PTH_ATTR_DEFAULT, barrier_reacher, NULL)) == NULL)
+        while (pth_ctrl(PTH_CTRL_GETTHREADS_WAITING) < 3)
+            pth_yield(NULL);
+        FAILED_IF(pth_barrier_reach(&sync_barrier) != PTH_BARRIER_TAILLIGHT)
+        FAILED_IF(pth_ctrl(PTH_CTRL_GETTHREADS_READY) < 3)
+        FAILED_IF(pth_barrier_reach(&sync_barrier) == FALSE)
+        headlights = 0;
+        for (i = 0; i < 3; i++) {
+            FAILED_IF(!pth_join(tids[i], &rv))
+            FAILED_IF(rv == NULL)
+            if ((long)rv == PTH_BARRIER_HEADLIGHT)
+                headlights++;
+        }
+        FAILED_IF(headlights != 1)
+    }
+
+    fprintf(stderr, "\n=== TESTING LIGHTWEIGHT TASKS ===\n\n");
+    {
+        struct task_echo_st te;
+        pth_message_t msg;
+        pth_msgport_t reply;
+        pth_event_t ev;
+        struct timeval tv1, tv2;
+        int i;
+
+        fprintf(stderr, "Tasks run until they are done\n");
+        FAILED_IF(pth_task_spawn(NULL, NULL) != NULL || errno != EINVAL)
+        for (i = 0; i < 100; i++) {
+            task_rounds[i] = 3;
+            FAILED_IF(pth_task_spawn(task_yielder, &task_rounds[i]) == NULL)
+        }
+        FAILED_IF(pth_ctrl(PTH_CTRL_GETTASKS) != 100)
+        while (pth_ctrl(PTH_CTRL_GETTASKS) > 0)
+            pth_yield(NULL);
+        FAILED_IF(task_runs != 400)
+
+        fprintf(stderr, "A task serves a message port\n");
+        FAILED_IF((te.mp = pth_msgport_create("task_echo")) == NULL)
+        FAILED_IF((reply = pth_msgport_create("task_reply")) == NULL)
+        te.ev = pth_event(PTH_EVENT_MSG, te.mp);
+        te.served = 0;
+        FAILED_IF(pth_task_spawn(task_echo, &te) == NULL)
+        ev = pth_event(PTH_EVENT_MSG, reply);
+        for (i = 0; i < 10; i++) {
+            msg.m_replyport = reply;
+            FAILED_IF(!pth_msgport_put(te.mp, &msg))
+            FAILED_IF(pth_wait(ev) != 1)
+            FAILED_IF(pth_msgport_get(reply) != &msg)
+        }
+        FAILED_IF(te.served != 10)
+        while (pth_ctrl(PTH_CTRL_GETTASKS) > 0)
+            pth_yield(NULL);
+        pth_event_free(ev, PTH_FREE_THIS);
+        pth_event_free(te.ev, PTH_FREE_THIS);
+        pth_msgport_destroy(reply);
+        pth_msgport_destroy(te.mp);
+
+        fprintf(stderr, "A task sleeps on a timer\n");
+        ev = pth_event(PTH_EVENT_TIME, pth_timeout(0, 20000));
+        gettimeofday(&tv1, NULL);
+        FAILED_IF(pth_task_spawn(task_timer, ev) == NULL)
+        while (pth_ctrl(PTH_CTRL_GETTASKS) > 0)
+            pth_nap(pth_time(0, 1000));
+        gettimeofday(&tv2, NULL);
+        FAILED_IF((tv2.tv_sec - tv1.tv_sec) * 1000000 + (tv2.tv_usec - tv1.tv_usec) < 20000)
+        pth_event_free(ev, PTH_FREE_THIS);
+    }
+
+    fprintf(stderr, "\n=== TESTING EVENT MANAGER BATCHING ===\n\n");
+    {
+        pth_t tid;
+        long i;
+
+        fprintf(stderr, "Setting and querying the batch limits\n");
+        FAILED_IF(pth_ctrl(PTH_CTRL_EVBATCH, -1) != 1)
+        FAILED_IF(pth_ctrl(PTH_CTRL_EVBUDGET, -1L) != 0)
+        FAILED_IF(pth_ctrl(PTH_CTRL_EVBATCH, -2) != -1 || errno != EINVAL)
+        FAILED_IF(pth_ctrl(PTH_CTRL_EVBUDGET, -2L) != -1 || errno != EINVAL)
+        FAILED_IF(pth_ctrl(PTH_CTRL_EVBATCH, 64) != 1)
+        FAILED_IF(pth_ctrl(PTH_CTRL_EVBUDGET, 500L) != 0)
+
+        fprintf(stderr, "Waiting threads still wake up between busy ones\n");
+        FAILED_IF((tid = pth_spawn(PTH_ATTR_DEFAULT, batch_napper, NULL)) == NULL)
+        for (i = 0; i < 10000000 && !batch_napped; i++)
+            pth_yield(NULL);
+        FAILED_IF(!batch_napped)
+        FAILED_IF(!pth_join(tid, NULL))
+
+        fprintf(stderr, "The same with the time budget alone\n");
+        FAILED_IF(pth_ctrl(PTH_CTRL_EVBATCH, 0) != 64)
+        batch_napped = FALSE;
+        FAILED_IF((tid = pth_spawn(PTH_ATTR_DEFAULT, batch_napper, NULL)) == NULL)
+        for (i = 0; i < 10000000 && !batch_napped; i++)
+            pth_yield(NULL);
+        FAILED_IF(!batch_napped)
+        FAILED_IF(!pth_join(tid, NULL))
+        FAILED_IF(pth_ctrl(PTH_CTRL_EVBATCH, 1) != 0)
+        FAILED_IF(pth_ctrl(PTH_CTRL_EVBUDGET, 0L) != 500)
+    }
+
+    fprintf(stderr, "\n=== TESTING BUSY POLLING ===\n\n");
+    {
+        struct timeval tv1, tv2;
+        long usec;
+
+        fprintf(stderr, "Setting and querying the spin time\n");
+        FAILED_IF(pth_ctrl(PTH_CTRL_BUSYPOLL, -1L) != 0)
+        FAILED_IF(pth_ctrl(PTH_CTRL_BUSYPOLL, -2L) != -1 || errno != EINVAL)
+        FAILED_IF(pth_ctrl(PTH_CTRL_BUSYPOLL, 1000001L) != -1 || errno != EINVAL)
+        FAILED_IF(pth_ctrl(PTH_CTRL_BUSYPOLL, 1000000L) != 0)
+
+        fprintf(stderr, "Spinning stops at the next timer\n");
+        gettimeofday(&tv1, NULL);
+        pth_nap(pth_time(0, 20000));
+        gettimeofday(&tv2, NULL);
+        usec = (tv2.tv_sec - tv1.tv_sec) * 1000000 + (tv2.tv_usec - tv1.tv_usec);
+        FAILED_IF(usec < 20000 || usec > 500000)
+        FAILED_IF(pth_ctrl(PTH_CTRL_BUSYPOLL, 0L) != 1000000)
+    }
+
+    fprintf(stderr, "\n=== TESTING ARENA ALLOCATION ===\n\n");
+    {
+        pth_attr_t attr;
+        pth_t tid;
+        unsigned int size;
+        void *rc;
+
+        fprintf(stderr, "Spawning a thread with an arena\n");
+        FAILED_IF((attr = pth_attr_new()) == NULL)
+        FAILED_IF(!pth_attr_get(attr, PTH_ATTR_ARENA_SIZE, &size) || size != 0)
+        FAILED_IF(!pth_attr_set(attr, PTH_ATTR_ARENA_SIZE, 1024))
+        FAILED_IF((tid = pth_spawn(attr, arena_worker, NULL)) == NULL)
+        pth_attr_destroy(attr);
+        FAILED_IF(!pth_join(tid, &rc))
+        FAILED_IF(rc != NULL)
+
+        fprintf(stderr, "Creating an arena on first use\n");
+        attr = pth_attr_of(pth_self());
+        FAILED_IF(!pth_attr_get(attr, PTH_ATTR_ARENA_SIZE, &size) || size != 0)
+        FAILED_IF(pth_arena_alloc(10) == NULL)
+        FAILED_IF(!pth_attr_get(attr, PTH_ATTR_ARENA_SIZE, &size) || size != 8192)
+        FAILED_IF(pth_attr_set(attr, PTH_ATTR_ARENA_SIZE, 4096) || errno != EPERM)
+        pth_attr_destroy(attr);
+        pth_arena_reset();
+    }
+
+    fprintf(stderr, "\n=== TESTING SIGNAL EVENTS ===\n\n");
+    {
+        static const int sigs[3] = { SIGUSR1, SIGUSR2, SIGUSR1 };
+        pth_attr_t attr;
+        pth_t tid;
+        sigset_t ss, oss;
+        int state;
+        int i, j;
+
+        /* we must not take the signals ourself while we raise them */
+        sigemptyset(&ss);
+        sigaddset(&ss, SIGUSR1);
+        sigaddset(&ss, SIGUSR2);
+        pth_sigmask(SIG_BLOCK, &ss, &oss);
+
+        fprintf(stderr, "Waiting for changing signals with pth_sigwait(3)\n");
+        FAILED_IF((tid = pth_spawn(PTH_ATTR_DEFAULT, sigwaiter, NULL)) == NULL)
+        attr = pth_attr_of(tid);
+        for (i = 0; i < 3; i++) {
+            for (j = 0; j < 1000; j++) {
+                pth_attr_get(attr, PTH_ATTR_STATE, &state);
+                if (state == PTH_STATE_WAITING)
+                    break;
+                pth_yield(NULL);
+            }
+            FAILED_IF(state != PTH_STATE_WAITING)
+            kill(getpid(), sigs[i]);
+            for (j = 0; j < 1000 && sigwaiter_got[i] == 0; j++)
+                pth_nap(pth_time(0, 1000));
+            FAILED_IF(sigwaiter_got[i] != sigs[i])
+        }
+        pth_attr_destroy(attr);
+        FAILED_IF(!pth_join(tid, NULL))
+        pth_sigmask(SIG_SETMASK, &oss, NULL);
+    }
+
+    fprintf(stderr, "\n=== TESTING USER-SPACE CONTEXT POOL ===\n\n");
+    {
+        pth_uctx_pool_t pool;
+        int round, i;
+
+        fprintf(stderr, "Running recycled contexts of a pool of two\n");
+        FAILED_IF(!pth_uctx_create(&uctx_main))
+        FAILED_IF(!pth_uctx_pool_create(&pool, 2, 32*1024))
+        for (round = 0; round < 3; round++) {
+            for (i = 0; i < 3; i++) {
+                uctx_steps[i] = 0;
+                FAILED_IF(!pth_uctx_pool_make(pool, &uctx_pooled[i], uctx_worker,
+                                              (void *)(long)i, uctx_main))
+            }
+            FAILED_IF(pth_uctx_pool_destroy(pool) || errno != EBUSY)
+            FAILED_IF(pth_uctx_make(uctx_pooled[0], NULL, 32*1024, NULL,
+                                    uctx_worker, NULL, uctx_main) || errno != EPERM)
+            for (i = 0; i < 3; i++) {
+                FAILED_IF(!pth_uctx_switch(uctx_main, uctx_pooled[i]))
+                FAILED_IF(uctx_steps[i] != 1)
+            }
+            /* the last one is given back while it still runs */
+            for (i = 0; i < 2; i++) {
+                FAILED_IF(!pth_uctx_switch(uctx_main, uctx_pooled[i]))
+                FAILED_IF(uctx_steps[i] != 2)
+            }
+            FAILED_IF(uctx_steps[2] != 1)
+            for (i = 0; i < 3; i++)
+                FAILED_IF(!pth_uctx_destroy(uctx_pooled[i]))
+            FAILED_IF(pth_uctx_destroy(uctx_pooled[0]) || errno != EINVAL)
+        }
+        FAILED_IF(!pth_uctx_pool_destroy(pool))
+        FAILED_IF(!pth_uctx_destroy(uctx_main))
+    }
+
+    fprintf(stderr, "\n=== TESTING LOAD STATISTICS AND ADMISSION CONTROL ===\n\n");
+    {
+        pth_load_stats_t ls;
+        pth_admission_t adm, oadm;
+        pth_event_t ev;
+        pth_t tid[4], ctid;
+        struct timeval tv0, tv;
+        socklen_t len;
+        void *rc;
+        char c;
+        int sl, fd, cfd[2];
+        int i;
+
+        fprintf(stderr, "Measuring the queueing delay of four spinning threads\n");
+        pth_ctrl(PTH_CTRL_GETLOADSTATS, &ls, TRUE);
+        spinner_stop = FALSE;
+        for (i = 0; i < 4; i++)
+            FAILED_IF((tid[i] = pth_spawn(PTH_ATTR_DEFAULT, spinner, NULL)) == NULL)
+        pth_nap(pth_time(0, 500000));
+        FAILED_IF(pth_ctrl(PTH_CTRL_GETLOADSTATS, &ls, FALSE) != 0)
+        fprintf(stderr, "load %.2f (fast %.2f), queueing delay avg %ld p50 %ld p90 %ld "
+                "p99 %ld max %ld usec in %lu dispatches\n", ls.ls_load, ls.ls_load_fast,
+                ls.ls_qdelay_avg, ls.ls_qdelay_p50, ls.ls_qdelay_p90, ls.ls_qdelay_p99,
+                ls.ls_qdelay_max, ls.ls_samples);
+        FAILED_IF(ls.ls_samples == 0 || ls.ls_load_fast < 2.0)
+        FAILED_IF(ls.ls_qdelay_p50 > ls.ls_qdelay_p90 || ls.ls_qdelay_p90 > ls.ls_qdelay_p99
+                  || ls.ls_qdelay_p99 > ls.ls_qdelay_max || ls.ls_qdelay_p90 < 1000)
+
+        fprintf(stderr, "Delaying a connection while overloaded\n");
+        adm.ad_action = 42;
+        adm.ad_load   = 2.0;
+        adm.ad_qdelay = 0;
+        adm.ad_wait   = 100000;
+        FAILED_IF(pth_ctrl(PTH_CTRL_ADMISSION, &adm, NULL) != -1 || errno != EINVAL)
+        adm.ad_action = PTH_ADMIT_DELAY;
+        FAILED_IF(pth_ctrl(PTH_CTRL_ADMISSION, &adm, &oadm) != 0)
+        FAILED_IF(oadm.ad_action != PTH_ADMIT_OFF)
+        FAILED_IF((sl = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+        memset(&admit_addr, 0, sizeof(admit_addr));
+        admit_addr.sin_family = AF_INET;
+        admit_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        admit_addr.sin_port = 0;
+        len = sizeof(admit_addr);
+        FAILED_IF(bind(sl, (struct sockaddr *)&admit_addr, sizeof(admit_addr)) == -1
+                  || listen(sl, 8) == -1
+                  || getsockname(sl, (struct sockaddr *)&admit_addr, &len) == -1)
+        FAILED_IF((cfd[0] = socket(AF_INET, SOCK_STREAM, 0)) == -1
+                  || connect(cfd[0], (struct sockaddr *)&admit_addr, sizeof(admit_addr)) == -1)
+        gettimeofday(&tv0, NULL);
+        FAILED_IF((fd = pth_accept(sl, NULL, NULL)) == -1)
+        gettimeofday(&tv, NULL);
+        FAILED_IF((tv.tv_sec - tv0.tv_sec) * 1000000 + (tv.tv_usec - tv0.tv_usec) < 90000)
+        close(fd);
+        close(cfd[0]);
+
+        fprintf(stderr, "Shedding a connection while overloaded\n");
+        adm.ad_action = PTH_ADMIT_SHED;
+        FAILED_IF(pth_ctrl(PTH_CTRL_ADMISSION, &adm, NULL) != 0)
+        cfd[0] = cfd[1] = -1;
+        FAILED_IF((ctid = pth_spawn(PTH_ATTR_DEFAULT, admit_client, cfd)) == NULL)
+        ev = pth_event(PTH_EVENT_TIME, pth_timeout(5, 0));
+        FAILED_IF((fd = pth_accept_ev(sl, NULL, NULL, ev)) == -1)
+        pth_event_free(ev, PTH_FREE_THIS);
+        FAILED_IF(!pth_join(ctid, &rc) || rc != NULL)
+        FAILED_IF(pth_read(cfd[0], &c, 1) > 0)
+        FAILED_IF(pth_write(cfd[1], "x", 1) != 1 || pth_read(fd, &c, 1) != 1 || c != 'x')
+        close(fd);
+        close(cfd[0]);
+        close(cfd[1]);
+        close(sl);
+        for (i = 0; i < 4; i++)
+            FAILED_IF(!pth_join(tid[i], NULL))
+        adm.ad_action = PTH_ADMIT_OFF;
+        FAILED_IF(pth_ctrl(PTH_CTRL_ADMISSION, &adm, NULL) != 0)
+        FAILED_IF(pth_ctrl(PTH_CTRL_GETLOADSTATS, &ls, TRUE) != 0)
+        FAILED_IF(ls.ls_delayed != 1 || ls.ls_shed < 1)
+    }
+
+    fprintf(stderr, "\n=== TESTING WAKE-AFFINE HANDOFF ===\n\n");
+    {
+        pth_msgport_t rp;
+        pth_message_t msg, *m;
+        pth_event_t ev;
+        pth_t bg[3], tid;
+        long direct[2], stamp;
+        int affine, i;
+
+        FAILED_IF(pth_ctrl(PTH_CTRL_WAKEAFFINE, -2) != -1 || errno != EINVAL)
+        FAILED_IF(pth_ctrl(PTH_CTRL_WAKEAFFINE, -1) != 0)
+        affine_stop = FALSE;
+        for (i = 0; i < 3; i++)
+            FAILED_IF((bg[i] = pth_spawn(PTH_ATTR_DEFAULT, affine_bg, NULL)) == NULL)
+        affine_mp = pth_msgport_create("affine");
+        rp = pth_msgport_create("affine_reply");
+        ev = pth_event(PTH_EVENT_MSG, rp);
+        for (affine = 0; affine < 2; affine++) {
+            pth_ctrl(PTH_CTRL_WAKEAFFINE, affine ? 8 : 0);
+            direct[affine] = 0;
+            FAILED_IF((tid = pth_spawn(PTH_ATTR_DEFAULT, affine_pong, &direct[affine])) == NULL)
+            memset(&msg, 0, sizeof(msg));
+            msg.m_replyport = rp;
+            for (i = 0; i < 1000; i++) {
+                stamp = affine_bgruns;
+                msg.m_data = &stamp;
+                pth_msgport_put(affine_mp, &msg);
+                while ((m = pth_msgport_get(rp)) == NULL)
+                    pth_wait(ev);
+            }
+            msg.m_data = NULL;
+            pth_msgport_put(affine_mp, &msg);
+            while ((m = pth_msgport_get(rp)) == NULL)
+                pth_wait(ev);
+            FAILED_IF(!pth_join(tid, NULL))
+            fprintf(stderr, "wake-affine %s: %ld of 1000 messages handed over directly\n",
+                    affine ? "on" : "off", direct[affine]);
+        }
+        FAILED_IF(pth_ctrl(PTH_CTRL_WAKEAFFINE, 0) != 8)
+        FAILED_IF(direct[1] < 500 || direct[1] <= direct[0])
+        pth_event_free(ev, PTH_FREE_THIS);
+        pth_msgport_destroy(affine_mp);
+        pth_msgport_destroy(rp);
+        affine_stop = TRUE;
+        for (i = 0; i < 3; i++)
+            FAILED_IF(!pth_join(bg[i], NULL))
+    }
+
     pth_kill();
     fprintf(stderr, "\nOK - ALL TESTS SUCCESSFULLY PASSED.\n\n");
     exit(0);
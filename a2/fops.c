@@ -7,6 +7,12 @@
 #include <linux/mm.h>
 #include <linux/mman.h>
 #include <linux/vmalloc.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <asm/atomic.h>
 #include <asm/uaccess.h>
 #include <asm/page.h>
 #include <asm/io.h>
@@ -30,6 +36,10 @@ struct detached_id {
 
 /*
  * struct for holding buffer and associating data
+ * The lock protects the ring indices, the cipher state and the
+ * references of the attached fds; refcount 0 marks a buffer being freed.
+ * The memory itself lives until the last user (the registry entry or an
+ * operation in flight) drops its reference.
  */
 struct dev_buf {
 	int id;
@@ -40,8 +50,15 @@ struct dev_buf {
 	char *buf;
 	int read_ref;
 	int write_ref;
+	int writer_gone;		/* a writer detached and none came back */
 	int enc_last;
 	int dec_last;
+	spinlock_t lock;		/* everything above but id and buf */
+	struct mutex read_mutex;	/* one reader from the ring to the user */
+	atomic_t users;			/* registry entry, operations, mappings */
+	wait_queue_head_t readq;	/* readers waiting for data */
+	wait_queue_head_t writeq;	/* writers waiting for space */
+	struct fasync_struct *async_queue;	/* fds to signal on I/O */
 };
 
 /*
@@ -62,8 +79,11 @@ struct priv_data {
 };
 
 /** function prototype */
-static int freebuf(struct dev_buf_list *);
+static int freebuf(struct dev_buf *);
+static int detach_buf(struct file *, struct dev_buf *);
 static void search_entry(int, struct dev_buf_list **);
+static struct dev_buf *get_buf(int);
+static void put_buf(struct dev_buf *);
 static void substr(const char[], char[], int, int, int);
 static void encrypt(struct dev_buf *, char[], int, int);
 static void decrypt(struct dev_buf *, char[], int, int);
@@ -76,6 +96,13 @@ static struct cdev *mycdev;
 static struct list_head detached_id_head;
 static struct list_head dev_buf_head;
 
+/*
+ * lock of the buffer registry: dev_buf_head, detached_id_head and new_id.
+ * It is only held to look buffers up and to add or remove them, so
+ * operations on different buffers do not serialise on it.
+ */
+static DEFINE_RWLOCK(dev_buf_lock);
+
 /*
  * When the device is opened by a file descriptor,
  * a private data struct will be allocated for the file descriptor.
@@ -113,31 +140,32 @@ static int device_open(struct inode *inode, struct file *filp)
 static int device_release(struct inode *inode, struct file *filp)
 {
 	struct priv_data *private_data;
-	struct dev_buf_list *entry = NULL;
+	struct dev_buf *this_buf;
+	int ret = 0;
 	printk(KERN_INFO "%s: release device\n", DEV_NAME);
 	/* decrease the refcount of the open module */
 	module_put(THIS_MODULE);
 	private_data = (struct priv_data *) filp->private_data;
 	if (private_data != NULL && private_data->buf_id != 0) {
-		search_entry(private_data->buf_id, &entry);
-		if (entry == NULL) {
+		this_buf = get_buf(private_data->buf_id);
+		if (this_buf == NULL) {
 			printk(KERN_INFO "%s: failed to search buffer\n",
 			       DEV_NAME);
-			return -EINVAL;
-		}
-		entry->buf->refcount--;
-		if (entry->buf->refcount == 0)
-			if (freebuf(entry) == -ENOMEM)
-				return -ENOMEM;
-		if (private_data) {
-			printk(KERN_INFO
-			       "%s: free private_data's memory\n",
-			       DEV_NAME);
-			kfree(private_data);
+			ret = -EINVAL;
+		} else {
+			ret = detach_buf(filp, this_buf);
+			put_buf(this_buf);
 		}
 	}
-	printk(KERN_INFO "%s: device closed successfully\n", DEV_NAME);
-	return 0;
+	if (private_data) {
+		printk(KERN_INFO "%s: free private_data's memory\n",
+		       DEV_NAME);
+		kfree(private_data);
+	}
+	if (ret == 0)
+		printk(KERN_INFO "%s: device closed successfully\n",
+		       DEV_NAME);
+	return ret;
 }
 
 /*
@@ -145,88 +173,142 @@ static int device_release(struct inode *inode, struct file *filp)
  * file descriptor. If the fd is not attached to any buffer,
  * an error will be returned. The text read will depends on
  * the mode set in the private data of the fd.
+ * If the buffer is empty the process sleeps until a writer puts data
+ * into it (or fails with -EAGAIN if the fd is non-blocking). Otherwise
+ * up to len bytes of what is available are returned, like a pipe does;
+ * like a pipe, an empty buffer reads as EOF once its writer detached
+ * (but not before a writer attached in the first place).
+ * Only the ring copy and the cipher run under the buffer's lock; the
+ * temporary buffer is allocated and copied to the user outside of it.
+ * The data is only consumed once it reached the user: readers hold the
+ * buffer's read mutex until then (but not while they sleep, and a
+ * non-blocking reader gets -EAGAIN instead of waiting for it), and if
+ * the copy fails the data stays in the ring and the cipher step is
+ * undone.
  */
 static ssize_t device_read(struct file *filp, char *buf, size_t len,
 			   loff_t *off)
 {
-	struct dev_buf_list *entry;
 	struct priv_data *private_data;
 	struct dev_buf *this_buf;
-	unsigned long left;
 	size_t wraplen;
-	int wrap;
-	int err;
 	ssize_t ret;
-	int id;
-	char *temp;
-	printk(KERN_INFO "%s: start reading\n", DEV_NAME);
-	left = 0;
+	int dead, eof;
+	int *last = NULL;
+	int last_before = 0, last_after = 0;
+	char *temp = NULL;
+	pr_debug("%s: start reading\n", DEV_NAME);
 	wraplen = 0;
-	wrap = 0;
-	err = 0;
-	ret = 0;
-	entry = NULL;
 	private_data = (struct priv_data *) filp->private_data;
 
 	if (private_data == NULL || private_data->buf_id == 0)
 		return -ENOTSUP;
-	id = private_data->buf_id;
-	search_entry(id, &entry);
-	if (entry == NULL)
+	this_buf = get_buf(private_data->buf_id);
+	if (this_buf == NULL)
 		return -EINVAL;
-	this_buf = entry->buf;
-	if (len > this_buf->count) {
-		len = this_buf->count;
-		err = 1;
-	}
-	if (this_buf->readoff + len > BUF_SIZE) {
-		wraplen = (len - BUF_SIZE) - this_buf->readoff;
-		len = BUF_SIZE - this_buf->readoff;
-		wrap = 1;
+	if (len == 0) {
+		ret = 0;
+		goto out;
 	}
-	temp = vmalloc(sizeof(char) * (len + wraplen));
+	if (len > BUF_SIZE)
+		len = BUF_SIZE;
+	temp = kmalloc(sizeof(char) * len, GFP_KERNEL);
 	if (!temp) {
 		printk(KERN_WARNING
-		       "%s: temp vmalloc memory allocation failed! \n",
-		       DEV_NAME);
-		return -ENOMEM;
+		       "%s: temp memory allocation failed! \n", DEV_NAME);
+		ret = -ENOMEM;
+		goto out;
 	}
-	if (wrap) {
-		substr(this_buf->buf, temp, this_buf->readoff, 0, len);
-		substr(this_buf->buf, temp, 0, len, wraplen);
+	if (filp->f_flags & O_NONBLOCK) {
+		if (!mutex_trylock(&this_buf->read_mutex)) {
+			ret = -EAGAIN;
+			goto out;
+		}
+	} else if (mutex_lock_interruptible(&this_buf->read_mutex)) {
+		ret = -ERESTARTSYS;
+		goto out;
+	}
+	spin_lock(&this_buf->lock);
+	while (this_buf->count == 0) {
+		dead = this_buf->refcount == 0;
+		eof = this_buf->writer_gone;
+		spin_unlock(&this_buf->lock);
+		if (dead) {
+			ret = -EINVAL;
+			goto unlock;
+		}
+		if (eof) {
+			ret = 0;
+			goto unlock;
+		}
+		if (filp->f_flags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			goto unlock;
+		}
+		mutex_unlock(&this_buf->read_mutex);
+		if (wait_event_interruptible(this_buf->readq,
+					     this_buf->count > 0 ||
+					     this_buf->refcount == 0 ||
+					     this_buf->writer_gone) ||
+		    mutex_lock_interruptible(&this_buf->read_mutex)) {
+			ret = -ERESTARTSYS;
+			goto out;
+		}
+		/* another reader may have been first: check again */
+		spin_lock(&this_buf->lock);
+	}
+	if (len > this_buf->count)
+		len = this_buf->count;
+	if (this_buf->readoff + len > BUF_SIZE) {
+		wraplen = this_buf->readoff + len - BUF_SIZE;
+		substr(this_buf->buf, temp, this_buf->readoff, 0,
+		       len - wraplen);
+		substr(this_buf->buf, temp, 0, len - wraplen, wraplen);
 	} else {
 		substr(this_buf->buf, temp, this_buf->readoff, 0, len);
 	}
 
 	switch (private_data->readsmode.mode) {
 	case CRYPTO_ENC:
-		printk(KERN_INFO "%s: reading with encryption\n",
-		       DEV_NAME);
-		encrypt(this_buf, temp, len + wraplen,
-			private_data->readsmode.key);
+		last = &this_buf->enc_last;
+		last_before = *last;
+		encrypt(this_buf, temp, len, private_data->readsmode.key);
 		break;
 	case CRYPTO_DEC:
-		printk(KERN_INFO "%s: reading with decryption\n",
-		       DEV_NAME);
-		decrypt(this_buf, temp, len + wraplen,
-			private_data->readsmode.key);
+		last = &this_buf->dec_last;
+		last_before = *last;
+		decrypt(this_buf, temp, len, private_data->readsmode.key);
 		break;
 	default:
 		break;
 	}
+	if (last)
+		last_after = *last;
+	spin_unlock(&this_buf->lock);
 	if (copy_to_user(buf, temp, len)) {
-		if (temp)
-			vfree(temp);
-		return -EFAULT;
+		/* keep the data for the next read (unless a writer
+		   ciphered on from the new state meanwhile) */
+		spin_lock(&this_buf->lock);
+		if (last && *last == last_after)
+			*last = last_before;
+		spin_unlock(&this_buf->lock);
+		ret = -EFAULT;
+		goto unlock;
 	}
-	if (temp)
-		vfree(temp);
-	this_buf->count -= (len + wraplen);
-	this_buf->readoff += (len + wraplen);
+	spin_lock(&this_buf->lock);
+	this_buf->count -= len;
+	this_buf->readoff += len;
 	this_buf->readoff %= BUF_SIZE;
-	ret = len + wraplen;
-	if (err)
-		return -ENOBUFS;
+	spin_unlock(&this_buf->lock);
+	/* there is space now for writers waiting or polling */
+	wake_up_interruptible(&this_buf->writeq);
+	kill_fasync(&this_buf->async_queue, SIGIO, POLL_OUT);
+	ret = len;
+unlock:
+	mutex_unlock(&this_buf->read_mutex);
+out:
+	kfree(temp);
+	put_buf(this_buf);
 	return ret;
 }
 
@@ -236,86 +318,156 @@ static ssize_t device_read(struct file *filp, char *buf, size_t len,
  * will be returned. Once again the text written to the buffer
  * in the kernel depends on the mode set in the private data
  * of the file descriptor.
+ * If the buffer is full the process sleeps until a reader makes space
+ * (or fails with -EAGAIN if the fd is non-blocking). Otherwise as much
+ * of the data as fits is written and its length returned.
+ * As in device_read() the data is copied from the user before the
+ * buffer's lock is taken.
  */
 static ssize_t device_write(struct file *filp, const char *buf, size_t len,
 			    loff_t *off)
 {
-
-	struct dev_buf_list *entry = NULL;
-
 	size_t wraplen = 0;
-	int wrap = 0, err = 0;
-	ssize_t ret = 0;
-	int id;
+	ssize_t ret;
+	int dead;
 	struct priv_data *private_data =
 	    (struct priv_data *) filp->private_data;
 	struct dev_buf *this_buf;
-	char *temp;
-	printk(KERN_INFO "%s: start writing\n", DEV_NAME);
+	char *temp = NULL;
+	pr_debug("%s: start writing\n", DEV_NAME);
 	if (private_data == NULL || private_data->buf_id == 0)
 		return -ENOTSUP;
-	id = private_data->buf_id;
-	printk(KERN_INFO "id : %d\n", id);
-	search_entry(id, &entry);
-	if (entry == NULL)
+	this_buf = get_buf(private_data->buf_id);
+	if (this_buf == NULL)
 		return -EINVAL;
-	this_buf = entry->buf;
-	if (this_buf->count > 0
-	    && this_buf->writeoff + len >= this_buf->readoff + BUF_SIZE) {
-		len = BUF_SIZE - this_buf->writeoff - this_buf->readoff;
-		err = 1;
-	}
-	if (this_buf->writeoff + len > BUF_SIZE) {
-		wraplen = this_buf->writeoff + len - BUF_SIZE;
-		len = BUF_SIZE - this_buf->writeoff;
-		wrap = 1;
+	if (len == 0) {
+		ret = 0;
+		goto out;
 	}
+	if (len > BUF_SIZE)
+		len = BUF_SIZE;
 
-	temp = vmalloc(sizeof(char) * (len + wraplen));
+	temp = kmalloc(sizeof(char) * len, GFP_KERNEL);
 	if (!temp) {
 		printk(KERN_WARNING
-		       "%s: temp vmalloc memory allocation failed! \n",
-		       DEV_NAME);
-		return -ENOMEM;
+		       "%s: temp memory allocation failed! \n", DEV_NAME);
+		ret = -ENOMEM;
+		goto out;
+	}
+	if (copy_from_user(temp, buf, len)) {
+		ret = -EFAULT;
+		goto out;
 	}
-	if (copy_from_user(temp, buf, wraplen + len)) {
-		if (temp)
-			vfree(temp);
-		return -EFAULT;
+	spin_lock(&this_buf->lock);
+	while (this_buf->count == BUF_SIZE) {
+		dead = this_buf->refcount == 0;
+		spin_unlock(&this_buf->lock);
+		if (dead) {
+			ret = -EINVAL;
+			goto out;
+		}
+		if (filp->f_flags & O_NONBLOCK) {
+			ret = -EAGAIN;
+			goto out;
+		}
+		if (wait_event_interruptible(this_buf->writeq,
+					     this_buf->count < BUF_SIZE ||
+					     this_buf->refcount == 0)) {
+			ret = -ERESTARTSYS;
+			goto out;
+		}
+		/* another writer may have been first: check again */
+		spin_lock(&this_buf->lock);
 	}
+	if (len > BUF_SIZE - this_buf->count)
+		len = BUF_SIZE - this_buf->count;
 
 	switch (private_data->writesmode.mode) {
 	case CRYPTO_ENC:
-		printk(KERN_INFO "%s: writing with encryption\n",
-		       DEV_NAME);
-		encrypt(this_buf, temp, len + wraplen,
-			private_data->writesmode.key);
+		encrypt(this_buf, temp, len, private_data->writesmode.key);
 		break;
 	case CRYPTO_DEC:
-		printk(KERN_INFO "%s: writing with decryption\n",
-		       DEV_NAME);
-		decrypt(this_buf, temp, len + wraplen,
-			private_data->writesmode.key);
+		decrypt(this_buf, temp, len, private_data->writesmode.key);
 		break;
 	default:
 		break;
 	}
-	if (wrap) {
-		printk(KERN_INFO "%s: writing with wrap-around\n",
-		       DEV_NAME);
-		substr(temp, this_buf->buf, 0, this_buf->writeoff, len);
-		substr(temp, this_buf->buf, len, 0, wraplen);
+	if (this_buf->writeoff + len > BUF_SIZE) {
+		wraplen = this_buf->writeoff + len - BUF_SIZE;
+		substr(temp, this_buf->buf, 0, this_buf->writeoff,
+		       len - wraplen);
+		substr(temp, this_buf->buf, len - wraplen, 0, wraplen);
 	} else {
 		substr(temp, this_buf->buf, 0, this_buf->writeoff, len);
 	}
-	vfree(temp);
-	this_buf->count += len + wraplen;
-	this_buf->writeoff += len + wraplen;
+	this_buf->count += len;
+	this_buf->writeoff += len;
 	this_buf->writeoff %= BUF_SIZE;
-	ret = wraplen + len;
-	printk(KERN_INFO "%s: data written", DEV_NAME);
-	if (err)
-		return -ENOBUFS;
+	spin_unlock(&this_buf->lock);
+	pr_debug("%s: %zu bytes written\n", DEV_NAME, len);
+	/* there is data now for readers waiting or polling */
+	wake_up_interruptible(&this_buf->readq);
+	kill_fasync(&this_buf->async_queue, SIGIO, POLL_IN);
+	ret = len;
+out:
+	kfree(temp);
+	put_buf(this_buf);
+	return ret;
+}
+
+/*
+ * This function is called by poll/select/epoll on the fd. The fd is
+ * readable while its buffer holds data and writable while the buffer
+ * has space; readers and writers wake the other side's wait queue.
+ * A reader whose buffer lost its writer (and got no new one) gets POLLHUP.
+ */
+static unsigned int device_poll(struct file *filp, poll_table *wait)
+{
+	struct priv_data *private_data =
+	    (struct priv_data *) filp->private_data;
+	struct dev_buf *this_buf;
+	unsigned int mask = 0;
+
+	if (private_data == NULL || private_data->buf_id == 0)
+		return POLLERR;
+	this_buf = get_buf(private_data->buf_id);
+	if (this_buf == NULL)
+		return POLLERR;
+	poll_wait(filp, &this_buf->readq, wait);
+	poll_wait(filp, &this_buf->writeq, wait);
+	spin_lock(&this_buf->lock);
+	if (this_buf->refcount == 0)
+		mask |= POLLERR;
+	if ((filp->f_mode & FMODE_READ) && this_buf->count > 0)
+		mask |= POLLIN | POLLRDNORM;
+	if ((filp->f_mode & FMODE_READ) && this_buf->writer_gone)
+		mask |= POLLHUP;
+	if ((filp->f_mode & FMODE_WRITE) && this_buf->count < BUF_SIZE)
+		mask |= POLLOUT | POLLWRNORM;
+	spin_unlock(&this_buf->lock);
+	put_buf(this_buf);
+	return mask;
+}
+
+/*
+ * This function is called when O_ASYNC is switched on or off for the
+ * fd. The fd then gets SIGIO whenever data or space becomes available
+ * in the buffer it is attached to.
+ */
+static int device_fasync(int fd, struct file *filp, int on)
+{
+	struct priv_data *private_data =
+	    (struct priv_data *) filp->private_data;
+	struct dev_buf *this_buf;
+	int ret;
+
+	if (private_data == NULL || private_data->buf_id == 0)
+		return on ? -ENOTSUP : 0;
+	this_buf = get_buf(private_data->buf_id);
+	if (this_buf == NULL)
+		return -EINVAL;
+	ret = fasync_helper(fd, filp, on, &this_buf->async_queue);
+	put_buf(this_buf);
 	return ret;
 }
 
@@ -328,13 +480,15 @@ static ssize_t device_write(struct file *filp, const char *buf, size_t len,
 static int device_ioctl(struct inode *inode, struct file *filp,
 			unsigned int cmd, unsigned long arg)
 {
-	struct dev_buf_list *entry = NULL;
 	struct priv_data *private_data = NULL;
 	struct dev_buf *new_dev_buf;
+	struct dev_buf *this_buf;
 	struct dev_buf_list *node;
+	struct detached_id *ident = NULL;
 	struct crypto_smode *p;
 	struct crypto_smode tempsmode;
 	int id;
+	int ret;
 
 	switch (cmd) {
 	case CRYPTO_IOCCREATE:
@@ -353,22 +507,17 @@ static int device_ioctl(struct inode *inode, struct file *filp,
 			printk(KERN_WARNING
 			       "%s: vmalloc buffer allocation failed!\n",
 			       DEV_NAME);
+			kfree(new_dev_buf);
 			return -ENOMEM;
 		}
-		if (list_empty(&detached_id_head))
-			new_dev_buf->id = new_id++;
-		else {
-			struct detached_id *ident =
-			    list_entry(detached_id_head.next,
-				       struct detached_id, list);
-			new_dev_buf->id = ident->id;
-			list_del(&ident->list);
-			if (ident) {
-				printk(KERN_INFO
-				       "%s: free id node's memory\n",
-				       DEV_NAME);
-				kfree(ident);
-			}
+		node = kzalloc(sizeof(struct dev_buf_list), GFP_KERNEL);
+		if (!node) {
+			printk(KERN_WARNING
+			       "%s: node memory allocation failed!\n",
+			       DEV_NAME);
+			vfree(new_dev_buf->buf);
+			kfree(new_dev_buf);
+			return -ENOMEM;
 		}
 		new_dev_buf->refcount = 1;
 		new_dev_buf->readoff = 0;
@@ -376,74 +525,107 @@ static int device_ioctl(struct inode *inode, struct file *filp,
 		new_dev_buf->count = 0;
 		new_dev_buf->enc_last = -1;
 		new_dev_buf->dec_last = -1;
+		spin_lock_init(&new_dev_buf->lock);
+		mutex_init(&new_dev_buf->read_mutex);
+		atomic_set(&new_dev_buf->users, 1);
+		init_waitqueue_head(&new_dev_buf->readq);
+		init_waitqueue_head(&new_dev_buf->writeq);
+		new_dev_buf->async_queue = NULL;
 		if (filp->f_mode & FMODE_READ)
 			new_dev_buf->read_ref = 1;
 		if (filp->f_mode & FMODE_WRITE)
 			new_dev_buf->write_ref = 1;
-		private_data->buf_id = new_dev_buf->id;
-		node = kzalloc(sizeof(struct dev_buf_list), GFP_KERNEL);
-		if (!node) {
-			printk(KERN_WARNING
-			       "%s: node memory allocation failed!\n",
-			       DEV_NAME);
-			return -ENOMEM;
-		}
 		node->buf = new_dev_buf;
 		INIT_LIST_HEAD(&node->list);
+		/* the id and the list entry are published together */
+		write_lock(&dev_buf_lock);
+		if (list_empty(&detached_id_head))
+			new_dev_buf->id = new_id++;
+		else {
+			ident = list_entry(detached_id_head.next,
+					   struct detached_id, list);
+			new_dev_buf->id = ident->id;
+			list_del(&ident->list);
+		}
 		list_add(&node->list, &dev_buf_head);
+		write_unlock(&dev_buf_lock);
+		if (ident) {
+			printk(KERN_INFO "%s: free id node's memory\n",
+			       DEV_NAME);
+			kfree(ident);
+		}
+		private_data->buf_id = new_dev_buf->id;
 		printk(KERN_INFO "%s: new buffer with id %d created\n",
 		       DEV_NAME, new_dev_buf->id);
-		printk(KERN_INFO "%s: head info %d\n", DEV_NAME,
-		       node->buf->id);
 		return new_dev_buf->id;
 	case CRYPTO_IOCTDELETE:
 		id = (int) arg;
 		private_data = (struct priv_data *) filp->private_data;
-		search_entry(id, &entry);
-		if (entry == NULL)
+		this_buf = get_buf(id);
+		if (this_buf == NULL)
 			return -EINVAL;
-		if (entry->buf->refcount > 1)
-			return -ENOTSUP;
-		private_data->buf_id = 0;
-		if (freebuf(entry) == -ENOMEM)
-			return -ENOMEM;
-		return 0;
+		/*
+		 * only the last fd attached may delete the buffer, so no
+		 * other fd is left behind with a stale id
+		 */
+		spin_lock(&this_buf->lock);
+		if (this_buf->refcount == 0) {
+			ret = -EINVAL;
+		} else if (this_buf->refcount > 1 ||
+			   private_data->buf_id != id) {
+			ret = -ENOTSUP;
+		} else {
+			this_buf->refcount = 0;
+			ret = 0;
+		}
+		spin_unlock(&this_buf->lock);
+		if (ret == 0) {
+			fasync_helper(-1, filp, 0, &this_buf->async_queue);
+			private_data->buf_id = 0;
+			ret = freebuf(this_buf);
+		}
+		put_buf(this_buf);
+		return ret;
 	case CRYPTO_IOCTATTACH:
 		private_data = (struct priv_data *) filp->private_data;
 		if (private_data != NULL && private_data->buf_id != 0)
 			return -ENOTSUP;
 		id = (int) arg;
-		search_entry(id, &entry);
-		if (entry == NULL)
+		this_buf = get_buf(id);
+		if (this_buf == NULL)
 			return -EINVAL;
-		if ((filp->f_mode & FMODE_READ) && entry->buf->read_ref)
-			return -ENOTSUP;
-		if ((filp->f_mode & FMODE_WRITE) && entry->buf->write_ref)
-			return -ENOTSUP;
-		if (filp->f_mode & FMODE_READ)
-			entry->buf->read_ref = 1;
-		if (filp->f_mode & FMODE_WRITE)
-			entry->buf->write_ref = 1;
-		entry->buf->refcount++;
-		private_data->buf_id = entry->buf->id;
-		return 0;
+		spin_lock(&this_buf->lock);
+		if (this_buf->refcount == 0)
+			ret = -EINVAL;
+		else if ((filp->f_mode & FMODE_READ) && this_buf->read_ref)
+			ret = -ENOTSUP;
+		else if ((filp->f_mode & FMODE_WRITE) && this_buf->write_ref)
+			ret = -ENOTSUP;
+		else {
+			if (filp->f_mode & FMODE_READ)
+				this_buf->read_ref = 1;
+			if (filp->f_mode & FMODE_WRITE) {
+				this_buf->write_ref = 1;
+				this_buf->writer_gone = 0;
+			}
+			this_buf->refcount++;
+			private_data->buf_id = this_buf->id;
+			ret = 0;
+		}
+		spin_unlock(&this_buf->lock);
+		put_buf(this_buf);
+		return ret;
 	case CRYPTO_IOCDETACH:
 		private_data = (struct priv_data *) filp->private_data;
 		if (private_data == NULL || private_data->buf_id == 0)
 			return -ENOTSUP;
-		search_entry(private_data->buf_id, &entry);
-		if (entry == NULL)
+		this_buf = get_buf(private_data->buf_id);
+		if (this_buf == NULL)
 			return -EINVAL;
-		if (filp->f_mode & FMODE_READ)
-			entry->buf->read_ref = 0;
-		if (filp->f_mode & FMODE_WRITE)
-			entry->buf->write_ref = 0;
-		entry->buf->refcount--;
 		private_data->buf_id = 0;
-		if (entry->buf->refcount == 0)
-			if (freebuf(entry) == -ENOMEM)
-				return -ENOMEM;
-		return 0;
+		ret = detach_buf(filp, this_buf);
+		put_buf(this_buf);
+		return ret;
 	case CRYPTO_IOCSMODE:
 		private_data = (struct priv_data *) filp->private_data;
 		p = (struct crypto_smode *) arg;
@@ -465,9 +647,33 @@ static int device_ioctl(struct inode *inode, struct file *filp,
 	return 0;
 }
 
+/*
+ * These functions are called when a mapping of a buffer is copied (on
+ * fork or when the area is split) and when one goes away. Every mapping
+ * holds a reference, so the memory stays until the last one is unmapped
+ * even if the buffer is deleted meanwhile (and thus no longer found by
+ * get_buf()).
+ */
+static void device_vma_open(struct vm_area_struct *vma)
+{
+	struct dev_buf *dbuf = (struct dev_buf *) vma->vm_private_data;
+	atomic_inc(&dbuf->users);
+}
+
+static void device_vma_close(struct vm_area_struct *vma)
+{
+	put_buf((struct dev_buf *) vma->vm_private_data);
+}
+
+static struct vm_operations_struct device_vm_ops = {
+	.open = device_vma_open,
+	.close = device_vma_close
+};
+
 /*
  * This function allows the kernel space buffer to be mapped to the
- * user space process which calls the function.
+ * user space process which calls the function. The mapping keeps the
+ * reference taken here until it is closed.
  */
 static int device_mmap(struct file *filp, struct vm_area_struct *vma)
 {
@@ -476,7 +682,7 @@ static int device_mmap(struct file *filp, struct vm_area_struct *vma)
 	int ret;
 	unsigned long start = vma->vm_start;
 	unsigned long pfn;
-	struct dev_buf_list *entry = NULL;
+	struct dev_buf *this_buf;
 	char *ptr;
 	struct priv_data *private_data =
 	    (struct priv_data *) filp->private_data;
@@ -488,23 +694,30 @@ static int device_mmap(struct file *filp, struct vm_area_struct *vma)
 	offset = vma->vm_pgoff;
 	if (offset % PAGE_SIZE != 0 || offset > BUF_SIZE)
 		return -EIO;
-	search_entry(private_data->buf_id, &entry);
-	if (entry == NULL) {
+	this_buf = get_buf(private_data->buf_id);
+	if (this_buf == NULL) {
 		printk(KERN_INFO "%s: Invalid buffer id in fd when mmap\n",
 		       DEV_NAME);
 		return -EINVAL;
 	}
-	ptr = entry->buf->buf;
+	ptr = this_buf->buf;
+	ret = 0;
 	while (size > 0) {
 		pfn = vmalloc_to_pfn(ptr);
 		ret = remap_pfn_range(vma, start, pfn, PAGE_SIZE,
 					   PAGE_SHARED);
 		if (ret < 0)
-			return ret;
+			break;
 		start += PAGE_SIZE;
 		ptr += PAGE_SIZE;
 		size -= PAGE_SIZE;
 	}
+	if (ret < 0) {
+		put_buf(this_buf);
+		return ret;
+	}
+	vma->vm_private_data = this_buf;
+	vma->vm_ops = &device_vm_ops;
 	/*
 	   if (remap_pfn_range
 	   (vma, vma->vm_start,
@@ -518,6 +731,7 @@ static int device_mmap(struct file *filp, struct vm_area_struct *vma)
 
 /*
  * This function search for a buffer in the kernel given the id.
+ * The caller has to hold dev_buf_lock.
  */
 static void search_entry(int id, struct dev_buf_list **entry)
 {
@@ -527,37 +741,108 @@ static void search_entry(int id, struct dev_buf_list **entry)
 		if ((*entry)->buf->id == id)
 			return;
 	}
-	entry = NULL;
+	*entry = NULL;
+}
+
+/*
+ * This function looks up a buffer given the id and takes a reference
+ * on it, so its memory stays valid until put_buf() even if the buffer
+ * is freed meanwhile.
+ */
+static struct dev_buf *get_buf(int id)
+{
+	struct dev_buf_list *entry;
+	struct dev_buf *dbuf = NULL;
+	read_lock(&dev_buf_lock);
+	search_entry(id, &entry);
+	if (entry != NULL) {
+		dbuf = entry->buf;
+		atomic_inc(&dbuf->users);
+	}
+	read_unlock(&dev_buf_lock);
+	return dbuf;
 }
 
 /*
- * This function frees buffer allocated for a particular buffer
+ * This function drops a reference taken by get_buf() (or the one of the
+ * registry) and frees the memory of the buffer with the last one.
  */
-static int freebuf(struct dev_buf_list *entry)
+static void put_buf(struct dev_buf *dbuf)
 {
+	if (!atomic_dec_and_test(&dbuf->users))
+		return;
+	printk(KERN_INFO "%s: free buffer's memory\n", DEV_NAME);
+	if (dbuf->buf)
+		vfree(dbuf->buf);
+	kfree(dbuf);
+}
+
+/*
+ * This function detaches a fd from its buffer. The buffer is freed
+ * when no fd is attached to it anymore; otherwise the fds left behind
+ * are woken up, as a reader may now see the end of the data.
+ */
+static int detach_buf(struct file *filp, struct dev_buf *dbuf)
+{
+	int last;
+	fasync_helper(-1, filp, 0, &dbuf->async_queue);
+	spin_lock(&dbuf->lock);
+	if (dbuf->refcount == 0) {
+		/* being freed already */
+		spin_unlock(&dbuf->lock);
+		return 0;
+	}
+	if (filp->f_mode & FMODE_READ)
+		dbuf->read_ref = 0;
+	if (filp->f_mode & FMODE_WRITE) {
+		dbuf->write_ref = 0;
+		dbuf->writer_gone = 1;
+	}
+	dbuf->refcount--;
+	last = dbuf->refcount == 0;
+	spin_unlock(&dbuf->lock);
+	if (last)
+		return freebuf(dbuf);
+	wake_up_interruptible(&dbuf->readq);
+	wake_up_interruptible(&dbuf->writeq);
+	kill_fasync(&dbuf->async_queue, SIGIO, POLL_HUP);
+	return 0;
+}
+
+/*
+ * This function frees buffer allocated for a particular buffer.
+ * Its refcount has to be 0 already: the buffer is removed from the
+ * registry, its id recycled and sleepers woken up, while its memory
+ * goes with the last reference to it. If there is no memory for
+ * recycling the id, the id is dropped and -ENOMEM returned.
+ */
+static int freebuf(struct dev_buf *dbuf)
+{
+	struct dev_buf_list *entry;
 	struct detached_id *idnode =
 	    kzalloc(sizeof(struct detached_id), GFP_KERNEL);
-	if (!idnode) {
+	if (!idnode)
 		printk(KERN_WARNING
 		       "%s: id node memory allocation failed\n", DEV_NAME);
-		return -ENOMEM;
+	write_lock(&dev_buf_lock);
+	search_entry(dbuf->id, &entry);
+	if (entry != NULL)
+		list_del(&entry->list);
+	if (idnode) {
+		idnode->id = dbuf->id;
+		INIT_LIST_HEAD(&idnode->list);
+		list_add(&idnode->list, &detached_id_head);
 	}
-	idnode->id = entry->buf->id;
-	if (entry->buf) {
-		printk(KERN_INFO "%s: free buffer's memory\n", DEV_NAME);
-		if (entry->buf->buf)
-			vfree(entry->buf->buf);
-		kfree(entry->buf);
-	}
-	list_del(&entry->list);
+	write_unlock(&dev_buf_lock);
 	if (entry) {
 		printk(KERN_INFO "%s: free buffer node's memory\n",
 		       DEV_NAME);
 		kfree(entry);
 	}
-	INIT_LIST_HEAD(&idnode->list);
-	list_add(&idnode->list, &detached_id_head);
-	return 0;
+	wake_up_interruptible(&dbuf->readq);
+	wake_up_interruptible(&dbuf->writeq);
+	put_buf(dbuf);
+	return idnode ? 0 : -ENOMEM;
 }
 
 /*
@@ -627,7 +912,9 @@ struct file_operations fops = {
 	.read = device_read,
 	.write = device_write,
 	.ioctl = device_ioctl,
-	.mmap = device_mmap
+	.mmap = device_mmap,
+	.poll = device_poll,
+	.fasync = device_fasync
 };
 
 /*
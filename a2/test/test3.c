@@ -0,0 +1,121 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include "../ioctl.h"
+
+/*
+ * This program checks the blocking semantics of the device. The parent
+ * creates a buffer for writing and passes its identifier to its child,
+ * which attaches for reading. A non-blocking read of the empty buffer
+ * has to fail with EAGAIN, then the child sleeps in poll() until the
+ * parent writes a second later and reads the message with a blocking
+ * read. Finally the parent fills the buffer with non-blocking writes,
+ * which have to stop with EAGAIN once 8192 bytes are in the buffer.
+ */
+int main(int argc, char *argv[])
+{
+	int pfd[2], fd;
+	pid_t cpid;
+	int buf, status;
+	int ret;
+	if (pipe(pfd) == -1) {
+		perror("pipe");
+		exit(1);
+	}
+	cpid = fork();
+	if (cpid == -1) {
+		perror("fork");
+		exit(1);
+	}
+	if (cpid == 0) {
+		close(pfd[1]);
+		ret = read(pfd[0], &buf, sizeof(int));
+		if (ret < 0) {
+			perror("id read");
+			return 1;
+		}
+		int cfd = open("/dev/crypto", O_RDONLY | O_NONBLOCK);
+		if (cfd < 0) {
+			perror("open");
+			return 1;
+		}
+		if (ioctl(cfd, CRYPTO_IOCTATTACH, buf)) {
+			perror("ioctl");
+			close(cfd);
+			return 1;
+		}
+		char msg[64];
+		ret = read(cfd, msg, sizeof(msg));
+		if (ret != -1 || errno != EAGAIN) {
+			printf("non-blocking read of an empty buffer: %d\n",
+			       ret);
+			close(cfd);
+			return 1;
+		}
+		printf("Non-blocking read of the empty buffer: EAGAIN\n");
+		struct pollfd p;
+		p.fd = cfd;
+		p.events = POLLIN;
+		ret = poll(&p, 1, 5000);
+		if (ret != 1 || !(p.revents & POLLIN)) {
+			printf("poll did not report data: %d\n", ret);
+			close(cfd);
+			return 1;
+		}
+		fcntl(cfd, F_SETFL, 0);
+		memset(msg, 0, sizeof(msg));
+		ret = read(cfd, msg, sizeof(msg) - 1);
+		if (ret < 0) {
+			perror("msg read");
+			close(cfd);
+			return 1;
+		}
+		printf("Woken by poll, read \"%s\" (%d bytes)\n", msg, ret);
+		ioctl(cfd, CRYPTO_IOCDETACH);
+		close(cfd);
+		close(pfd[0]);
+		exit(0);
+	} else {
+		close(pfd[0]);
+		fd = open("/dev/crypto", O_WRONLY);
+		if (fd < 0) {
+			perror("open");
+			return 1;
+		}
+		int buffer_id = ioctl(fd, CRYPTO_IOCCREATE);
+		char msg[] = "Consumers sleep until data arrives";
+		write(pfd[1], &buffer_id, sizeof(int));
+		close(pfd[1]);
+		sleep(1);
+		ret = write(fd, msg, strlen(msg));
+		if (ret < 0) {
+			perror("write");
+			return 1;
+		}
+		waitpid(cpid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			return 1;
+
+		char block[1000];
+		int total = 0;
+		memset(block, 'x', sizeof(block));
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		while ((ret = write(fd, block, sizeof(block))) > 0)
+			total += ret;
+		if (ret != -1 || errno != EAGAIN || total != 8192) {
+			printf("filled %d bytes, then %d\n", total, ret);
+			return 1;
+		}
+		printf("Non-blocking writes filled %d bytes, then EAGAIN\n",
+		       total);
+		ioctl(fd, CRYPTO_IOCTDELETE, buffer_id);
+		close(fd);
+		exit(0);
+	}
+}
@@ -0,0 +1,169 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "../ioctl.h"
+
+#define CHUNK 4096
+
+/*
+ * This program stresses the device with independent reader/writer
+ * pairs. Every pair is a writer process which creates a buffer of its
+ * own and a reader child which attaches to it; the writer pushes the
+ * given number of megabytes (default 16) through the buffer and the
+ * reader checks every byte. The run is done once with a single pair
+ * and once with the given number of pairs (default 4) at the same time.
+ * As the pairs share no buffer they should not contend with each other,
+ * so the aggregate throughput should grow with the number of pairs up
+ * to the number of CPUs.
+ */
+
+static char pattern(long i, int pair)
+{
+	return (char) (i * 7 + pair);
+}
+
+static int reader(int id, int pair, long total)
+{
+	char block[CHUNK];
+	long done = 0;
+	int i, ret;
+	int fd = open("/dev/crypto", O_RDONLY);
+	if (fd < 0) {
+		perror("open");
+		return 1;
+	}
+	if (ioctl(fd, CRYPTO_IOCTATTACH, id)) {
+		perror("ioctl");
+		close(fd);
+		return 1;
+	}
+	while (done < total) {
+		ret = read(fd, block, sizeof(block));
+		if (ret <= 0) {
+			perror("read");
+			close(fd);
+			return 1;
+		}
+		for (i = 0; i < ret; i++) {
+			if (block[i] != pattern(done + i, pair)) {
+				printf("pair %d: wrong byte at %ld\n", pair,
+				       done + i);
+				close(fd);
+				return 1;
+			}
+		}
+		done += ret;
+	}
+	ioctl(fd, CRYPTO_IOCDETACH);
+	close(fd);
+	return 0;
+}
+
+static int writer(int pair, long total)
+{
+	char block[CHUNK];
+	long done = 0;
+	int i, n, ret, status;
+	pid_t cpid;
+	int fd = open("/dev/crypto", O_WRONLY);
+	if (fd < 0) {
+		perror("open");
+		return 1;
+	}
+	int buffer_id = ioctl(fd, CRYPTO_IOCCREATE);
+	if (buffer_id < 0) {
+		perror("ioctl");
+		close(fd);
+		return 1;
+	}
+	cpid = fork();
+	if (cpid == -1) {
+		perror("fork");
+		return 1;
+	}
+	if (cpid == 0) {
+		close(fd);
+		exit(reader(buffer_id, pair, total));
+	}
+	while (done < total) {
+		n = total - done < CHUNK ? total - done : CHUNK;
+		for (i = 0; i < n; i++)
+			block[i] = pattern(done + i, pair);
+		/* short writes are fine: continue where the device stopped */
+		ret = write(fd, block, n);
+		if (ret <= 0) {
+			perror("write");
+			close(fd);
+			return 1;
+		}
+		done += ret;
+	}
+	waitpid(cpid, &status, 0);
+	ioctl(fd, CRYPTO_IOCTDELETE, buffer_id);
+	close(fd);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return 1;
+	return 0;
+}
+
+/* run the given number of pairs at once and return the elapsed time */
+static double run(int pairs, long total)
+{
+	struct timeval start, end;
+	pid_t pids[64];
+	int i, status, failed = 0;
+	gettimeofday(&start, NULL);
+	for (i = 0; i < pairs; i++) {
+		pids[i] = fork();
+		if (pids[i] == -1) {
+			perror("fork");
+			exit(1);
+		}
+		if (pids[i] == 0)
+			exit(writer(i, total));
+	}
+	for (i = 0; i < pairs; i++) {
+		waitpid(pids[i], &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed = 1;
+	}
+	gettimeofday(&end, NULL);
+	if (failed)
+		return -1;
+	return (end.tv_sec - start.tv_sec) +
+	    (end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+	int pairs = argc > 1 ? atoi(argv[1]) : 4;
+	long megabytes = argc > 2 ? atol(argv[2]) : 16;
+	long total = megabytes * 1024 * 1024;
+	double t1, tn, rate1, raten;
+	if (pairs < 1 || pairs > 64 || megabytes < 1) {
+		printf("usage: %s [pairs (1-64)] [megabytes per pair]\n",
+		       argv[0]);
+		return 1;
+	}
+	t1 = run(1, total);
+	if (t1 < 0) {
+		printf("1 pair: failed\n");
+		return 1;
+	}
+	tn = run(pairs, total);
+	if (tn < 0) {
+		printf("%d pairs: failed\n", pairs);
+		return 1;
+	}
+	rate1 = megabytes / t1;
+	raten = megabytes * pairs / tn;
+	printf("1 pair: %.1f MB/s\n", rate1);
+	printf("%d pairs: %.1f MB/s in total, %.2fx of 1 pair\n", pairs,
+	       raten, raten / rate1);
+	return 0;
+}
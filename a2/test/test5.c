@@ -0,0 +1,110 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include "../ioctl.h"
+
+/*
+ * This program checks the end of data of the device. The parent creates
+ * a buffer for writing and passes its identifier to its child, which
+ * attaches for reading. The child reads the parent's message and then
+ * sleeps in a second blocking read, until the parent detaches a second
+ * later. That read has to return 0 (end of data), and poll() then has
+ * to report POLLHUP right away, like it does for a pipe without writers.
+ */
+int main(int argc, char *argv[])
+{
+	int pfd[2], fd;
+	pid_t cpid;
+	int buf, status;
+	int ret;
+	if (pipe(pfd) == -1) {
+		perror("pipe");
+		exit(1);
+	}
+	cpid = fork();
+	if (cpid == -1) {
+		perror("fork");
+		exit(1);
+	}
+	if (cpid == 0) {
+		close(pfd[1]);
+		ret = read(pfd[0], &buf, sizeof(int));
+		if (ret < 0) {
+			perror("id read");
+			return 1;
+		}
+		int cfd = open("/dev/crypto", O_RDONLY);
+		if (cfd < 0) {
+			perror("open");
+			return 1;
+		}
+		if (ioctl(cfd, CRYPTO_IOCTATTACH, buf)) {
+			perror("ioctl");
+			close(cfd);
+			return 1;
+		}
+		char msg[64];
+		memset(msg, 0, sizeof(msg));
+		ret = read(cfd, msg, sizeof(msg) - 1);
+		if (ret <= 0) {
+			printf("read of the message: %d\n", ret);
+			close(cfd);
+			return 1;
+		}
+		printf("Read \"%s\" (%d bytes)\n", msg, ret);
+		ret = read(cfd, msg, sizeof(msg));
+		if (ret != 0) {
+			printf("read after the writer detached: %d\n", ret);
+			close(cfd);
+			return 1;
+		}
+		printf("Woken by the writer detaching, read 0 bytes\n");
+		struct pollfd p;
+		p.fd = cfd;
+		p.events = POLLIN;
+		ret = poll(&p, 1, 0);
+		if (ret != 1 || !(p.revents & POLLHUP)) {
+			printf("poll did not report a hangup: %d\n", ret);
+			close(cfd);
+			return 1;
+		}
+		printf("poll reports POLLHUP\n");
+		ioctl(cfd, CRYPTO_IOCDETACH);
+		close(cfd);
+		close(pfd[0]);
+		exit(0);
+	} else {
+		close(pfd[0]);
+		fd = open("/dev/crypto", O_WRONLY);
+		if (fd < 0) {
+			perror("open");
+			return 1;
+		}
+		int buffer_id = ioctl(fd, CRYPTO_IOCCREATE);
+		char msg[] = "Readers see the end of data";
+		write(pfd[1], &buffer_id, sizeof(int));
+		close(pfd[1]);
+		sleep(1);
+		ret = write(fd, msg, strlen(msg));
+		if (ret < 0) {
+			perror("write");
+			return 1;
+		}
+		sleep(1);
+		if (ioctl(fd, CRYPTO_IOCDETACH)) {
+			perror("ioctl");
+			return 1;
+		}
+		close(fd);
+		waitpid(cpid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			return 1;
+		exit(0);
+	}
+}
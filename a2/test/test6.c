@@ -0,0 +1,107 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include "../ioctl.h"
+
+/*
+ * This program checks that a buffer without a writer yet is not at its
+ * end of data. The parent creates a buffer for reading and passes its
+ * identifier to its child, which attaches for writing a second later.
+ * Until then poll() must report nothing (in particular no POLLHUP) and
+ * the parent's blocking read has to sleep until the child's message
+ * arrives. Only after the child detached a read returns 0.
+ */
+int main(int argc, char *argv[])
+{
+	int pfd[2], fd;
+	pid_t cpid;
+	int buf, status;
+	int ret;
+	if (pipe(pfd) == -1) {
+		perror("pipe");
+		exit(1);
+	}
+	cpid = fork();
+	if (cpid == -1) {
+		perror("fork");
+		exit(1);
+	}
+	if (cpid == 0) {
+		close(pfd[1]);
+		ret = read(pfd[0], &buf, sizeof(int));
+		if (ret < 0) {
+			perror("id read");
+			return 1;
+		}
+		int cfd = open("/dev/crypto", O_WRONLY);
+		if (cfd < 0) {
+			perror("open");
+			return 1;
+		}
+		sleep(1);
+		if (ioctl(cfd, CRYPTO_IOCTATTACH, buf)) {
+			perror("ioctl");
+			close(cfd);
+			return 1;
+		}
+		char msg[] = "Readers wait for the first writer";
+		ret = write(cfd, msg, strlen(msg));
+		if (ret < 0) {
+			perror("write");
+			close(cfd);
+			return 1;
+		}
+		sleep(1);
+		ioctl(cfd, CRYPTO_IOCDETACH);
+		close(cfd);
+		close(pfd[0]);
+		exit(0);
+	} else {
+		close(pfd[0]);
+		fd = open("/dev/crypto", O_RDONLY);
+		if (fd < 0) {
+			perror("open");
+			return 1;
+		}
+		int buffer_id = ioctl(fd, CRYPTO_IOCCREATE);
+		write(pfd[1], &buffer_id, sizeof(int));
+		close(pfd[1]);
+		struct pollfd p;
+		p.fd = fd;
+		p.events = POLLIN;
+		ret = poll(&p, 1, 0);
+		if (ret != 0) {
+			printf("poll before the first writer: %d (revents %#x)\n",
+			       ret, p.revents);
+			return 1;
+		}
+		printf("poll reports nothing before the first writer\n");
+		char msg[64];
+		memset(msg, 0, sizeof(msg));
+		ret = read(fd, msg, sizeof(msg) - 1);
+		if (ret <= 0) {
+			printf("read before the first writer: %d\n", ret);
+			return 1;
+		}
+		printf("Woken by the first writer, read \"%s\" (%d bytes)\n",
+		       msg, ret);
+		ret = read(fd, msg, sizeof(msg));
+		if (ret != 0) {
+			printf("read after the writer detached: %d\n", ret);
+			return 1;
+		}
+		printf("Read 0 bytes after the writer detached\n");
+		waitpid(cpid, &status, 0);
+		ioctl(fd, CRYPTO_IOCTDELETE, buffer_id);
+		close(fd);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			return 1;
+		exit(0);
+	}
+}